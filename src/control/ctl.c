@@ -16,6 +16,7 @@
 #include "gen/terrain.h"
 #include "tick/tick.h"
 #include "ui/ui.h"
+#include "prof/ptrace.h"
 
 #include "util.h"
 
@@ -31,6 +32,7 @@ int KEYMAP[N_CONTROLS] = {
   GLFW_KEY_V, // swap views
   GLFW_KEY_KP_ADD, GLFW_KEY_KP_SUBTRACT, // zoom in/out
   GLFW_KEY_F1, // draw debug info
+  GLFW_KEY_F2, // dump timing trace
   GLFW_KEY_L, // teleport
 };
 
@@ -155,6 +157,16 @@ void tick_general_controls(void) {
     DRAW_DEBUG_INFO = !DRAW_DEBUG_INFO;
   }
 
+  // Dumping a timing trace:
+#ifdef PROFILE_TIME
+  if (DOWN[C_DUMP_TRACE]) {
+    size_t spans = trace_dump(TRACE_FILE);
+    if (spans > 0) {
+      printf("Wrote %zu spans to timing trace '%s'.\n", spans, TRACE_FILE);
+    }
+  }
+#endif
+
   // Teleporting:
   if (DOWN[C_TELEPORT]) {
     vface(&teleport_vector, PLAYER->yaw, 0);
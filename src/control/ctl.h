@@ -21,6 +21,7 @@ enum control_e {
   C_LEFT, C_RIGHT, C_FORWARD, C_REVERSE,
   C_CHANGE_VIEW, C_ZOOM_IN, C_ZOOM_OUT,
   C_DRAW_DEBUG_INFO,
+  C_DUMP_TRACE,
   C_TELEPORT,
   N_CONTROLS
 };
@@ -25,7 +25,6 @@ float set_player_cursor(
   float length
 ) {
   cell_cursor* cursor = (cell_cursor*) data;
-  refresh_cell_at_cache();
   cell* cell = cell_at(pos);
   cursor->valid = 0;
   if (cell == NULL) {
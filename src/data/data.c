@@ -2,13 +2,18 @@
 // Data management.
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+
+#include <omp.h>
 
 #include "data.h"
 
 #include "persist.h"
+#include "render_set.h"
 
-#include "datatypes/queue.h"
+#include "datatypes/mpmc_queue.h"
 #include "datatypes/map.h"
 
 #include "graphics/display.h"
@@ -26,6 +31,7 @@
  *************/
 
 size_t const CHUNK_QUEUE_SET_MAP_SIZE = 2048;
+size_t const CHUNK_QUEUE_SET_CAPACITY = 16384;
 size_t const CHUNK_CACHE_MAP_SIZE = 16384;
 
 // TODO: dynamic capping?
@@ -39,6 +45,10 @@ int const BIOGEN_CAP = 16;
 //int const COMPILE_CAP = 2;
 //int const BIOGEN_CAP = 2;
 
+// BIOGEN_CAP is per biogen worker thread; this is the overall limit on how
+// many chunks tick_biogen will take on at once:
+#define BIOGEN_MAX_BATCH 256
+
 // TODO: Good values here
 //gl_cpos_t const LOAD_DISTANCES[N_LODS] = { 6, 16, 50, 150, 500 };
 //gl_cpos_t const LOAD_DISTANCES[N_LODS] = { 8, 16, 32, 64, 128 };
@@ -63,6 +73,27 @@ chunk_queue_set *BIOGEN_QUEUES = NULL;
 
 chunk_cache *CHUNK_CACHE = NULL;
 
+int BIOGEN_THREADS = 0;
+
+/**************
+ * Structures *
+ **************/
+
+// Data that's been replaced in the chunk cache but may still be in use:
+struct retired_data_s {
+  chunk_or_approx coa;
+  uint64_t generation; // CELL_AT_GENERATION once it was replaced
+};
+typedef struct retired_data_s retired_data;
+
+/*******************
+ * Private Globals *
+ *******************/
+
+// Replaced data waiting to be freed, oldest first (only the data thread
+// touches this):
+static queue *RETIRED_DATA = NULL;
+
 /********************
  * Search Functions *
  ********************/
@@ -108,6 +139,18 @@ static inline int is_loaded(global_chunk_pos *glcpos, lod detail) {
   return result;
 }
 
+// Biology generation for a chunk writes to that chunk and reads from its
+// immediate neighbors (and growth may eventually write to them too), so two
+// chunks can only be worked on at the same time if their 3x3x3 neighborhoods
+// don't overlap.
+static inline int biogen_conflict(chunk *a, chunk *b) {
+  return (
+     a->glcpos.x - b->glcpos.x <= 2 && b->glcpos.x - a->glcpos.x <= 2
+  && a->glcpos.y - b->glcpos.y <= 2 && b->glcpos.y - a->glcpos.y <= 2
+  && a->glcpos.z - b->glcpos.z <= 2 && b->glcpos.z - a->glcpos.z <= 2
+  );
+}
+
 static inline int is_loading(global_chunk_pos *glcpos, lod detail) {
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
   return m3_contains_key(
@@ -127,6 +170,92 @@ void iter_cleanup_chunk_approx(void * ptr) {
   cleanup_chunk_approximation((chunk_approximation *) ptr);
 }
 
+// Adds freshly compiled data to the render set, unless it has been replaced
+// in the chunk cache in the meantime (in which case it's been retired).
+// The check happens under the render set's lock, and eviction removes data
+// from the render set under the same lock after replacing it in the cache.
+static inline void make_renderable(chunk_or_approx *coa) {
+  lod detail = coa_detail_level(coa);
+  global_chunk_pos *glcpos;
+  void *cached;
+  if (coa->type == CA_TYPE_CHUNK) {
+    glcpos = &(((chunk *) (coa->ptr))->glcpos);
+  } else {
+    glcpos = &(((chunk_approximation *) (coa->ptr))->glcpos);
+  }
+  rs_lock(RENDER_SET);
+  m_lock(CHUNK_CACHE->levels[detail]);
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+  cached = m3_get_value(
+    CHUNK_CACHE->levels[detail],
+    (map_key_t) glcpos->x,
+    (map_key_t) glcpos->y,
+    (map_key_t) glcpos->z
+  );
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+  m_unlock(CHUNK_CACHE->levels[detail]);
+  if (cached == coa->ptr) {
+    rs_add(RENDER_SET, coa);
+  }
+  rs_unlock(RENDER_SET);
+}
+
+// Removes data that's about to be freed from the render set.
+static inline void make_unrenderable(chunk_or_approx *coa) {
+  rs_lock(RENDER_SET);
+  rs_remove(RENDER_SET, coa);
+  rs_unlock(RENDER_SET);
+}
+
+// Holds on to replaced data until nobody can be using it any more.
+static inline void retire_data(chunk_or_approx *coa, uint64_t generation) {
+  retired_data *rd = (retired_data*) malloc(sizeof(retired_data));
+  if (rd == NULL) {
+    perror("Failed to allocate retired data record.");
+    exit(errno);
+  }
+  rd->coa.type = coa->type;
+  rd->coa.ptr = coa->ptr;
+  rd->generation = generation;
+  q_push_element(RETIRED_DATA, (void *) rd);
+}
+
+// Frees retired data once every cell_at reader has quiesced since it was
+// replaced and it isn't waiting to be compiled (or all of it, if force is
+// given).
+static inline void free_retired_data(int force) {
+  retired_data *rd;
+  chunk_flag flags;
+  while ((rd = (retired_data *) q_get_item(RETIRED_DATA, 0)) != NULL) {
+    if (!force) {
+      if (!cell_at_quiesced(rd->generation)) {
+        break;
+      }
+      if (rd->coa.type == CA_TYPE_CHUNK) {
+        flags = __atomic_load_n(
+          &(((chunk *) rd->coa.ptr)->chunk_flags),
+          __ATOMIC_ACQUIRE
+        );
+      } else {
+        flags = __atomic_load_n(
+          &(((chunk_approximation *) rd->coa.ptr)->chunk_flags),
+          __ATOMIC_ACQUIRE
+        );
+      }
+      if (flags & CF_QUEUED_TO_COMPILE) {
+        break;
+      }
+    }
+    q_pop_element(RETIRED_DATA);
+    if (rd->coa.type == CA_TYPE_CHUNK) {
+      cleanup_chunk((chunk *) rd->coa.ptr);
+    } else {
+      cleanup_chunk_approximation((chunk_approximation *) rd->coa.ptr);
+    }
+    free(rd);
+  }
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -135,13 +264,20 @@ void setup_data(void) {
   LOAD_QUEUES = create_chunk_queue_set();
   COMPILE_QUEUES = create_chunk_queue_set();
   BIOGEN_QUEUES = create_chunk_queue_set();
+  RETIRED_DATA = create_queue();
   CHUNK_CACHE = create_chunk_cache();
+  RENDER_SET = create_render_set();
 }
 
 void cleanup_data(void) {
   destroy_chunk_queue_set(LOAD_QUEUES);
   cleanup_chunk_queue_set(COMPILE_QUEUES);
   cleanup_chunk_queue_set(BIOGEN_QUEUES);
+  invalidate_cell_at_caches();
+  free_retired_data(1);
+  cleanup_queue(RETIRED_DATA);
+  cleanup_render_set(RENDER_SET);
+  RENDER_SET = NULL;
   cleanup_chunk_cache(CHUNK_CACHE);
 }
 
@@ -149,8 +285,9 @@ chunk_queue_set *create_chunk_queue_set(void) {
   chunk_queue_set *cqs = (chunk_queue_set *) malloc(sizeof(chunk_queue_set));
   size_t i;
   for (i = LOD_BASE; i < N_LODS; ++i) {
-    cqs->levels[i] = create_queue();
+    cqs->levels[i] = create_mpmc_queue(CHUNK_QUEUE_SET_CAPACITY);
     cqs->maps[i] = create_map(3, CHUNK_QUEUE_SET_MAP_SIZE);
+    cqs->overflow[i] = create_queue();
   }
   return cqs;
 }
@@ -158,21 +295,26 @@ chunk_queue_set *create_chunk_queue_set(void) {
 void cleanup_chunk_queue_set(chunk_queue_set *cqs) {
   size_t i;
   for (i = LOD_BASE; i < N_LODS; ++i) {
-    cleanup_queue(cqs->levels[i]);
+    cleanup_mpmc_queue(cqs->levels[i]);
     cleanup_map(cqs->maps[i]);
+    cleanup_queue(cqs->overflow[i]);
   }
   free(cqs);
 }
 
 void destroy_chunk_queue_set(chunk_queue_set *cqs) {
   size_t i;
-  q_foreach(cqs->levels[LOD_BASE], &iter_cleanup_chunk);
-  cleanup_queue(cqs->levels[LOD_BASE]);
+  mq_foreach(cqs->levels[LOD_BASE], &iter_cleanup_chunk);
+  q_foreach(cqs->overflow[LOD_BASE], &iter_cleanup_chunk);
+  cleanup_mpmc_queue(cqs->levels[LOD_BASE]);
   cleanup_map(cqs->maps[LOD_BASE]);
+  cleanup_queue(cqs->overflow[LOD_BASE]);
   for (i = LOD_BASE + 1; i < N_LODS; ++i) {
-    q_foreach(cqs->levels[i], &iter_cleanup_chunk_approx);
-    cleanup_queue(cqs->levels[i]);
+    mq_foreach(cqs->levels[i], &iter_cleanup_chunk_approx);
+    q_foreach(cqs->overflow[i], &iter_cleanup_chunk_approx);
+    cleanup_mpmc_queue(cqs->levels[i]);
     cleanup_map(cqs->maps[i]);
+    cleanup_queue(cqs->overflow[i]);
   }
   free(cqs);
 }
@@ -201,10 +343,13 @@ void cleanup_chunk_cache(chunk_cache *cc) {
  * Functions *
  *************/
 
-void enqueue_chunk(chunk_queue_set *cqs, chunk *c) {
-  q_lock(cqs->levels[LOD_BASE]);
-  q_push_element(cqs->levels[LOD_BASE], (void *) c);
-  q_unlock(cqs->levels[LOD_BASE]);
+int enqueue_chunk(chunk_queue_set *cqs, chunk *c) {
+  if (!mq_push_element(cqs->levels[LOD_BASE], (void *) c)) {
+#ifdef DEBUG
+    fprintf(stderr, "Warning: chunk queue full; chunk not queued.\n");
+#endif
+    return 0;
+  }
   m_lock(cqs->maps[LOD_BASE]);
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
   m3_put_value(
@@ -216,12 +361,16 @@ void enqueue_chunk(chunk_queue_set *cqs, chunk *c) {
   );
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
   m_unlock(cqs->maps[LOD_BASE]);
+  return 1;
 }
 
-void enqueue_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca){
-  q_lock(cqs->levels[ca->detail]);
-  q_push_element(cqs->levels[ca->detail], (void *) ca);
-  q_unlock(cqs->levels[ca->detail]);
+int enqueue_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca){
+  if (!mq_push_element(cqs->levels[ca->detail], (void *) ca)) {
+#ifdef DEBUG
+    fprintf(stderr, "Warning: chunk queue full; approximation not queued.\n");
+#endif
+    return 0;
+  }
   m_lock(cqs->maps[ca->detail]);
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
   m3_put_value(
@@ -233,6 +382,39 @@ void enqueue_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca){
   );
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
   m_unlock(cqs->maps[ca->detail]);
+  return 1;
+}
+
+void defer_chunk(chunk_queue_set *cqs, chunk *c) {
+  queue *q = cqs->overflow[LOD_BASE];
+  q_lock(q);
+  q_push_element(q, (void *) c);
+  q_unlock(q);
+}
+
+void defer_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca){
+  queue *q = cqs->overflow[ca->detail];
+  q_lock(q);
+  q_push_element(q, (void *) ca);
+  q_unlock(q);
+}
+
+void drain_overflow(chunk_queue_set *cqs, lod detail) {
+  queue *q = cqs->overflow[detail];
+  void *ptr;
+  int queued = 1;
+  q_lock(q);
+  while (queued && (ptr = q_pop_element(q)) != NULL) {
+    if (detail == LOD_BASE) {
+      queued = enqueue_chunk(cqs, (chunk *) ptr);
+    } else {
+      queued = enqueue_chunk_approximation(cqs, (chunk_approximation *) ptr);
+    }
+    if (!queued) {
+      q_push_element(q, ptr); // still full; try again next tick
+    }
+  }
+  q_unlock(q);
 }
 
 void mark_for_loading(global_chunk_pos *glcpos, lod detail) {
@@ -243,12 +425,16 @@ void mark_for_loading(global_chunk_pos *glcpos, lod detail) {
     chunk *c = create_chunk(glcpos);
     c->chunk_flags |= CF_QUEUED_TO_LOAD;
     c->chunk_flags |= CF_COMPILE_ON_LOAD;
-    enqueue_chunk(LOAD_QUEUES, c);
+    if (!enqueue_chunk(LOAD_QUEUES, c)) {
+      cleanup_chunk(c); // we'll try again next time
+    }
   } else {
     chunk_approximation *ca = create_chunk_approximation(glcpos, detail);
     ca->chunk_flags |= CF_QUEUED_TO_LOAD;
     ca->chunk_flags |= CF_COMPILE_ON_LOAD;
-    enqueue_chunk_approximation(LOAD_QUEUES, ca);
+    if (!enqueue_chunk_approximation(LOAD_QUEUES, ca)) {
+      cleanup_chunk_approximation(ca);
+    }
   }
 }
 
@@ -257,12 +443,16 @@ void mark_for_compilation(chunk_or_approx *coa) {
     chunk *c = (chunk *) coa->ptr;
     if (c->chunk_flags & CF_QUEUED_TO_COMPILE) { return; }
     c->chunk_flags |= CF_QUEUED_TO_COMPILE;
-    enqueue_chunk(COMPILE_QUEUES, c);
+    if (!enqueue_chunk(COMPILE_QUEUES, c)) {
+      defer_chunk(COMPILE_QUEUES, c);
+    }
   } else if (coa->type == CA_TYPE_APPROXIMATION) {
     chunk_approximation *ca = (chunk_approximation *) coa->ptr;
     if (ca->chunk_flags & CF_QUEUED_TO_COMPILE) { return; }
     ca->chunk_flags |= CF_QUEUED_TO_COMPILE;
-    enqueue_chunk_approximation(COMPILE_QUEUES, ca);
+    if (!enqueue_chunk_approximation(COMPILE_QUEUES, ca)) {
+      defer_chunk_approximation(COMPILE_QUEUES, ca);
+    }
   } else {
     fprintf(stderr, "Can't mark an unloaded chunk for compilation.\n");
     exit(EXIT_FAILURE);
@@ -450,13 +640,16 @@ void tick_load_chunks(global_chunk_pos *load_center) {
   chunk *old_chunk = NULL;
   chunk_approximation *ca = NULL;
   chunk_approximation *old_approx = NULL;
+  chunk_or_approx coa;
   lod detail = LOD_BASE;
+  uint64_t generation;
 
-  queue *q = LOAD_QUEUES->levels[LOD_BASE];
+  mpmc_queue *q = LOAD_QUEUES->levels[LOD_BASE];
   map *m = LOAD_QUEUES->maps[LOD_BASE];
 
-  while (n < LOAD_CAP && q_get_length(q) > 0) {
-    c = (chunk *) q_pop_element(q);
+  free_retired_data(0);
+
+  while (n < LOAD_CAP && (c = (chunk *) mq_pop_element(q)) != NULL) {
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
     m3_pop_value(
       m,
@@ -483,16 +676,22 @@ void tick_load_chunks(global_chunk_pos *load_center) {
     );
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
     m_unlock(CHUNK_CACHE->levels[LOD_BASE]);
+    // The best data for this position just changed:
+    generation = invalidate_cell_at_caches();
     if (old_chunk != NULL) {
-      cleanup_chunk(old_chunk);
+      ch__coa(old_chunk, &coa);
+      make_unrenderable(&coa);
+      retire_data(&coa, generation);
     }
     n += 1;
   }
   for (detail = LOD_BASE + 1; detail < N_LODS; ++detail) {
     q = LOAD_QUEUES->levels[detail];
     m = LOAD_QUEUES->maps[detail];
-    while (n < LOAD_CAP && q_get_length(q) > 0) {
-      ca = (chunk_approximation *) q_pop_element(q);
+    while (
+      n < LOAD_CAP
+   && (ca = (chunk_approximation *) mq_pop_element(q)) != NULL
+    ) {
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
       m3_pop_value(
         m,
@@ -519,8 +718,11 @@ void tick_load_chunks(global_chunk_pos *load_center) {
       );
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
       m_unlock(CHUNK_CACHE->levels[ca->detail]);
+      generation = invalidate_cell_at_caches();
       if (old_approx != NULL) {
-        cleanup_chunk_approximation(old_approx);
+        aprx__coa(old_approx, &coa);
+        make_unrenderable(&coa);
+        retire_data(&coa, generation);
       }
       n += 1;
     }
@@ -533,11 +735,11 @@ void tick_compile_chunks(void) {
   chunk *c = NULL;
   chunk_approximation *ca = NULL;
   lod detail = LOD_BASE;
-  queue *q = COMPILE_QUEUES->levels[LOD_BASE];
+  mpmc_queue *q = COMPILE_QUEUES->levels[LOD_BASE];
   map *m = COMPILE_QUEUES->maps[LOD_BASE];
   chunk_or_approx coa;
-  while (n < COMPILE_CAP && q_get_length(q) > 0) {
-    c = (chunk *) q_pop_element(q);
+  drain_overflow(COMPILE_QUEUES, LOD_BASE);
+  while (n < COMPILE_CAP && (c = (chunk *) mq_pop_element(q)) != NULL) {
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
     m3_pop_value(
       m,
@@ -548,14 +750,23 @@ void tick_compile_chunks(void) {
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
     ch__coa(c, &coa);
     compile_chunk_or_approx(&coa);
-    c->chunk_flags &= ~CF_QUEUED_TO_COMPILE;
+    make_renderable(&coa);
+    // Retired data isn't freed while this flag is set (see free_retired_data):
+    __atomic_and_fetch(
+      &(c->chunk_flags),
+      (chunk_flag) ~CF_QUEUED_TO_COMPILE,
+      __ATOMIC_RELEASE
+    );
     n += 1;
   }
   for (detail = LOD_BASE + 1; detail < N_LODS; ++detail) {
     q = COMPILE_QUEUES->levels[detail];
     m = COMPILE_QUEUES->maps[detail];
-    while (n < COMPILE_CAP && q_get_length(q) > 0) {
-      ca = (chunk_approximation *) q_pop_element(q);
+    drain_overflow(COMPILE_QUEUES, detail);
+    while (
+      n < COMPILE_CAP
+   && (ca = (chunk_approximation *) mq_pop_element(q)) != NULL
+    ) {
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
       m3_pop_value(
         m,
@@ -566,7 +777,12 @@ void tick_compile_chunks(void) {
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
       aprx__coa(ca, &coa);
       compile_chunk_or_approx(&coa);
-      ca->chunk_flags &= ~CF_QUEUED_TO_COMPILE;
+      make_renderable(&coa);
+      __atomic_and_fetch(
+        &(ca->chunk_flags),
+        (chunk_flag) ~CF_QUEUED_TO_COMPILE,
+        __ATOMIC_RELEASE
+      );
       n += 1;
     }
   }
@@ -574,14 +790,32 @@ void tick_compile_chunks(void) {
 }
 
 void tick_biogen(void) {
-  int n = 0, ns = 0, in_queue = 0;
+  int n = 0, ns = 0, in_queue = 0, popped = 0;
+  int i, j, batch_size = 0, batch_cap, waves = 0, w;
+  uint64_t bc_hits, bc_misses;
   chunk *c = NULL;
+  chunk *batch[BIOGEN_MAX_BATCH];
+  int wave[BIOGEN_MAX_BATCH];
+  chunk_neighborhood ch_nbh;
   chunk_or_approx coa;
-  queue *q = BIOGEN_QUEUES->levels[LOD_BASE];
+  mpmc_queue *q = BIOGEN_QUEUES->levels[LOD_BASE];
   map *m = BIOGEN_QUEUES->maps[LOD_BASE];
-  in_queue = q_get_length(q);
-  while (n < BIOGEN_CAP && (n + ns) < in_queue) {
-    c = (chunk *) q_pop_element(q);
+  int threads = BIOGEN_THREADS > 0 ? BIOGEN_THREADS : omp_get_max_threads();
+
+  batch_cap = BIOGEN_CAP * threads;
+  if (batch_cap > BIOGEN_MAX_BATCH) {
+    batch_cap = BIOGEN_MAX_BATCH;
+  }
+
+  // Take chunks off of the queue until we have a full batch whose
+  // neighborhoods are available:
+  in_queue = mq_get_length(q);
+  while (batch_size < batch_cap && popped < in_queue) {
+    c = (chunk *) mq_pop_element(q);
+    if (c == NULL) {
+      break;
+    }
+    popped += 1;
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
     m3_pop_value(
       m,
@@ -590,45 +824,91 @@ void tick_biogen(void) {
       (map_key_t) c->glcpos.z
     );
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
-    add_biology(c);
-    if (c->chunk_flags & CF_HAS_BIOLOGY) {
-      n += 1;
-      persist_chunk(c); // when the chunk was loaded we saved a bare-terrain
-      // version, now that we've added biology let's save that too.
-      // Mark this chunk for re-compilation now that it's been changed.
-      coa.type = CA_TYPE_CHUNK;
-      coa.ptr = c;
-      mark_for_compilation(&coa);
-    } else {
-      ns += 1;
-      // Put it back in the queue:
-      mark_for_biogen(c); // infinite loop avoided in_queue isn't changed
+    if (!(c->chunk_flags & CF_HAS_BIOLOGY)) {
+      fill_chunk_neighborhood(&(c->glcpos), &ch_nbh);
+      if (ch_nbh.members[0] == NULL) {
+        // add_biology would fail: put it back in the queue
+        ns += 1;
+        mark_for_biogen(c); // infinite loop avoided in_queue isn't changed
+        c->chunk_flags &= ~CF_QUEUED_FOR_BIOGEN;
+        continue;
+      }
+    }
+    // Each chunk goes in the wave after the last earlier chunk that it
+    // conflicts with, so chunks that could see each other are processed in
+    // queue order no matter how many threads there are:
+    wave[batch_size] = 0;
+    for (j = 0; j < batch_size; ++j) {
+      if (wave[j] >= wave[batch_size] && biogen_conflict(batch[j], c)) {
+        wave[batch_size] = wave[j] + 1;
+      }
+    }
+    if (wave[batch_size] + 1 > waves) {
+      waves = wave[batch_size] + 1;
+    }
+    batch[batch_size] = c;
+    batch_size += 1;
+  }
+
+  for (w = 0; w < waves; ++w) {
+    // Chunks within a wave are independent:
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+    for (i = 0; i < batch_size; ++i) {
+      if (wave[i] == w) {
+        add_biology(batch[i]);
+      }
+    }
+    // Follow up on this wave's chunks in queue order:
+    for (i = 0; i < batch_size; ++i) {
+      if (wave[i] != w) {
+        continue;
+      }
+      c = batch[i];
+      if (c->chunk_flags & CF_HAS_BIOLOGY) {
+        n += 1;
+        persist_chunk(c); // when the chunk was loaded we saved a bare-terrain
+        // version, now that we've added biology let's save that too.
+        // Mark this chunk for re-compilation now that it's been changed.
+        coa.type = CA_TYPE_CHUNK;
+        coa.ptr = c;
+        mark_for_compilation(&coa);
+      } else {
+        ns += 1;
+        // Put it back in the queue:
+        mark_for_biogen(c);
+      }
+      c->chunk_flags &= ~CF_QUEUED_FOR_BIOGEN;
     }
-    c->chunk_flags &= ~CF_QUEUED_FOR_BIOGEN;
   }
   // TODO: Is it fine to ignore other LODs? Maybe we should be adding some fake
   // plants to them?
   update_count(&CHUNKS_BIOGEND, n);
   update_count(&CHUNKS_BIOSKIPPED, ns);
+  take_biome_cache_stats(THE_WORLD, &bc_hits, &bc_misses);
+  update_count(&BIOME_CACHE_HITS, (int) bc_hits);
+  update_count(&BIOME_CACHE_MISSES, (int) bc_misses);
 }
 
 void load_chunk(chunk *c) {
   // TODO: Cell entities!
   chunk_or_approx coa;
+  TRACE_SCOPE("load chunk");
 #ifdef PROFILE_TIME
   start_duration(&DISK_READ_TIME);
   start_duration(&DISK_MISS_TIME);
 #endif
   if (load_chunk_data(c)) {
 #ifdef PROFILE_TIME
-    end_duration(&DISK_READ_TIME);
     // in this case we don't record DISK_MISS_TIME
+    cancel_duration(&DISK_MISS_TIME);
+    end_duration(&DISK_READ_TIME);
 #endif
     // TODO: Anything here?
   } else {
 #ifdef PROFILE_TIME
     end_duration(&DISK_MISS_TIME);
     // in this case we don't record DISK_READ_TIME
+    cancel_duration(&DISK_READ_TIME);
     start_duration(&TGEN_TIME);
 #endif
     generate_chunk(c);
@@ -661,21 +941,9 @@ void load_chunk(chunk *c) {
 void load_chunk_approx(chunk_approximation *ca) {
   // TODO: Data from disk!
   // TODO: Cell entities!
-  int step = (1 << (ca->detail));
-  block_index idx;
-  global_pos glpos;
   chunk_or_approx coa;
   lod previous_detail;
-  // TODO: Better approximation?
-  idx.xyz.w = 0;
-  for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; idx.xyz.x += step) {
-    for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; idx.xyz.y += step) {
-      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; idx.xyz.z += step) {
-        caidx__glpos(ca, &idx, &glpos);
-        world_cell(THE_WORLD, &glpos, ca_cell(ca, idx));
-      }
-    }
-  }
+  generate_chunk_approximation(ca);
   ca->chunk_flags |= CF_LOADED;
   if (ca->chunk_flags & CF_COMPILE_ON_LOAD) {
     ca->chunk_flags &= ~CF_COMPILE_ON_LOAD;
@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include "datatypes/queue.h"
+#include "datatypes/mpmc_queue.h"
 #include "datatypes/map.h"
 
 #include "world/blocks.h"
@@ -33,6 +34,10 @@ typedef struct chunk_cache_s chunk_cache;
 extern size_t const CHUNK_QUEUE_SET_MAP_SIZE;
 extern size_t const CHUNK_CACHE_MAP_SIZE;
 
+// How many chunks or approximations each queue in a chunk queue set can hold
+// (more than fit within the load distance at any one level of detail):
+extern size_t const CHUNK_QUEUE_SET_CAPACITY;
+
 // Max chunks to load or compile per tick:
 extern int const LOAD_CAP;
 extern int const COMPILE_CAP;
@@ -62,13 +67,18 @@ extern chunk_queue_set *BIOGEN_QUEUES;
 // The global chunk cache:
 extern chunk_cache *CHUNK_CACHE;
 
+// How many threads (including the data thread itself) add biology to a
+// batch of chunks. Zero means OpenMP's default (see start_game).
+extern int BIOGEN_THREADS;
+
 /*************************
  * Structure Definitions *
  *************************/
 
 struct chunk_queue_set_s {
-  queue *levels[N_LODS];
+  mpmc_queue *levels[N_LODS];
   map *maps[N_LODS];
+  queue *overflow[N_LODS]; // requests that didn't fit (see defer_chunk)
 };
 
 struct chunk_cache_s {
@@ -165,9 +175,20 @@ void cleanup_chunk_cache(chunk_cache *cc);
  * Functions *
  *************/
 
-// Adds the given chunk/approx to the queue set at the base level of detail.
-void enqueue_chunk(chunk_queue_set *cqs, chunk *c);
-void enqueue_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca);
+// Adds the given chunk/approx to the queue set at its level of detail. These
+// may be called from any thread. Returns 0 (without queueing anything) if the
+// relevant queue is full, or 1 on success.
+int enqueue_chunk(chunk_queue_set *cqs, chunk *c);
+int enqueue_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca);
+
+// Holds a chunk/approx that didn't fit in its queue until drain_overflow moves
+// it across. Like the enqueue functions these may be called from any thread.
+void defer_chunk(chunk_queue_set *cqs, chunk *c);
+void defer_chunk_approximation(chunk_queue_set *cqs, chunk_approximation *ca);
+
+// Moves deferred entries at the given level of detail into their queue until
+// it fills up again. Consumers call this before popping from a level.
+void drain_overflow(chunk_queue_set *cqs, lod detail);
 
 // Creates a new chunk at the given position and level of detail and marks it
 // for loading. Does nothing if a chunk with the same coordinates and level of
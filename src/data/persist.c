@@ -12,6 +12,7 @@
 #include "world/blocks.h"
 #include "world/world.h"
 #include "filesys/filesys.h"
+#include "prof/ptrace.h"
 
 #include "persist.h"
 
@@ -226,12 +227,19 @@ int load_chunk_from_block(ps_block* block, ps_chunk_pos* cpos, chunk* chunk) {
     return 0;
   }
   fseek(block->file, *offset, SEEK_SET);
+  c_expand_cells(chunk);
   fread(
-    (void*) (&(chunk->cells)),
+    (void*) (chunk->cells),
     sizeof(cell),
     TOTAL_CHUNK_CELLS,
     block->file
   );
+  // The growth index isn't stored on disk (chunk slots only hold cell data),
+  // so it gets rebuilt from the loaded cells when it's next needed:
+  c_invalidate_growth_index(chunk);
+  // Chunks are always stored in full, so uniform ones have to be detected
+  // again:
+  c_compact_cells(chunk);
   // TODO: How to load entities?!?
   return 1;
 }
@@ -240,6 +248,7 @@ void persist_chunk(chunk* chunk) {
   ps_block_pos bpos;
   ps_chunk_pos cpos;
   size_t i;
+  TRACE_SCOPE("persist chunk");
   glcpos__psbpos(&(chunk->glcpos), &bpos);
   glcpos__pscpos(&(chunk->glcpos), &cpos);
   for (i = 0; i < PS_BLOCK_CACHE_SIZE; ++i) {
@@ -257,6 +266,8 @@ void persist_chunk(chunk* chunk) {
 
 void persist_chunk_in_block(ps_block* block, ps_chunk_pos* cpos, chunk* chunk) {
   // TODO: optimize pure-air/pure-water chunks?
+  cell slice[CHUNK_SIZE * CHUNK_SIZE];
+  size_t i;
   uint64_t* offset = block_chunk_index(block, cpos);
   if (*offset == 0) { // we had no data for this chunk: create some
     // Set our offset in memory to point to the current end of the file:
@@ -274,12 +285,27 @@ void persist_chunk_in_block(ps_block* block, ps_chunk_pos* cpos, chunk* chunk) {
     // Seek to offset for this chunk
     fseek(block->file, *offset, SEEK_SET);
   }
-  // Write out our cell data:
-  fwrite(
-    (void*) (&(chunk->cells)),
-    sizeof(cell),
-    TOTAL_CHUNK_CELLS,
-    block->file
-  );
+  // Write out our cell data (uniform chunks are written out in full, one
+  // layer at a time):
+  if (c_is_uniform(chunk)) {
+    for (i = 0; i < CHUNK_SIZE * CHUNK_SIZE; ++i) {
+      copy_cell(&(chunk->fill), &(slice[i]));
+    }
+    for (i = 0; i < CHUNK_SIZE; ++i) {
+      fwrite(
+        (void*) slice,
+        sizeof(cell),
+        CHUNK_SIZE * CHUNK_SIZE,
+        block->file
+      );
+    }
+  } else {
+    fwrite(
+      (void*) (chunk->cells),
+      sizeof(cell),
+      TOTAL_CHUNK_CELLS,
+      block->file
+    );
+  }
   // TODO: How to store entities?!?
 }
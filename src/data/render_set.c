@@ -0,0 +1,580 @@
+// render_set.c
+// The set of compiled chunks and approximations available to the renderer.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include <omp.h>
+
+#include "render_set.h"
+
+#include "datatypes/list.h"
+#include "datatypes/map.h"
+#include "datatypes/vector.h"
+#include "prof/ptime.h"
+
+/*************
+ * Constants *
+ *************/
+
+size_t const RENDER_SET_MAP_SIZE = 16384;
+
+// Radius of a sphere that contains a whole chunk:
+#define CHUNK_BOUNDING_RADIUS (CHUNK_SIZE * 0.8660254f)
+
+// Occlusion grid cell states (bits that CF_OPAQUE_FACES doesn't use; the
+// other bits of each grid cell hold the opaque face flags of its chunk):
+#define OCC_PRESENT 0x0001 // a chunk here passed the frustum test
+#define OCC_REACHED 0x0002 // the flood reached this position
+#define OCC_OUTSIDE 0x0004 // this position is outside the view
+#define OCC_QUEUED 0x0008 // the flood has passed into this position
+
+// The six directions the occlusion flood can step in, along with the face a
+// chunk must not have marked opaque to be left that way, and the face a chunk
+// must not have marked opaque to be entered that way:
+static int const OCC_STEP_X[6] = {  0,  0,  0,  0,  1, -1 };
+static int const OCC_STEP_Y[6] = {  0,  0,  1, -1,  0,  0 };
+static int const OCC_STEP_Z[6] = {  1, -1,  0,  0,  0,  0 };
+#define OCC_EXIT_FACES { \
+  CF_OPAQUE_ABOVE, CF_OPAQUE_BELOW, \
+  CF_OPAQUE_NORTH, CF_OPAQUE_SOUTH, \
+  CF_OPAQUE_EAST, CF_OPAQUE_WEST \
+}
+#define OCC_ENTRY_FACES { \
+  CF_OPAQUE_BELOW, CF_OPAQUE_ABOVE, \
+  CF_OPAQUE_SOUTH, CF_OPAQUE_NORTH, \
+  CF_OPAQUE_WEST, CF_OPAQUE_EAST \
+}
+
+/***********
+ * Globals *
+ ***********/
+
+render_set *RENDER_SET = NULL;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Looks up the index of the entry for the given position, returning -1 if
+// there isn't one. The caller must hold the set's lock.
+static inline ptrdiff_t rs_find(
+  render_set *rs,
+  global_chunk_pos const * const glcpos
+) {
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+  return ((ptrdiff_t) m3_get_value(
+    rs->index,
+    (map_key_t) glcpos->x,
+    (map_key_t) glcpos->y,
+    (map_key_t) glcpos->z
+  )) - 1;
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+}
+
+static inline void rs_set_index(
+  render_set *rs,
+  global_chunk_pos const * const glcpos,
+  size_t i
+) {
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+  m3_put_value(
+    rs->index,
+    (void *) (i + 1),
+    (map_key_t) glcpos->x,
+    (map_key_t) glcpos->y,
+    (map_key_t) glcpos->z
+  );
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+}
+
+// Removes the entry at the given index by moving the last entry into its
+// place. The caller must hold the set's lock.
+static inline void rs_remove_entry(render_set *rs, size_t i) {
+  render_set_entry *doomed = &(rs->entries[i]);
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+  m3_pop_value(
+    rs->index,
+    (map_key_t) doomed->glcpos.x,
+    (map_key_t) doomed->glcpos.y,
+    (map_key_t) doomed->glcpos.z
+  );
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+  rs->count -= 1;
+  if (i < rs->count) {
+    rs->entries[i] = rs->entries[rs->count];
+    rs_set_index(rs, &(rs->entries[i].glcpos), i);
+  }
+}
+
+// Sets up one frustum plane normal: the plane is tilted away from the forward
+// vector by the given angle towards the given direction.
+static inline void compute_plane(
+  vector *result,
+  vector const * const fwd,
+  vector const * const dir,
+  float angle
+) {
+  vcopy_as(result, dir);
+  vscale(result, cosf(angle));
+  vadd_to_scaled(result, fwd, -sinf(angle));
+}
+
+// Returns the highest level of detail that should be drawn for the chunk at
+// the given position, or N_LODS if it's beyond the render distance or outside of the view
+// frustum.
+static inline lod rv_desired_detail(
+  render_view const * const rv,
+  global_chunk_pos const * const glcpos
+) {
+  int p;
+  lod result;
+  vector center; // center of the chunk relative to the eye
+  gl_cpos_t farthest = rv->max_distances[N_LODS - 1];
+  gl_cpos_t dx = glcpos->x - rv->center.x;
+  gl_cpos_t dy = glcpos->y - rv->center.y;
+  gl_cpos_t dz = glcpos->z - rv->center.z;
+  float dist;
+
+  // Distance (in chunks) decides the desired level of detail:
+  if (
+    dx > farthest || dx < -farthest
+ || dy > farthest || dy < -farthest
+ || dz > farthest || dz < -farthest
+  ) {
+    return N_LODS;
+  }
+  dist = sqrtf((float) (dx*dx + dy*dy + dz*dz));
+  for (result = LOD_BASE; result < N_LODS; ++result) {
+    if (dist <= rv->max_distances[result]) {
+      break;
+    }
+  }
+  if (result == N_LODS) {
+    return N_LODS;
+  }
+
+  // Frustum test using the chunk's bounding sphere:
+  center.x = (
+    (((gl_pos_t) glcpos->x) << CHUNK_BITS) - rv->origin.x
+  ) + (CHUNK_SIZE / 2.0) - rv->eye.x;
+  center.y = (
+    (((gl_pos_t) glcpos->y) << CHUNK_BITS) - rv->origin.y
+  ) + (CHUNK_SIZE / 2.0) - rv->eye.y;
+  center.z = (
+    (((gl_pos_t) glcpos->z) << CHUNK_BITS) - rv->origin.z
+  ) + (CHUNK_SIZE / 2.0) - rv->eye.z;
+  if (fabs(center.x) + fabs(center.y) + fabs(center.z) <= rv->min_cull_dist) {
+    return result;
+  }
+  for (p = 0; p < 4; ++p) {
+    if (vdot(&center, &(rv->planes[p])) > CHUNK_BOUNDING_RADIUS) {
+      return N_LODS;
+    }
+  }
+  return result;
+}
+
+// Returns the chunk flags of the given chunk or approximation.
+static inline chunk_flag coa_flags(chunk_or_approx const * const coa) {
+  if (coa->type == CA_TYPE_CHUNK) {
+    return ((chunk *) (coa->ptr))->chunk_flags;
+  }
+  return ((chunk_approximation *) (coa->ptr))->chunk_flags;
+}
+
+// Returns the position of the given chunk or approximation.
+static inline global_chunk_pos * coa_glcpos(chunk_or_approx const * const coa) {
+  if (coa->type == CA_TYPE_CHUNK) {
+    return &(((chunk *) (coa->ptr))->glcpos);
+  }
+  return &(((chunk_approximation *) (coa->ptr))->glcpos);
+}
+
+// Adds up the draw calls and indices that rendering the given chunk or
+// approximation would take.
+static inline void count_draws(
+  chunk_or_approx const * const coa,
+  size_t *draws,
+  size_t *vertices
+) {
+  vertex_buffer *layers;
+  layer ly;
+  size_t i;
+  uintptr_t count;
+  if (coa->type == CA_TYPE_CHUNK) {
+    layers = ((chunk *) (coa->ptr))->layers;
+  } else {
+    layers = ((chunk_approximation *) (coa->ptr))->layers;
+  }
+  for (ly = 0; ly < N_LAYERS; ++ly) {
+    for (i = 0; i < l_get_length(layers[ly].vcounts); ++i) {
+      count = (uintptr_t) l_get_item(layers[ly].vcounts, i);
+      if (count > 0) {
+        *draws += 1;
+        *vertices += count;
+      }
+    }
+  }
+}
+
+// Makes sure the set's occlusion grid is big enough for the given view and
+// clears it. Returns the edge length of the grid.
+static inline size_t rs_setup_occlusion_grid(
+  render_set *rs,
+  render_view const * const rv
+) {
+  size_t edge = 2 * rv->max_distances[N_LODS - 1] + 1;
+  size_t volume = edge * edge * edge;
+  if (rs->occ_edge != edge) {
+    free(rs->occ_grid);
+    free(rs->occ_queue);
+    rs->occ_grid = (uint16_t *) malloc(sizeof(uint16_t) * volume);
+    rs->occ_queue = (uint32_t *) malloc(sizeof(uint32_t) * volume);
+    if (rs->occ_grid == NULL || rs->occ_queue == NULL) {
+      perror("Failed to allocate occlusion grid.");
+      exit(errno);
+    }
+    rs->occ_edge = edge;
+  }
+  memset(rs->occ_grid, 0, sizeof(uint16_t) * volume);
+  return edge;
+}
+
+// Removes results that can't be seen from the camera by flooding outwards
+// from the camera's chunk (see rs_collect_visible). Returns the new number of
+// results and updates the set's occlusion statistics. The caller must hold
+// the set's lock.
+static size_t rs_occlusion_cull(
+  render_set *rs,
+  render_view const * const rv,
+  chunk_or_approx *results,
+  size_t n
+) {
+  static chunk_flag const exit_faces[6] = OCC_EXIT_FACES;
+  static chunk_flag const entry_faces[6] = OCC_ENTRY_FACES;
+  gl_cpos_t radius = rv->max_distances[N_LODS - 1];
+  ptrdiff_t edge = (ptrdiff_t) rs_setup_occlusion_grid(rs, rv);
+  uint16_t *grid = rs->occ_grid;
+  uint32_t *queue = rs->occ_queue;
+  size_t head = 0, tail = 0;
+  size_t i, kept;
+  int d;
+  ptrdiff_t start, here, there;
+  ptrdiff_t cx, cy, cz; // camera position in grid coordinates
+  ptrdiff_t x, y, z, nx, ny, nz;
+  global_chunk_pos glcpos;
+  global_chunk_pos *pos;
+
+  // Find the camera's chunk:
+  cx = (
+    (rv->origin.x + (gl_pos_t) floorf(rv->eye.x)) >> CHUNK_BITS
+  ) - rv->center.x + radius;
+  cy = (
+    (rv->origin.y + (gl_pos_t) floorf(rv->eye.y)) >> CHUNK_BITS
+  ) - rv->center.y + radius;
+  cz = (
+    (rv->origin.z + (gl_pos_t) floorf(rv->eye.z)) >> CHUNK_BITS
+  ) - rv->center.z + radius;
+  if (
+    cx < 0 || cx >= edge
+ || cy < 0 || cy >= edge
+ || cz < 0 || cz >= edge
+  ) {
+    // The camera is somewhere strange; don't cull anything.
+    return n;
+  }
+
+  // Fill in the grid with the opaque faces of every candidate:
+  for (i = 0; i < n; ++i) {
+    pos = coa_glcpos(&(results[i]));
+    here = (
+      (pos->x - rv->center.x + radius)
+    + edge * (
+        (pos->y - rv->center.y + radius)
+      + edge * (pos->z - rv->center.z + radius)
+      )
+    );
+    grid[here] = (coa_flags(&(results[i])) & CF_OPAQUE_FACES) | OCC_PRESENT;
+  }
+
+  // Flood outwards from the camera. The camera's own chunk is never treated
+  // as opaque, since the camera may be partway into a wall.
+  start = cx + edge * (cy + edge * cz);
+  grid[start] |= OCC_REACHED | OCC_QUEUED;
+  queue[tail++] = start;
+  while (head < tail) {
+    here = queue[head++];
+    x = here % edge;
+    y = (here / edge) % edge;
+    z = here / (edge * edge);
+    for (d = 0; d < 6; ++d) {
+      nx = x + OCC_STEP_X[d];
+      ny = y + OCC_STEP_Y[d];
+      nz = z + OCC_STEP_Z[d];
+      if (
+        nx < 0 || nx >= edge
+     || ny < 0 || ny >= edge
+     || nz < 0 || nz >= edge
+      ) {
+        continue;
+      }
+      // Never step back towards the camera (lines of sight don't):
+      if (
+        (OCC_STEP_X[d] != 0 && labs(nx - cx) < labs(x - cx))
+     || (OCC_STEP_Y[d] != 0 && labs(ny - cy) < labs(y - cy))
+     || (OCC_STEP_Z[d] != 0 && labs(nz - cz) < labs(z - cz))
+      ) {
+        continue;
+      }
+      there = nx + edge * (ny + edge * nz);
+      if (grid[there] & (OCC_QUEUED | OCC_OUTSIDE)) {
+        continue;
+      }
+      if (here != start && (grid[here] & exit_faces[d])) {
+        continue;
+      }
+      if (!(grid[there] & OCC_PRESENT)) {
+        // Empty or unloaded: only worth flooding through if it's in view.
+        glcpos.x = nx + rv->center.x - radius;
+        glcpos.y = ny + rv->center.y - radius;
+        glcpos.z = nz + rv->center.z - radius;
+        if (rv_desired_detail(rv, &glcpos) == N_LODS) {
+          grid[there] |= OCC_OUTSIDE;
+          continue;
+        }
+      }
+      // We can see this chunk's face either way, but only see through it
+      // if the face we're entering by is open. An earlier arrival through an
+      // opaque face doesn't stop a later one through an open face:
+      grid[there] |= OCC_REACHED;
+      if (!(grid[there] & entry_faces[d])) {
+        grid[there] |= OCC_QUEUED;
+        queue[tail++] = there;
+      }
+    }
+  }
+
+  // Keep only the results the flood reached:
+  kept = 0;
+  for (i = 0; i < n; ++i) {
+    pos = coa_glcpos(&(results[i]));
+    here = (
+      (pos->x - rv->center.x + radius)
+    + edge * (
+        (pos->y - rv->center.y + radius)
+      + edge * (pos->z - rv->center.z + radius)
+      )
+    );
+    if (grid[here] & OCC_REACHED) {
+      results[kept] = results[i];
+      kept += 1;
+    } else {
+      rs->n_occluded += 1;
+      count_draws(
+        &(results[i]),
+        &(rs->occluded_draws),
+        &(rs->occluded_vertices)
+      );
+    }
+  }
+  return kept;
+}
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+render_set *create_render_set(void) {
+  render_set *rs = (render_set *) malloc(sizeof(render_set));
+  if (rs == NULL) {
+    perror("Failed to create render set.");
+    exit(errno);
+  }
+  rs->capacity = RENDER_SET_INITIAL_CAPACITY;
+  rs->count = 0;
+  rs->entries = (render_set_entry *) malloc(
+    sizeof(render_set_entry) * rs->capacity
+  );
+  if (rs->entries == NULL) {
+    perror("Failed to create render set entries.");
+    exit(errno);
+  }
+  rs->index = create_map(3, RENDER_SET_MAP_SIZE);
+  omp_init_lock(&(rs->lock));
+  rs->occ_grid = NULL;
+  rs->occ_queue = NULL;
+  rs->occ_edge = 0;
+  rs->n_occluded = 0;
+  rs->occluded_draws = 0;
+  rs->occluded_vertices = 0;
+  return rs;
+}
+
+CLEANUP_IMPL(render_set) {
+  cleanup_map(doomed->index);
+  free(doomed->entries);
+  free(doomed->occ_grid);
+  free(doomed->occ_queue);
+  omp_destroy_lock(&(doomed->lock));
+  free(doomed);
+}
+
+/*************
+ * Functions *
+ *************/
+
+void rs_lock(render_set *rs) {
+  omp_set_lock(&(rs->lock));
+}
+
+void rs_unlock(render_set *rs) {
+  omp_unset_lock(&(rs->lock));
+}
+
+size_t rs_get_count(render_set *rs) {
+  return rs->count;
+}
+
+void rs_add(render_set *rs, chunk_or_approx *coa) {
+  ptrdiff_t i;
+  lod detail = coa_detail_level(coa);
+  global_chunk_pos *glcpos;
+  render_set_entry *entry;
+  if (detail >= N_LODS) {
+    return;
+  }
+  glcpos = coa_glcpos(coa);
+  i = rs_find(rs, glcpos);
+  if (i < 0) {
+    if (rs->count == rs->capacity) {
+      rs->capacity *= 2;
+      rs->entries = (render_set_entry *) realloc(
+        rs->entries,
+        sizeof(render_set_entry) * rs->capacity
+      );
+      if (rs->entries == NULL) {
+        perror("Failed to grow render set.");
+        exit(errno);
+      }
+    }
+    i = rs->count;
+    rs->count += 1;
+    entry = &(rs->entries[i]);
+    copy_glcpos(glcpos, &(entry->glcpos));
+    for (detail = LOD_BASE; detail < N_LODS; ++detail) {
+      entry->levels[detail] = NULL;
+    }
+    detail = coa_detail_level(coa);
+    rs_set_index(rs, glcpos, i);
+  }
+  rs->entries[i].levels[detail] = coa->ptr;
+}
+
+void rs_remove(render_set *rs, chunk_or_approx *coa) {
+  ptrdiff_t i;
+  lod detail = coa_detail_level(coa);
+  lod other;
+  global_chunk_pos *glcpos;
+  render_set_entry *entry;
+  if (detail >= N_LODS) {
+    return;
+  }
+  glcpos = coa_glcpos(coa);
+  i = rs_find(rs, glcpos);
+  if (i >= 0) {
+    entry = &(rs->entries[i]);
+    // Only remove the data if it's the data we were asked about (a newer
+    // replacement may have been added already):
+    if (entry->levels[detail] == coa->ptr) {
+      entry->levels[detail] = NULL;
+      for (other = LOD_BASE; other < N_LODS; ++other) {
+        if (entry->levels[other] != NULL) {
+          break;
+        }
+      }
+      if (other == N_LODS) {
+        rs_remove_entry(rs, i);
+      }
+    }
+  }
+}
+
+void rs_clear(render_set *rs) {
+  rs_lock(rs);
+  while (rs->count > 0) {
+    rs_remove_entry(rs, rs->count - 1);
+  }
+  rs_unlock(rs);
+}
+
+void rv_set_frustum(
+  render_view *rv,
+  vector const * const eye,
+  vector const * const fwd,
+  vector const * const side,
+  vector const * const up,
+  float half_x,
+  float half_y
+) {
+  vector back_side, back_up;
+  vcopy_as(&(rv->eye), eye);
+  vcopy_as(&back_side, side);
+  vscale(&back_side, -1);
+  vcopy_as(&back_up, up);
+  vscale(&back_up, -1);
+  compute_plane(&(rv->planes[0]), fwd, &back_side, half_x);
+  compute_plane(&(rv->planes[1]), fwd, side, half_x);
+  compute_plane(&(rv->planes[2]), fwd, &back_up, half_y);
+  compute_plane(&(rv->planes[3]), fwd, up, half_y);
+}
+
+size_t rs_collect_visible(
+  render_set *rs,
+  render_view const * const rv,
+  chunk_or_approx *results,
+  size_t max_results
+) {
+  size_t i, n = 0;
+  render_set_entry *entry;
+  lod detail;
+
+  rs_lock(rs);
+  rs->n_occluded = 0;
+  rs->occluded_draws = 0;
+  rs->occluded_vertices = 0;
+  // Timed as a whole: a trace span per entry would flood the trace ring.
+#ifdef PROFILE_TIME
+  start_duration(&RENDER_INNER_TIME);
+#endif
+  for (i = 0; i < rs->count && n < max_results; ++i) {
+    entry = &(rs->entries[i]);
+    // Pick the best data at or below the desired level of detail:
+    detail = rv_desired_detail(rv, &(entry->glcpos));
+    for (; detail < N_LODS; ++detail) {
+      if (entry->levels[detail] != NULL) {
+        results[n].ptr = entry->levels[detail];
+        if (detail == LOD_BASE) {
+          results[n].type = CA_TYPE_CHUNK;
+        } else {
+          results[n].type = CA_TYPE_APPROXIMATION;
+        }
+        n += 1;
+        break;
+      }
+    }
+  }
+#ifdef PROFILE_TIME
+  end_duration(&RENDER_INNER_TIME);
+#endif
+  if (rv->occlusion_cull) {
+    n = rs_occlusion_cull(rs, rv, results, n);
+  }
+  rs_unlock(rs);
+  return n;
+}
@@ -0,0 +1,170 @@
+#ifndef RENDER_SET_H
+#define RENDER_SET_H
+
+// render_set.h
+// The set of compiled chunks and approximations available to the renderer.
+
+#include <stdint.h>
+
+#include <omp.h>
+
+#include "boilerplate.h"
+
+#include "datatypes/map.h"
+#include "datatypes/vector.h"
+
+#include "world/world.h"
+
+/**************
+ * Structures *
+ **************/
+
+// One entry per chunk position that has compiled data at some level of
+// detail.
+struct render_set_entry_s;
+typedef struct render_set_entry_s render_set_entry;
+
+// A render set keeps track of every compiled chunk and approximation so that
+// the renderer doesn't have to look each position up in the chunk cache every
+// frame. The data pipeline adds data when it finishes compiling it and
+// removes data before evicting it.
+struct render_set_s;
+typedef struct render_set_s render_set;
+
+// A view frustum along with the distance limits that decide which level of
+// detail to draw at each chunk position.
+struct render_view_s;
+typedef struct render_view_s render_view;
+
+/*************
+ * Constants *
+ *************/
+
+// Initial number of entries allocated for a render set (it grows as needed):
+#define RENDER_SET_INITIAL_CAPACITY 4096
+
+// The map table size for render set position lookups:
+extern size_t const RENDER_SET_MAP_SIZE;
+
+/***********
+ * Globals *
+ ***********/
+
+// The global render set (managed by the data subsystem):
+extern render_set *RENDER_SET;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct render_set_entry_s {
+  global_chunk_pos glcpos;
+  // Compiled data at each level of detail (or NULL). The LOD_BASE entry is a
+  // chunk and the rest are chunk approximations.
+  void *levels[N_LODS];
+};
+
+struct render_set_s {
+  render_set_entry *entries; // densely packed
+  size_t count;
+  size_t capacity;
+  map *index; // maps positions to entry indices (plus one)
+  omp_lock_t lock;
+
+  // Scratch space for occlusion culling: a cube of chunk positions around the
+  // view center and a queue for flooding through it:
+  uint16_t *occ_grid;
+  uint32_t *occ_queue;
+  size_t occ_edge; // edge length of the cube
+
+  // Statistics from the most recent call to rs_collect_visible:
+  size_t n_occluded; // chunks that passed the frustum test but were occluded
+  size_t occluded_draws; // non-empty layers those chunks would have drawn
+  size_t occluded_vertices; // indices those layers would have drawn
+};
+
+struct render_view_s {
+  global_pos origin; // reference point: the vectors below are relative to it
+  global_chunk_pos center; // chunk from which render distances are measured
+  vector eye; // the camera position
+  // Outward-facing normals of the left, right, bottom, and top planes of the
+  // view frustum (all of which pass through the eye):
+  vector planes[4];
+  // Chunks whose centers are within this Manhattan distance of the eye are
+  // never frustum culled:
+  float min_cull_dist;
+  // Per-LOD render distances in chunks (see MAX_RENDER_DISTANCES in render.h):
+  gl_cpos_t const *max_distances;
+  // Whether to skip chunks that can't be seen past opaque chunk faces:
+  uint8_t occlusion_cull;
+};
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+// Allocates and returns a new empty render set.
+render_set *create_render_set(void);
+
+// Frees the memory associated with a render set (but not the chunks and
+// approximations it refers to).
+CLEANUP_DECL(render_set);
+
+/*************
+ * Functions *
+ *************/
+
+// Locking and unlocking: rs_add and rs_remove don't lock the set, so that
+// callers can check the chunk cache under the same lock (otherwise data could
+// be added just after it was evicted). Code that reads entries directly
+// should also hold the lock.
+void rs_lock(render_set *rs);
+void rs_unlock(render_set *rs);
+
+// Returns the number of chunk positions with compiled data.
+size_t rs_get_count(render_set *rs);
+
+// Adds the given compiled chunk or approximation to the set, replacing any
+// previous data for the same position and level of detail. The caller must
+// hold the set's lock.
+void rs_add(render_set *rs, chunk_or_approx *coa);
+
+// Removes the given chunk or approximation from the set if it's present. Must
+// be called before the data is freed, and the caller must hold the set's lock.
+void rs_remove(render_set *rs, chunk_or_approx *coa);
+
+// Removes everything from the set (locks the set itself).
+void rs_clear(render_set *rs);
+
+// Sets up the frustum planes of the given view. The forward, side, and up
+// vectors must be orthonormal, and the half-angles give the horizontal and
+// vertical extent of the view to either side of the forward vector.
+void rv_set_frustum(
+  render_view *rv,
+  vector const * const eye,
+  vector const * const fwd,
+  vector const * const side,
+  vector const * const up,
+  float half_x,
+  float half_y
+);
+
+// Fills in the results array with the best compiled data for each position in
+// the given render set which is within render distance and which intersects
+// the view frustum, stopping after max_results entries. Returns the number of
+// results. Locks the set itself.
+//
+// If the view asks for occlusion culling, this also floods outwards from the
+// camera's chunk through chunks that intersect the frustum, never stepping
+// back towards the camera and never passing through a face that either chunk
+// has marked as opaque (see compute_opaque_faces). Chunks the flood doesn't
+// reach can't be seen and are left out of the results. Unloaded positions
+// count as empty, so this only culls chunks that are provably hidden.
+size_t rs_collect_visible(
+  render_set *rs,
+  render_view const * const rv,
+  chunk_or_approx *results,
+  size_t max_results
+);
+
+#endif // ifndef RENDER_SET_H
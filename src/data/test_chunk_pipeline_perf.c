@@ -0,0 +1,483 @@
+// test_chunk_pipeline_perf.c
+// Headless end-to-end benchmark for the chunk pipeline: streams chunks along
+// a path through a generated world, running each one through the same steps
+// as the data subsystem (disk lookup, generation, persistence, biology, and
+// meshing) and reporting per-stage latency percentiles, throughput, and peak
+// memory as JSON. GL calls are stubbed out, so no window or context is needed.
+//
+// Usage: chunk_bench [chunks [dx dy [seed [world_dir]]]]
+//
+// The path starts at the terrain surface in the middle of the world and steps
+// by (dx, dy) chunks each time, following the surface. It's run twice: first
+// against an empty world directory (so every chunk is generated and
+// persisted) and then again (so every chunk is read back from disk). Without a
+// world_dir a temporary one is used and deleted afterwards.
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <ftw.h>
+#include <sys/resource.h>
+
+#include <omp.h>
+
+#include <GL/glew.h>
+
+#include "util.h"
+
+#include "datatypes/string.h"
+#include "world/blocks.h"
+#include "world/world.h"
+#include "world/species.h"
+#include "tex/tex.h"
+#include "graphics/display.h"
+#include "gen/worldgen.h"
+#include "gen/terrain.h"
+#include "gen/biology.h"
+#include "math/manifold.h"
+#include "prof/pmem.h"
+
+#include "data.h"
+#include "persist.h"
+
+// Default path length (in chunks) and direction:
+#define DEFAULT_PATH_LENGTH 64
+#define DEFAULT_DX 1
+#define DEFAULT_DY 0
+
+#define DEFAULT_WORLD_SEED 1821271
+
+// Chunks are evicted once they're this far from the current path position:
+#define EVICT_DISTANCE 2
+
+// Upper bound on simultaneously loaded chunks:
+#define MAX_LOADED 256
+
+// Initial capacity of each stage's sample array:
+#define SAMPLES_INITIAL_CAPACITY 256
+
+/**************
+ * Structures *
+ **************/
+
+// Pipeline stages, in order:
+typedef enum {
+  ST_LOAD = 0, // disk lookup (every chunk)
+  ST_GENERATE = 1, // terrain generation (chunks not found on disk)
+  ST_PERSIST = 2, // writing generated chunks to disk
+  ST_BIOLOGY = 3, // add_biology (path chunks, once their neighbors are loaded)
+  ST_MESH = 4, // compile_chunk_or_approx (path chunks)
+  N_STAGES = 5
+} pipeline_stage;
+
+struct stage_samples_s {
+  double *seconds;
+  size_t count, capacity;
+};
+typedef struct stage_samples_s stage_samples;
+
+/*******************
+ * Private Globals *
+ *******************/
+
+static char const * const STAGE_NAMES[N_STAGES] = {
+  "load",
+  "generate",
+  "persist",
+  "biology",
+  "mesh"
+};
+
+static stage_samples SAMPLES[N_STAGES];
+
+static chunk *LOADED[MAX_LOADED];
+static size_t LOADED_COUNT = 0;
+
+// What the stubbed GL calls would have sent to the GPU:
+static size_t GL_BUFFERS_CREATED = 0;
+static size_t GL_BUFFER_BYTES = 0;
+static size_t GL_TEXTURE_BYTES = 0;
+
+/************
+ * GL Stubs *
+ ************/
+
+// Core GL functions are defined here so that they take the place of libGL's
+// versions. Extension functions go through GLEW's function pointers, which
+// are pointed at these stubs in main instead of being set up by glewInit.
+
+void GLAPIENTRY glGenTextures(GLsizei n, GLuint *textures) {
+  static GLuint next = 1;
+  GLsizei i;
+  for (i = 0; i < n; ++i) {
+    textures[i] = next++;
+  }
+}
+
+void GLAPIENTRY glBindTexture(GLenum target, GLuint texture) {}
+
+void GLAPIENTRY glPixelStorei(GLenum pname, GLint param) {}
+
+void GLAPIENTRY glTexParameterf(GLenum target, GLenum pname, GLfloat param) {}
+
+void GLAPIENTRY glTexImage2D(
+  GLenum target,
+  GLint level,
+  GLint internalformat,
+  GLsizei width,
+  GLsizei height,
+  GLint border,
+  GLenum format,
+  GLenum type,
+  GLvoid const *pixels
+) {
+  GL_TEXTURE_BYTES += width * height * sizeof(pixel);
+}
+
+static void GLAPIENTRY stub_gen_buffers(GLsizei n, GLuint *buffers) {
+  static GLuint next = 1;
+  GLsizei i;
+  for (i = 0; i < n; ++i) {
+    buffers[i] = next++;
+  }
+  GL_BUFFERS_CREATED += n;
+}
+
+static void GLAPIENTRY stub_bind_buffer(GLenum target, GLuint buffer) {}
+
+static void GLAPIENTRY stub_buffer_data(
+  GLenum target,
+  GLsizeiptr size,
+  void const *data,
+  GLenum usage
+) {
+  GL_BUFFER_BYTES += size;
+}
+
+static void GLAPIENTRY stub_delete_buffers(GLsizei n, GLuint const *buffers) {}
+
+/*********************
+ * Private Functions *
+ *********************/
+
+static void add_sample(pipeline_stage st, double seconds) {
+  stage_samples *s = &(SAMPLES[st]);
+  if (s->count == s->capacity) {
+    s->capacity = (
+      s->capacity == 0 ? SAMPLES_INITIAL_CAPACITY : s->capacity * 2
+    );
+    s->seconds = (double*) realloc(s->seconds, s->capacity * sizeof(double));
+    if (s->seconds == NULL) {
+      perror("Failed to grow stage samples.");
+      exit(errno);
+    }
+  }
+  s->seconds[s->count] = seconds;
+  s->count += 1;
+}
+
+static int compare_doubles(void const *a, void const *b) {
+  double da = *((double const *) a);
+  double db = *((double const *) b);
+  return (da > db) - (da < db);
+}
+
+// Nearest-rank percentile of sorted samples, in microseconds:
+static double percentile_us(stage_samples *s, double p) {
+  size_t rank;
+  if (s->count == 0) {
+    return 0;
+  }
+  rank = (size_t) (p * s->count + 0.999999);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > s->count) {
+    rank = s->count;
+  }
+  return s->seconds[rank - 1] * 1000000.0;
+}
+
+static inline gl_cpos_t chunk_distance(
+  global_chunk_pos const * const a,
+  global_chunk_pos const * const b
+) {
+  gl_cpos_t result = abs(a->x - b->x);
+  gl_cpos_t dy = abs(a->y - b->y);
+  gl_cpos_t dz = abs(a->z - b->z);
+  if (dy > result) { result = dy; }
+  if (dz > result) { result = dz; }
+  return result;
+}
+
+// The chunk at the terrain surface in the given column:
+static void surface_chunk_pos(gl_cpos_t x, gl_cpos_t y, global_chunk_pos *r) {
+  global_pos glpos;
+  manifold_point dontcare, th;
+  glpos.x = x * CHUNK_SIZE + CHUNK_SIZE / 2;
+  glpos.y = y * CHUNK_SIZE + CHUNK_SIZE / 2;
+  glpos.z = 0;
+  glpos.w = 0;
+  compute_terrain_height(THE_WORLD, &glpos, &dontcare, &dontcare, &th);
+  glpos.z = (gl_pos_t) th.z;
+  glpos__glcpos(&glpos, r);
+}
+
+// Loads the chunk at the given position the way load_chunk does (minus the
+// queue bookkeeping) and adds it to the chunk cache.
+static void load_one(global_chunk_pos *glcpos) {
+  int found;
+  double start;
+  chunk *c;
+  if (LOADED_COUNT == MAX_LOADED) {
+    fprintf(stderr, "Error: too many chunks loaded.\n");
+    exit(EXIT_FAILURE);
+  }
+  c = create_chunk(glcpos);
+  start = omp_get_wtime();
+  found = load_chunk_data(c);
+  add_sample(ST_LOAD, omp_get_wtime() - start);
+  if (!found) {
+    start = omp_get_wtime();
+    generate_chunk(c);
+    add_sample(ST_GENERATE, omp_get_wtime() - start);
+    start = omp_get_wtime();
+    persist_chunk(c);
+    add_sample(ST_PERSIST, omp_get_wtime() - start);
+  }
+  c->chunk_flags |= CF_LOADED;
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+  m3_put_value(
+    CHUNK_CACHE->levels[LOD_BASE],
+    (void *) c,
+    (map_key_t) glcpos->x,
+    (map_key_t) glcpos->y,
+    (map_key_t) glcpos->z
+  );
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+  invalidate_cell_at_caches();
+  LOADED[LOADED_COUNT] = c;
+  LOADED_COUNT += 1;
+}
+
+// Makes sure the given chunk and all of its neighbors are loaded.
+static void load_neighborhood(global_chunk_pos *center) {
+  global_chunk_pos nbpos;
+  for (nbpos.x = center->x - 1; nbpos.x <= center->x + 1; nbpos.x += 1) {
+    for (nbpos.y = center->y - 1; nbpos.y <= center->y + 1; nbpos.y += 1) {
+      for (nbpos.z = center->z - 1; nbpos.z <= center->z + 1; nbpos.z += 1) {
+        if (get_chunk(&nbpos) == NULL) {
+          load_one(&nbpos);
+        }
+      }
+    }
+  }
+}
+
+// Evicts every loaded chunk that's at least the given distance from the given
+// position (pass a negative distance to evict everything).
+static void evict_beyond(global_chunk_pos *center, gl_cpos_t distance) {
+  size_t i = 0;
+  chunk *c;
+  while (i < LOADED_COUNT) {
+    c = LOADED[i];
+    if (distance >= 0 && chunk_distance(&(c->glcpos), center) < distance) {
+      i += 1;
+      continue;
+    }
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+    m3_pop_value(
+      CHUNK_CACHE->levels[LOD_BASE],
+      (map_key_t) c->glcpos.x,
+      (map_key_t) c->glcpos.y,
+      (map_key_t) c->glcpos.z
+    );
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+    invalidate_cell_at_caches();
+    cleanup_chunk(c);
+    LOADED_COUNT -= 1;
+    LOADED[i] = LOADED[LOADED_COUNT];
+  }
+}
+
+// Streams every chunk on the path through the pipeline and prints a JSON
+// object describing the run.
+static void run_pass(
+  char const * const name,
+  global_chunk_pos *path,
+  size_t length,
+  uint8_t last
+) {
+  size_t i;
+  pipeline_stage st;
+  double start, pass_start, elapsed;
+  chunk *c;
+  chunk_or_approx coa;
+
+  for (st = ST_LOAD; st < N_STAGES; ++st) {
+    SAMPLES[st].count = 0;
+  }
+
+  pass_start = omp_get_wtime();
+  for (i = 0; i < length; ++i) {
+    load_neighborhood(&(path[i]));
+    c = get_chunk(&(path[i]));
+
+    start = omp_get_wtime();
+    add_biology(c);
+    add_sample(ST_BIOLOGY, omp_get_wtime() - start);
+
+    ch__coa(c, &coa);
+    start = omp_get_wtime();
+    compile_chunk_or_approx(&coa);
+    add_sample(ST_MESH, omp_get_wtime() - start);
+
+    evict_beyond(&(path[i]), EVICT_DISTANCE);
+  }
+  elapsed = omp_get_wtime() - pass_start;
+  evict_beyond(&(path[0]), -1);
+
+  printf("    {\n");
+  printf("      \"name\": \"%s\",\n", name);
+  printf("      \"seconds\": %.6f,\n", elapsed);
+  printf("      \"chunks_per_second\": %.3f,\n", length / elapsed);
+  printf("      \"stages\": {\n");
+  for (st = ST_LOAD; st < N_STAGES; ++st) {
+    stage_samples *s = &(SAMPLES[st]);
+    double total = 0;
+    size_t j;
+    for (j = 0; j < s->count; ++j) {
+      total += s->seconds[j];
+    }
+    qsort(s->seconds, s->count, sizeof(double), &compare_doubles);
+    printf(
+      "        \"%s\": { \"count\": %zu, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+      "\"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f }%s\n",
+      STAGE_NAMES[st],
+      s->count,
+      s->count > 0 ? total * 1000000.0 / s->count : 0,
+      percentile_us(s, 0.5),
+      percentile_us(s, 0.9),
+      percentile_us(s, 0.99),
+      percentile_us(s, 1.0),
+      st < N_STAGES - 1 ? "," : ""
+    );
+  }
+  printf("      }\n");
+  printf("    }%s\n", last ? "" : ",");
+}
+
+static int remove_entry(
+  char const *path,
+  struct stat const *sb,
+  int type,
+  struct FTW *ftwbuf
+) {
+  return remove(path);
+}
+
+/********
+ * Main *
+ ********/
+
+int main(int argc, char** argv) {
+  size_t i, length = DEFAULT_PATH_LENGTH;
+  gl_cpos_t dx = DEFAULT_DX, dy = DEFAULT_DY;
+  ptrdiff_t seed = DEFAULT_WORLD_SEED;
+  char temp_dir[] = "/tmp/chunk_bench_XXXXXX";
+  char const *world_dir = NULL;
+  string *world_dir_str;
+  global_chunk_pos *path;
+  global_chunk_pos start;
+  struct rusage usage;
+  double setup_start, setup_seconds;
+
+  if (argc > 1) { length = (size_t) strtoul(argv[1], NULL, 10); }
+  if (argc > 3) {
+    dx = (gl_cpos_t) strtol(argv[2], NULL, 10);
+    dy = (gl_cpos_t) strtol(argv[3], NULL, 10);
+  }
+  if (argc > 4) { seed = (ptrdiff_t) strtol(argv[4], NULL, 10); }
+  if (argc > 5) {
+    world_dir = argv[5];
+  } else {
+    world_dir = mkdtemp(temp_dir);
+    if (world_dir == NULL) {
+      perror("Failed to create a temporary world directory.");
+      exit(errno);
+    }
+  }
+  if (length == 0) {
+    fprintf(stderr, "Usage: %s [chunks [dx dy [seed [world_dir]]]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  glGenBuffers = &stub_gen_buffers;
+  glBindBuffer = &stub_bind_buffer;
+  glBufferData = &stub_buffer_data;
+  glDeleteBuffers = &stub_delete_buffers;
+
+  fprintf(stderr, "Setting up world %td in '%s'...\n", seed, world_dir);
+  setup_start = omp_get_wtime();
+  init_strings();
+  init_blocks();
+  setup_data();
+  world_dir_str = create_string_from_ntchars(world_dir);
+  setup_persist(world_dir_str);
+  cleanup_string(world_dir_str);
+  setup_species();
+  setup_textures();
+  setup_worldgen(seed);
+  setup_seconds = omp_get_wtime() - setup_start;
+
+  // Lay out the path along the terrain surface, starting in the middle of the
+  // world:
+  path = (global_chunk_pos*) malloc(sizeof(global_chunk_pos) * length);
+  if (path == NULL) {
+    perror("Failed to allocate chunk path.");
+    exit(errno);
+  }
+  start.x = (WORLD_WIDTH * WORLD_REGION_BLOCKS) / (2 * CHUNK_SIZE);
+  start.y = (WORLD_HEIGHT * WORLD_REGION_BLOCKS) / (2 * CHUNK_SIZE);
+  for (i = 0; i < length; ++i) {
+    surface_chunk_pos(start.x + dx * i, start.y + dy * i, &(path[i]));
+  }
+
+  fprintf(stderr, "Streaming %zu chunks...\n", length);
+  printf("{\n");
+  printf(
+    "  \"path\": { \"chunks\": %zu, \"dx\": %d, \"dy\": %d, \"seed\": %td },\n",
+    length,
+    (int) dx,
+    (int) dy,
+    seed
+  );
+  printf("  \"setup_seconds\": %.3f,\n", setup_seconds);
+  printf("  \"passes\": [\n");
+  run_pass("generate", path, length, 0);
+  run_pass("reload", path, length, 1);
+  printf("  ],\n");
+
+  getrusage(RUSAGE_SELF, &usage);
+  compute_chunk_pool_mem();
+  printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+  printf(
+    "  \"chunk_pool_resident_kb\": %zu,\n",
+    (CHUNK_POOL_USAGE.data + CHUNK_POOL_USAGE.overhead) / 1024
+  );
+  printf("  \"gl_buffers\": %zu,\n", GL_BUFFERS_CREATED);
+  printf("  \"gl_buffer_kb\": %zu,\n", GL_BUFFER_BYTES / 1024);
+  printf("  \"gl_texture_kb\": %zu\n", GL_TEXTURE_BYTES / 1024);
+  printf("}\n");
+
+  free(path);
+  for (i = 0; i < N_STAGES; ++i) {
+    free(SAMPLES[i].seconds);
+  }
+  if (argc <= 5) {
+    nftw(world_dir, &remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+  return 0;
+}
@@ -16,7 +16,11 @@
 // A single row of a bitmap (only used internally)
 typedef long unsigned int bitmap_row;
 
-#define BITMAP_ROW_WIDTH sizeof(bitmap_row)
+// Bits per row:
+#define BITMAP_ROW_WIDTH (sizeof(bitmap_row) * 8)
+
+// A row with every bit set:
+#define BITMAP_ROW_FULL (~((bitmap_row) 0))
 
 /*************************
  * Structure Definitions *
@@ -26,6 +30,11 @@ struct bitmap_s {
   size_t size; // how many entries are in this bitmap
   size_t rows; // how many rows there are
   bitmap_row *data; // the bits
+  size_t closed; // how many bits are set
+  // A Fenwick tree over per-row popcounts (1-indexed, so it has rows + 1
+  // entries) which supports rank and select in O(log rows):
+  size_t *tree;
+  size_t tree_top; // largest power of two <= rows (0 for an empty bitmap)
   omp_lock_t lock; // lock for thread safety
 };
 
@@ -45,26 +54,83 @@ static inline size_t bm_get_bit(bitmap *bm, size_t index) {
   return (bm->data[index / BITMAP_ROW_WIDTH] >> (index % BITMAP_ROW_WIDTH)) & 1;
 }
 
-// Sets the specified bit to 1.
-static inline void bm_set_bit(bitmap *bm, size_t index) {
-#ifdef DEBUG_CHECK_BITMAP_ACCESS
-  if (index >= bm->size) {
-    fprintf(stderr, "Error: out-of-range bitmap access in bm_set_bit.\n");
-    exit(EXIT_FAILURE);
+// Returns a row mask covering span bits starting at offset (the span must not
+// extend past the end of the row).
+static inline bitmap_row bm_row_mask(size_t offset, size_t span) {
+  if (span >= BITMAP_ROW_WIDTH) {
+    return BITMAP_ROW_FULL;
   }
-#endif
-  bm->data[index / BITMAP_ROW_WIDTH] |= 1 << (index % BITMAP_ROW_WIDTH);
+  return ((((bitmap_row) 1) << span) - 1) << offset;
 }
 
-// Sets the specified bit to 0.
-static inline void bm_clear_bit(bitmap *bm, size_t index) {
-#ifdef DEBUG_CHECK_BITMAP_ACCESS
+// Adds delta to the popcount recorded for the given row.
+static inline void bm_tree_adjust(bitmap *bm, size_t row, ptrdiff_t delta) {
+  size_t i;
+  for (i = row + 1; i <= bm->rows; i += i & (-i)) {
+    bm->tree[i] += delta;
+  }
+  bm->closed += delta;
+}
+
+// Returns the number of set bits in rows [0, row).
+static inline size_t bm_tree_prefix(bitmap *bm, size_t row) {
+  size_t i, result = 0;
+  for (i = row; i > 0; i -= i & (-i)) {
+    result += bm->tree[i];
+  }
+  return result;
+}
+
+// Returns the index of the nth set bit in the given row (which must have more
+// than n bits set).
+static inline size_t bm_row_select(bitmap_row row, size_t n) {
+  for (; n > 0; --n) {
+    row &= row - 1; // clear the lowest set bit
+  }
+  return __builtin_ctzl(row);
+}
+
+// Applies a set (if set is nonzero) or clear operation to size bits starting
+// at index, one row at a time, keeping the popcount tree up to date.
+static inline void bm_apply_bits(
+  bitmap *bm,
+  size_t index,
+  size_t size,
+  int set
+) {
+  size_t end, row, offset, span;
+  bitmap_row mask, before;
   if (index >= bm->size) {
-    fprintf(stderr, "Error: out-of-range bitmap access in bm_clear_bit.\n");
-    exit(EXIT_FAILURE);
+    return;
+  }
+  end = index + size;
+  if (end > bm->size || end < index) {
+    end = bm->size;
+  }
+  while (index < end) {
+    row = index / BITMAP_ROW_WIDTH;
+    offset = index % BITMAP_ROW_WIDTH;
+    span = BITMAP_ROW_WIDTH - offset;
+    if (span > end - index) {
+      span = end - index;
+    }
+    mask = bm_row_mask(offset, span);
+    before = bm->data[row];
+    if (set) {
+      bm->data[row] |= mask;
+    } else {
+      bm->data[row] &= ~mask;
+    }
+    if (bm->data[row] != before) {
+      bm_tree_adjust(
+        bm,
+        row,
+        (ptrdiff_t) __builtin_popcountl(bm->data[row])
+      - (ptrdiff_t) __builtin_popcountl(before)
+      );
+    }
+    index += span;
   }
-#endif
-  bm->data[index / BITMAP_ROW_WIDTH] &= ~(1 << (index % BITMAP_ROW_WIDTH));
 }
 
 /******************************
@@ -76,6 +142,15 @@ bitmap *create_bitmap(size_t bits) {
   bm->size = bits;
   bm->rows = (bits / BITMAP_ROW_WIDTH) + (bits % BITMAP_ROW_WIDTH > 0);
   bm->data = (bitmap_row *) calloc(bm->rows, sizeof(bitmap_row));
+  bm->closed = 0;
+  bm->tree = (size_t *) calloc(bm->rows + 1, sizeof(size_t));
+  bm->tree_top = 0;
+  if (bm->rows > 0) {
+    bm->tree_top = 1;
+    while (bm->tree_top * 2 <= bm->rows) {
+      bm->tree_top *= 2;
+    }
+  }
   omp_init_lock(&(bm->lock));
   return bm;
 }
@@ -83,6 +158,7 @@ bitmap *create_bitmap(size_t bits) {
 CLEANUP_IMPL(bitmap) {
   omp_set_lock(&(doomed->lock));
   omp_destroy_lock(&(doomed->lock));
+  free(doomed->tree);
   free(doomed->data);
   free(doomed);
 }
@@ -107,16 +183,10 @@ size_t bm_check_bit(bitmap *bm, size_t index) {
 }
 
 void bm_set_bits(bitmap *bm, size_t index, size_t size) {
-  size_t i;
-  for (i = index; i < index + size && i < bm->size; ++i) {
-    bm_set_bit(bm, i);
-  }
+  bm_apply_bits(bm, index, size, 1);
 }
 void bm_clear_bits(bitmap *bm, size_t index, size_t size) {
-  size_t i;
-  for (i = index; i < index + size && i < bm->size; ++i) {
-    bm_clear_bit(bm, i);
-  }
+  bm_apply_bits(bm, index, size, 0);
 }
 
 ptrdiff_t bm_find_space(bitmap *bm, size_t required) {
@@ -139,82 +209,54 @@ ptrdiff_t bm_find_space(bitmap *bm, size_t required) {
 }
 
 size_t bm_popcount(bitmap *bm) {
-  size_t result = 0;
-  size_t i;
-  for (i = 0; i < bm->rows; ++i) {
-    // TODO: Integer-size-dependent compilation?!?
-    result += __builtin_popcountl(bm->data[i]);
-    // No need to worry about trailing bits in the row beyond the size, because
-    // they should always be zeroes.
+  return bm->closed;
+}
+
+size_t bm_rank(bitmap *bm, size_t index) {
+  size_t row;
+  if (index >= bm->size) {
+    return bm->closed;
   }
-  return result;
+  row = index / BITMAP_ROW_WIDTH;
+  return bm_tree_prefix(bm, row) + __builtin_popcountl(
+    bm->data[row] & bm_row_mask(0, index % BITMAP_ROW_WIDTH)
+  );
 }
 
 ptrdiff_t bm_select_open(bitmap *bm, size_t n) {
-  size_t i, j;
-  size_t bits_here;
-  ptrdiff_t result;
-  bitmap_row row;
-  i = 0;
-  result = 0;
-  for (i = 0; i < bm->rows; ++i) {
-    bits_here = BITMAP_ROW_WIDTH - __builtin_popcountl(bm->data[i]);
-    // Ignore zeroes on the last row past the exact size:
-    if (i == bm->rows - 1) {
-      bits_here -= BITMAP_ROW_WIDTH - (
-        bm->size
-      - (BITMAP_ROW_WIDTH * (bm->rows - 1))
-      );
-    }
-    if (bits_here > n) {
-      row = bm->data[i];
-      for (j = 0; j < BITMAP_ROW_WIDTH; ++j) {
-        if (!(row & 1)) {
-          if (n == 0) {
-            return result;
-          } else {
-            n -= 1;
-          }
-        }
-        result += 1;
-        row = row >> 1;
+  size_t row, step, open_here;
+  if (n >= bm->size - bm->closed) {
+    // n is too large
+    return -1;
+  }
+  // Descend the tree, counting open bits as full rows minus closed bits. Only
+  // the last row has padding bits, and those are past every real open bit, so
+  // they never affect the result.
+  row = 0;
+  for (step = bm->tree_top; step > 0; step >>= 1) {
+    if (row + step <= bm->rows) {
+      open_here = step * BITMAP_ROW_WIDTH - bm->tree[row + step];
+      if (open_here <= n) {
+        n -= open_here;
+        row += step;
       }
-    } else {
-      n -= bits_here;
-      result += BITMAP_ROW_WIDTH;
     }
   }
-  // n is too large
-  return -1;
+  return row * BITMAP_ROW_WIDTH + bm_row_select(~(bm->data[row]), n);
 }
 
 ptrdiff_t bm_select_closed(bitmap *bm, size_t n) {
-  size_t i, j;
-  size_t bits_here;
-  ptrdiff_t result;
-  bitmap_row row;
-  i = 0;
-  result = 0;
-  for (i = 0; i < bm->rows; ++i) {
-    bits_here = __builtin_popcountl(bm->data[i]);
-    // Fine even for the last row, because excess bits should be zeroes.
-    row = bm->data[i];
-    if (bits_here > n) {
-      for (j = 0; j < BITMAP_ROW_WIDTH; ++j) {
-        if (row & 1) {
-          if (n == 0) {
-            return result;
-          } else {
-            n -= 1;
-          }
-        }
-        result += 1;
-        row = row >> 1;
-      }
+  size_t row, step;
+  if (n >= bm->closed) {
+    // n is too large
+    return -1;
+  }
+  row = 0;
+  for (step = bm->tree_top; step > 0; step >>= 1) {
+    if (row + step <= bm->rows && bm->tree[row + step] <= n) {
+      n -= bm->tree[row + step];
+      row += step;
     }
-    n -= bits_here;
-    result += BITMAP_ROW_WIDTH;
   }
-  // n is too large
-  return -1;
+  return row * BITMAP_ROW_WIDTH + bm_row_select(bm->data[row], n);
 }
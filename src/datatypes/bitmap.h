@@ -52,11 +52,16 @@ void bm_clear_bits(bitmap *bm, size_t index, size_t size);
 ptrdiff_t bm_find_space(bitmap *bm, size_t required);
 
 // Returns the number of closed bits in the bitmap. To find open bits just
-// subtract this number from the bitmap's size.
+// subtract this number from the bitmap's size. This is a constant-time
+// operation.
 size_t bm_popcount(bitmap *bm);
 
+// Returns the number of closed bits before the given index (the whole
+// popcount for out-of-range indices). Takes O(log n) time.
+size_t bm_rank(bitmap *bm, size_t index);
+
 // Return the index of the nth open/closed bit in the bitmap. These return -1
-// if there is no nth open/closed bit to select.
+// if there is no nth open/closed bit to select. Both take O(log n) time.
 ptrdiff_t bm_select_open(bitmap *bm, size_t n);
 ptrdiff_t bm_select_closed(bitmap *bm, size_t n);
 
@@ -1,8 +1,371 @@
 // heightmap.c
 // Two-dimensional arrays of floating point values.
 
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+
 #include "heightmap.h"
 
+/*************
+ * Constants *
+ *************/
+
+// Number of full-size scratch heightmaps each thread keeps around for the _q
+// functions.
+#define HM_SCRATCH_PLANES 3
+
+// Bits used to mark which of a cell's neighbors receive its water in
+// hm_compute_flows. They're ordered the same way the neighbors are visited:
+// column by column from the left, top to bottom within each column.
+#define HM_FLOW_NW 0x01
+#define HM_FLOW_W  0x02
+#define HM_FLOW_SW 0x04
+#define HM_FLOW_N  0x08
+#define HM_FLOW_S  0x10
+#define HM_FLOW_NE 0x20
+#define HM_FLOW_E  0x40
+#define HM_FLOW_SE 0x80
+
+// Codes used to mark which orthogonal neighbor a cell sheds material onto in
+// hm_slump:
+#define HM_SLUMP_NONE  0
+#define HM_SLUMP_LEFT  1
+#define HM_SLUMP_RIGHT 2
+#define HM_SLUMP_UP    3
+#define HM_SLUMP_DOWN  4
+
+/**************
+ * Structures *
+ **************/
+
+// Scratch space for the heightmap kernels, kept per-thread so that repeated
+// calls don't need to allocate anything.
+struct hm_scratch_s;
+typedef struct hm_scratch_s hm_scratch;
+
+struct hm_scratch_s {
+  size_t capacity; // how many cells the codes and totals arrays can hold
+  uint8_t *codes; // per-cell neighbor codes (hm_slump and hm_compute_flows)
+  float *totals; // per-cell downhill slope totals (hm_compute_flows)
+  heightmap *planes[HM_SCRATCH_PLANES]; // buffers for the _q functions
+};
+
+/*******************
+ * Private Globals *
+ *******************/
+
+static __thread hm_scratch *THREAD_SCRATCH = NULL;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Allocates aligned storage for the given number of heightmap cells.
+static float *_alloc_hm_data(size_t cells) {
+  void *result = NULL;
+  // Allocate at least one cell so that empty heightmaps still get a pointer:
+  errno = posix_memalign(&result, HM_ALIGNMENT, (cells + 1) * sizeof(float));
+  if (errno != 0) {
+    perror("Failed to allocate heightmap data.");
+    exit(errno);
+  }
+  return (float*) result;
+}
+
+// Gets the calling thread's scratch space, making sure its per-cell arrays
+// can hold at least the given number of cells.
+static hm_scratch *_get_scratch(size_t cells) {
+  hm_scratch *scr = THREAD_SCRATCH;
+  if (scr == NULL) {
+    scr = (hm_scratch*) calloc(1, sizeof(hm_scratch));
+    THREAD_SCRATCH = scr;
+  }
+  if (scr->capacity < cells) {
+    free(scr->codes);
+    free(scr->totals);
+    scr->codes = (uint8_t*) malloc(sizeof(uint8_t) * cells);
+    scr->totals = _alloc_hm_data(cells);
+    scr->capacity = cells;
+  }
+  return scr;
+}
+
+// Gets one of the calling thread's scratch heightmaps, zeroed and resized to
+// the given dimensions.
+static heightmap *_get_scratch_plane(size_t which, size_t w, size_t h) {
+  hm_scratch *scr = _get_scratch(0);
+  if (scr->planes[which] == NULL) {
+    scr->planes[which] = create_heightmap(w, h);
+  } else {
+    hm_resize(scr->planes[which], w, h);
+  }
+  return scr->planes[which];
+}
+
+// Splits a 2-d filter into x and y components whose outer product reproduces
+// it (to within HM_SEPARABLE_TOLERANCE), returning 1 if that's possible and 0
+// otherwise. The x_filter and y_filter arrays must be at least as long as the
+// filter's width and height respectively.
+static int _separate_filter(
+  heightmap const * const filter,
+  float *x_filter,
+  float *y_filter
+) {
+  size_t i, j, pi = 0, pj = 0;
+  float pivot = 0, here;
+  for (j = 0; j < filter->height; ++j) {
+    for (i = 0; i < filter->width; ++i) {
+      here = filter->data[i + j * filter->width];
+      if (fabsf(here) > fabsf(pivot)) {
+        pivot = here;
+        pi = i;
+        pj = j;
+      }
+    }
+  }
+  if (pivot == 0) {
+    return 0;
+  }
+  for (i = 0; i < filter->width; ++i) {
+    x_filter[i] = filter->data[i + pj * filter->width];
+  }
+  for (j = 0; j < filter->height; ++j) {
+    y_filter[j] = filter->data[pi + j * filter->width] / pivot;
+  }
+  for (j = 0; j < filter->height; ++j) {
+    for (i = 0; i < filter->width; ++i) {
+      here = filter->data[i + j * filter->width];
+      if (
+        fabsf(here - x_filter[i] * y_filter[j])
+      > HM_SEPARABLE_TOLERANCE * fabsf(pivot)
+      ) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+// Computes the normalized response of a 1-d filter centered at 'pos' on a line
+// of 'n' values spaced 'stride' apart, ignoring filter entries that fall
+// outside of the line. Used near heightmap edges.
+static inline float _filter_clipped(
+  float const * const line,
+  ptrdiff_t stride,
+  ptrdiff_t n,
+  ptrdiff_t pos,
+  float const * const filter,
+  ptrdiff_t len
+) {
+  ptrdiff_t i, at;
+  float sum = 0, weight = 0;
+  for (i = 0; i < len; ++i) {
+    at = pos - len / 2 + i;
+    if (at < 0 || at >= n) {
+      continue;
+    }
+    sum += line[at * stride] * filter[i];
+    weight += filter[i];
+  }
+  return sum / weight;
+}
+
+// Figures out which orthogonal neighbor (if any) the given cell should shed
+// material onto during hm_slump. The left/right/up/down flags indicate which
+// neighbors are in-bounds.
+static inline uint8_t _slump_code(
+  float const * const data,
+  size_t idx,
+  size_t width,
+  int left, int right, int up, int down,
+  float max_slope
+) {
+  float ln = data[idx];
+  uint8_t code = HM_SLUMP_NONE;
+  if (left && data[idx - 1] < ln) {
+    ln = data[idx - 1];
+    code = HM_SLUMP_LEFT;
+  }
+  if (right && data[idx + 1] < ln) {
+    ln = data[idx + 1];
+    code = HM_SLUMP_RIGHT;
+  }
+  if (up && data[idx - width] < ln) {
+    ln = data[idx - width];
+    code = HM_SLUMP_UP;
+  }
+  if (down && data[idx + width] < ln) {
+    ln = data[idx + width];
+    code = HM_SLUMP_DOWN;
+  }
+  if (code != HM_SLUMP_NONE && data[idx] - ln > max_slope) {
+    return code;
+  }
+  return HM_SLUMP_NONE;
+}
+
+// How much a slumping cell at height 'high' loses to its neighbor at height
+// 'low', and how much that neighbor gains:
+static inline double _slump_loss(float high, float low, float max_slope) {
+  float midpoint = low + (high - low) / 2.0;
+  return high - (midpoint + max_slope/2.0);
+}
+
+static inline double _slump_gain(float high, float low, float max_slope) {
+  float midpoint = low + (high - low) / 2.0;
+  return (midpoint - max_slope/2.0) - low;
+}
+
+// Works out the range of heights among the given cell and its in-bounds
+// orthogonal neighbors (used by hm_add_limited).
+static inline void _neighborhood_range(
+  float const * const data,
+  size_t idx,
+  size_t width,
+  int left, int right, int up, int down,
+  float *min,
+  float *max
+) {
+  float z;
+  *min = data[idx];
+  *max = data[idx];
+  if (left) {
+    z = data[idx - 1];
+    if (z < *min) { *min = z; }
+    if (z > *max) { *max = z; }
+  }
+  if (right) {
+    z = data[idx + 1];
+    if (z < *min) { *min = z; }
+    if (z > *max) { *max = z; }
+  }
+  if (up) {
+    z = data[idx - width];
+    if (z < *min) { *min = z; }
+    if (z > *max) { *max = z; }
+  }
+  if (down) {
+    z = data[idx + width];
+    if (z < *min) { *min = z; }
+    if (z > *max) { *max = z; }
+  }
+}
+
+// Finds the (up to) three most-downhill neighbors of the given cell for
+// hm_compute_flows, setting the corresponding HM_FLOW_* bits in 'targets' and
+// storing the sum of their slopes in 'total'. Ties go to whichever neighbor
+// is visited first.
+static inline void _find_flow_targets(
+  heightmap const * const hm,
+  ptrdiff_t x,
+  ptrdiff_t y,
+  uint8_t *targets,
+  float *total
+) {
+  ptrdiff_t xx, yy;
+  ptrdiff_t w = hm->width, h = hm->height;
+  size_t idx = x + w * y;
+  uint8_t bit = HM_FLOW_NW, bbit = 0, sbbit = 0, tbbit = 0;
+  float slope, bslope = 0, sbslope = 0, tbslope = 0;
+  for (xx = x - 1; xx <= x + 1; ++xx) {
+    for (yy = y - 1; yy <= y + 1; ++yy) {
+      if (xx == x && yy == y) {
+        continue;
+      }
+      if (xx >= 0 && xx < w && yy >= 0 && yy < h) {
+        slope = hm->data[idx] - hm->data[xx + w * yy];
+        if (slope > bslope) {
+          tbbit = sbbit;
+          tbslope = sbslope;
+          sbbit = bbit;
+          sbslope = bslope;
+          bbit = bit;
+          bslope = slope;
+        } else if (slope > sbslope) {
+          tbbit = sbbit;
+          tbslope = sbslope;
+          sbbit = bit;
+          sbslope = slope;
+        } else if (slope > tbslope) {
+          tbbit = bit;
+          tbslope = slope;
+        }
+      }
+      bit <<= 1;
+    }
+  }
+  *targets = bbit | sbbit | tbbit;
+  *total = bslope + sbslope + tbslope;
+}
+
+// Adds up the water flowing into the given cell from its neighbors for one
+// step of hm_compute_flows, starting from 'acc'. Neighbors are visited in the
+// same order as in _find_flow_targets, and the bit to check in each
+// neighbor's targets is the one pointing back towards this cell, which works
+// out to walking the bits in reverse.
+static inline float _gather_flow(
+  heightmap const * const hm,
+  float const * const water,
+  uint8_t const * const targets,
+  float const * const totals,
+  ptrdiff_t x,
+  ptrdiff_t y,
+  float acc
+) {
+  ptrdiff_t xx, yy;
+  ptrdiff_t w = hm->width, h = hm->height;
+  size_t idx = x + w * y, oidx;
+  uint8_t bit = HM_FLOW_SE;
+  for (xx = x - 1; xx <= x + 1; ++xx) {
+    for (yy = y - 1; yy <= y + 1; ++yy) {
+      if (xx == x && yy == y) {
+        continue;
+      }
+      if (xx >= 0 && xx < w && yy >= 0 && yy < h) {
+        oidx = xx + w * yy;
+        if (targets[oidx] & bit) {
+          acc += water[oidx] * (
+            (hm->data[oidx] - hm->data[idx]) / totals[oidx]
+          );
+        }
+      }
+      bit >>= 1;
+    }
+  }
+  return acc;
+}
+
+// The same as _gather_flow, but for cells that aren't on the edge of the
+// heightmap, which lets us skip all of the bounds checks.
+static inline float _gather_flow_interior(
+  float const * const data,
+  float const * const water,
+  uint8_t const * const targets,
+  float const * const totals,
+  size_t idx,
+  ptrdiff_t w,
+  float acc
+) {
+  ptrdiff_t const offsets[8] = {
+    -1 - w, -1, -1 + w,
+    -w,         w,
+    1 - w,  1,  1 + w
+  };
+  uint8_t bit = HM_FLOW_SE;
+  size_t i, oidx;
+  for (i = 0; i < 8; ++i) {
+    oidx = idx + offsets[i];
+    if (targets[oidx] & bit) {
+      acc += water[oidx] * ((data[oidx] - data[idx]) / totals[oidx]);
+    }
+    bit >>= 1;
+  }
+  return acc;
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -12,7 +375,8 @@ heightmap *create_heightmap(size_t width, size_t height) {
   heightmap *result = (heightmap*) malloc(sizeof(heightmap));
   result->width = width;
   result->height = height;
-  result->data = (float*) calloc(width * height, sizeof(float));
+  result->data = _alloc_hm_data(width * height);
+  memset(result->data, 0, sizeof(float) * width * height);
   return result;
 }
 
@@ -22,28 +386,46 @@ CLEANUP_IMPL(heightmap) {
   free(doomed);
 }
 
+void hm_release_scratch(void) {
+  size_t i;
+  hm_scratch *scr = THREAD_SCRATCH;
+  if (scr == NULL) {
+    return;
+  }
+  for (i = 0; i < HM_SCRATCH_PLANES; ++i) {
+    if (scr->planes[i] != NULL) {
+      cleanup_heightmap(scr->planes[i]);
+    }
+  }
+  free(scr->codes);
+  free(scr->totals);
+  free(scr);
+  THREAD_SCRATCH = NULL;
+}
+
 /*************
  * Functions *
  *************/
 
 void hm_reset(heightmap *hm) {
-  size_t i;
-  for (i = 0; i < hm->width * hm->height; ++i) {
-    hm->data[i] = 0;
+  memset(hm->data, 0, sizeof(float) * hm->width * hm->height);
+}
+
+void hm_resize(heightmap *hm, size_t width, size_t height) {
+  if (hm->width * hm->height != width * height) {
+    free(hm->data);
+    hm->data = _alloc_hm_data(width * height);
   }
+  hm->width = width;
+  hm->height = height;
+  hm_reset(hm);
 }
 
 void hm_copy(heightmap const * const source, heightmap *dest) {
-  size_t i;
   if (dest->width != source->width || dest->height != source->height) {
-    free(dest->data);
-    dest->width = source->width;
-    dest->height = source->height;
-    dest->data = (float*) malloc(sizeof(float) * dest->width * dest->height);
-  }
-  for (i = 0; i < dest->width * dest->height; ++i) {
-    dest->data[i] = source->data[i];
+    hm_resize(dest, source->width, source->height);
   }
+  memcpy(dest->data, source->data, sizeof(float) * dest->width * dest->height);
 }
 
 void hm_scale(heightmap *hm, float factor) {
@@ -119,103 +501,216 @@ void hm_normalize(heightmap *hm) {
 }
 
 void hm_convolve(heightmap *hm, heightmap *filter, heightmap *buffer) {
-  size_t idx, cidx;
-  ptrdiff_t x, y, xx, yy;
-  size_t i, j, fidx;
-  size_t xof = filter->width / 2;
-  size_t yof = filter->height / 2;
-  float total_weight;
+  ptrdiff_t x, y, xx, yy, x_lo, x_hi, y_lo, y_hi;
+  ptrdiff_t w = hm->width, h = hm->height;
+  ptrdiff_t xof = filter->width / 2;
+  ptrdiff_t yof = filter->height / 2;
+  float *x_filter, *y_filter;
+  float sum, total_weight, fv;
   if (
-    hm->width != filter->width
- || hm->height != filter->height
+    filter->width % 2 == 0
+ || filter->height % 2 == 0
  || hm->width != buffer->width
  || hm->height != buffer->height
   ) {
     return;
   }
-  for (x = 0; x < hm->width; ++x) {
-    for (y = 0; y < hm->height; ++y) {
-      idx = x + y * hm->width;
+  x_filter = (float*) malloc(sizeof(float) * (filter->width + filter->height));
+  y_filter = x_filter + filter->width;
+  if (_separate_filter(filter, x_filter, y_filter)) {
+    hm_convolve_separable(
+      hm,
+      x_filter, filter->width,
+      y_filter, filter->height,
+      buffer
+    );
+    free(x_filter);
+    return;
+  }
+  free(x_filter);
+#pragma omp parallel for schedule(static) \
+  private(x, xx, yy, x_lo, x_hi, y_lo, y_hi, sum, total_weight, fv) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    // Clip the filter against the top and bottom edges once per row:
+    y_lo = y - yof < 0 ? 0 : y - yof;
+    y_hi = y + yof > h - 1 ? h - 1 : y + yof;
+    for (x = 0; x < w; ++x) {
+      x_lo = x - xof < 0 ? 0 : x - xof;
+      x_hi = x + xof > w - 1 ? w - 1 : x + xof;
+      sum = 0;
       total_weight = 0;
-      i = 0;
-      for (xx = x - xof; xx < x + xof + 1; ++xx) {
-        j = 0;
-        if (xx < 0 || xx > hm->width - 1) {
-          i += 1;
-          continue;
-        }
-        for (yy = y - yof; yy < y + yof + 1; ++yy) {
-          if (yy < 0 || yy > hm->height - 1) {
-            j += 1;
-            continue;
-          }
-          cidx = xx + yy * hm->width;
-          fidx = i + j * filter->width;
-
-          buffer->data[idx] += hm->data[cidx] * filter->data[fidx];
-          total_weight += filter->data[fidx];
-
-          j += 1;
+      for (yy = y_lo; yy <= y_hi; ++yy) {
+        for (xx = x_lo; xx <= x_hi; ++xx) {
+          fv = filter->data[(xx - x + xof) + (yy - y + yof) * filter->width];
+          sum += hm->data[xx + yy * w] * fv;
+          total_weight += fv;
         }
-        i += 1;
       }
-      buffer->data[idx] /= total_weight;
+      buffer->data[x + y * w] = sum / total_weight;
     }
   }
-  for (i = 0; i < hm->width * hm->height; ++i) {
-    hm->data[i] = buffer->data[i];
-  }
+  memcpy(hm->data, buffer->data, sizeof(float) * w * h);
 }
 
 void hm_convolve_q(heightmap *hm, heightmap *filter) {
-  heightmap *buffer = create_heightmap(hm->width, hm->height);
-  hm_convolve(hm, filter, buffer);
-  cleanup_heightmap(buffer);
+  hm_convolve(hm, filter, _get_scratch_plane(0, hm->width, hm->height));
+}
+
+void hm_convolve_separable(
+  heightmap *hm,
+  float const * const x_filter,
+  size_t x_len,
+  float const * const y_filter,
+  size_t y_len,
+  heightmap *buffer
+) {
+  ptrdiff_t x, y, i, lo, hi;
+  ptrdiff_t w = hm->width, h = hm->height;
+  ptrdiff_t xof = x_len / 2, yof = y_len / 2;
+  float x_total = 0, y_total = 0;
+  float sum;
+  float *src, *dst;
+  if (
+    x_len % 2 == 0
+ || y_len % 2 == 0
+ || hm->width != buffer->width
+ || hm->height != buffer->height
+  ) {
+    return;
+  }
+  for (i = 0; i < x_len; ++i) {
+    x_total += x_filter[i];
+  }
+  for (i = 0; i < y_len; ++i) {
+    y_total += y_filter[i];
+  }
+  // Cells in [lo, hi) along each row have the whole x filter in-bounds:
+  lo = xof < w ? xof : w;
+  hi = w - xof > lo ? w - xof : lo;
+
+  // Horizontal pass from the heightmap into the buffer:
+#pragma omp parallel for schedule(static) private(x, i, sum, src, dst) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    src = hm->data + y * w;
+    dst = buffer->data + y * w;
+    for (x = 0; x < lo; ++x) {
+      dst[x] = _filter_clipped(src, 1, w, x, x_filter, x_len);
+    }
+    for (x = lo; x < hi; ++x) {
+      sum = 0;
+      for (i = 0; i < x_len; ++i) {
+        sum += src[x - xof + i] * x_filter[i];
+      }
+      dst[x] = sum / x_total;
+    }
+    for (x = hi; x < w; ++x) {
+      dst[x] = _filter_clipped(src, 1, w, x, x_filter, x_len);
+    }
+  }
+
+  // Vertical pass from the buffer back into the heightmap, accumulating whole
+  // rows at a time:
+#pragma omp parallel for schedule(static) private(x, i, src, dst) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    dst = hm->data + y * w;
+    if (y < yof || y + yof >= h) {
+      for (x = 0; x < w; ++x) {
+        dst[x] = _filter_clipped(buffer->data + x, w, h, y, y_filter, y_len);
+      }
+      continue;
+    }
+    memset(dst, 0, sizeof(float) * w);
+    for (i = 0; i < y_len; ++i) {
+      src = buffer->data + (y - yof + i) * w;
+      for (x = 0; x < w; ++x) {
+        dst[x] += src[x] * y_filter[i];
+      }
+    }
+    for (x = 0; x < w; ++x) {
+      dst[x] /= y_total;
+    }
+  }
 }
 
 void hm_slump(heightmap *hm, heightmap *buffer, float max_slope, float rate) {
-  size_t i, x, y, idx, lnidx;
-  float ln, midpoint;
+  size_t i, x, y, idx;
+  size_t w = hm->width, h = hm->height;
+  float const * const data = hm->data;
+  uint8_t *codes;
+  ptrdiff_t offsets[5];
+  float adj;
   if (hm->width != buffer->width || hm->height != buffer->height) {
     return;
   }
-  for (x = 0; x < hm->width; ++x) {
-    for (y = 0; y < hm->height; ++y) {
-      idx = x + hm->width * y;
-      ln = hm->data[idx];
-      lnidx = idx;
-      if (x > 0 && hm->data[idx - 1] < ln) {
-        ln = hm->data[idx - 1];
-        lnidx = idx - 1;
+  codes = _get_scratch(w * h)->codes;
+  offsets[HM_SLUMP_NONE] = 0;
+  offsets[HM_SLUMP_LEFT] = -1;
+  offsets[HM_SLUMP_RIGHT] = 1;
+  offsets[HM_SLUMP_UP] = -((ptrdiff_t) w);
+  offsets[HM_SLUMP_DOWN] = w;
+
+  // First figure out where each cell would slump to:
+#pragma omp parallel for schedule(static) private(x, idx) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    for (x = 0; x < w; ++x) {
+      idx = x + w * y;
+      codes[idx] = _slump_code(
+        data, idx, w,
+        x > 0, x < w - 1, y > 0, y < h - 1,
+        max_slope
+      );
+    }
+  }
+
+  // Now each cell gathers its own adjustment, visiting neighbors that slump
+  // onto it in the same order that a cell-by-cell sweep would have:
+#pragma omp parallel for schedule(static) private(x, idx, adj) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    for (x = 0; x < w; ++x) {
+      idx = x + w * y;
+      adj = buffer->data[idx];
+      if (x > 0 && codes[idx - 1] == HM_SLUMP_RIGHT) {
+        adj += _slump_gain(data[idx - 1], data[idx], max_slope);
       }
-      if (x < hm->width - 1 && hm->data[idx + 1] < ln) {
-        ln = hm->data[idx + 1];
-        lnidx = idx + 1;
+      if (y > 0 && codes[idx - w] == HM_SLUMP_DOWN) {
+        adj += _slump_gain(data[idx - w], data[idx], max_slope);
       }
-      if (y > 0 && hm->data[idx - hm->width] < ln) {
-        ln = hm->data[idx - hm->width];
-        lnidx = idx - hm->width;
+      if (codes[idx] != HM_SLUMP_NONE) {
+        adj -= _slump_loss(
+          data[idx],
+          data[idx + offsets[codes[idx]]],
+          max_slope
+        );
       }
-      if (y < hm->height - 1 && hm->data[idx + hm->width] < ln) {
-        ln = hm->data[idx + hm->width];
-        lnidx = idx + hm->width;
+      if (y < h - 1 && codes[idx + w] == HM_SLUMP_UP) {
+        adj += _slump_gain(data[idx + w], data[idx], max_slope);
       }
-      if (lnidx != idx && hm->data[idx] - ln > max_slope) {
-        midpoint = ln + (hm->data[idx] - ln) / 2.0;
-        buffer->data[idx] -= hm->data[idx] - (midpoint + max_slope/2.0);
-        buffer->data[lnidx] += (midpoint - max_slope/2.0) - ln;
+      if (x < w - 1 && codes[idx + 1] == HM_SLUMP_LEFT) {
+        adj += _slump_gain(data[idx + 1], data[idx], max_slope);
       }
+      buffer->data[idx] = adj;
     }
   }
-  for (i = 0; i < hm->width * hm->height; ++i) {
+
+#pragma omp parallel for simd schedule(static) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (i = 0; i < w * h; ++i) {
     hm->data[i] += buffer->data[i] * rate;
   }
 }
 
 void hm_slump_q(heightmap *hm, float max_slope, float rate) {
-  heightmap *buffer = create_heightmap(hm->width, hm->height);
-  hm_slump(hm, buffer, max_slope, rate);
-  cleanup_heightmap(buffer);
+  hm_slump(
+    hm,
+    _get_scratch_plane(0, hm->width, hm->height),
+    max_slope,
+    rate
+  );
 }
 
 void hm_add_limited(
@@ -224,9 +719,9 @@ void hm_add_limited(
   heightmap *buffer
 ) {
   size_t x, y, idx;
+  size_t w = base->width, h = base->height;
   float min_new, max_new;
   float z;
-  size_t i;
   if (
     base->width != fill->width
  || base->height != fill->height
@@ -235,49 +730,31 @@ void hm_add_limited(
   ) {
     return;
   }
-  for (x = 0; x < base->width; ++x) {
-    for (y = 0; y < base->height; ++y) {
-      idx = x + y * base->width;
-      min_new = base->data[idx];
-      max_new = base->data[idx];
-      if (x > 0) {
-        z = base->data[idx - 1];
-        if (z < min_new) { min_new = z; }
-        if (z > max_new) { max_new = z; }
-      }
-      if (x < base->width - 1) {
-        z = base->data[idx + 1];
-        if (z < min_new) { min_new = z; }
-        if (z > max_new) { max_new = z; }
-      }
-      if (y > 0) {
-        z = base->data[idx - base->width];
-        if (z < min_new) { min_new = z; }
-        if (z > max_new) { max_new = z; }
-      }
-      if (y < base->height - 1) {
-        z = base->data[idx + base->width];
-        if (z < min_new) { min_new = z; }
-        if (z > max_new) { max_new = z; }
-      }
+#pragma omp parallel for schedule(static) \
+  private(x, idx, min_new, max_new, z) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    for (x = 0; x < w; ++x) {
+      idx = x + y * w;
+      _neighborhood_range(
+        base->data, idx, w,
+        x > 0, x < w - 1, y > 0, y < h - 1,
+        &min_new, &max_new
+      );
       z = base->data[idx] + fill->data[idx];
       if (fill->data[idx] < 0 && z < min_new) { z = min_new; }
       if (fill->data[idx] > 0 && z > max_new) { z = max_new; }
       buffer->data[idx] = z;
     }
   }
-  for (i = 0; i < base->width * base->height; ++i) {
-    base->data[i] = buffer->data[i];
-  }
+  memcpy(base->data, buffer->data, sizeof(float) * w * h);
 }
 
 void hm_add_limited_q(
   heightmap *base,
   heightmap const * const fill
 ) {
-  heightmap *buffer = create_heightmap(base->width, base->height);
-  hm_add_limited(base, fill, buffer);
-  cleanup_heightmap(buffer);
+  hm_add_limited(base, fill, _get_scratch_plane(0, base->width, base->height));
 }
 
 void hm_process(
@@ -294,7 +771,7 @@ void hm_process(
   }
 }
 
-void  hm_compute_flows(
+void hm_compute_flows(
   heightmap const * const hm,
   heightmap const * const precip,
   heightmap *result,
@@ -302,11 +779,11 @@ void  hm_compute_flows(
   heightmap *extra_buffer,
   size_t flow_steps
 ) {
-  size_t n, i, idx, oidx;
-  ptrdiff_t x, y, xx, yy;
-  size_t bidx, sbidx, tbidx;
-  float bslope, sbslope, tbslope;
-  float slope, stotal;
+  size_t n, i;
+  ptrdiff_t x, y, idx;
+  ptrdiff_t w = hm->width, h = hm->height;
+  hm_scratch *scr;
+  float *swap;
   if (
     hm->width != precip->width
  || hm->height != precip->height
@@ -319,85 +796,64 @@ void  hm_compute_flows(
   ) {
     return;
   }
+  scr = _get_scratch(w * h);
+
+  // The heightmap doesn't change as water flows, so work out where each cell
+  // sends its water just once:
+#pragma omp parallel for schedule(static) private(x, idx) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+  for (y = 0; y < h; ++y) {
+    for (x = 0; x < w; ++x) {
+      idx = x + w * y;
+      _find_flow_targets(hm, x, y, &(scr->codes[idx]), &(scr->totals[idx]));
+    }
+  }
 
   // Copy precipitation into our buffer:
   hm_copy(precip, buffer);
 
   for (n = 0; n < flow_steps; ++n) {
-    for (x = 0; x < hm->width; ++x) {
-      for (y = 0; y < hm->height; ++y) {
-        idx = x + hm->width * y;
-        
-        // First, iterate over neighbors to find our three most-downhill
-        // neighbors:
-        oidx = 0;
-        bidx = 0;
-        sbidx = 0;
-        tbidx = 0;
-        bslope = 0;
-        sbslope = 0;
-        tbslope = 0;
-        slope = 0;
-        stotal = 0;
-        for (xx = x - 1; xx <= x + 1; ++xx) {
-          if (xx < 0 || xx > hm->width - 1) {
-            continue;
-          }
-          for (yy = y - 1; yy <= y + 1; ++yy) {
-            if (
-              (xx == x && yy == y)
-            || yy < 0
-            || yy > hm->height - 1
-            ) {
-              continue;
-            }
-            oidx = xx + hm->width * yy;
-            slope = hm->data[idx] - hm->data[oidx];
-            if (slope > bslope) {
-              tbidx = sbidx;
-              tbslope = sbslope;
-              sbidx = bidx;
-              sbslope = bslope;
-              bidx = oidx;
-              bslope = slope;
-            } else if (slope > sbslope) {
-              tbidx = sbidx;
-              tbslope = sbslope;
-              sbidx = oidx;
-              sbslope = slope;
-            } else if (slope > tbslope) {
-              tbidx = oidx;
-              tbslope = slope;
-            }
-          }
+    // Each cell collects the water flowing downhill into it (if we're at a
+    // minimum, no water leaves):
+#pragma omp parallel for schedule(static) private(x, idx) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+    for (y = 0; y < h; ++y) {
+      for (x = 0; x < w; ++x) {
+        idx = x + w * y;
+        if (x > 0 && x < w - 1 && y > 0 && y < h - 1) {
+          extra_buffer->data[idx] = _gather_flow_interior(
+            hm->data,
+            buffer->data,
+            scr->codes,
+            scr->totals,
+            idx,
+            w,
+            extra_buffer->data[idx]
+          );
+        } else {
+          extra_buffer->data[idx] = _gather_flow(
+            hm,
+            buffer->data,
+            scr->codes,
+            scr->totals,
+            x,
+            y,
+            extra_buffer->data[idx]
+          );
         }
-
-        // The sum of best slopes:
-        stotal = bslope + sbslope + tbslope;
-
-        // Redistribute water downstream:
-        if (stotal > 0) {
-          // Local water flows onwards to three most-downhill neighbors
-          // proportional to their slopes:
-          if (bslope != 0) {
-            extra_buffer->data[bidx] += buffer->data[idx] * (bslope / stotal);
-          }
-          if (sbslope != 0) {
-            extra_buffer->data[sbidx] += buffer->data[idx] * (sbslope / stotal);
-          }
-          if (tbslope != 0) {
-            extra_buffer->data[tbidx] += buffer->data[idx] * (tbslope / stotal);
-          }
-        } // if we're at a minima, no water leaves
       }
     }
 
-    // Flip buffers and accumulate:
-    for (i = 0; i < hm->width * hm->height; ++i) {
+    // Accumulate and flip buffers:
+#pragma omp parallel for simd schedule(static) \
+  if (w * h >= HM_PARALLEL_MIN_CELLS)
+    for (i = 0; i < w * h; ++i) {
       result->data[i] += buffer->data[i];
-      buffer->data[i] = extra_buffer->data[i];
-      extra_buffer->data[i] = 0;
     }
+    swap = buffer->data;
+    buffer->data = extra_buffer->data;
+    extra_buffer->data = swap;
+    hm_reset(extra_buffer);
   }
 }
 
@@ -407,11 +863,14 @@ void hm_compute_flows_q(
   heightmap *result,
   size_t flow_steps
 ) {
-  heightmap *buffer = create_heightmap(hm->width, hm->height);
-  heightmap *extra_buffer = create_heightmap(hm->width, hm->height);
-  hm_compute_flows(hm, precip, result, buffer, extra_buffer, flow_steps);
-  cleanup_heightmap(buffer);
-  cleanup_heightmap(extra_buffer);
+  hm_compute_flows(
+    hm,
+    precip,
+    result,
+    _get_scratch_plane(0, hm->width, hm->height),
+    _get_scratch_plane(1, hm->width, hm->height),
+    flow_steps
+  );
 }
 
 void hm_erode(
@@ -480,9 +939,9 @@ void hm_erode_q(
   float erosion_strength,
   float modulation_strength
 ) {
-  heightmap *flow = create_heightmap(hm->width, hm->height);
-  heightmap *save = create_heightmap(hm->width, hm->height);
-  heightmap *extra = create_heightmap(hm->width, hm->height);
+  heightmap *flow = _get_scratch_plane(0, hm->width, hm->height);
+  heightmap *save = _get_scratch_plane(1, hm->width, hm->height);
+  heightmap *extra = _get_scratch_plane(2, hm->width, hm->height);
   hm_erode(
     hm,
     modulate,
@@ -497,7 +956,4 @@ void hm_erode_q(
     erosion_strength,
     modulation_strength
   );
-  cleanup_heightmap(flow);
-  cleanup_heightmap(save);
-  cleanup_heightmap(extra);
 }
@@ -9,6 +9,23 @@
 
 #include "boilerplate.h"
 
+/*************
+ * Constants *
+ *************/
+
+// Heightmap data is allocated with this alignment (in bytes) so that each
+// array starts on a vector-register boundary.
+#define HM_ALIGNMENT 32
+
+// Kernels working on heightmaps with fewer cells than this run on a single
+// thread, since spinning up a team would cost more than it saves.
+#define HM_PARALLEL_MIN_CELLS (256*256)
+
+// Filters whose entries all match a separable (outer product) approximation
+// to within this fraction of their largest entry are convolved using two 1-d
+// passes instead of a full 2-d pass.
+#define HM_SEPARABLE_TOLERANCE 1e-6
+
 /**************
  * Structures *
  **************/
@@ -52,6 +69,11 @@ heightmap *create_heightmap(size_t width, size_t height);
 // Frees the memory associated with a heightmap.
 CLEANUP_DECL(heightmap);
 
+// Frees the scratch space that the calling thread has accumulated for the
+// heightmap kernels (see hm_compute_flows and the _q functions). It will be
+// re-allocated if needed by a later call.
+void hm_release_scratch(void);
+
 /*************
  * Functions *
  *************/
@@ -59,6 +81,10 @@ CLEANUP_DECL(heightmap);
 // Sets the given heightmap to all zeroes.
 void hm_reset(heightmap *hm);
 
+// Changes the dimensions of the given heightmap, reallocating its data only
+// if the number of cells changes. The heightmap is zeroed either way.
+void hm_resize(heightmap *hm, size_t width, size_t height);
+
 // Copies the source heightmap, overwriting the destination heightmap. If the
 // two heightmaps have different dimensions, the destination heightmap's data
 // will be freed and reallocated.
@@ -105,22 +131,40 @@ void hm_add(heightmap *base, heightmap const * const add_in);
 void hm_normalize(heightmap *hm);
 
 // Applies a convolution filter to the heightmap. The given convolution filter
-// should have odd dimensions. After summing nearby entries, results are
-// normalized according to the total weight from the filter, so filter entries
-// don't need to add up to any specific number. Filter entries can of course be
-// negative, but if the filter has a negative sum it will behave like its
-// inverse due to the normalization. This can be tricky when parts of a filter
-// are ignored near edges where they're out-of-bounds. Note that the _q version
-// of this function creates and destroys its own buffer heightmap rather than
-// requiring one as input.
+// should have odd dimensions (otherwise nothing happens). After summing nearby
+// entries, results are normalized according to the total weight from the
+// filter, so filter entries don't need to add up to any specific number.
+// Filter entries can of course be negative, but if the filter has a negative
+// sum it will behave like its inverse due to the normalization. This can be
+// tricky when parts of a filter are ignored near edges where they're
+// out-of-bounds. The buffer must be the same size as the heightmap, but
+// doesn't need to be zeroed. Separable filters (e.g., Gaussian blurs) are
+// detected automatically and handed off to hm_convolve_separable. Note that
+// the _q version of this function uses a per-thread scratch buffer rather
+// than requiring one as input.
 void hm_convolve(heightmap *hm, heightmap *filter, heightmap *buffer);
 void hm_convolve_q(heightmap *hm, heightmap *filter);
 
+// Works like hm_convolve for the filter given by the outer product of the
+// x_filter and y_filter arrays (which must have odd lengths), but does so
+// using one horizontal and one vertical pass, which costs O(x_len + y_len)
+// per cell instead of O(x_len * y_len). Edge normalization works out the same
+// as it would for the full filter.
+void hm_convolve_separable(
+  heightmap *hm,
+  float const * const x_filter,
+  size_t x_len,
+  float const * const y_filter,
+  size_t y_len,
+  heightmap *buffer
+);
+
 // For each entry in the heightmap with an orthogonal neighbor that's lower
 // than it by more than 'max_slope', average it with that neighbor (or at
 // least, move both towards the average by an amount proportional to 'rate').
-// Note that the _q version of this function allocates and destroys a buffer
-// array rather than requiring one as input.
+// The buffer should be zeroed when given (its contents are added to the
+// computed adjustments). Note that the _q version of this function uses a
+// per-thread scratch buffer rather than requiring one as input.
 void hm_slump(heightmap *hm, heightmap *buffer, float max_slope, float rate);
 void hm_slump_q(heightmap *hm, float max_slope, float rate);
 
@@ -128,8 +172,7 @@ void hm_slump_q(heightmap *hm, float max_slope, float rate);
 // but don't increase/decrease any point in base so that it becomes
 // higher/lower than the tallest/lowest orthogonal neighbor it had before the
 // operation. Does nothing if the heightmaps given are different sizes. The _q
-// version allocates and destroys a temporary processing buffer instead of
-// requiring one as input.
+// version uses a per-thread scratch buffer instead of requiring one as input.
 void hm_add_limited(
   heightmap *base,
   heightmap const * const fill,
@@ -151,11 +194,14 @@ void hm_process(
 );
 
 // Simulates water flow using the given height and precipitation maps, storing
-// results in the 'result' parameter. The required buffer should be zeroed when
-// given, or the _q version can be used to automatically allocate and destroy a
-// temporary buffer. The flow_steps parameter controls how many simulation
-// steps are performed, which in turn limits how far water can travel from
-// where it falls originally.
+// results in the 'result' parameter. The required buffers should be zeroed
+// when given, or the _q version can be used to draw them from per-thread
+// scratch space. The flow_steps parameter controls how many simulation steps
+// are performed, which in turn limits how far water can travel from where it
+// falls originally. Since the heightmap doesn't change during the simulation,
+// each cell's downhill neighbors are worked out once up front (using
+// per-thread scratch space) and each step then just gathers incoming water.
+// Note that the data arrays of buffer and extra_buffer may be swapped.
 void hm_compute_flows(
   heightmap const * const hm,
   heightmap const * const precip,
@@ -176,7 +222,7 @@ void hm_compute_flows_q(
 // flows for it and using hm_add_limited to build up low-lying areas of the
 // heightmap (doesn't wear down high areas like real erosion). Three buffers
 // are required (and are assumed to be zeroed when given); the _q version
-// constructs and destroys the buffers automatically. The modulation heightmap
+// draws them from per-thread scratch space. The modulation heightmap
 // acts as an erosion mask, as after using hm_add_limited, hm_erode uses
 // hm_combine_modulated with the given modulation strength against a copy of
 // the original heightmap. The precipitation heighmap influences flow
@@ -0,0 +1,217 @@
+// mpmc_queue.c
+// Bounded lock-free multi-producer/multi-consumer queues.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "mpmc_queue.h"
+
+/**************
+ * Structures *
+ **************/
+
+struct mq_cell_s {
+  uint64_t sequence; // whose turn it is to use this slot (see below)
+  void *element;
+};
+typedef struct mq_cell_s mq_cell;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// A cell at ring index i is free for the producer claiming position p (where
+// p & mask == i) when its sequence is p, and holds the element at position p
+// for the consumer when its sequence is p + 1. Popping it sets the sequence to
+// p + capacity, handing it on to the producer one lap later.
+struct mpmc_queue_s {
+  mq_cell *cells;
+  size_t capacity; // always a power of two
+  size_t mask; // capacity - 1
+  uint8_t _pad0[MQ_CACHE_LINE];
+  uint64_t enqueue_pos; // next position to push to
+  uint8_t _pad1[MQ_CACHE_LINE - sizeof(uint64_t)];
+  uint64_t dequeue_pos; // next position to pop from
+  uint8_t _pad2[MQ_CACHE_LINE - sizeof(uint64_t)];
+};
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+mpmc_queue *create_mpmc_queue(size_t capacity) {
+  size_t i;
+  mpmc_queue *q = (mpmc_queue *) malloc(sizeof(mpmc_queue));
+  if (q == NULL) {
+    perror("Failed to create MPMC queue.");
+    exit(errno);
+  }
+  q->capacity = 2;
+  while (q->capacity < capacity) {
+    q->capacity <<= 1;
+  }
+  q->mask = q->capacity - 1;
+  q->cells = (mq_cell *) malloc(sizeof(mq_cell) * q->capacity);
+  if (q->cells == NULL) {
+    perror("Failed to create MPMC queue cells.");
+    exit(errno);
+  }
+  for (i = 0; i < q->capacity; ++i) {
+    q->cells[i].sequence = i;
+    q->cells[i].element = NULL;
+  }
+  q->enqueue_pos = 0;
+  q->dequeue_pos = 0;
+  return q;
+}
+
+CLEANUP_IMPL(mpmc_queue) {
+  free(doomed->cells);
+  free(doomed);
+}
+
+void destroy_mpmc_queue(mpmc_queue *q) {
+  void *element;
+  while ((element = mq_pop_element(q)) != NULL) {
+    free(element);
+  }
+  cleanup_mpmc_queue(q);
+}
+
+/*************
+ * Functions *
+ *************/
+
+size_t mq_get_capacity(mpmc_queue *q) {
+  return q->capacity;
+}
+
+int mq_is_empty(mpmc_queue *q) {
+  return mq_get_length(q) == 0;
+}
+
+size_t mq_get_length(mpmc_queue *q) {
+  // The dequeue position never passes the enqueue position, so reading it
+  // first guarantees a non-negative result:
+  uint64_t dq = __atomic_load_n(&(q->dequeue_pos), __ATOMIC_ACQUIRE);
+  uint64_t eq = __atomic_load_n(&(q->enqueue_pos), __ATOMIC_ACQUIRE);
+  if (eq - dq > q->capacity) {
+    return q->capacity;
+  }
+  return (size_t) (eq - dq);
+}
+
+int mq_push_element(mpmc_queue *q, void *element) {
+  mq_cell *cell;
+  uint64_t seq;
+  int64_t diff;
+  uint64_t pos = __atomic_load_n(&(q->enqueue_pos), __ATOMIC_RELAXED);
+  while (1) {
+    cell = &(q->cells[pos & q->mask]);
+    seq = __atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE);
+    diff = (int64_t) seq - (int64_t) pos;
+    if (diff == 0) {
+      // The cell is free: try to claim this position (on failure pos is
+      // updated to the current enqueue position):
+      if (
+        __atomic_compare_exchange_n(
+          &(q->enqueue_pos),
+          &pos,
+          pos + 1,
+          1,
+          __ATOMIC_RELAXED,
+          __ATOMIC_RELAXED
+        )
+      ) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The cell still holds an element from the previous lap:
+      return 0;
+    } else {
+      // Someone else claimed this position:
+      pos = __atomic_load_n(&(q->enqueue_pos), __ATOMIC_RELAXED);
+    }
+  }
+  cell->element = element;
+  __atomic_store_n(&(cell->sequence), pos + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+void * mq_pop_element(mpmc_queue *q) {
+  mq_cell *cell;
+  uint64_t seq;
+  int64_t diff;
+  void *result;
+  uint64_t pos = __atomic_load_n(&(q->dequeue_pos), __ATOMIC_RELAXED);
+  while (1) {
+    cell = &(q->cells[pos & q->mask]);
+    seq = __atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE);
+    diff = (int64_t) seq - (int64_t) (pos + 1);
+    if (diff == 0) {
+      if (
+        __atomic_compare_exchange_n(
+          &(q->dequeue_pos),
+          &pos,
+          pos + 1,
+          1,
+          __ATOMIC_RELAXED,
+          __ATOMIC_RELAXED
+        )
+      ) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Nothing has been pushed here yet:
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&(q->dequeue_pos), __ATOMIC_RELAXED);
+    }
+  }
+  result = cell->element;
+  __atomic_store_n(
+    &(cell->sequence),
+    pos + q->mask + 1,
+    __ATOMIC_RELEASE
+  );
+  return result;
+}
+
+void mq_foreach(mpmc_queue *q, void (*f)(void *)) {
+  uint64_t pos = __atomic_load_n(&(q->dequeue_pos), __ATOMIC_ACQUIRE);
+  uint64_t end = __atomic_load_n(&(q->enqueue_pos), __ATOMIC_ACQUIRE);
+  mq_cell *cell;
+  for (; pos < end; ++pos) {
+    cell = &(q->cells[pos & q->mask]);
+    // Skip positions that have been claimed but not yet filled:
+    if (__atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE) == pos + 1) {
+      (*f)(cell->element);
+    }
+  }
+}
+
+void mq_witheach(mpmc_queue *q, void *arg, void (*f)(void *, void *)) {
+  uint64_t pos = __atomic_load_n(&(q->dequeue_pos), __ATOMIC_ACQUIRE);
+  uint64_t end = __atomic_load_n(&(q->enqueue_pos), __ATOMIC_ACQUIRE);
+  mq_cell *cell;
+  for (; pos < end; ++pos) {
+    cell = &(q->cells[pos & q->mask]);
+    if (__atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE) == pos + 1) {
+      (*f)(cell->element, arg);
+    }
+  }
+}
+
+size_t mq_data_size(mpmc_queue *q) {
+  return mq_get_length(q) * sizeof(void *);
+}
+
+size_t mq_overhead_size(mpmc_queue *q) {
+  return (
+    sizeof(mpmc_queue)
+  + q->capacity * sizeof(mq_cell)
+  - mq_data_size(q)
+  );
+}
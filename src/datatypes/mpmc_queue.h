@@ -0,0 +1,88 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+// mpmc_queue.h
+// Bounded lock-free multi-producer/multi-consumer queues.
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "boilerplate.h"
+
+/*************
+ * Constants *
+ *************/
+
+// Size of a cache line, used to keep the producer and consumer positions from
+// sharing one:
+#define MQ_CACHE_LINE 64
+
+/**************
+ * Structures *
+ **************/
+
+// A fixed-capacity ring of element slots, each with a sequence number that
+// tells producers and consumers whether it's their turn to use it (see Dmitry
+// Vyukov's bounded MPMC queue). Pushes and pops never take a lock: they only
+// contend on a compare-and-swap of the enqueue or dequeue position.
+struct mpmc_queue_s;
+typedef struct mpmc_queue_s mpmc_queue;
+
+// Note: mpmc_queue_s is defined in mpmc_queue.c, not here. This is
+// intentional: external code should only use queue pointers and shouldn't
+// deal with the internals of queues directly.
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+// Allocates and sets up a new empty queue that can hold at least the given
+// number of elements (the capacity is rounded up to a power of two).
+mpmc_queue *create_mpmc_queue(size_t capacity);
+
+// Frees the memory associated with a queue. No other thread may be using it.
+CLEANUP_DECL(mpmc_queue);
+
+// Frees the memory associated with a queue, and also calls free on each
+// element in the queue.
+void destroy_mpmc_queue(mpmc_queue *q);
+
+/*************
+ * Functions *
+ *************/
+
+// Returns the capacity of the given queue.
+size_t mq_get_capacity(mpmc_queue *q);
+
+// Tests whether the given queue is empty. When other threads are pushing or
+// popping the answer may already be out of date.
+int mq_is_empty(mpmc_queue *q);
+
+// Returns the length of the given queue (with the same caveat as mq_is_empty).
+size_t mq_get_length(mpmc_queue *q);
+
+// Adds the given element to the end of the given queue. Returns 1 on success
+// or 0 if the queue is full (in which case the element isn't added). NULL
+// elements can't be told apart from an empty queue when popped, and shouldn't
+// be pushed.
+int mq_push_element(mpmc_queue *q, void *element);
+
+// Removes and returns the first element of the given queue. Returns NULL if
+// the queue is empty.
+void * mq_pop_element(mpmc_queue *q);
+
+// Runs the given function sequentially on each element in the queue. This
+// doesn't remove anything, and is only reliable if no other thread is popping
+// elements from the queue at the same time (elements pushed concurrently may
+// or may not be visited).
+void mq_foreach(mpmc_queue *q, void (*f)(void *));
+
+// Like mq_foreach, but with the given extra argument passed as the second
+// argument to the given function.
+void mq_witheach(mpmc_queue *q, void *arg, void (*f)(void *, void *));
+
+// Counts the number of bytes of data/overhead used by the given queue.
+size_t mq_data_size(mpmc_queue *q);
+size_t mq_overhead_size(mpmc_queue *q);
+
+#endif //ifndef MPMC_QUEUE_H
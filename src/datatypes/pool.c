@@ -0,0 +1,356 @@
+// pool.c
+// Slab pools for large numbers of same-sized objects.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <omp.h>
+
+#include "pool.h"
+
+/*************
+ * Constants *
+ *************/
+
+// Alignment for objects smaller than a page:
+#define SP_ALIGN 16
+
+/**************
+ * Structures *
+ **************/
+
+// Each slab starts with a header. Objects come after it, and a slab is
+// aligned to its own size, so masking an object's address finds its header.
+struct pool_slab_s;
+typedef struct pool_slab_s pool_slab;
+
+// Which list a slab is on:
+typedef enum {
+  SPL_PARTIAL = 0, // some free objects and some live ones
+  SPL_FULL = 1, // no free objects
+  SPL_IDLE = 2, // no live objects
+  N_SLAB_LISTS = 3
+} slab_list;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct pool_slab_s {
+  pool_slab *prev, *next;
+  void *free; // intrusive list of freed objects
+  size_t used; // number of live objects
+  size_t fresh; // objects past this index have never been handed out
+  slab_list list;
+  uint8_t trimmed; // pages have been released since the slab went idle
+};
+
+struct slab_pool_s {
+  char const *name;
+  size_t object_size; // rounded up to the alignment
+  size_t slab_size; // always a power of two
+  size_t offset; // from the slab start to the first object
+  size_t per_slab; // objects per slab
+  size_t page_size;
+  size_t max_idle;
+  uint8_t trim;
+  pool_slab *lists[N_SLAB_LISTS];
+  slab_pool_stats stats;
+  omp_lock_t lock;
+};
+
+/*********************
+ * Private Functions *
+ *********************/
+
+static inline size_t round_up(size_t n, size_t to) {
+  return ((n + to - 1) / to) * to;
+}
+
+static inline pool_slab * slab_of(slab_pool *sp, void *obj) {
+  return (pool_slab*) ((uintptr_t) obj & ~((uintptr_t) sp->slab_size - 1));
+}
+
+static inline void slab_unlink(slab_pool *sp, pool_slab *s) {
+  if (s->prev != NULL) {
+    s->prev->next = s->next;
+  } else {
+    sp->lists[s->list] = s->next;
+  }
+  if (s->next != NULL) {
+    s->next->prev = s->prev;
+  }
+  s->prev = NULL;
+  s->next = NULL;
+}
+
+static inline void slab_link(slab_pool *sp, pool_slab *s, slab_list l) {
+  s->list = l;
+  s->prev = NULL;
+  s->next = sp->lists[l];
+  if (s->next != NULL) {
+    s->next->prev = s;
+  }
+  sp->lists[l] = s;
+}
+
+// Maps a new slab aligned to the slab size. mmap only guarantees page
+// alignment, so this maps twice as much as needed and unmaps the excess on
+// either side.
+static pool_slab * map_slab(slab_pool *sp) {
+  uint8_t *raw, *aligned;
+  size_t lead, trail;
+  raw = (uint8_t*) mmap(
+    NULL,
+    sp->slab_size * 2,
+    PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS,
+    -1,
+    0
+  );
+  if (raw == MAP_FAILED) {
+    perror("Failed to map pool slab.");
+    exit(errno);
+  }
+  aligned = (uint8_t*) round_up((uintptr_t) raw, sp->slab_size);
+  lead = aligned - raw;
+  trail = sp->slab_size - lead;
+  if (lead > 0) {
+    munmap(raw, lead);
+  }
+  if (trail > 0) {
+    munmap(aligned + sp->slab_size, trail);
+  }
+  pool_slab *s = (pool_slab*) aligned;
+  s->prev = NULL;
+  s->next = NULL;
+  s->free = NULL;
+  s->used = 0;
+  s->fresh = 0;
+  s->list = SPL_IDLE;
+  s->trimmed = 0;
+  sp->stats.slabs += 1;
+  if (sp->stats.slabs > sp->stats.peak_slabs) {
+    sp->stats.peak_slabs = sp->stats.slabs;
+  }
+  return s;
+}
+
+// Releases the pages holding an idle slab's objects. The header stays put (it
+// shares a page with the first objects when they're small, so that page is
+// kept). Since every page after it reads back as zeroes, the free list is
+// thrown away and objects get handed out fresh again.
+static void trim_slab(slab_pool *sp, pool_slab *s) {
+  uint8_t *start = (uint8_t*) s + round_up(sizeof(pool_slab), sp->page_size);
+  size_t len = ((uint8_t*) s + sp->slab_size) - start;
+  if (s->trimmed) {
+    return;
+  }
+  if (madvise(start, len, MADV_DONTNEED) != 0) {
+    perror("Failed to trim pool slab.");
+    exit(errno);
+  }
+  s->free = NULL;
+  s->fresh = 0;
+  s->trimmed = 1;
+  sp->stats.trimmed_slabs += 1;
+}
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+slab_pool *create_slab_pool(
+  char const * const name,
+  size_t object_size,
+  size_t max_idle,
+  uint8_t trim
+) {
+  size_t need;
+  slab_pool *sp = (slab_pool *) malloc(sizeof(slab_pool));
+  if (sp == NULL) {
+    perror("Failed to create slab pool.");
+    exit(errno);
+  }
+  sp->name = name;
+  sp->page_size = (size_t) sysconf(_SC_PAGESIZE);
+  if (object_size < sizeof(void*)) {
+    object_size = sizeof(void*); // room for the free list link
+  }
+  if (object_size >= sp->page_size) {
+    sp->object_size = round_up(object_size, sp->page_size);
+    sp->offset = round_up(sizeof(pool_slab), sp->page_size);
+  } else {
+    sp->object_size = round_up(object_size, SP_ALIGN);
+    sp->offset = round_up(sizeof(pool_slab), SP_ALIGN);
+  }
+  need = sp->offset + sp->object_size * SP_MIN_SLAB_OBJECTS;
+  sp->slab_size = SP_MIN_SLAB_BYTES;
+  while (sp->slab_size < need) {
+    sp->slab_size <<= 1;
+  }
+  sp->per_slab = (sp->slab_size - sp->offset) / sp->object_size;
+  sp->max_idle = max_idle;
+  sp->trim = trim;
+  sp->lists[SPL_PARTIAL] = NULL;
+  sp->lists[SPL_FULL] = NULL;
+  sp->lists[SPL_IDLE] = NULL;
+  sp->stats.object_size = sp->object_size;
+  sp->stats.slab_size = sp->slab_size;
+  sp->stats.allocations = 0;
+  sp->stats.frees = 0;
+  sp->stats.live = 0;
+  sp->stats.peak_live = 0;
+  sp->stats.slabs = 0;
+  sp->stats.peak_slabs = 0;
+  sp->stats.idle_slabs = 0;
+  sp->stats.trimmed_slabs = 0;
+  sp->stats.unmapped_slabs = 0;
+  omp_init_lock(&(sp->lock));
+  return sp;
+}
+
+CLEANUP_IMPL(slab_pool) {
+  slab_list l;
+  pool_slab *s, *next;
+  for (l = SPL_PARTIAL; l < N_SLAB_LISTS; ++l) {
+    for (s = doomed->lists[l]; s != NULL; s = next) {
+      next = s->next;
+      munmap(s, doomed->slab_size);
+    }
+  }
+  omp_destroy_lock(&(doomed->lock));
+  free(doomed);
+}
+
+/*************
+ * Functions *
+ *************/
+
+char const * sp_get_name(slab_pool *sp) {
+  return sp->name;
+}
+
+void * sp_alloc(slab_pool *sp) {
+  pool_slab *s;
+  void *result;
+  omp_set_lock(&(sp->lock));
+  s = sp->lists[SPL_PARTIAL];
+  if (s == NULL) {
+    s = sp->lists[SPL_IDLE];
+    if (s != NULL) {
+      slab_unlink(sp, s);
+      sp->stats.idle_slabs -= 1;
+      if (s->trimmed) {
+        sp->stats.trimmed_slabs -= 1;
+        s->trimmed = 0;
+      }
+    } else {
+      s = map_slab(sp);
+    }
+    slab_link(sp, s, SPL_PARTIAL);
+  }
+  if (s->free != NULL) {
+    result = s->free;
+    s->free = *((void**) result);
+  } else {
+    result = (uint8_t*) s + sp->offset + s->fresh * sp->object_size;
+    s->fresh += 1;
+  }
+  s->used += 1;
+  if (s->used == sp->per_slab) {
+    slab_unlink(sp, s);
+    slab_link(sp, s, SPL_FULL);
+  }
+  sp->stats.allocations += 1;
+  sp->stats.live += 1;
+  if (sp->stats.live > sp->stats.peak_live) {
+    sp->stats.peak_live = sp->stats.live;
+  }
+  omp_unset_lock(&(sp->lock));
+  return result;
+}
+
+void sp_free(slab_pool *sp, void *obj) {
+  pool_slab *s;
+  if (obj == NULL) {
+    return;
+  }
+  s = slab_of(sp, obj);
+#ifdef DEBUG
+  if (
+    (uint8_t*) obj < (uint8_t*) s + sp->offset
+ || ((uint8_t*) obj - ((uint8_t*) s + sp->offset)) % sp->object_size != 0
+  ) {
+    fprintf(stderr, "Error: bad object freed to pool '%s'.\n", sp->name);
+    exit(EXIT_FAILURE);
+  }
+#endif
+  omp_set_lock(&(sp->lock));
+#ifdef DEBUG
+  if (s->used == 0 || s->list == SPL_IDLE) {
+    fprintf(stderr, "Error: double free in pool '%s'.\n", sp->name);
+    exit(EXIT_FAILURE);
+  }
+#endif
+  *((void**) obj) = s->free;
+  s->free = obj;
+  s->used -= 1;
+  sp->stats.frees += 1;
+  sp->stats.live -= 1;
+  if (s->used == 0) {
+    slab_unlink(sp, s);
+    if (sp->stats.idle_slabs < sp->max_idle) {
+      slab_link(sp, s, SPL_IDLE);
+      sp->stats.idle_slabs += 1;
+      if (sp->trim) {
+        trim_slab(sp, s);
+      }
+    } else {
+      munmap(s, sp->slab_size);
+      sp->stats.slabs -= 1;
+      sp->stats.unmapped_slabs += 1;
+    }
+  } else if (s->list == SPL_FULL) {
+    slab_unlink(sp, s);
+    slab_link(sp, s, SPL_PARTIAL);
+  }
+  omp_unset_lock(&(sp->lock));
+}
+
+size_t sp_trim(slab_pool *sp) {
+  pool_slab *s;
+  size_t result = 0;
+  omp_set_lock(&(sp->lock));
+  for (s = sp->lists[SPL_IDLE]; s != NULL; s = s->next) {
+    if (!s->trimmed) {
+      trim_slab(sp, s);
+      result += 1;
+    }
+  }
+  omp_unset_lock(&(sp->lock));
+  return result;
+}
+
+void sp_get_stats(slab_pool *sp, slab_pool_stats *stats) {
+  omp_set_lock(&(sp->lock));
+  *stats = sp->stats;
+  omp_unset_lock(&(sp->lock));
+}
+
+size_t sp_data_size(slab_pool *sp) {
+  return sp->stats.live * sp->object_size;
+}
+
+size_t sp_overhead_size(slab_pool *sp) {
+  // Trimmed slabs only keep their header page:
+  size_t resident = (
+    (sp->stats.slabs - sp->stats.trimmed_slabs) * sp->slab_size
+  + sp->stats.trimmed_slabs * round_up(sizeof(pool_slab), sp->page_size)
+  );
+  return resident - sp_data_size(sp) + sizeof(slab_pool);
+}
@@ -0,0 +1,99 @@
+#ifndef POOL_H
+#define POOL_H
+
+// pool.h
+// Slab pools for large numbers of same-sized objects.
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "boilerplate.h"
+
+/*************
+ * Constants *
+ *************/
+
+// Slabs are at least this big, and hold at least SP_MIN_SLAB_OBJECTS objects
+// (slab sizes are always powers of two):
+#define SP_MIN_SLAB_BYTES (64 * 1024)
+#define SP_MIN_SLAB_OBJECTS 4
+
+/**************
+ * Structures *
+ **************/
+
+// A pool hands out fixed-size objects carved from big slabs of memory that
+// are mapped directly from the OS. A slab goes back to the OS once it's empty
+// (unless the pool is keeping it around for reuse), so unlike the heap, a
+// pool's memory use comes back down after a burst of allocations. Allocation
+// and freeing take the pool's lock.
+struct slab_pool_s;
+typedef struct slab_pool_s slab_pool;
+
+// Allocation statistics for a pool (see sp_get_stats).
+struct slab_pool_stats_s;
+typedef struct slab_pool_stats_s slab_pool_stats;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct slab_pool_stats_s {
+  size_t object_size; // bytes per object
+  size_t slab_size; // bytes per slab
+  size_t allocations, frees; // cumulative counts
+  size_t live, peak_live; // objects currently (and at most ever) allocated
+  size_t slabs, peak_slabs; // slabs currently (and at most ever) mapped
+  size_t idle_slabs; // mapped slabs without any live objects
+  size_t trimmed_slabs; // idle slabs whose pages have been released
+  size_t unmapped_slabs; // cumulative count of slabs returned to the OS
+};
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+// Creates a new pool for objects of the given size. Up to max_idle empty
+// slabs are kept mapped for reuse; beyond that, empty slabs are returned to
+// the OS. If trim is nonzero, the pages of kept slabs are released as soon as
+// they go idle (with madvise), so they only take up address space. Objects
+// bigger than a page are page-aligned; smaller ones are aligned to 16 bytes.
+slab_pool *create_slab_pool(
+  char const * const name,
+  size_t object_size,
+  size_t max_idle,
+  uint8_t trim
+);
+
+// Unmaps every slab and frees the pool. Any objects still allocated from it
+// become invalid.
+CLEANUP_DECL(slab_pool);
+
+/*************
+ * Functions *
+ *************/
+
+// Returns the name that the pool was created with.
+char const * sp_get_name(slab_pool *sp);
+
+// Returns a new uninitialized object from the given pool.
+void * sp_alloc(slab_pool *sp);
+
+// Returns the given object to the pool it came from. Passing NULL does
+// nothing.
+void sp_free(slab_pool *sp, void *obj);
+
+// Releases the pages of every idle slab that hasn't already been trimmed,
+// keeping the slabs mapped for reuse. Returns the number of slabs trimmed.
+size_t sp_trim(slab_pool *sp);
+
+// Copies the pool's current statistics into the given struct.
+void sp_get_stats(slab_pool *sp, slab_pool_stats *stats);
+
+// Memory accounting (see pmem.h): data is the space taken by live objects,
+// and overhead is the rest of the pool's resident slab memory plus the pool
+// itself.
+size_t sp_data_size(slab_pool *sp);
+size_t sp_overhead_size(slab_pool *sp);
+
+#endif // ifndef POOL_H
@@ -1,4 +1,4 @@
-// promise.h
+// promise.c
 // A C implementation of promises, using OMP multithreading.
 
 #include <stdlib.h>
@@ -11,93 +11,292 @@
 
 #include "promise.h"
 
+/*********
+ * Enums *
+ *********/
+
+enum pr_state_e {
+  PR_STATE_UNRESOLVED = 0,
+  PR_STATE_FULFILLED = 1,
+  PR_STATE_BROKEN = 2,
+};
+typedef enum pr_state_e pr_state;
+
+// What (if anything) a promise does when its parent resolves:
+enum pr_continuation_e {
+  PR_CONT_NONE = 0,
+  PR_CONT_THEN = 1,
+  PR_CONT_ELSE = 2,
+};
+typedef enum pr_continuation_e pr_continuation;
+
 /**************
  * Structures *
  **************/
 
-struct promsie_s {
+struct promise_s {
+  pr_state state; // unresolved, fulfilled, or broken
+  void *value; // the value (if fulfilled) or message (if broken)
   list *parents; // promises that this one is waiting for
   list *children; // promises that are waiting for this one
+  pr_continuation kind; // how to resolve this promise once its parent resolves
+  void * (*resolve)(void **); // continuation function for pr_then/pr_else
   omp_lock_t lock; // lock for thread safety
 };
 
+/***********
+ * Globals *
+ ***********/
+
+pr_dispatcher PR_DISPATCH = NULL;
+
 /*********************
  * Private Functions *
  *********************/
 
-// TODO: Any of these?
+// Runs the continuation for the given promise, whose (single) parent must
+// already be resolved.
+static void _pr_run_continuation(void *v_pr) {
+  promise *pr = (promise*) v_pr;
+  promise *parent = (promise*) l_get_item(pr->parents, 0);
+  // A resolved promise never changes, so we don't need the parent's lock:
+  void *value = parent->value;
+  if (pr->kind == PR_CONT_THEN) {
+    if (parent->state == PR_STATE_FULFILLED) {
+      pr_fulfill(pr, pr->resolve(&value));
+    } else {
+      pr_reject(pr, value);
+    }
+  } else { // PR_CONT_ELSE
+    if (parent->state == PR_STATE_BROKEN) {
+      pr_fulfill(pr, pr->resolve(&value));
+    } else {
+      pr_fulfill(pr, value);
+    }
+  }
+}
+
+// Schedules the continuation of a child whose parent just resolved.
+static void _pr_schedule(promise *child) {
+  if (child->kind == PR_CONT_NONE) {
+    return; // just a record of the relationship
+  }
+  if (PR_DISPATCH == NULL) {
+    _pr_run_continuation(child);
+  } else {
+    PR_DISPATCH(&_pr_run_continuation, child);
+  }
+}
+
+static void _pr_resolve(promise *pr, pr_state state, void *value) {
+  list *children;
+  size_t i;
+  pr_lock(pr);
+  if (pr->state != PR_STATE_UNRESOLVED) {
+    pr_unlock(pr);
+#ifdef DEBUG
+    fprintf(stderr, "Warning: Attempt to resolve an already-resolved promise.\n");
+#endif
+    return;
+  }
+  pr->state = state;
+  pr->value = value;
+  // Children added after this point see that we're resolved and schedule
+  // themselves (see _pr_continue).
+  children = create_list();
+  for (i = 0; i < l_get_length(pr->children); ++i) {
+    l_append_element(children, l_get_item(pr->children, i));
+  }
+  pr_unlock(pr);
+  for (i = 0; i < l_get_length(children); ++i) {
+    _pr_schedule((promise*) l_get_item(children, i));
+  }
+  cleanup_list(children);
+}
+
+// Creates a continuation promise of the given kind as a child of the given
+// promise.
+static promise* _pr_continue(
+  promise *pr,
+  pr_continuation kind,
+  void * (*f)(void **)
+) {
+  int resolved;
+  promise *child = create_promise();
+  child->kind = kind;
+  child->resolve = f;
+  l_append_element(child->parents, pr);
+  pr_lock(pr);
+  l_append_element(pr->children, child);
+  resolved = pr->state != PR_STATE_UNRESOLVED;
+  pr_unlock(pr);
+  if (resolved) {
+    _pr_schedule(child);
+  }
+  return child;
+}
 
 /******************************
  * Constructors & Destructors *
  ******************************/
 
-// Allocates and sets up a new unfulfilled promise:
-promise *create_promise();
+promise *create_promise(void) {
+  promise *result = (promise*) malloc(sizeof(promise));
+  if (result == NULL) {
+    perror("Failed to allocate promise");
+    exit(errno);
+  }
+  result->state = PR_STATE_UNRESOLVED;
+  result->value = NULL;
+  result->parents = create_list();
+  result->children = create_list();
+  result->kind = PR_CONT_NONE;
+  result->resolve = NULL;
+  omp_init_lock(&(result->lock));
+  return result;
+}
 
-// Frees the memory associated with a promise.
-CLEANUP_DECL(promise);
+CLEANUP_IMPL(promise) {
+  cleanup_list(doomed->parents);
+  cleanup_list(doomed->children);
+  omp_destroy_lock(&(doomed->lock));
+  free(doomed);
+}
 
 /***********
  * Locking *
  ***********/
 
-void pr_lock(promise *pr);
-void pr_unlock(promise *pr);
+void pr_lock(promise *pr) {
+  omp_set_lock(&(pr->lock));
+}
+
+void pr_unlock(promise *pr) {
+  omp_unset_lock(&(pr->lock));
+}
 
 /*************
  * Functions *
  *************/
 
-// Frees the memory associated with a promise, and also calls free on each
-// other promise that was waiting for this one. Warning: if something in the
-// destroyed promise chain is unfulfilled, work waiting for that will never
-// happen, and future attempts to act on destroyed promises can potentially
-// corrupt memory.
-void destroy_promise(promise *pr);
-
-// These functions test the state of a promise: it's always either unresolved,
-// fulfilled, or broken.
-int pr_is_unresolved(promise const * const pr);
-int pr_is_fulfilled(promise const * const pr);
-int pr_is_broken(promise const * const pr);
-
-// Returns the number of parents that this promise is waiting for.
-size_t pr_get_parent_count(promise const * const pr);
-
-// Returns the number of children waiting for the given promise.
-size_t pr_get_child_count(promise const * const pr);
-
-// Functions for adding/removing parents and children:
-void pr_add_parent(promise *pr);
-void pr_add_child(promise *pr);
-void pr_remove_parent(promise *pr, promise *parent);
-void pr_remove_child(promise *pr, promise *child);
-
-// Run the given function sequentially on each parent/child of the promise.
-void pr_foreach_parent(promise const * const pr, void (*f)(void *));
-void pr_foreach_child(promise const * const pr, void (*f)(void *));
-
-// Runs the given function sequentially on each parent/child of the promise
-// with the given extra argument as its second argument.
+void destroy_promise(promise *pr) {
+  size_t i;
+  promise *child;
+  for (i = 0; i < l_get_length(pr->children); ++i) {
+    child = (promise*) l_get_item(pr->children, i);
+    l_remove_element(child->parents, pr);
+    // Children shared with some other parent are left to that parent:
+    if (l_is_empty(child->parents)) {
+      destroy_promise(child);
+    }
+  }
+  for (i = 0; i < l_get_length(pr->parents); ++i) {
+    l_remove_element(
+      ((promise*) l_get_item(pr->parents, i))->children,
+      pr
+    );
+  }
+  cleanup_promise(pr);
+}
+
+int pr_is_unresolved(promise const * const pr) {
+  return pr->state == PR_STATE_UNRESOLVED;
+}
+
+int pr_is_fulfilled(promise const * const pr) {
+  return pr->state == PR_STATE_FULFILLED;
+}
+
+int pr_is_broken(promise const * const pr) {
+  return pr->state == PR_STATE_BROKEN;
+}
+
+void * pr_get_value(promise const * const pr) {
+  return pr->value;
+}
+
+size_t pr_get_parent_count(promise const * const pr) {
+  return l_get_length(pr->parents);
+}
+
+size_t pr_get_child_count(promise const * const pr) {
+  return l_get_length(pr->children);
+}
+
+void pr_add_parent(promise *pr, promise *parent) {
+  pr_add_child(parent, pr);
+}
+
+void pr_add_child(promise *pr, promise *child) {
+  pr_lock(pr);
+  l_append_element(pr->children, child);
+  pr_unlock(pr);
+  pr_lock(child);
+  l_append_element(child->parents, pr);
+  pr_unlock(child);
+}
+
+void pr_remove_parent(promise *pr, promise *parent) {
+  pr_remove_child(parent, pr);
+}
+
+void pr_remove_child(promise *pr, promise *child) {
+  pr_lock(pr);
+  l_remove_element(pr->children, child);
+  pr_unlock(pr);
+  pr_lock(child);
+  l_remove_element(child->parents, pr);
+  pr_unlock(child);
+}
+
+void pr_foreach_parent(promise const * const pr, void (*f)(void *)) {
+  l_foreach(pr->parents, f);
+}
+
+void pr_foreach_child(promise const * const pr, void (*f)(void *)) {
+  l_foreach(pr->children, f);
+}
+
 void pr_witheach_parent(
   promise const * const pr,
   void *arg,
   void (*f)(void *, void *)
-);
+) {
+  l_witheach(pr->parents, arg, f);
+}
+
 void pr_witheach_child(
   promise const * const pr,
   void *arg,
   void (*f)(void *, void *)
-);
+) {
+  l_witheach(pr->children, arg, f);
+}
+
+void pr_fulfill(promise *pr, void * value) {
+  _pr_resolve(pr, PR_STATE_FULFILLED, value);
+}
+
+void pr_reject(promise *pr, void * message) {
+  _pr_resolve(pr, PR_STATE_BROKEN, message);
+}
+
+promise * pr_then(promise *pr, void * (*f)(void **)) {
+  return _pr_continue(pr, PR_CONT_THEN, f);
+}
 
-// Primitives for manipulating promises:
-void pr_fulfill(promise *pr, void * value);
-void pr_reject(promise *pr, void * message);
+promise * pr_else(promise *pr, void * (*f)(void **)) {
+  return _pr_continue(pr, PR_CONT_ELSE, f);
+}
 
-// Creates a new promise as a child of this one that
-void pr_then(promise *pr, void * (*f)(void **));
-void pr_else(promise *pr, void * (*f)(void **));
+size_t pr_data_size(promise const * const pr) {
+  return sizeof(void*);
+}
 
-// Counts the number of bytes of data/overhead used by the given promise.
-size_t pr_data_size(promise const * const pr);
-size_t pr_overhead_size(promise const * const pr);
+size_t pr_overhead_size(promise const * const pr) {
+  return (
+    sizeof(promise) - sizeof(void*)
+  + l_data_size(pr->parents) + l_overhead_size(pr->parents)
+  + l_data_size(pr->children) + l_overhead_size(pr->children)
+  );
+}
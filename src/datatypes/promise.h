@@ -17,19 +17,34 @@
  **************/
 
 // The promise of a future value, which has perhaps already been computed.
-struct promsie_s;
-typedef struct promsie_s promsie;
+struct promise_s;
+typedef struct promise_s promise;
 
 // Note: promise_s is defined in promise.c, not here. This is intentional:
 // external code should only use promise pointers and shouldn't deal with the
 // internals of promises directly.
 
+// A task dispatcher runs the given task with the given argument at some point
+// in the future (possibly right away). See PR_DISPATCH.
+typedef void (*pr_dispatcher)(void (*task)(void *), void *arg);
+
+/***********
+ * Globals *
+ ***********/
+
+// Continuations created by pr_then and pr_else are handed to this dispatcher
+// once their parent promise resolves. If it's NULL (the default) they are run
+// immediately on the thread that resolves the parent. The jobs system
+// installs a dispatcher that runs them on its worker pool (see
+// jp_run_promises).
+extern pr_dispatcher PR_DISPATCH;
+
 /******************************
  * Constructors & Destructors *
  ******************************/
 
 // Allocates and sets up a new unfulfilled promise:
-promise *create_promise();
+promise *create_promise(void);
 
 // Frees the memory associated with a promise.
 CLEANUP_DECL(promise);
@@ -58,15 +73,21 @@ int pr_is_unresolved(promise const * const pr);
 int pr_is_fulfilled(promise const * const pr);
 int pr_is_broken(promise const * const pr);
 
+// Returns the value of a fulfilled promise or the message of a broken one
+// (NULL for an unresolved promise).
+void * pr_get_value(promise const * const pr);
+
 // Returns the number of parents that this promise is waiting for.
 size_t pr_get_parent_count(promise const * const pr);
 
 // Returns the number of children waiting for the given promise.
 size_t pr_get_child_count(promise const * const pr);
 
-// Functions for adding/removing parents and children:
-void pr_add_parent(promise *pr);
-void pr_add_child(promise *pr);
+// Functions for adding/removing parents and children. These only record the
+// relationship (in both promises); use pr_then/pr_else to create children
+// that do something when their parent resolves.
+void pr_add_parent(promise *pr, promise *parent);
+void pr_add_child(promise *pr, promise *child);
 void pr_remove_parent(promise *pr, promise *parent);
 void pr_remove_child(promise *pr, promise *child);
 
@@ -87,13 +108,21 @@ void pr_witheach_child(
   void (*f)(void *, void *)
 );
 
-// Primitives for manipulating promises:
+// Primitives for manipulating promises. Resolving a promise that's already
+// resolved does nothing (and prints a warning in DEBUG mode).
 void pr_fulfill(promise *pr, void * value);
 void pr_reject(promise *pr, void * message);
 
-// Creates a new promise as a child of this one that
-void pr_then(promise *pr, void * (*f)(void **));
-void pr_else(promise *pr, void * (*f)(void **));
+// Creates a new promise as a child of this one that will be resolved once this
+// one is. For pr_then, when this promise is fulfilled the given function is
+// called with a pointer to its value and the child is fulfilled with the
+// result; if this promise is broken the child is broken with the same message.
+// pr_else is the reverse: the function is called (and the child fulfilled
+// with its result) only if this promise is broken, with a pointer to the
+// message, and otherwise the child is fulfilled with this promise's value.
+// The function is run via PR_DISPATCH.
+promise * pr_then(promise *pr, void * (*f)(void **));
+promise * pr_else(promise *pr, void * (*f)(void **));
 
 // Counts the number of bytes of data/overhead used by the given promise.
 size_t pr_data_size(promise const * const pr);
@@ -1,14 +1,157 @@
 // rngtable.c
 // A table of values with weights for random selection.
 
-#ifdef DEBUG
-  #include <stdio.h>
-#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include "util.h"
 
 #include "rngtable.h"
 
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct rt_cache_s {
+  float total_weight; // the sum of all weights (in table order)
+  // Vose alias table: column i keeps its own entry with probability
+  // prob[i] and otherwise yields entry alias[i]:
+  float *prob;
+  size_t *alias;
+};
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Picks a uniform value in [0, total) from the given seed. Shared by all of
+// the selection methods so that they consume seeds the same way.
+static inline float rt_choice(ptrdiff_t seed, float total) {
+  return ptrf(prng(seed + 4680514)) * total;
+}
+
+static inline void rt_warn_ran_out(void) {
+#ifdef DEBUG
+  fprintf(
+    stderr,
+    "WARNING: Ran out of table when choosing a random entry in rngtable.\n"
+  );
+#endif
+}
+
+static void rt_cleanup_cache(rt_cache *cache) {
+  free(cache->prob);
+  free(cache->alias);
+  free(cache);
+}
+
+// Builds the cache for the given table using Vose's method.
+static rt_cache* rt_build_cache(rngtable const * const t) {
+  size_t i, s, l, n_small, n_large, last_large;
+  size_t *small, *large;
+  float *scaled;
+  rt_cache *result = (rt_cache*) malloc(sizeof(rt_cache));
+  if (result == NULL) {
+    perror("Failed to allocate rngtable cache.");
+    exit(errno);
+  }
+  result->total_weight = 0;
+  for (i = 0; i < t->size; ++i) {
+    result->total_weight += t->weights[i];
+  }
+  result->prob = (float*) malloc(t->size * sizeof(float));
+  result->alias = (size_t*) malloc(t->size * sizeof(size_t));
+  scaled = (float*) malloc(t->size * sizeof(float));
+  small = (size_t*) malloc(t->size * sizeof(size_t));
+  large = (size_t*) malloc(t->size * sizeof(size_t));
+  if (
+    (result->prob == NULL || result->alias == NULL || scaled == NULL)
+  || (small == NULL || large == NULL)
+  ) {
+    perror("Failed to allocate rngtable cache.");
+    exit(errno);
+  }
+
+  // Sort columns by whether they're under- or over-full:
+  n_small = 0;
+  n_large = 0;
+  last_large = 0;
+  for (i = 0; i < t->size; ++i) {
+    result->alias[i] = i;
+    if (result->total_weight > 0) {
+      scaled[i] = t->weights[i] * t->size / result->total_weight;
+    } else {
+      scaled[i] = 0;
+    }
+    if (scaled[i] < 1) {
+      small[n_small++] = i;
+    } else {
+      large[n_large++] = i;
+      last_large = i;
+    }
+  }
+  // Fill each under-full column from an over-full one:
+  while (n_small > 0 && n_large > 0) {
+    s = small[--n_small];
+    l = large[n_large - 1];
+    last_large = l;
+    result->prob[s] = scaled[s];
+    result->alias[s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1;
+    if (scaled[l] < 1) {
+      n_large -= 1;
+      small[n_small++] = l;
+    }
+  }
+  // Whatever is left over is full up to rounding error, except that entries
+  // with no weight at all must never be picked:
+  while (n_large > 0) {
+    result->prob[large[--n_large]] = 1;
+  }
+  while (n_small > 0) {
+    s = small[--n_small];
+    if (t->weights[s] > 0) {
+      result->prob[s] = 1;
+    } else {
+      result->prob[s] = 0;
+      result->alias[s] = last_large;
+    }
+  }
+
+  free(scaled);
+  free(small);
+  free(large);
+  return result;
+}
+
+// Returns the table's cache, building it if necessary. Threads that race to
+// build the cache each build one, and all but the first to be installed are
+// thrown away.
+static inline rt_cache* rt_get_cache(rngtable * const t) {
+  rt_cache *cache, *expected;
+  cache = __atomic_load_n(&(t->cache), __ATOMIC_ACQUIRE);
+  if (cache != NULL) {
+    return cache;
+  }
+  cache = rt_build_cache(t);
+  expected = NULL;
+  if (
+    !__atomic_compare_exchange_n(
+      &(t->cache),
+      &expected,
+      cache,
+      0,
+      __ATOMIC_ACQ_REL,
+      __ATOMIC_ACQUIRE
+    )
+  ) {
+    rt_cleanup_cache(cache);
+    cache = expected;
+  }
+  return cache;
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -18,6 +161,7 @@ rngtable *create_rngtable(size_t size) {
   result->size = size;
   result->values = (void**) calloc(size, sizeof(void*));
   result->weights = (float*) calloc(size, sizeof(float));
+  result->cache = NULL;
   return result;
 }
 
@@ -32,6 +176,7 @@ rngtable* copy_rngtable(rngtable *src) {
 }
 
 CLEANUP_IMPL(rngtable) {
+  rt_invalidate(doomed);
   free(doomed->values);
   free(doomed->weights);
   free(doomed);
@@ -41,18 +186,32 @@ CLEANUP_IMPL(rngtable) {
  * Functions *
  *************/
 
-void* rt_pick_result(rngtable const * const t, ptrdiff_t seed) {
-  float total_weight = 0;
-  float choice = 0;
+void rt_set_entry(rngtable *t, size_t i, void *value, float weight) {
+  t->values[i] = value;
+  t->weights[i] = weight;
+  rt_invalidate(t);
+}
+
+void rt_invalidate(rngtable *t) {
+  if (t->cache != NULL) {
+    rt_cleanup_cache(t->cache);
+    t->cache = NULL;
+  }
+}
+
+void* rt_pick_result(rngtable * const t, ptrdiff_t seed) {
+  rt_cache *cache;
+  float choice;
   size_t i;
-  for (i = 0; i < t->size; ++i) {
-    total_weight += t->weights[i];
+  if (t->size == 0) {
+    return NULL;
   }
-  if (total_weight == 0) {
+  cache = rt_get_cache(t);
+  if (cache->total_weight == 0) {
     return NULL;
   }
-  choice = ptrf(prng(seed + 4680514)) * total_weight;
-  total_weight = 0;
+#ifdef RNGTABLE_LEGACY_PICKS
+  choice = rt_choice(seed, cache->total_weight);
   for (i = 0; i < t->size; ++i) {
     choice -= t->weights[i];
     if (choice < 0) {
@@ -60,21 +219,32 @@ void* rt_pick_result(rngtable const * const t, ptrdiff_t seed) {
     }
   }
   // Shouldn't be possible to end up here...
-#ifdef DEBUG
-  fprintf(
-    stderr,
-    "WARNING: Ran out of table when choosing a random entry in rngtable.\n"
-  );
-#endif
+  rt_warn_ran_out();
   return NULL;
+#else
+  // One draw picks a column and a second decides between the column's own
+  // entry and its alias. The second draw takes an extra prng step because
+  // nearby seeds give correlated ptrf results:
+  choice = rt_choice(seed, t->size);
+  i = (size_t) choice;
+  if (i >= t->size) { // rounding
+    i = t->size - 1;
+  }
+  if (ptrf(prng(prng(seed + 4680514))) < cache->prob[i]) {
+    return t->values[i];
+  } else {
+    return t->values[cache->alias[i]];
+  }
+#endif
 }
 
 void* rt_pick_filtered_result(
-  rngtable const * const t,
+  rngtable * const t,
   void *arg,
   int (*filter)(void*, void*),
   ptrdiff_t seed
 ) {
+#ifdef RNGTABLE_LEGACY_PICKS
   float total_weight = 0;
   float choice = 0;
   size_t i;
@@ -86,8 +256,7 @@ void* rt_pick_filtered_result(
   if (total_weight == 0) {
     return NULL;
   }
-  choice = ptrf(prng(seed + 4680514)) * total_weight;
-  total_weight = 0;
+  choice = rt_choice(seed, total_weight);
   for (i = 0; i < t->size; ++i) {
     if (filter(t->values[i], arg)) {
       choice -= t->weights[i];
@@ -97,11 +266,55 @@ void* rt_pick_filtered_result(
     }
   }
   // Shouldn't be possible to end up here...
-#ifdef DEBUG
-  fprintf(
-    stderr,
-    "WARNING: Ran out of table when choosing a random entry in rngtable.\n"
-  );
-#endif
+  rt_warn_ran_out();
   return NULL;
+#else
+  float stack_sums[RT_FILTER_STACK_SIZE];
+  float *sums = stack_sums;
+  float total_weight = 0;
+  float choice = 0;
+  size_t i, lo, hi, mid;
+  void *result = NULL;
+
+  if (t->size > RT_FILTER_STACK_SIZE) {
+    sums = (float*) malloc(t->size * sizeof(float));
+    if (sums == NULL) {
+      perror("Failed to allocate rngtable filter buffer.");
+      exit(errno);
+    }
+  }
+  // Run the filter once per entry, recording running sums of the weights
+  // that pass (entries that fail add nothing and so can never be found by the
+  // search below):
+  for (i = 0; i < t->size; ++i) {
+    if (filter(t->values[i], arg)) {
+      total_weight += t->weights[i];
+    }
+    sums[i] = total_weight;
+  }
+  if (total_weight > 0) {
+    choice = rt_choice(seed, total_weight);
+    // Binary search for the first running sum that exceeds our choice:
+    lo = 0;
+    hi = t->size;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (sums[mid] > choice) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    if (lo < t->size) {
+      result = t->values[lo];
+    } else {
+      // Shouldn't be possible to end up here...
+      rt_warn_ran_out();
+    }
+  }
+  if (sums != stack_sums) {
+    free(sums);
+  }
+  return result;
+#endif
 }
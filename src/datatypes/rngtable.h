@@ -15,14 +15,29 @@
 struct rngtable_s;
 typedef struct rngtable_s rngtable;
 
+// Lookup data derived from a table's weights (only used internally):
+struct rt_cache_s;
+typedef struct rt_cache_s rt_cache;
+
+/*************
+ * Constants *
+ *************/
+
+// Filtered picks from tables up to this size don't need to allocate:
+#define RT_FILTER_STACK_SIZE 64
+
 /*************************
  * Structure Definitions *
  *************************/
 
+// Statically declared tables can leave the cache out (it starts out NULL and
+// is built on the first pick). Code that changes a table's entries after it
+// has been used must call rt_invalidate (or use rt_set_entry).
 struct rngtable_s {
   size_t size;
   void* *values;
   float *weights;
+  rt_cache *cache;
 };
 
 /******************************
@@ -44,17 +59,33 @@ CLEANUP_DECL(rngtable);
  * Functions *
  *************/
 
+// Sets the value and weight of the ith entry of the table, invalidating any
+// cached lookup data.
+void rt_set_entry(rngtable *t, size_t i, void *value, float weight);
+
+// Discards cached lookup data for the given table, which must be done after
+// its weights are changed directly. Must not be called while other threads
+// are picking from the table.
+void rt_invalidate(rngtable *t);
+
 // Picks a result from the table corresponding to the given seed. Returns NULL
-// if the table is empty. Note that the resolution of the selection algorithm
-// is a bit limited, so some distortion is expected when very small weights (in
-// relation to the total weight) are used.
-void* rt_pick_result(rngtable const * const t, ptrdiff_t seed);
+// if the table is empty. Picks take constant time using an alias table which
+// is built on the first pick. Note that the resolution of the selection
+// algorithm is a bit limited, so some distortion is expected when very small
+// weights (in relation to the total weight) are used.
+//
+// Results are deterministic for a given seed. Compile with
+// RNGTABLE_LEGACY_PICKS defined to get the same results as the original
+// linear-scan selection (needed to reproduce worlds generated before the
+// alias tables were added).
+void* rt_pick_result(rngtable * const t, ptrdiff_t seed);
 
 // Works just like rt_pick_result, but only uses elements from the table that
 // pass the given filter function (given a table element as the first argument
-// and the fixed argument as the second argument).
+// and the fixed argument as the second argument). The filter is called exactly
+// once per table entry.
 void* rt_pick_filtered_result(
-  rngtable const * const t,
+  rngtable * const t,
   void *arg,
   int (*filter)(void*, void*),
   ptrdiff_t seed
@@ -0,0 +1,151 @@
+// test_heightmap_perf.c
+// heightmap kernel throughput testing
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "util.h"
+
+#include "heightmap.h"
+
+// Each kernel is run repeatedly until at least this much time has passed:
+#define MIN_SECONDS 0.5
+
+// Flow simulation steps used by the flow and erosion benchmarks (matches
+// TR_BUILD_EROSION_FLOW_STEPS):
+#define FLOW_STEPS 6
+
+static size_t const SIZES[] = { 1024, 4096 };
+
+heightmap *TOPO, *PRECIP, *MODULATE, *FILL, *BUF_A, *BUF_B, *BUF_C;
+heightmap *GAUSS, *SHARPEN;
+
+static void fill_random(heightmap *hm, ptrdiff_t seed, float min, float max) {
+  size_t i;
+  for (i = 0; i < hm->width * hm->height; ++i) {
+    seed = prng(seed);
+    hm->data[i] = randf(seed, min, max);
+  }
+}
+
+// Builds a smooth random terrain (white noise blurred a few times), since the
+// data-dependent kernels behave quite differently on pure noise.
+static void fill_terrain(heightmap *hm, ptrdiff_t seed) {
+  size_t i;
+  fill_random(hm, seed, 0, 1);
+  for (i = 0; i < 4; ++i) {
+    hm_convolve(hm, GAUSS, BUF_A);
+  }
+  hm_normalize(hm);
+}
+
+static void setup_filters(void) {
+  size_t i, j;
+  static float const BINOMIAL[] = { 1, 4, 6, 4, 1 };
+  GAUSS = create_heightmap(5, 5);
+  SHARPEN = create_heightmap(5, 5);
+  for (i = 0; i < 5; ++i) {
+    for (j = 0; j < 5; ++j) {
+      GAUSS->data[i + 5*j] = BINOMIAL[i] * BINOMIAL[j];
+      SHARPEN->data[i + 5*j] = -BINOMIAL[i] - BINOMIAL[j];
+    }
+  }
+  SHARPEN->data[2 + 5*2] = 64;
+}
+
+static void run_convolve_separable(void) { hm_convolve(TOPO, GAUSS, BUF_A); }
+
+static void run_convolve_full(void) { hm_convolve(TOPO, SHARPEN, BUF_A); }
+
+static void run_slump(void) {
+  hm_reset(BUF_A);
+  hm_slump(TOPO, BUF_A, 0.005, 0.3);
+}
+
+static void run_add_limited(void) { hm_add_limited(TOPO, FILL, BUF_A); }
+
+static void run_flows(void) {
+  hm_reset(BUF_A);
+  hm_reset(BUF_B);
+  hm_reset(BUF_C);
+  hm_compute_flows(TOPO, PRECIP, BUF_A, BUF_B, BUF_C, FLOW_STEPS);
+}
+
+static void run_erode(void) {
+  hm_reset(BUF_A);
+  hm_reset(BUF_B);
+  hm_reset(BUF_C);
+  hm_erode(
+    TOPO,
+    MODULATE,
+    PRECIP,
+    BUF_A,
+    BUF_B,
+    BUF_C,
+    FLOW_STEPS,
+    FLOW_STEPS,
+    0.15,
+    0.3,
+    0.2,
+    0.85
+  );
+}
+
+static void bench(char const * const name, size_t size, void (*kernel)(void)) {
+  size_t reps = 0;
+  double start, elapsed;
+  fill_terrain(TOPO, 81723 + size);
+  kernel(); // warm up (and let any scratch space get allocated)
+  start = omp_get_wtime();
+  do {
+    kernel();
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  printf(
+    "%-20s %5zu^2: %10.2f Mpixels/s (%8.3f ms/call)\n",
+    name,
+    size,
+    (size * size * reps) / elapsed / 1000000.0,
+    elapsed * 1000.0 / reps
+  );
+}
+
+int main(int argc, char** argv) {
+  size_t i, size;
+  setup_filters();
+  printf("Using up to %d threads.\n", omp_get_max_threads());
+  for (i = 0; i < sizeof(SIZES) / sizeof(size_t); ++i) {
+    size = SIZES[i];
+    TOPO = create_heightmap(size, size);
+    PRECIP = create_heightmap(size, size);
+    MODULATE = create_heightmap(size, size);
+    FILL = create_heightmap(size, size);
+    BUF_A = create_heightmap(size, size);
+    BUF_B = create_heightmap(size, size);
+    BUF_C = create_heightmap(size, size);
+    fill_random(PRECIP, 1712, 0.4, 0.6);
+    fill_random(MODULATE, 55109, 0, 1);
+    fill_random(FILL, 30013, -0.05, 0.05);
+
+    bench("convolve (5x5 sep)", size, &run_convolve_separable);
+    bench("convolve (5x5 full)", size, &run_convolve_full);
+    bench("slump", size, &run_slump);
+    bench("add_limited", size, &run_add_limited);
+    bench("compute_flows (x6)", size, &run_flows);
+    bench("erode", size, &run_erode);
+
+    cleanup_heightmap(TOPO);
+    cleanup_heightmap(PRECIP);
+    cleanup_heightmap(MODULATE);
+    cleanup_heightmap(FILL);
+    cleanup_heightmap(BUF_A);
+    cleanup_heightmap(BUF_B);
+    cleanup_heightmap(BUF_C);
+  }
+  cleanup_heightmap(GAUSS);
+  cleanup_heightmap(SHARPEN);
+  return 0;
+}
@@ -0,0 +1,124 @@
+// test_mpmc_queue_perf.c
+// Compares the omp-locked queue against the lock-free MPMC queue under
+// contention.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <omp.h>
+
+#include "queue.h"
+#include "mpmc_queue.h"
+
+// Each configuration is run repeatedly until at least this much time has
+// passed:
+#define MIN_SECONDS 0.5
+
+// Push/pop pairs per thread per run:
+#define OPS_PER_THREAD 200000
+
+// Capacity of the MPMC queue (and the number of elements both queues start
+// with, so that pops don't usually find an empty queue):
+#define CAPACITY 4096
+#define PREFILL 1024
+
+static int const THREAD_COUNTS[] = { 1, 2, 4, 8, 16, 0 };
+
+// Every thread alternates between pushing and popping, the way the chunk
+// pipelines have a mix of producers and consumers:
+static void run_locked(queue *q, int n_threads) {
+#pragma omp parallel num_threads(n_threads)
+  {
+    size_t i;
+    uintptr_t v = 1;
+    for (i = 0; i < OPS_PER_THREAD; ++i) {
+      q_lock(q);
+      q_push_element(q, (void*) v);
+      q_unlock(q);
+      q_lock(q);
+      v = (uintptr_t) q_pop_element(q);
+      q_unlock(q);
+    }
+  }
+}
+
+static void run_mpmc(mpmc_queue *q, int n_threads) {
+#pragma omp parallel num_threads(n_threads)
+  {
+    size_t i;
+    uintptr_t v = 1;
+    for (i = 0; i < OPS_PER_THREAD; ++i) {
+      while (!mq_push_element(q, (void*) v)) {}
+      v = (uintptr_t) mq_pop_element(q);
+      if (v == 0) {
+        v = 1;
+      }
+    }
+  }
+}
+
+static void report(
+  char const * const name,
+  int n_threads,
+  size_t reps,
+  double elapsed
+) {
+  double ops = 2.0 * reps * n_threads * OPS_PER_THREAD;
+  printf(
+    "%-12s %3d thread(s) %8.1f ns/op %12.0f ops/s\n",
+    name,
+    n_threads,
+    elapsed * 1000000000.0 / ops,
+    ops / elapsed
+  );
+}
+
+static void bench_locked(int n_threads) {
+  size_t i, reps = 0;
+  double start, elapsed;
+  queue *q = create_queue();
+  for (i = 0; i < PREFILL; ++i) {
+    q_push_element(q, (void*) 1);
+  }
+  start = omp_get_wtime();
+  do {
+    run_locked(q, n_threads);
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  report("omp lock", n_threads, reps, elapsed);
+  cleanup_queue(q);
+}
+
+static void bench_mpmc(int n_threads) {
+  size_t i, reps = 0;
+  double start, elapsed;
+  mpmc_queue *q = create_mpmc_queue(CAPACITY);
+  for (i = 0; i < PREFILL; ++i) {
+    mq_push_element(q, (void*) 1);
+  }
+  start = omp_get_wtime();
+  do {
+    run_mpmc(q, n_threads);
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  report("lock-free", n_threads, reps, elapsed);
+  cleanup_mpmc_queue(q);
+}
+
+int main(int argc, char** argv) {
+  size_t i;
+  omp_set_dynamic(0);
+  printf(
+    "%d push/pop pairs per thread, %d processors available.\n",
+    OPS_PER_THREAD,
+    omp_get_num_procs()
+  );
+  for (i = 0; THREAD_COUNTS[i] != 0; ++i) {
+    bench_locked(THREAD_COUNTS[i]);
+    bench_mpmc(THREAD_COUNTS[i]);
+  }
+  return 0;
+}
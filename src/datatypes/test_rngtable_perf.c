@@ -0,0 +1,187 @@
+// test_rngtable_perf.c
+// rngtable selection throughput testing
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <omp.h>
+
+#include "util.h"
+
+#include "rngtable.h"
+
+// Each test is run repeatedly until at least this much time has passed:
+#define MIN_SECONDS 0.5
+
+// Picks per timing batch:
+#define BATCH 100000
+
+static size_t const SIZES[] = { 3, 8, 64, 1024 };
+
+// Sink for results so that the picks can't be optimized away:
+static volatile size_t SINK = 0;
+
+// The selection loop from before alias tables were added, for comparison:
+static void* linear_pick(rngtable *t, ptrdiff_t seed) {
+  float total_weight = 0;
+  float choice;
+  size_t i;
+  for (i = 0; i < t->size; ++i) {
+    total_weight += t->weights[i];
+  }
+  if (total_weight == 0) {
+    return NULL;
+  }
+  choice = ptrf(prng(seed + 4680514)) * total_weight;
+  for (i = 0; i < t->size; ++i) {
+    choice -= t->weights[i];
+    if (choice < 0) {
+      return t->values[i];
+    }
+  }
+  return NULL;
+}
+
+// The filtered selection loop from before, which runs the filter twice:
+static void* linear_filtered_pick(
+  rngtable *t,
+  void *arg,
+  int (*filter)(void*, void*),
+  ptrdiff_t seed
+) {
+  float total_weight = 0;
+  float choice;
+  size_t i;
+  for (i = 0; i < t->size; ++i) {
+    if (filter(t->values[i], arg)) {
+      total_weight += t->weights[i];
+    }
+  }
+  if (total_weight == 0) {
+    return NULL;
+  }
+  choice = ptrf(prng(seed + 4680514)) * total_weight;
+  for (i = 0; i < t->size; ++i) {
+    if (filter(t->values[i], arg)) {
+      choice -= t->weights[i];
+      if (choice < 0) {
+        return t->values[i];
+      }
+    }
+  }
+  return NULL;
+}
+
+// Lets through entries whose value is a multiple of the argument:
+static int filter_multiples(void *v_value, void *v_arg) {
+  return ((size_t) v_value) % ((size_t) v_arg) == 0;
+}
+
+// Called through a volatile pointer so that the old loops can't inline the
+// filter (real filters live in other files):
+static int (* volatile FILTER)(void*, void*) = &filter_multiples;
+
+static void run_linear(rngtable *t, ptrdiff_t seed) {
+  SINK += (size_t) linear_pick(t, seed);
+}
+
+static void run_alias(rngtable *t, ptrdiff_t seed) {
+  SINK += (size_t) rt_pick_result(t, seed);
+}
+
+static void run_linear_filtered(rngtable *t, ptrdiff_t seed) {
+  SINK += (size_t) linear_filtered_pick(
+    t,
+    (void*) 2,
+    FILTER,
+    seed
+  );
+}
+
+static void run_filtered(rngtable *t, ptrdiff_t seed) {
+  SINK += (size_t) rt_pick_filtered_result(
+    t,
+    (void*) 2,
+    FILTER,
+    seed
+  );
+}
+
+static void bench(
+  char const * const name,
+  rngtable *t,
+  void (*pick)(rngtable*, ptrdiff_t)
+) {
+  size_t i, reps = 0;
+  ptrdiff_t seed = 1771;
+  double start, elapsed;
+  start = omp_get_wtime();
+  do {
+    for (i = 0; i < BATCH; ++i) {
+      pick(t, seed);
+      seed = prng(seed);
+    }
+    reps += BATCH;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  printf(
+    "%-14s %5zu entries: %8.2f Mpicks/s (%7.1f ns/pick)\n",
+    name,
+    t->size,
+    reps / elapsed / 1000000.0,
+    elapsed * 1000000000.0 / reps
+  );
+}
+
+// Compares observed pick frequencies against the table's weights and prints
+// the largest relative error among entries expected to be picked at least
+// 1000 times (fewer picks are too noisy to say much).
+static void check_distribution(rngtable *t) {
+  size_t i, n = 4000000;
+  size_t *counts = (size_t*) calloc(t->size, sizeof(size_t));
+  float total = 0, expected, err, worst = 0;
+  ptrdiff_t seed = 88111;
+  for (i = 0; i < t->size; ++i) {
+    total += t->weights[i];
+  }
+  for (i = 0; i < n; ++i) {
+    counts[(size_t) rt_pick_result(t, seed)] += 1;
+    seed = prng(seed);
+  }
+  for (i = 0; i < t->size; ++i) {
+    expected = n * t->weights[i] / total;
+    if (expected >= 1000) {
+      err = fabs(counts[i] - expected) / expected;
+      if (err > worst) {
+        worst = err;
+      }
+    } else if (t->weights[i] == 0 && counts[i] > 0) {
+      printf("  ERROR: zero-weight entry %zu was picked!\n", i);
+    }
+  }
+  printf("  worst relative frequency error: %.4f\n", worst);
+  free(counts);
+}
+
+int main(int argc, char** argv) {
+  size_t i, j, size;
+  ptrdiff_t seed = 6151;
+  rngtable *t;
+  for (i = 0; i < sizeof(SIZES) / sizeof(size_t); ++i) {
+    size = SIZES[i];
+    t = create_rngtable(size);
+    for (j = 0; j < size; ++j) {
+      seed = prng(seed);
+      // Values are indices; every fifth entry gets no weight:
+      rt_set_entry(t, j, (void*) j, (j % 5 == 4) ? 0 : randf(seed, 0.2, 3.0));
+    }
+    bench("linear (old)", t, &run_linear);
+    bench("alias", t, &run_alias);
+    bench("filtered (old)", t, &run_linear_filtered);
+    bench("filtered", t, &run_filtered);
+    check_distribution(t);
+    cleanup_rngtable(t);
+  }
+  return 0;
+}
@@ -26,7 +26,7 @@ void update_growth(block *b) {
 void grow_block(chunk_neighborhood *nbh, block_index idx, ptrdiff_t t) {
   global_pos cell_position;
   chunk *c = nbh->members[NBH_CENTER];
-  block *b = c_block(c, idx);
+  block *b = c_edit_block(c, idx);
   cidx__glpos(c, &idx, &cell_position);
   ptrdiff_t growth_rate = get_growth_rate(*b);
   ptrdiff_t growth_offset = posmod(cell_hash(&cell_position), growth_rate);
@@ -48,7 +48,7 @@ void grow_at_site(
 ) {
   global_pos cell_position;
   chunk *c = nbh->members[NBH_CENTER];
-  block *b = c_block(c, idx);
+  block *b = c_edit_block(c, idx);
   block_data sprout_timer = 0;
   cidx__glpos(c, &idx, &cell_position);
   // TODO: We'll probably need this...
@@ -75,7 +75,7 @@ void grow_from_core(
   global_pos cell_position;
   chunk *c = nbh->members[NBH_CENTER];
   // TODO: We'll need this.
-  // block *b = c_block(c, idx);
+  // block *b = c_edit_block(c, idx);
   cidx__glpos(c, &idx, &cell_position);
   // TODO: Implement growth algorithm here!
 }
@@ -84,7 +84,7 @@ int grow_plants(chunk *c, ptrdiff_t cycles) {
   chunk_neighborhood nbh;
   block_index idx;
   ptrdiff_t t;
-  cell* cl;
+  uint32_t i, n;
   block* b;
 
   fill_chunk_neighborhood(&(c->glcpos), &nbh);
@@ -92,31 +92,19 @@ int grow_plants(chunk *c, ptrdiff_t cycles) {
     return 0; // failure: insufficient data
   }
 
-  // TODO: A find-into-list, then iterate-over-list approach might be more
-  // efficient? Probably worse for lots of low-t updates, but better for a few
-  // high-t updates.
-
   // loop forward in time growing things as necessary:
   for (t = c->growth_counter; t < c->growth_counter + cycles; ++t) {
-    for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
-      for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
-        for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
-          cl = c_cell(c, idx);
-
-          idx.xyz.w = 0;
-          b = &(cl->blocks[0]);
-          if (bi_grws(*b)) {
-            update_growth(b);
-            grow_block(&nbh, idx, t);
-          }
-
-          idx.xyz.w = 1;
-          b = &(cl->blocks[1]);
-          if (bi_grws(*b)) {
-            update_growth(b);
-            grow_block(&nbh, idx, t);
-          }
-        }
+    // Only visit blocks that can grow, in the same order that a full scan of
+    // the chunk would. Blocks noted during a cycle (growth may add new ones)
+    // get picked up starting with the next cycle.
+    c_refresh_growth_index(c);
+    n = c->growing.count;
+    for (i = 0; i < n; ++i) {
+      idx = c->growing.entries[i];
+      b = c_edit_block(c, idx);
+      if (bi_grws(*b)) {
+        update_growth(b);
+        grow_block(&nbh, idx, t);
       }
     }
   }
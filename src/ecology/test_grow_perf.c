@@ -0,0 +1,184 @@
+// test_grow_perf.c
+// Compares full-chunk-scan growth against indexed growth on generated chunks.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "util.h"
+
+#include "datatypes/string.h"
+#include "world/blocks.h"
+#include "world/world.h"
+#include "world/species.h"
+#include "data/data.h"
+#include "data/persist.h"
+#include "gen/worldgen.h"
+#include "gen/terrain.h"
+#include "math/manifold.h"
+
+#include "grow.h"
+
+// How many surface chunks to generate:
+#define N_CHUNKS 32
+
+// Growth cycles per chunk per timing run (add_biology uses 2):
+#define CYCLES 2
+
+// Each path is timed repeatedly until at least this much time has passed:
+#define MIN_SECONDS 0.5
+
+chunk *CHUNKS[N_CHUNKS];
+
+static size_t VISITED = 0;
+
+// The visiting loop that grow_plants used before chunks had growth indices
+// (grow_block is left out since it needs a loaded neighborhood):
+static void grow_by_scan(chunk *c, ptrdiff_t cycles) {
+  block_index idx;
+  ptrdiff_t t;
+  cell *cl;
+  block *b;
+  for (t = 0; t < cycles; ++t) {
+    for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
+      for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
+        for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
+          cl = c_cell(c, idx);
+
+          idx.xyz.w = 0;
+          b = &(cl->blocks[0]);
+          if (bi_grws(*b)) {
+            update_growth(b);
+            VISITED += 1;
+          }
+
+          idx.xyz.w = 1;
+          b = &(cl->blocks[1]);
+          if (bi_grws(*b)) {
+            update_growth(b);
+            VISITED += 1;
+          }
+        }
+      }
+    }
+  }
+}
+
+// The same work using the chunk's growth index:
+static void grow_by_index(chunk *c, ptrdiff_t cycles) {
+  ptrdiff_t t;
+  uint32_t i, n;
+  block *b;
+  for (t = 0; t < cycles; ++t) {
+    c_refresh_growth_index(c);
+    n = c->growing.count;
+    for (i = 0; i < n; ++i) {
+      b = c_block(c, c->growing.entries[i]);
+      if (bi_grws(*b)) {
+        update_growth(b);
+        VISITED += 1;
+      }
+    }
+  }
+}
+
+// Like grow_by_index, but as if the chunk had just been loaded from disk.
+static void grow_by_rebuilt_index(chunk *c, ptrdiff_t cycles) {
+  c_invalidate_growth_index(c);
+  grow_by_index(c, cycles);
+}
+
+// Generates a chunk at the terrain surface somewhere in the world and puts
+// seeds on top of its natural terrain the way add_biology would.
+static chunk* surface_chunk(ptrdiff_t seed) {
+  global_pos glpos;
+  global_chunk_pos glcpos;
+  manifold_point dontcare, th;
+  block_index idx;
+  cell *cl, *above;
+  chunk *c;
+
+  glpos.x = posmod(seed, WORLD_WIDTH * WORLD_REGION_BLOCKS);
+  seed = prng(seed);
+  glpos.y = posmod(seed, WORLD_HEIGHT * WORLD_REGION_BLOCKS);
+  glpos.z = 0;
+  glpos.w = 0;
+  compute_terrain_height(THE_WORLD, &glpos, &dontcare, &dontcare, &th);
+  glpos.z = (gl_pos_t) th.z;
+  glpos__glcpos(&glpos, &glcpos);
+
+  c = create_chunk(&glcpos);
+  generate_chunk(c);
+
+  idx.xyz.w = 0;
+  for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
+    for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
+      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE - 1; ++idx.xyz.z) {
+        cl = c_edit_cell(c, idx);
+        idx.xyz.z += 1;
+        above = c_cell(c, idx);
+        idx.xyz.z -= 1;
+        if (
+          b_is_natural_terrain(cl->blocks[0])
+       && b_id(above->blocks[0]) == B_AIR
+       && b_is_void(cl->blocks[1])
+        ) {
+          cl->blocks[1] = b_make_block(B_GRASS_SEEDS);
+          idx.xyz.w = 1;
+          c_note_growing_block(c, idx);
+          idx.xyz.w = 0;
+        }
+      }
+    }
+  }
+  return c;
+}
+
+static void bench(char const * const name, void (*grow)(chunk*, ptrdiff_t)) {
+  size_t i, reps = 0;
+  double start, elapsed;
+  VISITED = 0;
+  start = omp_get_wtime();
+  do {
+    for (i = 0; i < N_CHUNKS; ++i) {
+      grow(CHUNKS[i], CYCLES);
+    }
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  printf(
+    "%-20s %9.1f us/chunk (%zu growing blocks visited per chunk-cycle)\n",
+    name,
+    elapsed * 1000000.0 / (reps * N_CHUNKS),
+    VISITED / (reps * N_CHUNKS * CYCLES)
+  );
+}
+
+int main(int argc, char** argv) {
+  size_t i;
+  ptrdiff_t seed = 17712;
+
+  init_strings();
+  init_blocks();
+  setup_data();
+  setup_persist(PS_DEFAULT_WORLD_DIR);
+  setup_species();
+  setup_worldgen(1821271);
+
+  printf("Generating %d surface chunks...\n", N_CHUNKS);
+  for (i = 0; i < N_CHUNKS; ++i) {
+    CHUNKS[i] = surface_chunk(seed);
+    seed = prng(seed + i);
+  }
+
+  bench("full scan (old)", &grow_by_scan);
+  bench("growth index", &grow_by_index);
+  bench("rebuilt index", &grow_by_rebuilt_index);
+
+  for (i = 0; i < N_CHUNKS; ++i) {
+    cleanup_chunk(CHUNKS[i]);
+  }
+  cleanup_worldgen();
+  return 0;
+}
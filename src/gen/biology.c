@@ -13,6 +13,8 @@
 
 #include "data/data.h"
 
+#include "prof/ptrace.h"
+
 #include "biology.h"
 
 
@@ -420,75 +422,38 @@ void setup_biology_gen(void) {
   add_sprout_grammar(B_YOUNG_CORAL, B_VOID, B_CORAL_CORE, B_SAND, 1, 1);
 }
 
-void add_biology(chunk *c) {
-  world_map_pos wmpos;
-  world_region *wr, *wr_second;
-  float strbest, strsecond;
-  world_region *wr_neighborhood[9];
-  biome *local_biome;
+void place_seeds(chunk *c, chunk_neighborhood *ch_nbh, biome *local_biome) {
   list *sp_list;
   frequent_species fqsp;
-  chunk_neighborhood ch_nbh;
-  cell_neighborhood cl_nbh;
-  cell* cl;
+  chunk *c_below = ch_nbh->members[NBH_CENTER - NBH_DIR_UD];
+  chunk *c_above = ch_nbh->members[NBH_CENTER + NBH_DIR_UD];
+  cell *cl, *cl_below, *cl_above;
   block_index idx;
   block substrate;
   global_pos glpos;
   ptrdiff_t seed_hash = prng(chunk_hash(c) + 616485);
   ptrdiff_t spacing_hash = prng(THE_WORLD->seed + 44544);
 
-  if (c->chunk_flags & CF_HAS_BIOLOGY) {
-    return; // Already has biology
-  }
-  fill_chunk_neighborhood(&(c->glcpos), &ch_nbh);
-  if (ch_nbh.members[0] == NULL) {
-    return; // Return without setting the CF_HAS_BIOLOGY flag.
-  }
-  // Look up the local biomes:
-  glcpos__wmpos(&(c->glcpos), &wmpos);
-  // TODO: Avoid using THE_WORLD here?
-  wr = get_world_region(THE_WORLD, &wmpos);
-  if (wr == NULL) {
-    // TODO: Go farther here?
-    return; // outside the world map: no biology
-  }
-  get_world_neighborhood_small(THE_WORLD, &wmpos, wr_neighborhood);
-  // Use the center of our chunk to compute region contenders:
-  idx.xyz.x = CHUNK_SIZE / 2;
-  idx.xyz.y = CHUNK_SIZE / 2;
-  idx.xyz.z = CHUNK_SIZE / 2;
-  idx.xyz.w = 0;
-  cidx__glpos(c, &idx, &glpos);
-  compute_region_contenders(
-    THE_WORLD,
-    wr_neighborhood,
-    &glpos,
-    1232331,
-    &wr,
-    &wr_second,
-    &strbest,
-    &strsecond
-  );
-  // Mix biomes for this chunk:
-  local_biome = create_merged_biome(
-    wr,
-    wr_second,
-    strbest,
-    strsecond
-  );
-  // Add seeds:
   idx.xyz.w = 0;
   for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
     for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
+      // Walk up this column keeping a window of the cells just below and just
+      // above the current cell; only the ends of the column reach into the
+      // chunks below and above.
+      idx.xyz.z = CHUNK_SIZE - 1;
+      cl_below = c_cell(c_below, idx);
+      idx.xyz.z = 0;
+      cl = c_cell(c, idx);
+      cidx__glpos(c, &idx, &glpos);
       for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
-        // Get global cell position for hashing:
-        cidx__glpos(c, &idx, &glpos);
-        // TODO: optimize this within a loop...
-        fill_cell_neighborhood_exact(idx, &ch_nbh, &cl_nbh);
-
-        cl = cl_nbh.members[NBH_CENTER];
-        // Array is in xyz order so up/down is +/- 1, north/south is +/- 3, and
-        // east/west is +/- 9.
+        if (idx.xyz.z < CHUNK_SIZE - 1) {
+          // (in a uniform chunk every cell is the same cell)
+          cl_above = cl + (c_is_uniform(c) ? 0 : CHUNK_SIZE * CHUNK_SIZE);
+        } else {
+          idx.xyz.z = 0;
+          cl_above = c_cell(c_above, idx);
+          idx.xyz.z = CHUNK_SIZE - 1;
+        }
 
         // If our secondary is empty we can put a seed here: figure out what
         // distribution to draw from.
@@ -497,21 +462,19 @@ void add_biology(chunk *c) {
           if (b_id(cl->blocks[0]) == B_AIR) {
             // Ephemeral species seeds settle in the air directly on top of
             // dirt/sand/mud/etc.
-            substrate = cl_nbh.members[NBH_CENTER - NBH_DIR_UD]->blocks[0];
+            substrate = cl_below->blocks[0];
             if (b_is_natural_terrain(substrate)) {
               sp_list = local_biome->ephemeral_terrestrial_flora;
             }
           } else if (b_id(cl->blocks[0]) == B_WATER) {
             // Aquatic ephemeral species start in water above dirt/sand/mud/etc.
-            substrate = cl_nbh.members[NBH_CENTER - NBH_DIR_UD]->blocks[0];
+            substrate = cl_below->blocks[0];
             if (b_is_natural_terrain(substrate)) {
               sp_list = local_biome->ephemeral_aquatic_flora;
             }
           } else if (b_is_natural_terrain(cl->blocks[0])) {
             substrate = cl->blocks[0];
-            if (
-              b_id(cl_nbh.members[NBH_CENTER + NBH_DIR_UD]->blocks[0]) == B_AIR
-            ) {
+            if (b_id(cl_above->blocks[0]) == B_AIR) {
               // Most terrestrial species sprout in the ground with air above.
               // TODO: Subterranean species!
               // Select between spacings:
@@ -524,9 +487,7 @@ void add_biology(chunk *c) {
               } else {
                 sp_list = local_biome->ubiquitous_terrestrial_flora;
               }
-            } else if (
-              b_id(cl_nbh.members[NBH_CENTER + NBH_DIR_UD]->blocks[0]) ==B_WATER
-            ) {
+            } else if (b_id(cl_above->blocks[0]) == B_WATER) {
               // Aquatic plants sprout from seeds in terrain below water.
               // Select between spacings:
               if (wide_spacing_hit(glpos, spacing_hash)) {
@@ -538,9 +499,7 @@ void add_biology(chunk *c) {
               } else {
                 sp_list = local_biome->ubiquitous_aquatic_flora;
               }
-            } else if (
-              b_id(cl_nbh.members[NBH_CENTER - NBH_DIR_UD]->blocks[0]) == B_AIR
-            ) {
+            } else if (b_id(cl_below->blocks[0]) == B_AIR) {
               // Some plants can also grow down into air from ceilings.
               sp_list = local_biome->hanging_terrestrial_flora;
             }
@@ -554,12 +513,26 @@ void add_biology(chunk *c) {
               seed_hash
             );
             if (frequent_species_species_type(fqsp) != SPT_NO_SPECIES) {
+              if (c_is_uniform(c)) {
+                // The first seed in a uniform chunk needs a cell array (the
+                // window cells that were the fill cell still hold the right
+                // values):
+                cl = c_edit_cell(c, idx);
+                if (idx.xyz.z < CHUNK_SIZE - 1) {
+                  cl_above = cl + CHUNK_SIZE * CHUNK_SIZE;
+                }
+              }
               cl->blocks[1] = b_make_species(
                 seed_block_type(frequent_species_species_type(fqsp)),
                 frequent_species_species(fqsp)
               );
               // TODO: Real sprout timers...
               gri_set_sprout_timer(&(cl->blocks[1]), 1);
+              if (bi_grws(cl->blocks[1])) {
+                idx.xyz.w = 1;
+                c_note_growing_block(c, idx);
+                idx.xyz.w = 0;
+              }
               seed_hash = prng(
                 idx.xyz.x + idx.xyz.y + glpos.z +
                 prng(seed_hash + glpos.x + glpos.y + idx.xyz.z)
@@ -567,11 +540,71 @@ void add_biology(chunk *c) {
             }
           }
         }
+
+        // Slide the window up:
+        cl_below = cl;
+        cl = cl_above;
+        glpos.z += 1;
       }
     }
   }
-  // Clean up the local biome info now that we're done with it:
-  cleanup_biome(local_biome);
+}
+
+void add_biology(chunk *c) {
+  world_map_pos wmpos;
+  world_region *wr, *wr_second;
+  float strbest, strsecond;
+  world_region *wr_neighborhood[9];
+  biome *local_biome;
+  chunk_neighborhood ch_nbh;
+  block_index idx;
+  global_pos glpos;
+  TRACE_SCOPE("biology");
+
+  if (c->chunk_flags & CF_HAS_BIOLOGY) {
+    return; // Already has biology
+  }
+  fill_chunk_neighborhood(&(c->glcpos), &ch_nbh);
+  if (ch_nbh.members[0] == NULL) {
+    return; // Return without setting the CF_HAS_BIOLOGY flag.
+  }
+  // Look up the local biomes:
+  glcpos__wmpos(&(c->glcpos), &wmpos);
+  // TODO: Avoid using THE_WORLD here?
+  wr = get_world_region(THE_WORLD, &wmpos);
+  if (wr == NULL) {
+    // TODO: Go farther here?
+    return; // outside the world map: no biology
+  }
+  get_world_neighborhood_small(THE_WORLD, &wmpos, wr_neighborhood);
+  // Use the center of our chunk to compute region contenders:
+  idx.xyz.x = CHUNK_SIZE / 2;
+  idx.xyz.y = CHUNK_SIZE / 2;
+  idx.xyz.z = CHUNK_SIZE / 2;
+  idx.xyz.w = 0;
+  cidx__glpos(c, &idx, &glpos);
+  compute_region_contenders(
+    THE_WORLD,
+    wr_neighborhood,
+    &glpos,
+    1232331,
+    &wr,
+    &wr_second,
+    &strbest,
+    &strsecond
+  );
+  // Mix biomes for this chunk (neighboring chunks usually share the result):
+  local_biome = acquire_merged_biome(
+    THE_WORLD,
+    wr,
+    wr_second,
+    strbest,
+    strsecond
+  );
+  // Add seeds:
+  place_seeds(c, &ch_nbh, local_biome);
+  // Hand back the local biome info now that we're done with it:
+  release_merged_biome(THE_WORLD, local_biome);
   // Grow plants a bit:
   // TODO: How many cycles to use?
 #ifdef DEBUG
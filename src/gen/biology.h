@@ -114,6 +114,11 @@ void add_sprout_grammar(
 // Setup for the biology generation module.
 void setup_biology_gen(void);
 
+// Places seeds throughout the given chunk using species from the given biome.
+// The chunk must be the center of the given neighborhood (cells in the chunks
+// directly above and below it are consulted).
+void place_seeds(chunk *c, chunk_neighborhood *ch_nbh, biome *local_biome);
+
 // Adds biology to the given chunk as part of chunk initialization. Should be
 // called after the chunk's base cell contents (rocks, soil, air, water) have
 // been added (see generate_chunk in worldgen). If data for the chunk's
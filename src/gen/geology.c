@@ -1,7 +1,9 @@
 // geology.c
 // Stone types and strata generation.
 
+#include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 
 #include "noise/noise.h"
 #include "math/functions.h"
@@ -34,6 +36,13 @@ CSTR(GEO_GEN_KEY_SPECIES, "%gen_stone_species", 18);
 CSTR(GEO_GEN_KEY_STRATA_PARAMS, "%gen_strata_params", 18);
 CSTR(GEO_GEN_KEY_STRATUM, "%gen_stratum", 12);
 
+/*******************
+ * Private Globals *
+ *******************/
+
+// Each thread keeps its own strata profile for the column it's working on:
+static __thread strata_profile *THREAD_PROFILE = NULL;
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -81,6 +90,19 @@ void cleanup_tectonic_sheet(tectonic_sheet *ts) {
   free(ts);
 }
 
+void reset_strata_profile(
+  strata_profile *sp,
+  world_map *wm,
+  gl_cpos_t x, gl_cpos_t y
+) {
+  sp->wm = wm;
+  sp->seed = wm == NULL ? 0 : wm->seed;
+  sp->x = x;
+  sp->y = y;
+  sp->count = 0;
+  sp->next = 0;
+}
+
 /*************
  * Functions *
  *************/
@@ -1066,15 +1088,15 @@ void generate_geology(world_map *wm) {
 }
 
 gl_pos_t compute_stratum_height(stratum *st, global_pos *glpos) {
-  // static variables:
-  static stratum *pr_st = NULL;
-  static global_chunk_pos pr_glcpos = { .x = -1, .y = -1, .z = -1 };
+  // per-thread memo variables:
+  static __thread stratum *pr_st = NULL;
+  static __thread global_chunk_pos pr_glcpos = { .x = -1, .y = -1, .z = -1 };
   // low- and high-frequency distortion:
-  static float lfdx = 0; static float lfdy = 0;
+  static __thread float lfdx = 0; static __thread float lfdy = 0;
   // low- and high-frequency noise:
-  static float lfn = 0;
+  static __thread float lfn = 0;
   // base thickness:
-  static float base = 0;
+  static __thread float base = 0;
 
   // normal variables:
   float fx;
@@ -1097,3 +1119,113 @@ gl_pos_t compute_stratum_height(stratum *st, global_pos *glpos) {
   pr_st = st;
   return (gl_pos_t) fastfloor(base + lfn);
 }
+
+strata_profile* strata_profile_for_column(world_map *wm, global_pos *glpos) {
+  strata_profile *sp = THREAD_PROFILE;
+  global_chunk_pos glcpos;
+  glpos__glcpos(glpos, &glcpos);
+  if (sp == NULL) {
+    sp = (strata_profile*) malloc(sizeof(strata_profile));
+    if (sp == NULL) {
+      perror("Failed to allocate strata profile.");
+      exit(errno);
+    }
+    THREAD_PROFILE = sp;
+    reset_strata_profile(sp, wm, glcpos.x, glcpos.y);
+  } else if (
+    sp->wm != wm
+  || (wm != NULL && sp->seed != wm->seed)
+  || sp->x != glcpos.x
+  || sp->y != glcpos.y
+  ) {
+    reset_strata_profile(sp, wm, glcpos.x, glcpos.y);
+  }
+  return sp;
+}
+
+size_t load_strata_profile_region(strata_profile *sp, world_region *wr) {
+  size_t slot, i;
+  float limit;
+  float *limits;
+  if (sp->count < GEO_PROFILE_REGIONS) {
+    slot = sp->count;
+    sp->count += 1;
+  } else {
+    slot = sp->next;
+    sp->next = (sp->next + 1) % GEO_PROFILE_REGIONS;
+  }
+  sp->regions[slot] = wr;
+  limits = sp->limits[slot];
+  // The bottom stratum is never skipped, so its entry is unused:
+  limits[0] = -INFINITY;
+  limit = -INFINITY;
+  for (i = 1; i < wr->geology.stratum_count; ++i) {
+    // A NaN bottom can never stop get_stratum's scan, so it's ignored here:
+    if (wr->geology.bottoms[i] > limit) {
+      limit = wr->geology.bottoms[i];
+    }
+    limits[i] = limit;
+  }
+  return slot;
+}
+
+stratum* profile_stratum(strata_profile *sp, world_region* wr, float h) {
+  size_t slot, lo, hi, mid;
+  float *limits;
+  if (wr->geology.stratum_count == 0) {
+    return NULL;
+  }
+  for (slot = 0; slot < sp->count; ++slot) {
+    if (sp->regions[slot] == wr) {
+      break;
+    }
+  }
+  if (slot == sp->count) {
+    slot = load_strata_profile_region(sp, wr);
+  }
+  limits = sp->limits[slot];
+  // get_stratum stops at the first stratum whose bottom is above h, which is
+  // also the first one whose limit is above h; the answer is the stratum just
+  // below it (or the top stratum if there isn't one):
+  lo = 1;
+  hi = wr->geology.stratum_count;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (h < limits[mid]) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return wr->geology.strata[lo - 1];
+}
+
+uint8_t stratum_range(
+  world_region *wr,
+  float lo, float hi,
+  size_t *r_first, size_t *r_last
+) {
+  size_t i;
+  if (wr->geology.stratum_count == 0) {
+    return 0;
+  }
+  // Like get_stratum, stop at the first stratum whose bottom is above each
+  // height. Since that's the first stratum whose running maximum bottom is
+  // above the height, the index can only grow as the height does, so
+  // everything in between the two indices is covered:
+  *r_first = wr->geology.stratum_count - 1;
+  for (i = 1; i < wr->geology.stratum_count; i += 1) {
+    if (lo < wr->geology.bottoms[i]) {
+      *r_first = i - 1;
+      break;
+    }
+  }
+  *r_last = wr->geology.stratum_count - 1;
+  for (i = 1; i < wr->geology.stratum_count; i += 1) {
+    if (hi < wr->geology.bottoms[i]) {
+      *r_last = i - 1;
+      break;
+    }
+  }
+  return 1;
+}
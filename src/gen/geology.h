@@ -99,6 +99,38 @@ ELFSCRIPT_GL(n, STRATA_COMPLEXITY)
 static float const BASE_STRATUM_THICKNESS = 10.0;
 ELFSCRIPT_GL(n, BASE_STRATUM_THICKNESS);
 
+// The number of regions whose strata a strata profile can hold at once (a
+// small world neighborhood):
+#define GEO_PROFILE_REGIONS 9
+
+/**************
+ * Structures *
+ **************/
+
+// Resolved stratum boundaries for the regions that can contend for a single
+// chunk column, so that stratum lookups in that column don't have to rescan
+// each region's strata.
+struct strata_profile_s;
+typedef struct strata_profile_s strata_profile;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct strata_profile_s {
+  world_map *wm;
+  ptrdiff_t seed; // the world's seed when the profile was loaded
+  gl_cpos_t x, y; // the chunk column
+  size_t count; // how many regions have been loaded
+  size_t next; // which slot to replace when all of them are full
+  world_region *regions[GEO_PROFILE_REGIONS];
+  // For each region, the running maximum of its stratum bottoms (entry i is
+  // the highest bottom among strata 1 through i). Since these are ordered,
+  // the stratum at a height can be found with a binary search even though the
+  // bottoms themselves needn't be.
+  float limits[GEO_PROFILE_REGIONS][WM_MAX_STRATA_LAYERS];
+};
+
 /***********
  * Globals *
  ***********/
@@ -474,6 +506,14 @@ stratum *create_stratum(
   geologic_source source
 );
 
+// Resets the given strata profile to hold no regions and to cover the given
+// chunk column of the given world.
+void reset_strata_profile(
+  strata_profile *sp,
+  world_map *wm,
+  gl_cpos_t x, gl_cpos_t y
+);
+
 /*************
  * Functions *
  *************/
@@ -608,4 +648,31 @@ void generate_geology(world_map *wm);
 // Computes the height of the given stratum at the given position (ignores z):
 gl_pos_t compute_stratum_height(stratum *st, global_pos *glpos);
 
+// Strata profile functions:
+// -------------------------
+
+// Returns the calling thread's strata profile, reset first if it doesn't
+// already cover the chunk column containing the given position.
+strata_profile* strata_profile_for_column(world_map *wm, global_pos *glpos);
+
+// Loads the given region's stratum boundaries into the given profile
+// (replacing an older region if the profile is full) and returns the slot
+// they were loaded into.
+size_t load_strata_profile_region(strata_profile *sp, world_region *wr);
+
+// Finds the range of indices of the strata that get_stratum could return for
+// the given region at heights between lo and hi (inclusive). The range may
+// include strata that can't actually be returned, but never excludes one that
+// can. Returns 0 if the region doesn't have any strata.
+uint8_t stratum_range(
+  world_region *wr,
+  float lo, float hi,
+  size_t *r_first, size_t *r_last
+);
+
+// Works like get_stratum, but uses the given strata profile (loading the
+// region into it if necessary) to find the stratum with a binary search.
+// Always returns the same stratum that get_stratum would.
+stratum* profile_stratum(strata_profile *sp, world_region* wr, float h);
+
 #endif // ifndef GEOLOGY_H
@@ -3,6 +3,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef DEBUG
   #include <stdlib.h>
 #endif
@@ -38,6 +39,226 @@ char const * const TR_REGION_NAMES[] = {
   "sky",
 };
 
+uint8_t LATTICE_TERRAIN_NOISE = 1;
+
+ptrdiff_t const TR_STRATA_NOISE_SALTS[NV_MAX_SALTS] = { 7193, 7194, 0, 0 };
+ptrdiff_t const TR_CAVE_NOISE_SALTS[NV_MAX_SALTS] = { 17, 18, 0, 0 };
+
+/*******************
+ * Private Globals *
+ *******************/
+
+// Each thread keeps noise volumes for the chunk it's working on:
+static __thread noise_volume *STRATA_VOLUME = NULL;
+static __thread noise_volume *CAVE_VOLUME = NULL;
+static __thread noise_volume *SOIL_VOLUMES[TR_SOIL_VOLUMES];
+static __thread size_t NEXT_SOIL_VOLUME = 0;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Places the noise volume in the given slot over the chunk that contains the
+// given position (creating it first if the slot is empty) and returns it.
+static noise_volume* _chunk_volume(
+  noise_volume **slot,
+  noise_field_3d field,
+  ptrdiff_t spacing,
+  global_pos *glpos,
+  ptrdiff_t const *salts
+) {
+  if (*slot == NULL) {
+    *slot = create_noise_volume(field, CHUNK_SIZE, spacing);
+  }
+  nv_place(
+    *slot,
+    (glpos->x >> CHUNK_BITS) << CHUNK_BITS,
+    (glpos->y >> CHUNK_BITS) << CHUNK_BITS,
+    (glpos->z >> CHUNK_BITS) << CHUNK_BITS,
+    salts
+  );
+  return *slot;
+}
+
+// Finds the calling thread's soil alternative noise volume for the given salts
+// in the chunk containing the given position, replacing the oldest one if
+// there isn't one yet.
+static noise_volume* _soil_volume(global_pos *glpos, ptrdiff_t const *salts) {
+  size_t i;
+  noise_volume *nv;
+  for (i = 0; i < TR_SOIL_VOLUMES; ++i) {
+    nv = SOIL_VOLUMES[i];
+    if (
+      nv != NULL
+    && nv->x == (glpos->x >> CHUNK_BITS) << CHUNK_BITS
+    && nv->y == (glpos->y >> CHUNK_BITS) << CHUNK_BITS
+    && nv->z == (glpos->z >> CHUNK_BITS) << CHUNK_BITS
+    && memcmp(nv->salts, salts, sizeof(ptrdiff_t) * NV_MAX_SALTS) == 0
+    ) {
+      return nv;
+    }
+  }
+  i = NEXT_SOIL_VOLUME;
+  NEXT_SOIL_VOLUME = (NEXT_SOIL_VOLUME + 1) % TR_SOIL_VOLUMES;
+  return _chunk_volume(
+    &(SOIL_VOLUMES[i]),
+    &tr_soil_alt_noise,
+    TR_SOIL_ALT_NOISE_SPACING,
+    glpos,
+    salts
+  );
+}
+
+// DEBUG: Whether the given position is within the window that's cut out of the
+// terrain to show the strata.
+static inline uint8_t _in_strata_window(global_pos const * const glpos) {
+  return (
+    (
+      abs(
+        glpos->x -
+        ((WORLD_WIDTH / 2.0) * WORLD_REGION_BLOCKS + 2*CHUNK_SIZE)
+      ) < CHUNK_SIZE
+    ) && (
+      glpos->z > (
+        glpos->y - (WORLD_HEIGHT/2.0) * WORLD_REGION_BLOCKS
+      ) + 8000
+      //glpos->z > (glpos->y - (WORLD_HEIGHT*WORLD_REGION_BLOCKS)/2)
+    )
+  );
+}
+
+// Returns 1 if nothing is carved out of the chunk starting at the given
+// position (by either the strata window or caves). Cave noise can only be
+// bounded when it's sampled from a noise volume.
+static uint8_t _chunk_is_sealed(global_pos const * const origin) {
+  global_pos glpos;
+  float lo, hi;
+  if (!LATTICE_TERRAIN_NOISE) {
+    return 0;
+  }
+  glpos.w = 0;
+  for (glpos.x = origin->x; glpos.x < origin->x + CHUNK_SIZE; ++glpos.x) {
+    for (glpos.y = origin->y; glpos.y < origin->y + CHUNK_SIZE; ++glpos.y) {
+      for (glpos.z = origin->z; glpos.z < origin->z + CHUNK_SIZE; ++glpos.z) {
+        if (_in_strata_window(&glpos)) {
+          return 0;
+        }
+      }
+    }
+  }
+  copy_glpos(origin, &glpos);
+  nv_lattice_bounds(
+    _chunk_volume(
+      &CAVE_VOLUME,
+      &tr_cave_noise,
+      TR_CAVE_NOISE_SPACING,
+      &glpos,
+      TR_CAVE_NOISE_SALTS
+    ),
+    &lo, &hi
+  );
+  return hi < -TR_BOUND_SLACK;
+}
+
+// Figures out whether stone_cell would pick the same stone species for every
+// cell of the chunk covered by the given bounds (assuming that every cell is
+// below the stone height). If so, writes that species into r_species and
+// returns 1.
+static uint8_t _uniform_stone(
+  world_region* neighborhood[],
+  chunk_bounds const * const cb,
+  global_pos const * const origin,
+  species *r_species
+) {
+  size_t i, j, first, last;
+  uint8_t found = 0;
+  float dlo, dhi, max_dist = 0;
+  double ceiling, lo = INFINITY, hi = -INFINITY;
+  vector v;
+  global_pos glpos;
+  stratum *st;
+  if (!LATTICE_TERRAIN_NOISE) {
+    return 0;
+  }
+  // Missing neighbors can win contention, which gives plain stone:
+  for (i = 0; i < 9; ++i) {
+    if (neighborhood[i] == NULL) {
+      return 0;
+    }
+  }
+  // If the home region has positive strength throughout the chunk, some region
+  // always wins contention (the noise factors in compute_region_contenders are
+  // always positive). Distance is largest at one of the corners:
+  for (i = 0; i < 8; ++i) {
+    v.x = origin->x + ((i & 1) ? CHUNK_SIZE - 1 : 0);
+    v.y = origin->y + ((i & 2) ? CHUNK_SIZE - 1 : 0);
+    v.z = origin->z + ((i & 4) ? CHUNK_SIZE - 1 : 0);
+    v.x -= neighborhood[4]->anchor.x;
+    v.y -= neighborhood[4]->anchor.y;
+    v.z -= neighborhood[4]->anchor.z;
+    if (vmag(&v) > max_dist) {
+      max_dist = vmag(&v);
+    }
+  }
+  if (max_dist >= MAX_REGION_ANCHOR_DISTANCE * (1 - TR_BOUND_SLACK)) {
+    return 0;
+  }
+  // Bound the fractional heights that stone_cell will see, including the
+  // strata distortion noise:
+  copy_glpos(origin, &glpos);
+  nv_lattice_bounds(
+    _chunk_volume(
+      &STRATA_VOLUME,
+      &tr_strata_noise,
+      TR_STRATA_NOISE_SPACING,
+      &glpos,
+      TR_STRATA_NOISE_SALTS
+    ),
+    &dlo, &dhi
+  );
+  dlo -= TR_BOUND_SLACK;
+  dhi += TR_BOUND_SLACK;
+  for (i = 0; i < CHUNK_SIZE; ++i) {
+    for (j = 0; j < CHUNK_SIZE; ++j) {
+      ceiling = cb->stone[i][j];
+      lo = fmin(
+        lo,
+        (origin->z + (TR_STRATA_FRACTION_NOISE_STRENGTH * dlo)) / ceiling
+      );
+      hi = fmax(
+        hi,
+        (
+          origin->z + CHUNK_SIZE - 1
+        + (TR_STRATA_FRACTION_NOISE_STRENGTH * dhi)
+        ) / ceiling
+      );
+    }
+  }
+  lo = fmax(0.0, lo - TR_BOUND_SLACK);
+  hi = fmin(1.0, hi + TR_BOUND_SLACK);
+  // Every stratum that any of the contenders might use has to share a
+  // species. Persistence also has to be positive so that a missing second-best
+  // region never wins.
+  for (i = 0; i < 9; ++i) {
+    if (!stratum_range(neighborhood[i], lo, hi, &first, &last)) {
+      return 0;
+    }
+    for (j = first; j <= last; ++j) {
+      st = neighborhood[i]->geology.strata[j];
+      if (st == NULL || !(st->persistence > 0)) {
+        return 0;
+      }
+      if (!found) {
+        *r_species = st->base_species;
+        found = 1;
+      } else if (st->base_species != *r_species) {
+        return 0;
+      }
+    }
+  }
+  return found;
+}
+
 /*******************
  * Private Globals *
  *******************/
@@ -272,10 +493,11 @@ void generate_topography(world_map *wm) {
   hm_normalize(topo);
 
 #ifdef DEBUG
-  tx = create_texture(wm->width, wm->height);
-  render_heightmap(topo, tx, 0);
-  write_texture_to_png(tx, "out/topography_tectonics.png");
-  cleanup_texture(tx);
+  tx = create_preview_texture(wm->width, wm->height);
+  if (tx != NULL) {
+    render_heightmap(topo, tx, 0);
+    write_preview(tx, "out/topography_tectonics.png");
+  }
 #endif
 
   // Now we start adding particles:
@@ -299,10 +521,11 @@ void generate_topography(world_map *wm) {
   printf("\n");
 
 #ifdef DEBUG
-  tx = create_texture(wm->width, wm->height);
-  render_heightmap(topo, tx, 0);
-  write_texture_to_png(tx, "out/topography_with_particles.png");
-  cleanup_texture(tx);
+  tx = create_preview_texture(wm->width, wm->height);
+  if (tx != NULL) {
+    render_heightmap(topo, tx, 0);
+    write_preview(tx, "out/topography_with_particles.png");
+  }
 #endif
 
   // We want to slump things out, but at each step we mix back in a little of
@@ -321,10 +544,11 @@ void generate_topography(world_map *wm) {
   }
 
 #ifdef DEBUG
-  tx = create_texture(wm->width, wm->height);
-  render_heightmap(topo, tx, 0);
-  write_texture_to_png(tx, "out/topography_slumped.png");
-  cleanup_texture(tx);
+  tx = create_preview_texture(wm->width, wm->height);
+  if (tx != NULL) {
+    render_heightmap(topo, tx, 0);
+    write_preview(tx, "out/topography_slumped.png");
+  }
 #endif
 
   // TODO: Is this fine?
@@ -385,13 +609,16 @@ void generate_topography(world_map *wm) {
   hm_normalize(flow);
 
 #ifdef DEBUG
-  tx = create_texture(wm->width, wm->height);
-  render_heightmap(topo, tx, 0);
-  write_texture_to_png(tx, "out/topography_eroded.png");
-
-  render_heightmap(flow, tx, 0);
-  write_texture_to_png(tx, "out/flow.png");
-  cleanup_texture(tx);
+  tx = create_preview_texture(wm->width, wm->height);
+  if (tx != NULL) {
+    render_heightmap(topo, tx, 0);
+    write_preview(tx, "out/topography_eroded.png");
+  }
+  tx = create_preview_texture(wm->width, wm->height);
+  if (tx != NULL) {
+    render_heightmap(flow, tx, 0);
+    write_preview(tx, "out/flow.png");
+  }
 #endif
 
   // At this point our heightmap is complete, we just need to copy values over
@@ -583,6 +810,10 @@ void compute_terrain_height(
     printf("nan final dirt_height\n");
     exit(EXIT_FAILURE);
   }
+  if (dirt_height.z - rocks_height.z > TR_MAX_SOIL_DEPTH) {
+    printf("dirt deeper than TR_MAX_SOIL_DEPTH\n");
+    exit(EXIT_FAILURE);
+  }
 #endif
 
   // Write out our results:
@@ -768,6 +999,128 @@ void geoform_info(
   */
 }
 
+void compute_chunk_bounds(
+  world_map *wm,
+  global_chunk_pos const * const glcpos,
+  chunk_bounds *cb
+) {
+  size_t i, j;
+  global_pos origin, glpos;
+  manifold_point gross_height, stone_height, dirt_height;
+  copy_glcpos(glcpos, &(cb->glcpos));
+  glcpos__glpos(glcpos, &origin);
+  copy_glpos(&origin, &glpos);
+  cb->min_stone = INFINITY;
+  cb->max_stone = -INFINITY;
+  cb->usable = 1;
+  // Stone height doesn't depend on z:
+  for (i = 0; i < CHUNK_SIZE; ++i) {
+    glpos.x = origin.x + i;
+    for (j = 0; j < CHUNK_SIZE; ++j) {
+      glpos.y = origin.y + j;
+      compute_terrain_height(
+        wm,
+        &glpos,
+        &gross_height,
+        &stone_height,
+        &dirt_height
+      );
+      cb->stone[i][j] = stone_height.z;
+      if (!(stone_height.z > 0)) { // also catches NaN
+        cb->usable = 0;
+      }
+      cb->min_stone = fmin(cb->min_stone, stone_height.z);
+      cb->max_stone = fmax(cb->max_stone, stone_height.z);
+    }
+  }
+}
+
+uint8_t uniform_terrain_chunk(
+  world_map *wm,
+  world_region* neighborhood[],
+  chunk_bounds const * const cb,
+  cell *result
+) {
+  global_pos origin;
+  gl_pos_t top;
+  species sp;
+  if (!cb->usable) {
+    return 0;
+  }
+  glcpos__glpos(&(cb->glcpos), &origin);
+  top = origin.z + CHUNK_SIZE - 1;
+  result->blocks[1] = b_make_block(B_VOID);
+  if (origin.z >= cb->max_stone + TR_MAX_SOIL_DEPTH + 1) {
+    // Above the dirt everywhere, so only air and water are possible:
+    if (origin.z > TR_HEIGHT_SEA_LEVEL) {
+      result->blocks[0] = b_make_block(B_AIR);
+      return 1;
+    } else if (top <= TR_HEIGHT_SEA_LEVEL && _chunk_is_sealed(&origin)) {
+      result->blocks[0] = b_make_block(B_WATER);
+      return 1;
+    }
+  } else if (top <= cb->min_stone && _chunk_is_sealed(&origin)) {
+    // Below the stone height everywhere:
+    if (_uniform_stone(neighborhood, cb, &origin, &sp)) {
+      result->blocks[0] = b_make_species(B_STONE, sp);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+float tr_strata_noise(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+) {
+  return (
+    sxnoise_3d(
+      x * TR_STRATA_FRACTION_NOISE_SCALE,
+      y * TR_STRATA_FRACTION_NOISE_SCALE,
+      z * TR_STRATA_FRACTION_NOISE_SCALE,
+      salts[0]
+    ) +
+    0.5 * sxnoise_3d(
+      x * TR_STRATA_FRACTION_NOISE_SCALE * 1.7,
+      y * TR_STRATA_FRACTION_NOISE_SCALE * 1.7,
+      z * TR_STRATA_FRACTION_NOISE_SCALE * 1.7,
+      salts[1]
+    )
+  ) / 1.5;
+}
+
+float tr_cave_noise(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+) {
+  return (
+    sxnoise_3d(x*1/12.0, y*1/12.0, z*1/12.0, salts[0])
+  - sxnoise_3d(x*1/52.0, y*1/52.0, z*1/52.0, salts[1])
+  );
+}
+
+float tr_soil_alt_noise(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+) {
+  return sxnoise_3d(
+    x * TR_SOIL_ALT_NOISE_SCALE,
+    y * TR_SOIL_ALT_NOISE_SCALE,
+    z * TR_SOIL_ALT_NOISE_SCALE,
+    salts[0]
+  ) + 0.7 * sxnoise_3d(
+    x * TR_SOIL_ALT_NOISE_SCALE * 2.4,
+    y * TR_SOIL_ALT_NOISE_SCALE * 2.4,
+    z * TR_SOIL_ALT_NOISE_SCALE * 2.4,
+    salts[1]
+  ) + 0.3 * sxnoise_3d(
+    x * TR_SOIL_ALT_NOISE_SCALE * 3.8,
+    y * TR_SOIL_ALT_NOISE_SCALE * 3.8,
+    z * TR_SOIL_ALT_NOISE_SCALE * 3.8,
+    salts[2]
+  );
+}
+
 void terrain_cell(
   world_map *wm,
   world_region* neighborhood[],
@@ -778,25 +1131,14 @@ void terrain_cell(
   float h;
   world_region *best, *secondbest; // best and second-best regions
   float strbest, strsecond; // their respective strengths
+  float cave;
 
   // compute_terrain_height handles caching:
   compute_terrain_height(wm, glpos, &gross_height, &stone_height, &dirt_height);
 
   // DEBUG: (to show the strata)
   //*
-  if (
-    (
-      abs(
-        glpos->x -
-        ((WORLD_WIDTH / 2.0) * WORLD_REGION_BLOCKS + 2*CHUNK_SIZE)
-      ) < CHUNK_SIZE
-    ) && (
-      glpos->z > (
-        glpos->y - (WORLD_HEIGHT/2.0) * WORLD_REGION_BLOCKS
-      ) + 8000
-      //glpos->z > (glpos->y - (WORLD_HEIGHT*WORLD_REGION_BLOCKS)/2)
-    )
-  ) {
+  if (_in_strata_window(glpos)) {
   //if (abs(glpos->x - 32770) < CHUNK_SIZE) {
     result->blocks[0] = b_make_block(B_AIR);
     result->blocks[1] = b_make_block(B_VOID);
@@ -806,10 +1148,21 @@ void terrain_cell(
 
   // DEBUG: Caves to show things off more:
   //*
-  if (
-    sxnoise_3d(glpos->x*1/12.0, glpos->y*1/12.0, glpos->z*1/12.0, 17) >
-      sxnoise_3d(glpos->x*1/52.0, glpos->y*1/52.0, glpos->z*1/52.0, 18)
-  ) {
+  if (LATTICE_TERRAIN_NOISE) {
+    cave = nv_sample(
+      _chunk_volume(
+        &CAVE_VOLUME,
+        &tr_cave_noise,
+        TR_CAVE_NOISE_SPACING,
+        glpos,
+        TR_CAVE_NOISE_SALTS
+      ),
+      glpos->x, glpos->y, glpos->z
+    );
+  } else {
+    cave = tr_cave_noise(glpos->x, glpos->y, glpos->z, TR_CAVE_NOISE_SALTS);
+  }
+  if (cave > 0) {
     result->blocks[0] = b_make_block(B_AIR);
     result->blocks[1] = b_make_block(B_VOID);
     return;
@@ -861,35 +1214,41 @@ void stone_cell(
   cell *result
 ) {
   stratum *st;
+  float distortion;
+  strata_profile *sp = strata_profile_for_column(wm, glpos);
   // Add some noise to distort the base height:
   // TODO: more spatial variance in noise strength?
-  h += (TR_STRATA_FRACTION_NOISE_STRENGTH / ceiling) * (
-    sxnoise_3d(
-      glpos->x * TR_STRATA_FRACTION_NOISE_SCALE,
-      glpos->y * TR_STRATA_FRACTION_NOISE_SCALE,
-      glpos->z * TR_STRATA_FRACTION_NOISE_SCALE,
-      7193
-    ) + 
-    0.5 * sxnoise_3d(
-      glpos->x * TR_STRATA_FRACTION_NOISE_SCALE * 1.7,
-      glpos->y * TR_STRATA_FRACTION_NOISE_SCALE * 1.7,
-      glpos->z * TR_STRATA_FRACTION_NOISE_SCALE * 1.7,
-      7194
-    )
-  ) / 1.5;
+  if (LATTICE_TERRAIN_NOISE) {
+    distortion = nv_sample(
+      _chunk_volume(
+        &STRATA_VOLUME,
+        &tr_strata_noise,
+        TR_STRATA_NOISE_SPACING,
+        glpos,
+        TR_STRATA_NOISE_SALTS
+      ),
+      glpos->x, glpos->y, glpos->z
+    );
+  } else {
+    distortion = tr_strata_noise(
+      glpos->x, glpos->y, glpos->z,
+      TR_STRATA_NOISE_SALTS
+    );
+  }
+  h += (TR_STRATA_FRACTION_NOISE_STRENGTH / ceiling) * distortion;
   // Clamp out-of-range values after noise:
   // TODO: get geologic_height in here!
   if (h > 1.0) { h = 1.0; } else if (h < 0.0) { h = 0.0; }
 
   // Where available, persistence values are also a factor:
   if (best != NULL) {
-    st = get_stratum(best, h);
+    st = profile_stratum(sp, best, h);
     if (st != NULL) {
       strbest *= st->persistence;
     }
   }
   if (secondbest != NULL) {
-    st = get_stratum(secondbest, h);
+    st = profile_stratum(sp, secondbest, h);
     if (st != NULL) {
       strsecond *= st->persistence;
     }
@@ -903,7 +1262,7 @@ void stone_cell(
     // TODO: Various edge types here?
     result->blocks[0] = b_make_block(B_STONE);
   } else {
-    st = get_stratum(best, h);
+    st = profile_stratum(sp, best, h);
     if (st == NULL) {
       // TODO: Something else here?
       result->blocks[0] = b_make_block(B_STONE);
@@ -1028,25 +1387,21 @@ void pick_dirt_block(
 
   float beststr = TR_SOIL_ALT_THRESHOLD;
   float str = 0;
+  ptrdiff_t salts[NV_MAX_SALTS] = { 0, 0, 0, 0 };
 
   for (i = 0; i < WM_MAX_SOIL_ALTS; ++i) {
     // TODO: Moisture dependence?
-    str = sxnoise_3d(
-      glpos->x * TR_SOIL_ALT_NOISE_SCALE,
-      glpos->y * TR_SOIL_ALT_NOISE_SCALE,
-      glpos->z * TR_SOIL_ALT_NOISE_SCALE,
-      wr->seed + 4920 * i
-    ) + 0.7 * sxnoise_3d(
-      glpos->x * TR_SOIL_ALT_NOISE_SCALE * 2.4,
-      glpos->y * TR_SOIL_ALT_NOISE_SCALE * 2.4,
-      glpos->z * TR_SOIL_ALT_NOISE_SCALE * 2.4,
-      wr->seed + 7482 * i
-    ) + 0.3 * sxnoise_3d(
-      glpos->x * TR_SOIL_ALT_NOISE_SCALE * 3.8,
-      glpos->y * TR_SOIL_ALT_NOISE_SCALE * 3.8,
-      glpos->z * TR_SOIL_ALT_NOISE_SCALE * 3.8,
-      wr->seed + 3194 * i
-    );
+    salts[0] = wr->seed + 4920 * i;
+    salts[1] = wr->seed + 7482 * i;
+    salts[2] = wr->seed + 3194 * i;
+    if (LATTICE_TERRAIN_NOISE) {
+      str = nv_sample(
+        _soil_volume(glpos, salts),
+        glpos->x, glpos->y, glpos->z
+      );
+    } else {
+      str = tr_soil_alt_noise(glpos->x, glpos->y, glpos->z, salts);
+    }
     str = (2 + str)/4.0; // [0, 1]
     str *= alt_strengths[i];
     if (alt_hdeps[i] > 0) {
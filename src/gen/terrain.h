@@ -147,6 +147,12 @@
 
 #define TR_SLOPE_EROSION_STRENGTH 12
 
+// An upper bound on the depth of the dirt layer. The base depth, altitude, and
+// slope terms in compute_dirt_height add up to less than 20 blocks, and
+// chunk classification relies on no column having dirt any deeper than this
+// (see uniform_terrain_chunk):
+#define TR_MAX_SOIL_DEPTH 32
+
 // Beach height above sea level:
 #define TR_BEACH_BASE_HEIGHT 7
 #define TR_BEACH_HEIGHT_VAR 6
@@ -158,6 +164,40 @@
 // Soil alternate threshold:
 #define TR_SOIL_ALT_THRESHOLD 0.5
 
+// Noise volumes:
+// --------------
+// Slowly-varying 3D noise used during chunk generation is sampled on a coarse
+// lattice over each chunk instead of being evaluated for every cell (see
+// noise_volume in noise/noise.h). Each field gets a lattice spacing in blocks
+// and an error budget: the largest difference allowed between the sampled
+// field and the exact one, in the field's own units (see
+// test_noise_volumes).
+
+// Strata boundary distortion (on [-1, 1]):
+#define TR_STRATA_NOISE_SPACING 4
+#define TR_STRATA_NOISE_BUDGET 0.1
+
+// Cave noise (on [-2, 2]; cave walls move by about a block at most):
+#define TR_CAVE_NOISE_SPACING 2
+#define TR_CAVE_NOISE_BUDGET 0.2
+
+// Soil alternative noise (on about [-2, 2]):
+#define TR_SOIL_ALT_NOISE_SPACING 4
+#define TR_SOIL_ALT_NOISE_BUDGET 0.1
+
+// How many soil alternative noise volumes each thread keeps (enough for every
+// alternative of a few regions):
+#define TR_SOIL_VOLUMES (WM_MAX_SOIL_ALTS * 4)
+
+// Chunk classification:
+// ---------------------
+// Chunks which can be shown to hold nothing but air, water, or a single kind
+// of stone are filled in bulk (see uniform_terrain_chunk).
+
+// Bounds on sampled noise and fractional heights are widened by this much to
+// cover rounding error:
+#define TR_BOUND_SLACK 0.0001
+
 /*********
  * Enums *
  *********/
@@ -172,6 +212,28 @@ enum terrain_region_e {
 };
 typedef enum terrain_region_e terrain_region;
 
+/**************
+ * Structures *
+ **************/
+
+// The stone height of every column in a chunk's footprint, which bounds where
+// stone, dirt, and water can be within the chunk.
+struct chunk_bounds_s;
+typedef struct chunk_bounds_s chunk_bounds;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct chunk_bounds_s {
+  global_chunk_pos glcpos;
+  float stone[CHUNK_SIZE][CHUNK_SIZE]; // indexed by x then y within the chunk
+  float min_stone, max_stone;
+  // Whether every stone height is positive (otherwise fractional heights
+  // don't increase with z, and the bounds can't be used):
+  uint8_t usable;
+};
+
 /***********
  * Globals *
  ***********/
@@ -179,10 +241,31 @@ typedef enum terrain_region_e terrain_region;
 // An array of names for each terrain region:
 extern char const * const TR_REGION_NAMES[];
 
+// Whether chunk generation samples slowly-varying noise from noise volumes
+// (otherwise it's evaluated exactly for every cell):
+extern uint8_t LATTICE_TERRAIN_NOISE;
+
+// The salts used for the strata distortion and cave noise fields:
+extern ptrdiff_t const TR_STRATA_NOISE_SALTS[NV_MAX_SALTS];
+extern ptrdiff_t const TR_CAVE_NOISE_SALTS[NV_MAX_SALTS];
+
 /********************
  * Inline Functions *
  ********************/
 
+// Returns 1 if there can't be any stone or dirt at or above the given height
+// in the given column of a chunk (x and y are relative to the chunk).
+static inline uint8_t cb_open_above(
+  chunk_bounds const * const cb,
+  size_t x, size_t y,
+  gl_pos_t z
+) {
+  return (
+    cb->usable
+  && z >= cb->stone[x][y] + TR_MAX_SOIL_DEPTH + 1
+  );
+}
+
 static inline void trig_component(
   manifold_point *result,
   float x, float y,
@@ -482,9 +565,44 @@ void compute_dirt_height(
   manifold_point *result
 );
 
+// The 3D noise fields that chunk generation samples through noise volumes
+// (the soil alternative field takes three salts; see pick_dirt_block):
+float tr_strata_noise(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+);
+float tr_cave_noise(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+);
+float tr_soil_alt_noise(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+);
+
 // Computes the terrain region and interpolation values at the given position.
 void geoform_info(global_pos *pos, terrain_region* region, float* tr_interp);
 
+// Computes the stone height of every column in the given chunk's footprint.
+void compute_chunk_bounds(
+  world_map *wm,
+  global_chunk_pos const * const glcpos,
+  chunk_bounds *cb
+);
+
+// Checks whether terrain_cell would produce the same contents for every cell
+// of the chunk covered by the given bounds, using conservative bounds on the
+// terrain surface, sea level, cave noise, and the strata that can be reached.
+// If so, writes those contents into result and returns 1. Otherwise returns 0,
+// in which case the chunk has to be generated cell by cell. The neighborhood
+// should be the chunk's small world neighborhood.
+uint8_t uniform_terrain_chunk(
+  world_map *wm,
+  world_region* neighborhood[],
+  chunk_bounds const * const cb,
+  cell *result
+);
+
 // Computes the cell contents at the given position based on the terrain.
 void terrain_cell(
   world_map *wm,
@@ -1,15 +1,22 @@
 // worldgen.c
 // World map generation.
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <math.h>
 
+#include <omp.h>
+
 #include "datatypes/bitmap.h"
+#include "datatypes/heightmap.h"
 #include "noise/noise.h"
 #include "world/blocks.h"
 #include "world/world_map.h"
 #include "data/data.h"
 #include "data/persist.h"
 #include "txgen/cartography.h"
+#include "prof/ptrace.h"
 #include "tex/tex.h"
 #include "math/manifold.h"
 #include "util.h"
@@ -38,10 +45,37 @@ CSTR(WORLD_MAP_FILE_PQ, "world_map_pq.png", 16);
 CSTR(WORLD_MAP_FILE_RAIN, "world_map_rain.png", 18);
 CSTR(WORLD_MAP_FILE_LRAIN, "world_map_land_rain.png", 23);
 
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// Describes a preview map: which layer(s) to render and where to write it.
+struct worldgen_preview_s {
+  string const * const *file;
+  pixel (*layer_fn)(world_region*);
+  void (*vector_layer_fn)(world_region*, float*, float*); // may be NULL
+};
+typedef struct worldgen_preview_s worldgen_preview;
+
+// Scheduling state for a single call to run_worldgen_stages.
+struct worldgen_schedule_s {
+  world_map *wm;
+  worldgen_stage *stages;
+  size_t count;
+  uint8_t *started; // per-stage flags
+  size_t finished; // number of stages that are done
+  wg_product available; // products of all finished stages
+  double epoch; // omp_get_wtime() when the run began
+  omp_lock_t lock; // protects started, finished, and available
+};
+typedef struct worldgen_schedule_s worldgen_schedule;
+
 /*********************
  * Private Functions *
  *********************/
 
+// Queues a preview map to be written into the maps directory (see
+// write_preview), taking ownership of the texture.
 static inline void write_map_to_file(texture *map, string const * const file) {
   char *map_file;
   string *full_file;
@@ -49,12 +83,339 @@ static inline void write_map_to_file(texture *map, string const * const file) {
   full_file = s_concat(PS_MAPS_DIR_PATH, file);
   map_file = s_encode_nt(full_file);
 
-  write_texture_to_png(map, map_file);
+  write_preview(map, map_file);
 
   free(map_file);
   cleanup_string(full_file);
 }
 
+// Stage wrappers for the generation functions:
+
+static void _stage_init(world_map *wm, void *arg) { init_world_map(wm); }
+
+static void _stage_elements(world_map *wm, void *arg) {
+  generate_elements(wm);
+}
+
+static void _stage_tectonics(world_map *wm, void *arg) {
+  generate_tectonics(wm);
+}
+
+static void _stage_topography(world_map *wm, void *arg) {
+  generate_topography(wm);
+}
+
+static void _stage_hydrology(world_map *wm, void *arg) {
+  generate_hydrology(wm);
+}
+
+static void _stage_climate(world_map *wm, void *arg) { generate_climate(wm); }
+
+static void _stage_geology(world_map *wm, void *arg) { generate_geology(wm); }
+
+static void _stage_summarize(world_map *wm, void *arg) {
+  summarize_all_regions(wm);
+}
+
+static void _stage_soil(world_map *wm, void *arg) { generate_soil(wm); }
+
+static void _stage_ecology(world_map *wm, void *arg) { generate_ecology(wm); }
+
+// Renders a preview map and queues it to be written out (arg should be a
+// worldgen_preview*). Does nothing if previews are turned off.
+static void _stage_preview(world_map *wm, void *arg) {
+  worldgen_preview *pv = (worldgen_preview*) arg;
+  texture *map = create_preview_texture(wm->width, wm->height);
+  if (map == NULL) {
+    return;
+  }
+  render_map_layer(wm, map, pv->layer_fn);
+  if (pv->vector_layer_fn != NULL) {
+    render_map_vectors(wm, map, PX_BLACK, PX_WHITE, pv->vector_layer_fn);
+  }
+  write_map_to_file(map, *(pv->file));
+}
+
+static void _run_stage(worldgen_schedule *sched, size_t i);
+
+// Launches a task for every stage whose inputs are all available and which
+// hasn't been started yet. Tasks are spawned outside of the schedule lock
+// because the runtime is free to execute a new task immediately.
+static void _launch_ready_stages(worldgen_schedule *sched) {
+  size_t i, next;
+  worldgen_stage *st;
+  while (1) {
+    next = sched->count;
+    omp_set_lock(&(sched->lock));
+    for (i = 0; i < sched->count; ++i) {
+      st = &(sched->stages[i]);
+      if (
+        !sched->started[i]
+     && (st->inputs & sched->available) == st->inputs
+      ) {
+        sched->started[i] = 1;
+        next = i;
+        break;
+      }
+    }
+    omp_unset_lock(&(sched->lock));
+    if (next == sched->count) {
+      break;
+    }
+#pragma omp task firstprivate(next)
+    _run_stage(sched, next);
+  }
+}
+
+// Runs a single stage, records its timing, publishes its outputs, and then
+// launches any stages that were waiting on them.
+static void _run_stage(worldgen_schedule *sched, size_t i) {
+  worldgen_stage *st = &(sched->stages[i]);
+  printf("  ...%s...\n", st->name);
+  st->thread = omp_get_thread_num();
+  st->start = omp_get_wtime() - sched->epoch;
+  st->run(sched->wm, st->arg);
+  st->duration = (omp_get_wtime() - sched->epoch) - st->start;
+
+  omp_set_lock(&(sched->lock));
+  sched->available |= st->outputs;
+  sched->finished += 1;
+  omp_unset_lock(&(sched->lock));
+
+  _launch_ready_stages(sched);
+}
+
+// Figures out whether every cell of the chunk at the given position can be
+// filled with the same value, and if so puts that value in r_fill and returns
+// 1. Either way the given bounds are filled in (they're left unusable when
+// bulk generation is turned off).
+static uint8_t _classify_chunk(
+  global_chunk_pos const * const glcpos,
+  chunk_bounds *bounds,
+  cell *r_fill
+) {
+  global_pos glpos;
+  world_map_pos wmpos;
+  world_region *neighborhood[9];
+  bounds->usable = 0;
+  if (!BULK_CHUNK_GENERATION) {
+    return 0;
+  }
+  glcpos__glpos(glcpos, &glpos);
+  glpos__wmpos(&glpos, &wmpos);
+  get_world_neighborhood_small(THE_WORLD, &wmpos, neighborhood);
+  r_fill->blocks[1] = b_make_block(B_VOID);
+  if (glpos.z < 0 || neighborhood[4] == NULL) {
+    // Outside the world (see world_cell):
+    r_fill->blocks[0] = b_make_block(B_BOUNDARY);
+    return 1;
+  }
+  compute_chunk_bounds(THE_WORLD, glcpos, bounds);
+  return uniform_terrain_chunk(THE_WORLD, neighborhood, bounds, r_fill);
+}
+
+/**********
+ * Stages *
+ **********/
+
+static worldgen_preview PREVIEW_BASE = {
+  .file = &WORLD_MAP_FILE_BASE,
+  .layer_fn = &ly_terrain_height,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_REGIONS = {
+  .file = &WORLD_MAP_FILE_REGIONS,
+  .layer_fn = &ly_georegions,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_TEMP = {
+  .file = &WORLD_MAP_FILE_TEMP,
+  .layer_fn = &ly_temperature,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_WIND = {
+  .file = &WORLD_MAP_FILE_WIND,
+  .layer_fn = &ly_terrain_height,
+  .vector_layer_fn = &vly_wind_vectors
+};
+static worldgen_preview PREVIEW_EVAP = {
+  .file = &WORLD_MAP_FILE_EVAP,
+  .layer_fn = &ly_evaporation,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_CLOUDS = {
+  .file = &WORLD_MAP_FILE_CLOUDS,
+  .layer_fn = &ly_cloud_cover,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_PQ = {
+  .file = &WORLD_MAP_FILE_PQ,
+  .layer_fn = &ly_precipitation_quotient,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_RAIN = {
+  .file = &WORLD_MAP_FILE_RAIN,
+  .layer_fn = &ly_precipitation,
+  .vector_layer_fn = NULL
+};
+static worldgen_preview PREVIEW_LRAIN = {
+  .file = &WORLD_MAP_FILE_LRAIN,
+  .layer_fn = &ly_land_precipitation,
+  .vector_layer_fn = NULL
+};
+
+// Stages are listed in their old sequential order, which is also the order in
+// which ready stages get launched. Note that generate_ecology currently
+// clobbers the world seed (see WG_P_WORLD_SEED), which the evaporation layer
+// reads, so that preview has to wait for ecology to match earlier output.
+// The other previews also wait for ecology (which comes after soil) so that
+// they don't print over the progress output of those long stages; they only
+// run alongside each other, as the old loop of map writes did.
+worldgen_stage WORLDGEN_STAGES[] = {
+  {
+    .name = "initializing world",
+    .run = &_stage_init,
+    .arg = NULL,
+    .inputs = WG_P_NONE,
+    .outputs = WG_P_REGIONS
+  },
+  {
+    .name = "generating elements",
+    .run = &_stage_elements,
+    .arg = NULL,
+    .inputs = WG_P_NONE,
+    .outputs = WG_P_ELEMENTS
+  },
+  {
+    .name = "generating tectonics",
+    .run = &_stage_tectonics,
+    .arg = NULL,
+    .inputs = WG_P_NONE,
+    .outputs = WG_P_TECTONICS
+  },
+  {
+    .name = "generating topography",
+    .run = &_stage_topography,
+    .arg = NULL,
+    .inputs = WG_P_REGIONS | WG_P_TECTONICS,
+    .outputs = WG_P_TOPOGRAPHY
+  },
+  {
+    .name = "generating hydrology",
+    .run = &_stage_hydrology,
+    .arg = NULL,
+    .inputs = WG_P_REGIONS | WG_P_TOPOGRAPHY,
+    .outputs = WG_P_HYDROLOGY
+  },
+  {
+    .name = "generating climate",
+    .run = &_stage_climate,
+    .arg = NULL,
+    .inputs = WG_P_REGIONS | WG_P_TOPOGRAPHY | WG_P_HYDROLOGY,
+    .outputs = WG_P_CLIMATE
+  },
+  {
+    .name = "generating geology",
+    .run = &_stage_geology,
+    .arg = NULL,
+    // Stone species are built from element species and are registered in
+    // the same species tables, so geology must never overlap with elements:
+    .inputs = WG_P_REGIONS | WG_P_ELEMENTS,
+    .outputs = WG_P_GEOLOGY
+  },
+  {
+    .name = "summarizing altitude and climate information",
+    .run = &_stage_summarize,
+    .arg = NULL,
+    .inputs = WG_P_TOPOGRAPHY | WG_P_CLIMATE,
+    .outputs = WG_P_SUMMARY
+  },
+  {
+    .name = "generating soil",
+    .run = &_stage_soil,
+    .arg = NULL,
+    // hydrology uses soil data as scratch space, so it must be done first
+    .inputs = WG_P_ELEMENTS | WG_P_HYDROLOGY | WG_P_GEOLOGY | WG_P_SUMMARY,
+    .outputs = WG_P_SOIL
+  },
+  {
+    .name = "generating ecology",
+    .run = &_stage_ecology,
+    .arg = NULL,
+    .inputs = WG_P_ELEMENTS | WG_P_SUMMARY | WG_P_SOIL,
+    .outputs = WG_P_ECOLOGY | WG_P_WORLD_SEED
+  },
+  {
+    .name = "writing elevation map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_BASE,
+    .inputs = WG_P_ECOLOGY | WG_P_TOPOGRAPHY | WG_P_HYDROLOGY,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing geographic regions map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_REGIONS,
+    .inputs = WG_P_ECOLOGY | WG_P_TOPOGRAPHY,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing temperature map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_TEMP,
+    .inputs = WG_P_ECOLOGY | WG_P_CLIMATE,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing wind map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_WIND,
+    .inputs = WG_P_ECOLOGY | WG_P_TOPOGRAPHY | WG_P_HYDROLOGY | WG_P_CLIMATE,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing evaporation map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_EVAP,
+    .inputs = WG_P_ECOLOGY | WG_P_TOPOGRAPHY | WG_P_CLIMATE | WG_P_WORLD_SEED,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing clouds map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_CLOUDS,
+    .inputs = WG_P_ECOLOGY | WG_P_CLIMATE,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing precipitation quotient map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_PQ,
+    .inputs = WG_P_ECOLOGY | WG_P_CLIMATE,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing precipitation map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_RAIN,
+    .inputs = WG_P_ECOLOGY | WG_P_CLIMATE,
+    .outputs = WG_P_NONE
+  },
+  {
+    .name = "writing land precipitation map",
+    .run = &_stage_preview,
+    .arg = (void*) &PREVIEW_LRAIN,
+    .inputs = WG_P_ECOLOGY | WG_P_HYDROLOGY | WG_P_CLIMATE,
+    .outputs = WG_P_NONE
+  },
+};
+
+size_t const WORLDGEN_STAGE_COUNT = (
+  sizeof(WORLDGEN_STAGES) / sizeof(worldgen_stage)
+);
+
+uint8_t BULK_CHUNK_GENERATION = 1;
+
 /*************
  * Functions *
  *************/
@@ -65,85 +426,92 @@ void setup_worldgen(ptrdiff_t seed) {
 
   THE_WORLD = create_world_map(prng(seed + 71), WORLD_WIDTH, WORLD_HEIGHT);
 
-  printf("  ...initializing world...\n");
-  init_world_map(THE_WORLD);
-  printf("  ...generating elements...\n");
-  generate_elements(THE_WORLD);
-  printf("  ...generating tectonics...\n");
-  generate_tectonics(THE_WORLD);
-  printf("  ...generating topography...\n");
-  generate_topography(THE_WORLD);
-  printf("  ...generating hydrology...\n");
-  generate_hydrology(THE_WORLD);
-  printf("  ...generating climate...\n");
-  generate_climate(THE_WORLD);
-  printf("  ...generating geology...\n");
-  generate_geology(THE_WORLD);
-  printf("  ...summarizing altitude and climate information...\n");
-  summarize_all_regions(THE_WORLD);
-  printf("  ...generating soil...\n");
-  generate_soil(THE_WORLD);
-  printf("  ...generating ecology...\n");
-  generate_ecology(THE_WORLD);
-
-
-  printf("  ...writing world maps...\n");
-  texture *base_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *regions_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *temp_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *wind_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *evap_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *cloud_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *pq_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *rain_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-  texture *lrain_map = create_texture(WORLD_WIDTH, WORLD_HEIGHT);
-
-  printf("    ...elevation...\n");
-  render_map_layer(THE_WORLD, base_map, &ly_terrain_height);
-  write_map_to_file(base_map, WORLD_MAP_FILE_BASE);
-
-  printf("    ...geographic regions...\n");
-  render_map_layer(THE_WORLD, regions_map, &ly_georegions);
-  write_map_to_file(regions_map, WORLD_MAP_FILE_REGIONS);
-
-  printf("    ...temperature...\n");
-  render_map_layer(THE_WORLD, temp_map, &ly_temperature);
-  write_map_to_file(temp_map, WORLD_MAP_FILE_TEMP);
-
-  printf("    ...wind...\n");
-  render_map_layer(THE_WORLD, wind_map, &ly_terrain_height);
-  render_map_vectors(THE_WORLD, wind_map, PX_BLACK,PX_WHITE, &vly_wind_vectors);
-  write_map_to_file(wind_map, WORLD_MAP_FILE_WIND);
-
-  printf("    ...evaporation...\n");
-  render_map_layer(THE_WORLD, evap_map, &ly_evaporation);
-  write_map_to_file(evap_map, WORLD_MAP_FILE_EVAP);
-
-  printf("    ...clouds...\n");
-  render_map_layer(THE_WORLD, cloud_map, &ly_cloud_cover);
-  write_map_to_file(cloud_map, WORLD_MAP_FILE_CLOUDS);
-
-  printf("    ...precipitation_quotient...\n");
-  render_map_layer(THE_WORLD, pq_map, &ly_precipitation_quotient);
-  write_map_to_file(pq_map, WORLD_MAP_FILE_PQ);
-
-  printf("    ...precipitation...\n");
-  render_map_layer(THE_WORLD, rain_map, &ly_precipitation);
-  write_map_to_file(rain_map, WORLD_MAP_FILE_RAIN);
-
-  printf("    ...land precipitation...\n");
-  render_map_layer(THE_WORLD, lrain_map, &ly_land_precipitation);
-  write_map_to_file(lrain_map, WORLD_MAP_FILE_LRAIN);
-
-  cleanup_texture(base_map);
-  cleanup_texture(regions_map);
-  cleanup_texture(temp_map);
-  cleanup_texture(wind_map);
-  cleanup_texture(evap_map);
-  cleanup_texture(cloud_map);
-  cleanup_texture(pq_map);
-  cleanup_texture(rain_map);
-  cleanup_texture(lrain_map);
+  run_worldgen_stages(THE_WORLD, WORLDGEN_STAGES, WORLDGEN_STAGE_COUNT);
+  print_worldgen_timings(stdout, WORLDGEN_STAGES, WORLDGEN_STAGE_COUNT);
+}
+
+void run_worldgen_stages(
+  world_map *wm,
+  worldgen_stage *stages,
+  size_t count
+) {
+  size_t i;
+  int old_max_levels;
+  worldgen_schedule sched;
+
+  sched.wm = wm;
+  sched.stages = stages;
+  sched.count = count;
+  sched.started = (uint8_t*) calloc(count, sizeof(uint8_t));
+  if (sched.started == NULL) {
+    perror("Failed to allocate worldgen schedule.");
+    exit(errno);
+  }
+  sched.finished = 0;
+  sched.available = WG_P_NONE;
+  omp_init_lock(&(sched.lock));
+  for (i = 0; i < count; ++i) {
+    stages[i].start = -1;
+    stages[i].duration = -1;
+    stages[i].thread = -1;
+  }
+
+  // Stages like topography use parallel loops internally, which would be
+  // serialized inside our task team unless nesting is allowed:
+  old_max_levels = omp_get_max_active_levels();
+  if (old_max_levels < omp_get_level() + 2) {
+    omp_set_max_active_levels(omp_get_level() + 2);
+  }
+
+  sched.epoch = omp_get_wtime();
+#pragma omp parallel num_threads(WG_MAX_CONCURRENT_STAGES)
+  {
+#pragma omp single
+    _launch_ready_stages(&sched);
+    // All tasks (including ones spawned by other tasks) finish at the end of
+    // the single block. The heightmap kernels keep scratch space on whichever
+    // threads ran them, and nothing needs it after worldgen:
+    hm_release_scratch();
+  }
+
+  omp_set_max_active_levels(old_max_levels);
+  omp_destroy_lock(&(sched.lock));
+  free(sched.started);
+
+  if (sched.finished < count) {
+    for (i = 0; i < count; ++i) {
+      if (stages[i].duration < 0) {
+        fprintf(
+          stderr,
+          "ERROR: Worldgen stage '%s' never ran (missing inputs 0x%04x).\n",
+          stages[i].name,
+          stages[i].inputs & ~sched.available
+        );
+      }
+    }
+    exit(EXIT_FAILURE);
+  }
+}
+
+void print_worldgen_timings(FILE *out, worldgen_stage *stages, size_t count) {
+  size_t i;
+  double end, total = 0;
+  fprintf(out, "  ...worldgen stage timings:\n");
+  for (i = 0; i < count; ++i) {
+    end = stages[i].start + stages[i].duration;
+    if (end > total) {
+      total = end;
+    }
+    fprintf(
+      out,
+      "    %-46s %8.3fs (at %8.3fs on thread %d)\n",
+      stages[i].name,
+      stages[i].duration,
+      stages[i].start,
+      stages[i].thread
+    );
+  }
+  fprintf(out, "    %-46s %8.3fs\n", "total (wall clock)", total);
 }
 
 void cleanup_worldgen() {
@@ -297,7 +665,7 @@ void compute_manifold(world_map *wm) {
 }
 
 void world_cell(world_map *wm, global_pos *glpos, cell *result) {
-  static world_region *neighborhood[9];
+  world_region *neighborhood[9];
   world_map_pos wmpos;
   // default values:
   result->blocks[0] = b_make_block(B_VOID);
@@ -321,13 +689,69 @@ void world_cell(world_map *wm, global_pos *glpos, cell *result) {
 void generate_chunk(chunk *c) {
   block_index idx;
   global_pos glpos;
+  chunk_bounds bounds;
+  cell fill;
+  cell *cl;
+  // See whether the whole chunk can be filled at once (uniform chunks don't
+  // need a cell array at all):
+  if (_classify_chunk(&(c->glcpos), &bounds, &fill)) {
+    c_make_uniform(c, &fill);
+    return;
+  }
+  // Every cell gets overwritten, so we can rebuild the growth index as we go:
+  c_expand_cells(c);
+  c_reset_growth_index(c);
   // Generate base materials:
   idx.xyz.w = 0;
   for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
     for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
       for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
         cidx__glpos(c, &idx, &glpos);
-        world_cell(THE_WORLD, &glpos, c_cell(c, idx));
+        cl = c_edit_cell(c, idx);
+        if (
+          cb_open_above(&bounds, idx.xyz.x, idx.xyz.y, glpos.z)
+        && glpos.z > TR_HEIGHT_SEA_LEVEL
+        ) {
+          // Nothing but air this high up:
+          cl->blocks[0] = b_make_block(B_AIR);
+          cl->blocks[1] = b_make_block(B_VOID);
+        } else {
+          world_cell(THE_WORLD, &glpos, cl);
+        }
+        if (bi_grws(cl->blocks[0])) {
+          c_note_growing_block(c, idx);
+        }
+        if (bi_grws(cl->blocks[1])) {
+          idx.xyz.w = 1;
+          c_note_growing_block(c, idx);
+          idx.xyz.w = 0;
+        }
+      }
+    }
+  }
+  // Chunks that couldn't be classified in advance might still turn out to be
+  // uniform (e.g., if caves hollow them out entirely):
+  c_compact_cells(c);
+}
+
+void generate_chunk_approximation(chunk_approximation *ca) {
+  int step = (1 << (ca->detail));
+  block_index idx;
+  global_pos glpos;
+  chunk_bounds bounds;
+  cell fill;
+  TRACE_SCOPE("approximation generation");
+  if (_classify_chunk(&(ca->glcpos), &bounds, &fill)) {
+    ca_make_uniform(ca, &fill);
+    return;
+  }
+  // TODO: Better approximation?
+  idx.xyz.w = 0;
+  for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; idx.xyz.x += step) {
+    for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; idx.xyz.y += step) {
+      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; idx.xyz.z += step) {
+        caidx__glpos(ca, &idx, &glpos);
+        world_cell(THE_WORLD, &glpos, ca_edit_cell(ca, idx));
       }
     }
   }
@@ -5,6 +5,7 @@
 // World map generation.
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "noise/noise.h"
 #include "world/blocks.h"
@@ -14,10 +15,42 @@
 #include "geology.h"
 #include "climate.h"
 
+/**************
+ * Structures *
+ **************/
+
+// A bitmask of world map products (see wg_product_e):
+typedef uint32_t wg_product;
+
+// A worldgen stage: one step of world map generation (or a preview render)
+// along with the products that it reads and writes.
+struct worldgen_stage_s;
+typedef struct worldgen_stage_s worldgen_stage;
+
 /*************
  * Constants *
  *************/
 
+// How many worldgen stages may run at once:
+#define WG_MAX_CONCURRENT_STAGES 4
+
+// World map products. A stage may start once every product in its inputs has
+// been written by a finished stage.
+enum wg_product_e {
+  WG_P_NONE        = 0x0000,
+  WG_P_REGIONS     = 0x0001, // region positions, seeds, anchors, and defaults
+  WG_P_ELEMENTS    = 0x0002, // element species
+  WG_P_TECTONICS   = 0x0004, // the tectonic sheet
+  WG_P_TOPOGRAPHY  = 0x0008, // terrain heights and flow
+  WG_P_HYDROLOGY   = 0x0010, // bodies of water and rivers
+  WG_P_CLIMATE     = 0x0020, // temperature, wind, clouds, and precipitation
+  WG_P_GEOLOGY     = 0x0040, // strata
+  WG_P_SUMMARY     = 0x0080, // altitude/precipitation/temperature categories
+  WG_P_SOIL        = 0x0100, // soil types
+  WG_P_ECOLOGY     = 0x0200, // biomes
+  WG_P_WORLD_SEED  = 0x0400, // the final value of the world map's seed
+};
+
 // The name of the file to write a copy of the world map into:
 extern string const * const WORLD_MAP_FILE_BASE;
 extern string const * const WORLD_MAP_FILE_REGIONS;
@@ -29,6 +62,36 @@ extern string const * const WORLD_MAP_FILE_PQ;
 extern string const * const WORLD_MAP_FILE_RAIN;
 extern string const * const WORLD_MAP_FILE_LRAIN;
 
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct worldgen_stage_s {
+  char const *name; // used for progress messages and timing reports
+  void (*run)(world_map *wm, void *arg); // does the actual work
+  void *arg; // passed through to run
+  wg_product inputs; // products needed before this stage can start
+  wg_product outputs; // products this stage creates
+
+  // Timing information from the most recent run (all -1 if it didn't run):
+  double start; // seconds since the run began
+  double duration; // in seconds
+  int thread; // which thread ran the stage
+};
+
+/***********
+ * Globals *
+ ***********/
+
+// The stages run by setup_worldgen, including the preview map renders. Their
+// timing information is filled in each time they're run.
+extern worldgen_stage WORLDGEN_STAGES[];
+extern size_t const WORLDGEN_STAGE_COUNT;
+
+// Whether generate_chunk fills chunks that hold only one kind of cell (and
+// columns that are open to the sky) in bulk instead of cell by cell:
+extern uint8_t BULK_CHUNK_GENERATION;
+
 /*************
  * Functions *
  *************/
@@ -36,6 +99,19 @@ extern string const * const WORLD_MAP_FILE_LRAIN;
 // Sets up the world map system, including generating the main world map.
 void setup_worldgen(ptrdiff_t seed);
 
+// Runs the given stages on the given world map. Each stage is launched as soon
+// as all of its inputs are available, so stages that don't depend on each
+// other run concurrently. Timing information is recorded in each stage. Exits
+// with an error if some stage's inputs are never produced.
+void run_worldgen_stages(
+  world_map *wm,
+  worldgen_stage *stages,
+  size_t count
+);
+
+// Prints the timing information recorded by run_worldgen_stages.
+void print_worldgen_timings(FILE *out, worldgen_stage *stages, size_t count);
+
 // Cleans up the world map system.
 void cleanup_worldgen();
 
@@ -52,7 +128,16 @@ void world_cell(world_map *wm, global_pos *pos, cell *result);
 // a position. The chunk's existing block data (if any) will be overwritten.
 // Note that there are some further steps before a chunk is fully polished,
 // like adding biology, but these extra steps require basic terrain data
-// generated here from multiple chunks.
+// generated here from multiple chunks. Chunks which provably hold only air,
+// water, or a single kind of stone are filled in bulk (see
+// uniform_terrain_chunk) and stored as uniform chunks (see c_make_uniform),
+// and cells high enough above the ground are filled in bulk too, so only the
+// band around the terrain surface is generated cell by cell.
 void generate_chunk(chunk *c);
 
+// Generates the contents of the given chunk approximation, sampling cells at
+// its level of detail. Uniform approximations are detected just like uniform
+// chunks in generate_chunk.
+void generate_chunk_approximation(chunk_approximation *ca);
+
 #endif // ifndef WORLDGEN_H
@@ -17,6 +17,7 @@
 #include "tex/dta.h"
 
 #include "data/data.h"
+#include "prof/ptrace.h"
 #include "world/blocks.h"
 #include "world/world.h"
 #include "util.h"
@@ -655,6 +656,52 @@ static inline void add_herb_block(
   push_se_nw_face(vb, idx, step, st, light, 0, 0, 0, 0, 0, zf_off);
 }
 
+// Marks the given chunk or approximation as compiled, updating the opaque
+// face flags used for occlusion culling at the same time.
+static inline void mark_compiled(chunk_or_approx *coa) {
+  chunk_flag faces = compute_opaque_faces(coa);
+  if (coa->type == CA_TYPE_CHUNK) {
+    ((chunk *) (coa->ptr))->chunk_flags &= ~CF_OPAQUE_FACES;
+    ((chunk *) (coa->ptr))->chunk_flags |= faces | CF_COMPILED;
+  } else {
+    ((chunk_approximation *) (coa->ptr))->chunk_flags &= ~CF_OPAQUE_FACES;
+    ((chunk_approximation *) (coa->ptr))->chunk_flags |= faces | CF_COMPILED;
+  }
+}
+
+// Returns the fill cell of the given chunk or approximation if it's uniform,
+// or NULL otherwise.
+static inline cell const * uniform_fill(chunk_or_approx *coa) {
+  chunk *c;
+  chunk_approximation *ca;
+  if (coa->type == CA_TYPE_CHUNK) {
+    c = (chunk *) (coa->ptr);
+    return c_is_uniform(c) ? &(c->fill) : NULL;
+  } else if (coa->type == CA_TYPE_APPROXIMATION) {
+    ca = (chunk_approximation *) (coa->ptr);
+    return ca_is_uniform(ca) ? &(ca->fill) : NULL;
+  }
+  return NULL;
+}
+
+// Whether the given cell is far enough from the edges of its chunk that all of
+// its neighbors are in the same chunk.
+static inline int interior_xy(block_index idx, int step) {
+  return (
+    idx.xyz.x >= step && idx.xyz.x <= CHUNK_SIZE - 2*step
+ && idx.xyz.y >= step && idx.xyz.y <= CHUNK_SIZE - 2*step
+  );
+}
+
+// Steps along a column of cells. In a hollow column (one whose interior cells
+// can't be exposed) this skips straight from the bottom cell to the top one.
+static inline int next_z(int z, int step, int hollow) {
+  if (hollow && z == 0) {
+    return CHUNK_SIZE - step;
+  }
+  return z + step;
+}
+
 /*************
  * Functions *
  *************/
@@ -671,6 +718,8 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
   vertex_buffer *vb;
   block_info geom;
   int step = 1;
+  cell const *fill;
+  int hollow = 0;
   cube_illumination ext_lighting;
   cube_illumination int_lighting;
 
@@ -680,6 +729,7 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
 
   // A pointer to an array of vertex buffers:
   vertex_buffer (*layers)[] = NULL;
+  TRACE_SCOPE("compile chunk");
   if (coa->type == CA_TYPE_CHUNK) {
     c = (chunk *) (coa->ptr);
     ca = NULL;
@@ -697,9 +747,6 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
     return;
   }
 
-  // Get the chunk neighborhood:
-  fill_approx_neighborhood(glcpos, &apx_nbh);
-
   uint16_t counts[N_LAYERS];
   uint16_t total = 0;
   layer i;
@@ -708,12 +755,36 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
     counts[i] = 0;
     reset_vertex_buffer(&((*layers)[i]));
   }
+
+  // A uniform chunk full of invisible blocks (like air) has no geometry at
+  // all, and in one full of solid opaque blocks only the cells on its surface
+  // can be exposed:
+  fill = uniform_fill(coa);
+  if (fill != NULL) {
+    if (b_is_invisible(fill->blocks[0]) && b_is_invisible(fill->blocks[1])) {
+      mark_compiled(coa);
+      return;
+    }
+    hollow = (
+      b_is_opaque(fill->blocks[0])
+   && bi_geom(fill->blocks[0]) == BI_GEOM_SOLID
+   && b_is_invisible(fill->blocks[1])
+    );
+  }
+
+  // Get the chunk neighborhood:
+  fill_approx_neighborhood(glcpos, &apx_nbh);
+
   block_index idx;
   cell *here = NULL;
   block exposure = 0;
   for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; idx.xyz.x += step) {
     for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; idx.xyz.y += step) {
-      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; idx.xyz.z += step) {
+      for (
+        idx.xyz.z = 0;
+        idx.xyz.z < CHUNK_SIZE;
+        idx.xyz.z = next_z(idx.xyz.z, step, hollow && interior_xy(idx, step))
+      ) {
         if (coa->type == CA_TYPE_CHUNK) {
           here = c_cell(c, idx);
         } else {
@@ -740,11 +811,7 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
     for (i = 0; i < N_LAYERS; ++i) {
       reset_vertex_buffer(&((*layers)[i]));
     }
-    if (coa->type == CA_TYPE_CHUNK) {
-      c->chunk_flags |= CF_COMPILED;
-    } else {
-      ca->chunk_flags |= CF_COMPILED;
-    }
+    mark_compiled(coa);
     return;
   }
 
@@ -778,7 +845,11 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
 
   for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; idx.xyz.x += step) {
     for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; idx.xyz.y += step) {
-      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; idx.xyz.z += step) {
+      for (
+        idx.xyz.z = 0;
+        idx.xyz.z < CHUNK_SIZE;
+        idx.xyz.z = next_z(idx.xyz.z, step, hollow && interior_xy(idx, step))
+      ) {
         // get local cell and neighbors:
         fill_cell_neighborhood(idx, &apx_nbh, &cl_nbh, step, &dummy);
         here = cl_nbh.members[NBH_CENTER];
@@ -896,9 +967,5 @@ void compile_chunk_or_approx(chunk_or_approx *coa) {
     }
   }
   // Mark the chunk as compiled:
-  if (coa->type == CA_TYPE_CHUNK) {
-    c->chunk_flags |= CF_COMPILED;
-  } else {
-    ca->chunk_flags |= CF_COMPILED;
-  }
+  mark_compiled(coa);
 }
@@ -26,6 +26,7 @@
 #include "world/world.h"
 #include "world/entities.h"
 #include "data/data.h"
+#include "data/render_set.h"
 #include "prof/ptime.h"
 #include "ui/ui.h"
 #include "gen/worldgen.h"
@@ -86,48 +87,14 @@ float THIRD_PERSON_DISTANCE = 3.2;
 
 float FOG_DENSITY = 0.01;
 
+uint8_t OCCLUSION_CULLING = 1;
+
 area_render_callback AREA_PRE_RENDER_CALLBACK = NULL;
 
 /*********************
  * Private Functions *
  *********************/
 
-// Takes a distance and returns the highest level of detail desired at that
-// distance.
-static inline lod desired_detail(gl_cpos_t dist) {
-  lod result = LOD_BASE;
-  gl_cpos_t mrd = 0;
-  for (result = LOD_BASE; result < N_LODS; ++result) {
-    mrd = MAX_RENDER_DISTANCES[result];
-    if (dist <= mrd) {
-      break;
-    }
-  }
-  return result;
-}
-
-static inline void compute_hv_angles(
-  vector const * const obs, // the vector from the eye to the observed object
-  vector const * const eye_fwd, // three basis vectors for the eye-space
-    vector const * const eye_side,
-    vector const * const eye_up,
-  float * xangle, float * yangle // outputs
-) {
-  vector tmp;
-  vcopy_as(&tmp, obs);
-  // 1: transform the observation vector into eye-space:
-  vintermsof(
-    &tmp,
-    eye_side, // x becomes the sideways direction
-    eye_fwd, // y becomes the forwards direction
-    eye_up // z is still the upwards direction
-  );
-
-  // 3: compute horizontal and vertical angles:
-  *xangle = atan2(tmp.x, tmp.y);
-  *yangle = atan2(tmp.z, tmp.y);
-}
-
 // DEBUG: draw a set of basis vectors at the given location:
 static inline void draw_basis_vectors(
   vector const * const view_origin,
@@ -210,9 +177,6 @@ void render_area(
   size_t which_chunk; // which chunk we're rendering
   size_t n_visible_chunks; // how many chunks are visible
   size_t count = 0; // A count of how many chunks we rendered
-  float xangle = 0; // horizontal angle to chunk being considered
-  float yangle = 0; // vertical angle to chunk being considered
-  int cull = 0; // Whether to cull this chunk
   global_pos cursor; // The area-local cursor position
 
   // Set the fog density:
@@ -236,10 +200,6 @@ void render_area(
 
   vector side_vector; // the cross product of the view and up vectors
 
-  // The vector from the viewing position to the chunk being rendered, both in 
-  // standard coordinates and in eye-space.
-  vector chunk_vector;
-
   // Compute the eye, up, and side vectors:
   vface(&eye_vector, yaw, pitch);
   vface(&up_vector, yaw, pitch + M_PI_2);
@@ -335,142 +295,36 @@ void render_area(
   render_world_neighborhood(&wmorigin, &(area->origin));
   */
 
-  // Some loop variables:
-  global_chunk_pos origin;
-  global_chunk_pos glcpos;
   layer ly;
-
-  glpos__glcpos(&(area->origin), &origin);
+  render_view view;
 
 #ifdef PROFILE_TIME
     start_duration(&RENDER_CORE_TIME);
 #endif
-  // Iterate over chunk positions in a sphere:
-  gl_cpos_t farthest_render_distance = MAX_RENDER_DISTANCES[N_LODS - 1];
-  gl_cpos_t skipy = 0, skipz = 0, xdist_sq = 0, xydist_sq = 0, dist = 0;
-
-  // The main loop: loop over a spherical region out to the farthest render
-  // distance, getting the best data for each chunk (subject to render
-  // distance constraints) and checking cull angles.
-  which_chunk = 0;
-  for (
-    glcpos.x = origin.x - farthest_render_distance;
-    glcpos.x < origin.x + farthest_render_distance + 1;
-    ++glcpos.x
-  ) {
-    chunk_vector.x = (glcpos.x - origin.x) * CHUNK_SIZE - view_origin.x;
-    xdist_sq = (glcpos.x - origin.x);
-    xdist_sq *= xdist_sq;
-    skipy = farthest_render_distance - fastceil(
-      sqrt(farthest_render_distance*farthest_render_distance - xdist_sq)
-    );
-    for (
-      glcpos.y = origin.y - farthest_render_distance + skipy;
-      glcpos.y < origin.y + farthest_render_distance + 1 - skipy;
-      ++glcpos.y
-    ) { 
-      chunk_vector.y = (glcpos.y - origin.y) * CHUNK_SIZE - view_origin.y;
-      xydist_sq = (glcpos.y - origin.y);
-      xydist_sq *= xydist_sq;
-      xydist_sq += xdist_sq;
-      skipz = farthest_render_distance - fastceil(
-        sqrt(farthest_render_distance*farthest_render_distance - xydist_sq)
-      );
-      for (
-        glcpos.z = origin.z - farthest_render_distance + skipz;
-        glcpos.z < origin.z + farthest_render_distance + 1 - skipz;
-        ++glcpos.z
-      ) { 
-#ifdef PROFILE_TIME
-        start_duration(&RENDER_INNER_TIME);
-#endif
-        chunk_vector.z = (glcpos.z - origin.z) * CHUNK_SIZE - view_origin.z;
-        dist = (glcpos.z - origin.z);
-        dist *= dist;
-        dist += xydist_sq;
-        dist = sqrtf(dist);
-        // Compute angle to chunk:
-        compute_hv_angles(
-          &chunk_vector,
-          &view_vector, &side_vector, &up_vector,
-          &xangle, &yangle
-        );
-        cull = ( // chunk is farther than the min cull distance
-          (
-            fabs(chunk_vector.x) +
-            fabs(chunk_vector.y) +
-            fabs(chunk_vector.z)
-          ) > MIN_CULL_DIST
-        &&
-          ( // and it fails the frustum test
-            fabs(xangle) > (fovx/2) + RENDER_ANGLE_ALLOWANCE
-          ||
-            fabs(yangle) > (fovy/2) + RENDER_ANGLE_ALLOWANCE
-          )
-        );
-     
-        // DEBUG: Draw vectors to nearby chunks:
-        /*
-        use_pipeline(&RAW_PIPELINE);
-        if (
-          (
-            fabs(chunk_vector.x) +
-            fabs(chunk_vector.y) +
-            fabs(chunk_vector.z)
-          ) < CHUNK_SIZE * 3
-        ) {
-          glColor4ub(255, 255, 0, 255);
-          //glLineWidth(2);
-          glBegin( GL_LINES );
-          glVertex3f(
-            view_origin.x + view_vector.x,
-            view_origin.y + view_vector.y,
-            view_origin.z + view_vector.z
-          );
-          glVertex3f(
-            view_origin.x + chunk_vector.x,
-            view_origin.y + chunk_vector.y,
-            view_origin.z + chunk_vector.z
-          );
-          glEnd();
-          glColor4ub(255, 255, 128, 255);
-          glPointSize(10);
-          glBegin( GL_POINTS );
-          glVertex3f(
-            view_origin.x + chunk_vector.x,
-            view_origin.y + chunk_vector.y,
-            view_origin.z + chunk_vector.z
-          );
-          glEnd();
-        }
-        // */
-        if (!cull) {
-          get_best_data_limited(
-            &glcpos,
-            desired_detail(dist),
-            1,
-            &(chunks_to_render[which_chunk])
-          );
-          if (chunks_to_render[which_chunk].type != CA_TYPE_NOT_LOADED) {
-            which_chunk += 1;
-          }
-          if (which_chunk > MAX_VIEWABLE_CHUNKS) {
-            fprintf(
-              stderr,
-              "ERROR: out of places to store chunks while culling!\n"
-            );
-            fprintf(stderr, "Chunk: %zu\n", which_chunk);
-            fprintf(stderr, "Max: %d\n", MAX_VIEWABLE_CHUNKS);
-            exit(EXIT_FAILURE);
-          }
-        }
-#ifdef PROFILE_TIME
-        end_duration(&RENDER_INNER_TIME);
-#endif
-      }
-    }
-  }
-  n_visible_chunks = which_chunk;
+  // Collect visible chunks from the render set, which the data subsystem
+  // keeps up-to-date as chunks are compiled and evicted. Each one is drawn
+  // using the best compiled data available at or below the level of detail
+  // desired at its distance, provided its bounding sphere intersects the view
+  // frustum and (with occlusion culling on) it isn't hidden behind opaque
+  // chunks.
+  copy_glpos(&(area->origin), &(view.origin));
+  glpos__glcpos(&(area->origin), &(view.center));
+  view.min_cull_dist = MIN_CULL_DIST;
+  view.max_distances = MAX_RENDER_DISTANCES;
+  view.occlusion_cull = OCCLUSION_CULLING;
+  rv_set_frustum(
+    &view,
+    &view_origin,
+    &view_vector, &side_vector, &up_vector,
+    (fovx/2) + RENDER_ANGLE_ALLOWANCE,
+    (fovy/2) + RENDER_ANGLE_ALLOWANCE
+  );
+  n_visible_chunks = rs_collect_visible(
+    RENDER_SET,
+    &view,
+    chunks_to_render,
+    MAX_VIEWABLE_CHUNKS
+  );
 
   // TODO: per-layer pipelines...
   use_pipeline(&CELL_PIPELINE);
@@ -538,8 +392,11 @@ void render_area(
   );
   // */
 
-  // Update the count of rendered layers:
+  // Update the count of rendered layers and of what occlusion culling saved:
   update_count(&CHUNK_LAYERS_RENDERED, count);
+  update_count(&CHUNKS_OCCLUDED, RENDER_SET->n_occluded);
+  update_count(&DRAWS_OCCLUDED, RENDER_SET->occluded_draws);
+  update_count(&VERTICES_OCCLUDED, RENDER_SET->occluded_vertices);
 }
 
 // This function renders one layer of the given chunk. It returns 1 if it
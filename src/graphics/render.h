@@ -72,6 +72,10 @@ extern float THIRD_PERSON_DISTANCE;
 // The fog distance:
 extern float FOG_DENSITY;
 
+// Whether to skip chunks hidden behind opaque chunk faces (see
+// rs_collect_visible):
+extern uint8_t OCCLUSION_CULLING;
+
 // A callback to call after the model view matrix is set up but before anything
 // is rendered in render_area:
 typedef void (*area_render_callback)(active_entity_area *);
@@ -1,16 +1,259 @@
 // jobs.c
 // Asynchronous jobs.
 
+#include <stdio.h>
+#include <errno.h>
+
+#include <omp.h>
+
 #include "datatypes/queue.h"
+#include "datatypes/promise.h"
+
+#include "prof/ptrace.h"
+
+#include "util.h"
 
 #include "jobs.h"
 
+/**************
+ * Structures *
+ **************/
+
+// A promise continuation waiting to be run as a job:
+struct promise_task_s {
+  void (*task)(void *);
+  void *arg;
+};
+typedef struct promise_task_s promise_task;
+
 /***********
  * Globals *
  ***********/
 
 queue* ACTIVE_JOBS = NULL;
 
+job_pool* JOB_POOL = NULL;
+
+/*******************
+ * Private Globals *
+ *******************/
+
+// The worker (if any) that the current thread is working as:
+static __thread job_worker *CURRENT_WORKER = NULL;
+
+// The pool that promise continuations are dispatched to:
+static job_pool *PROMISE_POOL = NULL;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+static void _jd_init(job_deque *d) {
+  d->items = (work_state**) malloc(
+    JOB_DEQUE_INITIAL_CAPACITY * sizeof(work_state*)
+  );
+  if (d->items == NULL) {
+    perror("Failed to allocate job deque");
+    exit(errno);
+  }
+  d->head = 0;
+  d->count = 0;
+  d->capacity = JOB_DEQUE_INITIAL_CAPACITY;
+  omp_init_lock(&(d->lock));
+}
+
+static void _jd_free(job_deque *d) {
+  free(d->items);
+  omp_destroy_lock(&(d->lock));
+}
+
+// Doubles the capacity of the given deque, which must be locked.
+static void _jd_grow(job_deque *d) {
+  size_t i;
+  work_state **items = (work_state**) malloc(
+    2 * d->capacity * sizeof(work_state*)
+  );
+  if (items == NULL) {
+    perror("Failed to grow job deque");
+    exit(errno);
+  }
+  for (i = 0; i < d->count; ++i) {
+    items[i] = d->items[(d->head + i) % d->capacity];
+  }
+  free(d->items);
+  d->items = items;
+  d->head = 0;
+  d->capacity *= 2;
+}
+
+static inline int _jd_looks_empty(job_deque *d) {
+  // Just a hint (the count can change right after we read it), but it saves
+  // taking the lock on the many empty deques that a search for work visits.
+  return __atomic_load_n(&(d->count), __ATOMIC_RELAXED) == 0;
+}
+
+static void _jd_push_bottom(job_deque *d, work_state *ws) {
+  omp_set_lock(&(d->lock));
+  if (d->count == d->capacity) {
+    _jd_grow(d);
+  }
+  d->items[(d->head + d->count) % d->capacity] = ws;
+  __atomic_store_n(&(d->count), d->count + 1, __ATOMIC_RELAXED);
+  omp_unset_lock(&(d->lock));
+}
+
+static void _jd_push_top(job_deque *d, work_state *ws) {
+  omp_set_lock(&(d->lock));
+  if (d->count == d->capacity) {
+    _jd_grow(d);
+  }
+  d->head = (d->head + d->capacity - 1) % d->capacity;
+  d->items[d->head] = ws;
+  __atomic_store_n(&(d->count), d->count + 1, __ATOMIC_RELAXED);
+  omp_unset_lock(&(d->lock));
+}
+
+static work_state* _jd_pop_bottom(job_deque *d) {
+  work_state *result = NULL;
+  if (_jd_looks_empty(d)) {
+    return NULL;
+  }
+  omp_set_lock(&(d->lock));
+  if (d->count > 0) {
+    result = d->items[(d->head + d->count - 1) % d->capacity];
+    __atomic_store_n(&(d->count), d->count - 1, __ATOMIC_RELAXED);
+  }
+  omp_unset_lock(&(d->lock));
+  return result;
+}
+
+static work_state* _jd_pop_top(job_deque *d) {
+  work_state *result = NULL;
+  if (_jd_looks_empty(d)) {
+    return NULL;
+  }
+  omp_set_lock(&(d->lock));
+  if (d->count > 0) {
+    result = d->items[d->head];
+    d->head = (d->head + 1) % d->capacity;
+    __atomic_store_n(&(d->count), d->count - 1, __ATOMIC_RELAXED);
+  }
+  omp_unset_lock(&(d->lock));
+  return result;
+}
+
+static inline void _ws_release(work_state *ws) {
+  if (__atomic_sub_fetch(&(ws->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+    cleanup_work_state(ws);
+  }
+}
+
+// Marks the given job as done and drops the pool's reference to it.
+static void _jp_finish(job_pool *jp, work_state *ws) {
+  __atomic_store_n(&(ws->done), 1, __ATOMIC_RELEASE);
+  _ws_release(ws);
+  __atomic_sub_fetch(&(jp->pending), 1, __ATOMIC_ACQ_REL);
+}
+
+static void _jp_enqueue(job_pool *jp, work_state *ws) {
+  job_worker *w = CURRENT_WORKER;
+  __atomic_add_fetch(&(jp->pending), 1, __ATOMIC_ACQ_REL);
+  if (w != NULL && w->pool == jp) {
+    _jd_push_bottom(&(w->deques[ws->priority]), ws);
+  } else {
+    _jd_push_bottom(&(jp->injected[ws->priority]), ws);
+  }
+  // Pairs with the fence in _jp_sleep: either a sleeper sees the new job
+  // before waiting, or we see the sleeper here and wake it up.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&(jp->sleeping), __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&(jp->sleep_lock));
+    pthread_cond_signal(&(jp->wake));
+    pthread_mutex_unlock(&(jp->sleep_lock));
+  }
+}
+
+// Finds the next job for the given worker: its own newest work first, then
+// the oldest work submitted from outside the pool, then the oldest work from
+// other workers, checking each priority in turn.
+static work_state* _jp_next_job(job_worker *w) {
+  job_pool *jp = w->pool;
+  work_state *result = NULL;
+  size_t i, k, p;
+  int fair = (w->picks % JOB_FAIRNESS_INTERVAL) == JOB_FAIRNESS_INTERVAL - 1;
+  for (i = 0; i < N_JOB_PRIORITIES && result == NULL; ++i) {
+    p = fair ? N_JOB_PRIORITIES - 1 - i : i;
+    result = _jd_pop_bottom(&(w->deques[p]));
+    if (result != NULL) { break; }
+    result = _jd_pop_top(&(jp->injected[p]));
+    if (result != NULL) { break; }
+    for (k = 1; k < jp->n_workers; ++k) {
+      result = _jd_pop_top(
+        &(jp->workers[(w->index + k) % jp->n_workers].deques[p])
+      );
+      if (result != NULL) {
+        w->steals += 1;
+        break;
+      }
+    }
+  }
+  if (result != NULL) {
+    w->picks += 1;
+  }
+  return result;
+}
+
+// Blocks the given worker until there might be work for it (or the pool is
+// stopping), and returns the job it found, if any.
+static work_state* _jp_sleep(job_worker *w) {
+  job_pool *jp = w->pool;
+  work_state *result = NULL;
+  pthread_mutex_lock(&(jp->sleep_lock));
+  __atomic_add_fetch(&(jp->sleeping), 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  // Check once more now that enqueuers can see us:
+  result = _jp_next_job(w);
+  if (result == NULL && !__atomic_load_n(&(jp->stopping), __ATOMIC_ACQUIRE)) {
+    pthread_cond_wait(&(jp->wake), &(jp->sleep_lock));
+  }
+  __atomic_sub_fetch(&(jp->sleeping), 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&(jp->sleep_lock));
+  return result;
+}
+
+static void _jp_run_step(job_worker *w, work_state *ws) {
+  TRACE_SCOPE("job step");
+  if (!__atomic_load_n(&(ws->cancelled), __ATOMIC_ACQUIRE)) {
+    do_step_for(ws);
+    if (
+      ws->j != NULL
+   && !__atomic_load_n(&(ws->cancelled), __ATOMIC_ACQUIRE)
+    ) {
+      // Not done yet: let other work of the same priority go first.
+      _jd_push_top(&(w->deques[ws->priority]), ws);
+      return;
+    }
+  }
+  _jp_finish(w->pool, ws);
+}
+
+static void (*_promise_task_job(void *s))() {
+  promise_task *pt = (promise_task*) s;
+  pt->task(pt->arg);
+  return NULL;
+}
+
+static void _dispatch_promise_task(void (*task)(void *), void *arg) {
+  promise_task *pt = (promise_task*) malloc(sizeof(promise_task));
+  if (pt == NULL) {
+    perror("Failed to allocate promise task");
+    exit(errno);
+  }
+  pt->task = task;
+  pt->arg = arg;
+  jp_start(PROMISE_POOL, &_promise_task_job, pt, NULL, JOB_PRIORITY_HIGH);
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -20,6 +263,10 @@ work_state* create_work_state(job j, void *s, job_cleanup cl) {
   result->j = j;
   result->s = s;
   result->cl = cl;
+  result->priority = JOB_PRIORITY_NORMAL;
+  result->cancelled = 0;
+  result->done = 0;
+  result->refs = 1;
   return result;
 }
 
@@ -36,17 +283,86 @@ void cleanup_work_state_in_queue(void *wsp) {
   cleanup_work_state((work_state *) wsp);
 }
 
+job_pool* create_job_pool(size_t n_workers) {
+  size_t i, p;
+  job_pool *result = (job_pool*) malloc(sizeof(job_pool));
+  if (result == NULL) {
+    perror("Failed to allocate job pool");
+    exit(errno);
+  }
+  if (n_workers < 1) {
+    n_workers = 1;
+  }
+  result->n_workers = n_workers;
+  result->workers = (job_worker*) malloc(n_workers * sizeof(job_worker));
+  if (result->workers == NULL) {
+    perror("Failed to allocate job workers");
+    exit(errno);
+  }
+  for (i = 0; i < n_workers; ++i) {
+    result->workers[i].pool = result;
+    result->workers[i].index = i;
+    for (p = 0; p < N_JOB_PRIORITIES; ++p) {
+      _jd_init(&(result->workers[i].deques[p]));
+    }
+    result->workers[i].picks = 0;
+    result->workers[i].steals = 0;
+  }
+  for (p = 0; p < N_JOB_PRIORITIES; ++p) {
+    _jd_init(&(result->injected[p]));
+  }
+  result->pending = 0;
+  result->active = 0;
+  result->stopping = 0;
+  result->sleeping = 0;
+  pthread_mutex_init(&(result->sleep_lock), NULL);
+  pthread_cond_init(&(result->wake), NULL);
+  return result;
+}
+
+CLEANUP_IMPL(job_pool) {
+  size_t i, p;
+  work_state *ws;
+  for (p = 0; p < N_JOB_PRIORITIES; ++p) {
+    for (i = 0; i < doomed->n_workers; ++i) {
+      while ((ws = _jd_pop_top(&(doomed->workers[i].deques[p]))) != NULL) {
+        ws->cancelled = 1;
+        _jp_finish(doomed, ws);
+      }
+      _jd_free(&(doomed->workers[i].deques[p]));
+    }
+    while ((ws = _jd_pop_top(&(doomed->injected[p]))) != NULL) {
+      ws->cancelled = 1;
+      _jp_finish(doomed, ws);
+    }
+    _jd_free(&(doomed->injected[p]));
+  }
+  pthread_cond_destroy(&(doomed->wake));
+  pthread_mutex_destroy(&(doomed->sleep_lock));
+  free(doomed->workers);
+  free(doomed);
+}
+
 /*************
  * Functions *
  *************/
 
-void setup_jobs() {
+void setup_jobs(void) {
+  // Leave room for the two main threads, and give the pool only half of the
+  // remaining cores: the data thread's biogen waves fan out over the rest
+  // (see BIOGEN_THREADS).
+  int n_workers = (omp_get_num_procs() - 2) / 2;
   ACTIVE_JOBS = create_queue();
+  JOB_POOL = create_job_pool(n_workers < 1 ? 1 : (size_t) n_workers);
+  jp_run_promises(JOB_POOL);
 }
 
-void cleanup_jobs() {
+void cleanup_jobs(void) {
   q_foreach(ACTIVE_JOBS, &cleanup_work_state_in_queue);
   cleanup_queue(ACTIVE_JOBS);
+  jp_run_promises(NULL);
+  cleanup_job_pool(JOB_POOL);
+  JOB_POOL = NULL;
 }
 
 void start_job(job j, void *s, job_cleanup cl) {
@@ -54,7 +370,7 @@ void start_job(job j, void *s, job_cleanup cl) {
   q_push_element(ACTIVE_JOBS, (void *) ws);
 }
 
-size_t do_step() {
+size_t do_step(void) {
   work_state *nws = (work_state*) q_pop_element(ACTIVE_JOBS);
   if (nws == NULL) {
     return 0; // no work to do at this time
@@ -77,3 +393,97 @@ void run_to_completion(work_state *ws) {
     ws->j = (job) ((*(ws->j))(ws->s));
   }
 }
+
+void jp_start(
+  job_pool *jp,
+  job j,
+  void *s,
+  job_cleanup cl,
+  job_priority priority
+) {
+  work_state *ws = create_work_state(j, s, cl);
+  ws->priority = priority;
+  _jp_enqueue(jp, ws);
+}
+
+work_state* jp_submit(
+  job_pool *jp,
+  job j,
+  void *s,
+  job_cleanup cl,
+  job_priority priority
+) {
+  work_state *ws = create_work_state(j, s, cl);
+  ws->priority = priority;
+  ws->refs = 2; // one for the pool and one for the caller
+  _jp_enqueue(jp, ws);
+  return ws;
+}
+
+void jp_cancel(work_state *ws) {
+  __atomic_store_n(&(ws->cancelled), 1, __ATOMIC_RELEASE);
+}
+
+int jp_is_done(work_state *ws) {
+  return __atomic_load_n(&(ws->done), __ATOMIC_ACQUIRE);
+}
+
+void jp_release(work_state *ws) {
+  _ws_release(ws);
+}
+
+int jp_is_idle(job_pool *jp) {
+  return __atomic_load_n(&(jp->pending), __ATOMIC_ACQUIRE) == 0;
+}
+
+void jp_work(job_pool *jp, size_t worker) {
+  job_worker *w = &(jp->workers[worker]);
+  job_worker *outer = CURRENT_WORKER;
+  work_state *ws;
+  int idle = 0;
+  __atomic_add_fetch(&(jp->active), 1, __ATOMIC_ACQ_REL);
+  CURRENT_WORKER = w;
+  while (!__atomic_load_n(&(jp->stopping), __ATOMIC_ACQUIRE)) {
+    ws = _jp_next_job(w);
+    if (ws == NULL && idle >= JOB_IDLE_SPINS) {
+      ws = _jp_sleep(w);
+    }
+    if (ws != NULL) {
+      _jp_run_step(w, ws);
+      idle = 0;
+    } else if (idle < JOB_IDLE_SPINS) {
+      idle += 1;
+    }
+  }
+  CURRENT_WORKER = outer;
+  __atomic_sub_fetch(&(jp->active), 1, __ATOMIC_ACQ_REL);
+}
+
+size_t jp_run_pending(job_pool *jp, size_t worker, size_t limit) {
+  job_worker *w = &(jp->workers[worker]);
+  job_worker *outer = CURRENT_WORKER;
+  work_state *ws;
+  size_t steps = 0;
+  CURRENT_WORKER = w;
+  while ((limit == 0 || steps < limit) && (ws = _jp_next_job(w)) != NULL) {
+    _jp_run_step(w, ws);
+    steps += 1;
+  }
+  CURRENT_WORKER = outer;
+  return steps;
+}
+
+void jp_shutdown(job_pool *jp) {
+  __atomic_store_n(&(jp->stopping), 1, __ATOMIC_RELEASE);
+  pthread_mutex_lock(&(jp->sleep_lock));
+  pthread_cond_broadcast(&(jp->wake));
+  pthread_mutex_unlock(&(jp->sleep_lock));
+  while (__atomic_load_n(&(jp->active), __ATOMIC_ACQUIRE) > 0) {
+    nap(JOB_IDLE_NAP);
+  }
+}
+
+void jp_run_promises(job_pool *jp) {
+  PROMISE_POOL = jp;
+  PR_DISPATCH = (jp == NULL) ? NULL : &_dispatch_promise_task;
+}
@@ -4,8 +4,30 @@
 // jobs.h
 // Asynchronous jobs.
 
+#include <stdint.h>
+#include <pthread.h>
+
+#include <omp.h>
+
 #include <datatypes/queue.h>
 
+#include "boilerplate.h"
+
+/*********
+ * Enums *
+ *********/
+
+// Job priorities. Workers prefer more urgent jobs, but see
+// JOB_FAIRNESS_INTERVAL.
+enum job_priority_e {
+  JOB_PRIORITY_HIGH = 0,
+  JOB_PRIORITY_NORMAL = 1,
+  JOB_PRIORITY_LOW = 2,
+};
+typedef enum job_priority_e job_priority;
+
+#define N_JOB_PRIORITIES 3
+
 /************************
  * Types and Structures *
  ************************/
@@ -26,11 +48,46 @@ typedef void (*job_cleanup)(void *);
 struct work_state_s;
 typedef struct work_state_s work_state;
 
+// A double-ended queue of work states. The worker that owns a deque works at
+// its bottom while other workers steal from its top.
+struct job_deque_s;
+typedef struct job_deque_s job_deque;
+
+// A job worker is one thread's slot in a job pool.
+struct job_worker_s;
+typedef struct job_worker_s job_worker;
+
+// A job pool runs jobs on a fixed set of workers, each with its own deques
+// (one per priority), stealing from each other when they run out of work.
+struct job_pool_s;
+typedef struct job_pool_s job_pool;
+
+/*************
+ * Constants *
+ *************/
+
+// Once out of every this many jobs a worker looks for the least urgent work
+// first, so that a steady stream of urgent jobs can't starve everything else:
+#define JOB_FAIRNESS_INTERVAL 8
+
+// Starting capacity for each job deque (they grow as needed):
+#define JOB_DEQUE_INITIAL_CAPACITY 64
+
+// How many times an idle worker looks for work before it goes to sleep until
+// more work is submitted:
+#define JOB_IDLE_SPINS 64
+
+// How long jp_shutdown naps while waiting for workers to leave (ms):
+#define JOB_IDLE_NAP 1
+
 /***********
  * Globals *
  ***********/
 
-extern queue* active_jobs;
+extern queue* ACTIVE_JOBS;
+
+// The main job pool (set up by setup_jobs):
+extern job_pool* JOB_POOL;
 
 /*************************
  * Structure Definitions *
@@ -40,11 +97,41 @@ struct work_state_s {
   job j;
   void * s;
   job_cleanup cl;
+  job_priority priority;
+  uint8_t cancelled; // set (atomically) by jp_cancel
+  uint8_t done; // set (atomically) once the job has finished or been dropped
+  uint32_t refs; // number of holders (the pool, plus any handles)
 };
 
-/********************
- * Inline Functions *
- ********************/
+struct job_deque_s {
+  work_state **items; // ring buffer
+  size_t head; // ring index of the top item
+  size_t count;
+  size_t capacity;
+  omp_lock_t lock;
+};
+
+struct job_worker_s {
+  job_pool *pool;
+  size_t index;
+  job_deque deques[N_JOB_PRIORITIES];
+  uint64_t picks; // how many jobs this worker has picked up
+  uint64_t steals; // how many of those were taken from other workers
+};
+
+struct job_pool_s {
+  size_t n_workers;
+  job_worker *workers;
+  // Work submitted from outside the pool:
+  job_deque injected[N_JOB_PRIORITIES];
+  uint64_t pending; // jobs submitted but not yet finished
+  uint32_t active; // workers currently inside jp_work
+  uint8_t stopping; // set by jp_shutdown
+  // Idle workers sleep on this condition until work arrives:
+  uint32_t sleeping; // workers waiting (or about to wait) on wake
+  pthread_mutex_t sleep_lock;
+  pthread_cond_t wake;
+};
 
 /******************************
  * Constructors & Destructors *
@@ -62,22 +149,33 @@ void cleanup_work_state(work_state *ws);
 // Just calls cleanup_work_state on the given void*.
 void cleanup_work_state_in_queue(void *wsp);
 
+// Allocates a new job pool with the given number of workers (at least one).
+// The pool doesn't start any threads of its own: each worker runs when some
+// thread calls jp_work (or jp_run_pending) for it.
+job_pool* create_job_pool(size_t n_workers);
+
+// Cleans up a job pool. Any jobs that never finished are dropped (their
+// cleanup functions are called). No thread may be working for the pool.
+CLEANUP_DECL(job_pool);
+
 /*************
  * Functions *
  *************/
 
-// Sets up the jobs system.
-void setup_jobs();
+// Sets up the jobs system, including the main job pool (with one worker per
+// processor beyond the two main threads). Continuations from pr_then/pr_else
+// are dispatched onto the main pool once it's set up.
+void setup_jobs(void);
 
-// Cleans up the jobs system.
-void cleanup_jobs();
+// Cleans up the jobs system. The main pool should be shut down first.
+void cleanup_jobs(void);
 
 // Adds the given job to the jobs queue.
 void start_job(job j, void *s, job_cleanup cl);
 
 // Runs the next work step on the jobs queue. Returns 1 if it runs a step, and
 // 0 if there are no current jobs.
-size_t do_step();
+size_t do_step(void);
 
 // Runs the next step of the given job, hopefully not blocking for very long.
 void do_step_for(work_state *ws);
@@ -85,4 +183,60 @@ void do_step_for(work_state *ws);
 // Runs the given job to completion, possibly blocking for a while.
 void run_to_completion(work_state *ws);
 
+// Submits the given job to the given pool with the given priority. Jobs
+// submitted from a worker of the pool go onto that worker's own deque, and
+// others are queued for whichever worker gets to them first. The pool runs
+// one step at a time, putting unfinished jobs back behind other work of the
+// same priority.
+void jp_start(
+  job_pool *jp,
+  job j,
+  void *s,
+  job_cleanup cl,
+  job_priority priority
+);
+
+// Works like jp_start, but returns a handle that can be used to check on or
+// cancel the job. The handle must be given back with jp_release.
+work_state* jp_submit(
+  job_pool *jp,
+  job j,
+  void *s,
+  job_cleanup cl,
+  job_priority priority
+);
+
+// Requests cancellation of a job. A job that hasn't started won't be run, and
+// a running job won't get any more steps (the current step isn't interrupted).
+// Either way its cleanup function is still called.
+void jp_cancel(work_state *ws);
+
+// Returns 1 if the given job has finished (or been cancelled and dropped).
+int jp_is_done(work_state *ws);
+
+// Gives back a handle from jp_submit.
+void jp_release(work_state *ws);
+
+// Returns 1 if the given pool has no unfinished jobs.
+int jp_is_idle(job_pool *jp);
+
+// Runs the given worker of the given pool on the calling thread until the pool
+// is shut down. Only one thread may work as a given worker at once.
+void jp_work(job_pool *jp, size_t worker);
+
+// Acts as the given worker of the given pool until no work can be found or
+// the given number of job steps have been run (a limit of 0 means no limit),
+// returning the number of steps run. Useful for helping out from a thread
+// that would otherwise be waiting, and for single-threaded testing.
+size_t jp_run_pending(job_pool *jp, size_t worker, size_t limit);
+
+// Tells all of the pool's workers to stop once they finish their current
+// steps, and waits until they have. Jobs that haven't finished stay queued
+// until the pool is cleaned up.
+void jp_shutdown(job_pool *jp);
+
+// Makes PR_DISPATCH run promise continuations as high-priority jobs on the
+// given pool (or immediately, if jp is NULL).
+void jp_run_promises(job_pool *jp);
+
 #endif // ifndef JOBS_H
@@ -0,0 +1,175 @@
+// test_jobs_perf.c
+// Measures job throughput for the old global job queue and the job pool.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "util.h"
+
+#include "datatypes/queue.h"
+
+#include "jobs.h"
+
+// How many jobs each timing run goes through:
+#define N_JOBS 200000
+
+// How many rounds of busy-work each job does:
+#define JOB_WORK 32
+
+// Each configuration is timed repeatedly until at least this much time has
+// passed:
+#define MIN_SECONDS 0.5
+
+// Worker counts to try (anything above the number of processors is skipped):
+static size_t const WORKER_COUNTS[] = { 1, 2, 4, 8, 16, 0 };
+
+static uint64_t FINISHED = 0;
+
+static job_pool *SPAWN_POOL = NULL;
+
+// A tiny job: a little bit of arithmetic and a counter bump.
+static void (*tiny_job(void *s))() {
+  ptrdiff_t *seed = (ptrdiff_t*) s;
+  size_t i;
+  for (i = 0; i < JOB_WORK; ++i) {
+    *seed = prng(*seed);
+  }
+  __atomic_add_fetch(&FINISHED, 1, __ATOMIC_ACQ_REL);
+  return NULL;
+}
+
+static ptrdiff_t* tiny_state(size_t i) {
+  ptrdiff_t *result = (ptrdiff_t*) malloc(sizeof(ptrdiff_t));
+  *result = (ptrdiff_t) i;
+  return result;
+}
+
+// Submits all of the tiny jobs from inside a worker, so that the other workers
+// have to steal them.
+static void (*spawn_job(void *s))() {
+  size_t i;
+  for (i = 0; i < N_JOBS; ++i) {
+    jp_start(SPAWN_POOL, &tiny_job, tiny_state(i), NULL, JOB_PRIORITY_NORMAL);
+  }
+  return NULL;
+}
+
+static void report(
+  char const * const name,
+  size_t workers,
+  size_t reps,
+  double elapsed,
+  uint64_t steals
+) {
+  printf(
+    "%-24s %3zu worker(s) %8.1f ns/job %12.0f jobs/s %6.1f%% stolen\n",
+    name,
+    workers,
+    elapsed * 1000000000.0 / (reps * N_JOBS),
+    (reps * N_JOBS) / elapsed,
+    100.0 * steals / (reps * N_JOBS)
+  );
+}
+
+// The single-threaded ACTIVE_JOBS queue that the game used before job pools.
+static void bench_queue(void) {
+  size_t i, reps = 0;
+  double start, elapsed;
+  start = omp_get_wtime();
+  do {
+    for (i = 0; i < N_JOBS; ++i) {
+      start_job(&tiny_job, tiny_state(i), NULL);
+    }
+    while (do_step()) {}
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  report("global queue (old)", 1, reps, elapsed, 0);
+}
+
+// Runs N_JOBS tiny jobs through a fresh pool with the given number of
+// workers, either submitting them from outside or spawning them from inside
+// the pool. Returns the elapsed time and adds to the given steal count.
+static double run_pool(size_t n_workers, int spawn, uint64_t *steals) {
+  job_pool *jp = create_job_pool(n_workers);
+  double start = 0, elapsed = 0;
+  size_t i;
+  SPAWN_POOL = jp;
+  FINISHED = 0;
+#pragma omp parallel num_threads(n_workers + 1) private(i)
+  {
+    int id = omp_get_thread_num();
+    if (id > 0) {
+      jp_work(jp, (size_t) (id - 1));
+    } else {
+      start = omp_get_wtime();
+      if (spawn) {
+        jp_start(jp, &spawn_job, tiny_state(0), NULL, JOB_PRIORITY_NORMAL);
+      } else {
+        for (i = 0; i < N_JOBS; ++i) {
+          jp_start(jp, &tiny_job, tiny_state(i), NULL, JOB_PRIORITY_NORMAL);
+        }
+      }
+      while (!jp_is_idle(jp)) {}
+      elapsed = omp_get_wtime() - start;
+      jp_shutdown(jp);
+    }
+  }
+  if (FINISHED != N_JOBS) {
+    fprintf(
+      stderr,
+      "Error: only %lu of %d jobs finished.\n",
+      (unsigned long) FINISHED,
+      N_JOBS
+    );
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < n_workers; ++i) {
+    *steals += jp->workers[i].steals;
+  }
+  cleanup_job_pool(jp);
+  return elapsed;
+}
+
+static void bench_pool(char const * const name, size_t n_workers, int spawn) {
+  size_t reps = 0;
+  double elapsed = 0;
+  uint64_t steals = 0;
+  do {
+    elapsed += run_pool(n_workers, spawn, &steals);
+    reps += 1;
+  } while (elapsed < MIN_SECONDS);
+  report(name, n_workers, reps, elapsed, steals);
+}
+
+int main(int argc, char** argv) {
+  size_t i;
+  size_t n_procs = (size_t) omp_get_num_procs();
+
+  omp_set_dynamic(0);
+  setup_jobs();
+
+  printf(
+    "%d tiny jobs per run, %zu processors available.\n",
+    N_JOBS,
+    n_procs
+  );
+  bench_queue();
+  for (i = 0; WORKER_COUNTS[i] != 0; ++i) {
+    if (WORKER_COUNTS[i] > n_procs) {
+      break;
+    }
+    bench_pool("pool (submitted)", WORKER_COUNTS[i], 0);
+  }
+  for (i = 0; WORKER_COUNTS[i] != 0; ++i) {
+    if (WORKER_COUNTS[i] > n_procs) {
+      break;
+    }
+    bench_pool("pool (spawned)", WORKER_COUNTS[i], 1);
+  }
+
+  cleanup_jobs();
+  return 0;
+}
@@ -3,6 +3,9 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "noise.h"
 
@@ -2076,6 +2079,111 @@ FRACTAL_SXNOISE_VAR_TABLE
 // And now we can create the 3D version of the same function:
 FRACTAL_SXNOISE_VAR_TABLE
 
+// Noise volumes:
+// --------------
+
+noise_volume *create_noise_volume(
+  noise_field_3d field,
+  ptrdiff_t size,
+  ptrdiff_t spacing
+) {
+  noise_volume *nv = (noise_volume*) malloc(sizeof(noise_volume));
+  if (nv == NULL) {
+    perror("Failed to allocate noise volume.");
+    exit(errno);
+  }
+#ifdef DEBUG
+  if (spacing < 1 || size % spacing != 0) {
+    fprintf(
+      stderr,
+      "Noise volume size %td isn't a multiple of its spacing %td.\n",
+      size,
+      spacing
+    );
+    exit(EXIT_FAILURE);
+  }
+#endif
+  nv->field = field;
+  nv->size = size;
+  nv->spacing = spacing;
+  nv->points = size / spacing + 1;
+  nv->placed = 0;
+  nv->evaluations = 0;
+  nv->values = (float*) malloc(
+    sizeof(float) * nv->points * nv->points * nv->points
+  );
+  if (nv->values == NULL) {
+    perror("Failed to allocate noise volume lattice.");
+    exit(errno);
+  }
+  return nv;
+}
+
+void cleanup_noise_volume(noise_volume *nv) {
+  free(nv->values);
+  free(nv);
+}
+
+void nv_place(
+  noise_volume *nv,
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+) {
+  size_t i;
+  size_t count = nv->points * nv->points * nv->points;
+  if (
+    nv->placed
+  && nv->x == x && nv->y == y && nv->z == z
+  && memcmp(nv->salts, salts, sizeof(ptrdiff_t) * NV_MAX_SALTS) == 0
+  ) {
+    return;
+  }
+  nv->x = x;
+  nv->y = y;
+  nv->z = z;
+  memcpy(nv->salts, salts, sizeof(ptrdiff_t) * NV_MAX_SALTS);
+  for (i = 0; i < count; ++i) {
+    nv->values[i] = NAN;
+  }
+  nv->placed = 1;
+}
+
+void nv_lattice_bounds(noise_volume *nv, float *r_min, float *r_max) {
+  ptrdiff_t i, j, k;
+  float v;
+  *r_min = INFINITY;
+  *r_max = -INFINITY;
+  for (i = 0; i < nv->points; ++i) {
+    for (j = 0; j < nv->points; ++j) {
+      for (k = 0; k < nv->points; ++k) {
+        v = nv_lattice_value(nv, i, j, k);
+        if (v < *r_min) {
+          *r_min = v;
+        }
+        if (v > *r_max) {
+          *r_max = v;
+        }
+      }
+    }
+  }
+}
+
+float nv_max_error(noise_volume *nv) {
+  ptrdiff_t x, y, z;
+  float error, result = 0;
+  for (x = nv->x; x < nv->x + nv->size; ++x) {
+    for (y = nv->y; y < nv->y + nv->size; ++y) {
+      for (z = nv->z; z < nv->z + nv->size; ++z) {
+        error = fabs(nv_sample(nv, x, y, z) - nv_exact(nv, x, y, z));
+        if (error > result) {
+          result = error;
+        }
+      }
+    }
+  }
+  return result;
+}
+
 /*
  * Appendices:
 
@@ -23,6 +23,23 @@ typedef struct grid_neighborhood_2d_s grid_neighborhood_2d;
 struct simplex_neighborhood_2d_s;
 typedef struct simplex_neighborhood_2d_s simplex_neighborhood_2d;
 
+// A noise volume stands in for a slowly-varying 3D field over a cube (usually
+// a chunk) by sampling the field on a coarse lattice and trilinearly
+// interpolating between lattice points. Lattice values are only computed when
+// they're first needed.
+struct noise_volume_s;
+typedef struct noise_volume_s noise_volume;
+
+// The maximum number of salts that a noise volume passes to its field:
+#define NV_MAX_SALTS 4
+
+// A 3D field that a noise volume can sample. It's given integer coordinates
+// and an array of NV_MAX_SALTS salt values.
+typedef float (*noise_field_3d)(
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+);
+
 /*********
  * Flags *
  *********/
@@ -236,6 +253,18 @@ struct simplex_neighborhood_2d_s {
   float z[22]; // cartesian z
 };
 
+struct noise_volume_s {
+  noise_field_3d field;
+  ptrdiff_t salts[NV_MAX_SALTS];
+  ptrdiff_t x, y, z; // the corner of the covered cube
+  ptrdiff_t size; // the edge length of the covered cube
+  ptrdiff_t spacing; // the distance between lattice points
+  ptrdiff_t points; // lattice points along each edge (size/spacing + 1)
+  uint8_t placed; // whether the volume has been placed yet (see nv_place)
+  size_t evaluations; // the number of times the field has been evaluated
+  float *values; // lattice values (NaN until computed)
+};
+
 /********************
  * Inline Functions *
  ********************/
@@ -348,10 +377,118 @@ static inline ptrdiff_t hash_3d(ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) {
 }
 // */
 
+// Noise volume functions:
+
+// Evaluates the noise volume's field exactly at the given position.
+static inline float nv_exact(
+  noise_volume *nv,
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z
+) {
+  nv->evaluations += 1;
+  return nv->field(x, y, z, nv->salts);
+}
+
+// Returns the value at the given lattice point, computing it if necessary.
+static inline float nv_lattice_value(
+  noise_volume *nv,
+  ptrdiff_t i, ptrdiff_t j, ptrdiff_t k
+) {
+  float *v = &(nv->values[i + nv->points * (j + nv->points * k)]);
+  if (isnan(*v)) {
+    *v = nv_exact(
+      nv,
+      nv->x + i * nv->spacing,
+      nv->y + j * nv->spacing,
+      nv->z + k * nv->spacing
+    );
+  }
+  return *v;
+}
+
+// Samples the noise volume at the given position by interpolating between the
+// surrounding lattice points. Positions outside of the volume's cube fall
+// back to evaluating the field exactly.
+static inline float nv_sample(
+  noise_volume *nv,
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z
+) {
+  ptrdiff_t i, j, k;
+  float tx, ty, tz;
+  float c00, c10, c01, c11, c0, c1;
+  x -= nv->x;
+  y -= nv->y;
+  z -= nv->z;
+  if (
+     x < 0 || x >= nv->size
+  || y < 0 || y >= nv->size
+  || z < 0 || z >= nv->size
+  ) {
+    return nv_exact(nv, x + nv->x, y + nv->y, z + nv->z);
+  }
+  i = x / nv->spacing;
+  j = y / nv->spacing;
+  k = z / nv->spacing;
+  tx = (x - i * nv->spacing) / (float) nv->spacing;
+  ty = (y - j * nv->spacing) / (float) nv->spacing;
+  tz = (z - k * nv->spacing) / (float) nv->spacing;
+  // Points on the lattice don't need to interpolate at all:
+  if (tx == 0 && ty == 0 && tz == 0) {
+    return nv_lattice_value(nv, i, j, k);
+  }
+  c00 = nv_lattice_value(nv, i, j, k);
+  c00 += tx * (nv_lattice_value(nv, i + 1, j, k) - c00);
+  c10 = nv_lattice_value(nv, i, j + 1, k);
+  c10 += tx * (nv_lattice_value(nv, i + 1, j + 1, k) - c10);
+  c01 = nv_lattice_value(nv, i, j, k + 1);
+  c01 += tx * (nv_lattice_value(nv, i + 1, j, k + 1) - c01);
+  c11 = nv_lattice_value(nv, i, j + 1, k + 1);
+  c11 += tx * (nv_lattice_value(nv, i + 1, j + 1, k + 1) - c11);
+  c0 = c00 + ty * (c10 - c00);
+  c1 = c01 + ty * (c11 - c01);
+  return c0 + tz * (c1 - c0);
+}
+
+/******************************
+ * Constructors & Destructors *
+ ******************************/
+
+// Allocates and returns a new noise volume for the given field which covers a
+// cube with the given edge length using a lattice with the given spacing. The
+// edge length must be a multiple of the spacing. The volume must be placed
+// using nv_place before it can be sampled.
+noise_volume *create_noise_volume(
+  noise_field_3d field,
+  ptrdiff_t size,
+  ptrdiff_t spacing
+);
+
+// Frees the memory associated with a noise volume.
+void cleanup_noise_volume(noise_volume *nv);
+
 /*************
  * Functions *
  *************/
 
+// Moves the given noise volume so that its cube starts at the given position
+// and sets the salts passed to its field. If either has changed, the lattice
+// values are forgotten. The salts array must hold NV_MAX_SALTS values.
+void nv_place(
+  noise_volume *nv,
+  ptrdiff_t x, ptrdiff_t y, ptrdiff_t z,
+  ptrdiff_t const *salts
+);
+
+// Computes every lattice value of the given noise volume and writes out the
+// smallest and largest of them. Since samples interpolate between lattice
+// values, every sample within the volume's cube lies within these bounds (up
+// to rounding error).
+void nv_lattice_bounds(noise_volume *nv, float *r_min, float *r_max);
+
+// Returns the largest difference between the noise volume's samples and its
+// exact field over its entire cube. This is expensive, and is meant for
+// checking error budgets.
+float nv_max_error(noise_volume *nv);
+
 // 2D simplex noise:
 float sxnoise_2d(float x, float y, ptrdiff_t salt);
 
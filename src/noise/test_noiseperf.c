@@ -20,7 +20,7 @@ int main(int argc, char** argv) {
   float f[SIZE*SIZE];
   duration_data dd;
   // sxnoise_2d:
-  setup_duration_data(&dd, 0.2);
+  setup_duration_data(&dd, "sxnoise_2d", 0.2);
   for (x = 0; x < SIZE; ++x) {
     for (y = 0; y < SIZE; ++y) {
       start_duration(&dd);
@@ -35,7 +35,7 @@ int main(int argc, char** argv) {
   );
 
   // wrnoise_2d:
-  setup_duration_data(&dd, 0.2);
+  setup_duration_data(&dd, "wrnoise_2d", 0.2);
   for (x = 0; x < SIZE; ++x) {
     for (y = 0; y < SIZE; ++y) {
       start_duration(&dd);
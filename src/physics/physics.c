@@ -367,8 +367,6 @@ static inline void update_position_collide_blocks(entity *e) {
   // compute increment
   vcopy_as(&increment, &(e->vel));
   vscale(&increment, PHYS_SUB_DT);
-  // Make sure we're getting up-to-date cell data from cell_at:
-  refresh_cell_at_cache();
 
   // DEBUG:
 #ifdef DEBUG_DETECT_JUMPS
@@ -402,16 +400,10 @@ static inline void update_position_collide_blocks(entity *e) {
     printf("increment: %f,  %f,  %f\n", increment.x, increment.y, increment.z);
   }
 #endif
-
-  // Try to avoid poisoning anyone else who might use cell_at:
-  refresh_cell_at_cache();
 }
 
 static inline void check_move_flags(entity *e) {
   global_pos pos;
-  // Avoid getting stale cell data:
-  // TODO: this less often (esp. considering multiple entities)
-  refresh_cell_at_cache();
   // MF_IN_VOID
   clear_in_void(e);
   get_head_glpos(e, &pos);
@@ -468,8 +460,6 @@ static inline void check_move_flags(entity *e) {
     }
   }
   // MF_CROUCHING, MF_DO_JUMP, and MF_DO_FLAP handled in ctl.c
-  // Avoid letting others get stale cell data:
-  refresh_cell_at_cache();
 }
 
 /*************
@@ -21,6 +21,8 @@ mem_data TEXTURE_GPU_USAGE;
 
 mem_data DISK_DATA_SEEN;
 
+mem_data CHUNK_POOL_USAGE;
+
 /*********************
  * Private Functions *
  *********************/
@@ -52,6 +54,48 @@ void count_chunk_approx_gpu_size(void *chunk_approx_handle, void *data_handle) {
   md_add_size(md, chunk_approx_gpu_size(ca), 0);
 }
 
+// Applies the given function to each chunk pool that's been created:
+static void with_chunk_pools(void *arg, void (*f)(slab_pool *, void *)) {
+  lod i;
+  if (CHUNK_POOL == NULL) {
+    return;
+  }
+  f(CHUNK_POOL, arg);
+  f(CHUNK_APPROX_POOL, arg);
+  for (i = LOD_BASE; i < N_LODS; ++i) {
+    f(CELL_DATA_POOLS[i], arg);
+  }
+}
+
+static void count_pool_size(slab_pool *sp, void *data_handle) {
+  mem_data *md = (mem_data *) data_handle;
+  md_add_size(md, sp_data_size(sp), sp_overhead_size(sp));
+}
+
+static void print_pool_stats(slab_pool *sp, void *stream_handle) {
+  FILE *out = (FILE *) stream_handle;
+  slab_pool_stats st;
+  sp_get_stats(sp, &st);
+  fprintf(
+    out,
+    "%-20s %8zu B objects, %7zu KB slabs: %zu live (peak %zu), "
+    "%zu slabs (peak %zu, %zu idle, %zu trimmed, %zu unmapped), "
+    "%zu allocs, %zu frees\n",
+    sp_get_name(sp),
+    st.object_size,
+    st.slab_size / 1024,
+    st.live,
+    st.peak_live,
+    st.slabs,
+    st.peak_slabs,
+    st.idle_slabs,
+    st.trimmed_slabs,
+    st.unmapped_slabs,
+    st.allocations,
+    st.frees
+  );
+}
+
 /*************
  * Functions *
  *************/
@@ -98,16 +142,16 @@ void compute_chunk_cache_mem(void) {
   md_add_size(&CHUNK_CACHE_RAM_USAGE, 0, sizeof(chunk_queue_set)*2);
   md_add_size(&CHUNK_CACHE_RAM_USAGE, 0, sizeof(chunk_cache));
   for (i = LOD_BASE; i < N_LODS; ++i) {
-    queue *lq = LOAD_QUEUES->levels[i];
+    mpmc_queue *lq = LOAD_QUEUES->levels[i];
     map *lm = LOAD_QUEUES->maps[i];
-    queue *cq = COMPILE_QUEUES->levels[i];
+    mpmc_queue *cq = COMPILE_QUEUES->levels[i];
     map *cm = LOAD_QUEUES->maps[i];
     map *ccm = CHUNK_CACHE->levels[i];
     md_add_size(
       &CHUNK_CACHE_RAM_USAGE,
       0,
-      q_data_size(lq) + q_overhead_size(lq) + m_overhead_size(lm) +\
-      q_data_size(cq) + q_overhead_size(cq) + m_overhead_size(cm)
+      mq_data_size(lq) + mq_overhead_size(lq) + m_overhead_size(lm) +\
+      mq_data_size(cq) + mq_overhead_size(cq) + m_overhead_size(cm)
     );
     md_add_size(
       &CHUNK_CACHE_RAM_USAGE,
@@ -115,15 +159,24 @@ void compute_chunk_cache_mem(void) {
       m_data_size(ccm) + m_overhead_size(ccm)
     );
     if (i == LOD_BASE) {
-      q_witheach(lq, &CHUNK_CACHE_RAM_USAGE, count_chunk_size);
-      q_witheach(cq, &CHUNK_CACHE_RAM_USAGE, count_chunk_size);
+      mq_witheach(lq, &CHUNK_CACHE_RAM_USAGE, count_chunk_size);
+      mq_witheach(cq, &CHUNK_CACHE_RAM_USAGE, count_chunk_size);
       m_witheach(ccm, &CHUNK_CACHE_RAM_USAGE, count_chunk_size);
       m_witheach(ccm, &CHUNK_CACHE_GPU_USAGE, count_chunk_gpu_size);
     } else {
-      q_witheach(lq, &CHUNK_CACHE_RAM_USAGE, count_chunk_approx_size);
-      q_witheach(cq, &CHUNK_CACHE_RAM_USAGE, count_chunk_approx_size);
+      mq_witheach(lq, &CHUNK_CACHE_RAM_USAGE, count_chunk_approx_size);
+      mq_witheach(cq, &CHUNK_CACHE_RAM_USAGE, count_chunk_approx_size);
       m_witheach(ccm, &CHUNK_CACHE_RAM_USAGE, count_chunk_approx_size);
       m_witheach(ccm, &CHUNK_CACHE_GPU_USAGE, count_chunk_approx_gpu_size);
     }
   }
 }
+
+void compute_chunk_pool_mem(void) {
+  md_set_size(&CHUNK_POOL_USAGE, 0, 0);
+  with_chunk_pools(&CHUNK_POOL_USAGE, count_pool_size);
+}
+
+void print_chunk_pool_stats(FILE *out) {
+  with_chunk_pools(out, print_pool_stats);
+}
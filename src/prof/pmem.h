@@ -5,6 +5,7 @@
 // Profiling utilities for tracking memory.
 
 #include <stddef.h>
+#include <stdio.h>
 
 /**************
  * Structures *
@@ -28,6 +29,11 @@ extern mem_data TEXTURE_GPU_USAGE;
 // Tracks data stored on disk that's been accessed by the program:
 extern mem_data DISK_DATA_SEEN;
 
+// Tracks the slab pools that chunk and approximation memory comes from (see
+// CHUNK_POOLING in world.h). Data is memory in live objects and overhead is
+// the rest of the pools' resident memory:
+extern mem_data CHUNK_POOL_USAGE;
+
 /*************************
  * Structure Definitions *
  *************************/
@@ -55,6 +61,14 @@ void md_sub_size(mem_data *md, size_t data, size_t overhead);
 // CHUNK_CACHE_RAM_USAGE and CHUNK_CACHE_GPU_USAGE.
 void compute_chunk_cache_mem(void);
 
+// Computes the current resident memory of the chunk pools, storing the result
+// in CHUNK_POOL_USAGE. Unlike compute_chunk_cache_mem, this counts unused
+// space in partly-full slabs and idle slabs that haven't been trimmed.
+void compute_chunk_pool_mem(void);
+
+// Prints allocation statistics for each chunk pool to the given stream.
+void print_chunk_pool_stats(FILE *out);
+
 // TODO: Functions to compute other memory usage we're interested in.
 
 #endif //ifndef PMEM_H
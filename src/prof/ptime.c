@@ -34,17 +34,26 @@ duration_data DISK_MISS_TIME;
 duration_data DISK_WRITE_TIME;
 
 count_data CHUNK_LAYERS_RENDERED;
+count_data CHUNKS_OCCLUDED;
+count_data DRAWS_OCCLUDED;
+count_data VERTICES_OCCLUDED;
 count_data CHUNKS_LOADED;
 count_data CHUNKS_COMPILED;
 count_data CHUNKS_BIOGEND;
 count_data CHUNKS_BIOSKIPPED;
+count_data BIOME_CACHE_HITS;
+count_data BIOME_CACHE_MISSES;
 
 /*************
  * Functions *
  *************/
 
-void setup_duration_data(duration_data *dd, double weight) {
-  dd->starttime = -1;
+void setup_duration_data(
+  duration_data *dd,
+  char const *name,
+  double weight
+) {
+  dd->name = name;
   dd->duration = -1;
   dd->weight = weight;
 }
@@ -67,44 +76,56 @@ void setup_count_data(count_data *cd, double interval) {
 }
 
 void init_ptime(void) {
+  double weight = DEFAULT_AVERAGING_WEIGHT;
+
+  init_ptrace();
+
   setup_rate_data(&TICKRATE, DEFAULT_TRACKING_INTERVAL);
   setup_rate_data(&FRAMERATE, DEFAULT_TRACKING_INTERVAL);
 
-  setup_duration_data(&RENDER_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&RENDER_AREA_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&RENDER_UI_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&RENDER_CORE_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&RENDER_INNER_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&COMPILE_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&PHYSICS_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&DATA_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&TGEN_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&DISK_READ_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&DISK_MISS_TIME, DEFAULT_AVERAGING_WEIGHT);
-  setup_duration_data(&DISK_WRITE_TIME, DEFAULT_AVERAGING_WEIGHT);
+  setup_duration_data(&RENDER_TIME, "render", weight);
+  setup_duration_data(&RENDER_AREA_TIME, "render area", weight);
+  setup_duration_data(&RENDER_UI_TIME, "render ui", weight);
+  setup_duration_data(&RENDER_CORE_TIME, "render core", weight);
+  setup_duration_data(&RENDER_INNER_TIME, "render inner", weight);
+  setup_duration_data(&COMPILE_TIME, "compile", weight);
+  setup_duration_data(&PHYSICS_TIME, "physics", weight);
+  setup_duration_data(&DATA_TIME, "data", weight);
+  setup_duration_data(&TGEN_TIME, "terrain generation", weight);
+  setup_duration_data(&DISK_READ_TIME, "disk read", weight);
+  setup_duration_data(&DISK_MISS_TIME, "disk miss", weight);
+  setup_duration_data(&DISK_WRITE_TIME, "disk write", weight);
 
   setup_count_data(&CHUNK_LAYERS_RENDERED, DEFAULT_TRACKING_INTERVAL);
+  setup_count_data(&CHUNKS_OCCLUDED, DEFAULT_TRACKING_INTERVAL);
+  setup_count_data(&DRAWS_OCCLUDED, DEFAULT_TRACKING_INTERVAL);
+  setup_count_data(&VERTICES_OCCLUDED, DEFAULT_TRACKING_INTERVAL);
   setup_count_data(&CHUNKS_LOADED, DEFAULT_TRACKING_INTERVAL);
   setup_count_data(&CHUNKS_COMPILED, DEFAULT_TRACKING_INTERVAL);
   setup_count_data(&CHUNKS_BIOGEND, DEFAULT_TRACKING_INTERVAL);
   setup_count_data(&CHUNKS_BIOSKIPPED, DEFAULT_TRACKING_INTERVAL);
+  setup_count_data(&BIOME_CACHE_HITS, DEFAULT_TRACKING_INTERVAL);
+  setup_count_data(&BIOME_CACHE_MISSES, DEFAULT_TRACKING_INTERVAL);
 }
 
 void start_duration(duration_data *dd) {
-  dd->starttime = glfwGetTime();
+  trace_begin(dd->name);
 }
 
 void end_duration(duration_data *dd) {
-  double curtime = glfwGetTime();
-  double elapsed;
-  if (dd->starttime > 0) {
-    elapsed = curtime - dd->starttime;
-    if (dd->duration >= 0) {
-      dd->duration = (1 - dd->weight) * dd->duration + dd->weight * elapsed;
-    } else {
-      dd->duration = elapsed;
-    }
+  double elapsed = trace_end(dd->name);
+  if (elapsed < 0) {
+    return;
   }
+  if (dd->duration >= 0) {
+    dd->duration = (1 - dd->weight) * dd->duration + dd->weight * elapsed;
+  } else {
+    dd->duration = elapsed;
+  }
+}
+
+void cancel_duration(duration_data *dd) {
+  trace_cancel(dd->name);
 }
 
 void update_rate(rate_data *rd) {
@@ -4,6 +4,8 @@
 // ptime.h
 // Profiling utilities for tracking time and rates.
 
+#include "ptrace.h"
+
 /**************
  * Structures *
  **************/
@@ -54,17 +56,22 @@ extern duration_data DISK_WRITE_TIME;
 
 // Count trackers:
 extern count_data CHUNK_LAYERS_RENDERED;
+extern count_data CHUNKS_OCCLUDED;
+extern count_data DRAWS_OCCLUDED;
+extern count_data VERTICES_OCCLUDED;
 extern count_data CHUNKS_LOADED;
 extern count_data CHUNKS_COMPILED;
 extern count_data CHUNKS_BIOGEND;
 extern count_data CHUNKS_BIOSKIPPED;
+extern count_data BIOME_CACHE_HITS;
+extern count_data BIOME_CACHE_MISSES;
 
 /*************************
  * Structure Definitions *
  *************************/
 
 struct duration_data_s {
-  double starttime; // when was star_duration called?
+  char const *name; // name for trace spans
   double duration; // the current duration estimate for one cycle
   double weight; // weight of incoming sample vs. existing average
 };
@@ -93,7 +100,7 @@ struct count_data_s {
 
 // Initializes up the given rate/count data structure with the given tracking
 // interval.
-void setup_duration_data(duration_data *sd, double weight);
+void setup_duration_data(duration_data *sd, char const *name, double weight);
 void setup_rate_data(rate_data *rd, double interval);
 void setup_count_data(count_data *cd, double interval);
 
@@ -102,9 +109,13 @@ void setup_count_data(count_data *cd, double interval);
 void init_ptime(void);
 
 // Call these every time the thing that you want to time happens. Make sure to
-// call setup_duration_data first.
+// call setup_duration_data first. Start times are kept per-thread as trace
+// spans (see ptrace.h), so durations must nest properly on each thread; use
+// cancel_duration to close one without recording it. The running average is
+// not synchronized, so each duration should only be timed by one thread.
 void start_duration(duration_data *sd);
 void end_duration(duration_data *sd);
+void cancel_duration(duration_data *sd);
 
 // Call this every time the thing that you want to track occurs. Make sure to
 // call setup_rate_data first.
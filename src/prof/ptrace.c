@@ -0,0 +1,318 @@
+// ptrace.c
+// Per-thread span tracing, dumped as Chrome trace-event JSON.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ptrace.h"
+
+/**************
+ * Structures *
+ **************/
+
+// An open span:
+struct trace_frame_s;
+typedef struct trace_frame_s trace_frame;
+
+// Each thread that traces gets its own buffer, which only that thread writes
+// to. Finished spans go into a ring, and the count of spans written is
+// published after each one so that dumps can read the ring without locking.
+struct trace_buffer_s;
+typedef struct trace_buffer_s trace_buffer;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct trace_frame_s {
+  char const *name;
+  double start;
+};
+
+struct trace_buffer_s {
+  trace_span spans[TRACE_BUFFER_SIZE];
+  uint64_t written; // total spans ever recorded
+  trace_frame open[TRACE_MAX_DEPTH];
+  size_t depth;
+  uint32_t tid;
+  char name[TRACE_THREAD_NAME_SIZE];
+  trace_buffer *next; // all buffers, for dumping
+};
+
+/***********
+ * Globals *
+ ***********/
+
+char const *TRACE_FILE = "trace.json";
+uint8_t TRACE_AT_EXIT = 0;
+
+/*******************
+ * Private Globals *
+ *******************/
+
+static __thread trace_buffer *THREAD_TRACE = NULL;
+
+static trace_buffer *TRACE_BUFFERS = NULL;
+
+static uint32_t NEXT_TRACE_TID = 1;
+
+static double TRACE_EPOCH = 0;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Gets the calling thread's buffer, creating and registering it the first
+// time. Buffers are never freed, so spans from threads that have exited
+// still show up in dumps.
+static trace_buffer * thread_buffer(void) {
+  trace_buffer *tb = THREAD_TRACE;
+  if (tb != NULL) {
+    return tb;
+  }
+  tb = (trace_buffer*) malloc(sizeof(trace_buffer));
+  if (tb == NULL) {
+    perror("Failed to allocate trace buffer.");
+    exit(errno);
+  }
+  tb->written = 0;
+  tb->depth = 0;
+  tb->tid = __atomic_fetch_add(&NEXT_TRACE_TID, 1, __ATOMIC_RELAXED);
+  snprintf(tb->name, TRACE_THREAD_NAME_SIZE, "thread %u", tb->tid);
+  tb->next = __atomic_load_n(&TRACE_BUFFERS, __ATOMIC_RELAXED);
+  while (
+    !__atomic_compare_exchange_n(
+      &TRACE_BUFFERS,
+      &(tb->next),
+      tb,
+      1,
+      __ATOMIC_RELEASE,
+      __ATOMIC_RELAXED
+    )
+  ) {}
+  THREAD_TRACE = tb;
+  return tb;
+}
+
+static trace_frame * pop_frame(char const *name) {
+  trace_buffer *tb = thread_buffer();
+  trace_frame *f;
+  if (tb->depth == 0) {
+#ifdef DEBUG
+    fprintf(stderr, "Error: span '%s' ended but never began.\n", name);
+    exit(EXIT_FAILURE);
+#endif
+    return NULL;
+  }
+  tb->depth -= 1;
+  if (tb->depth >= TRACE_MAX_DEPTH) {
+    return NULL;
+  }
+  f = &(tb->open[tb->depth]);
+#ifdef DEBUG
+  if (f->name != name && strcmp(f->name, name) != 0) {
+    fprintf(
+      stderr,
+      "Error: span '%s' ended while '%s' was still open.\n",
+      name,
+      f->name
+    );
+    exit(EXIT_FAILURE);
+  }
+#endif
+  return f;
+}
+
+// Copies the spans still in the given buffer into scratch (which must hold
+// TRACE_BUFFER_SIZE spans), oldest first, and returns how many there are.
+static size_t snapshot(trace_buffer *tb, trace_span *scratch) {
+  uint64_t before, after, first, valid, i;
+  before = __atomic_load_n(&(tb->written), __ATOMIC_ACQUIRE);
+  first = before > TRACE_BUFFER_SIZE ? before - TRACE_BUFFER_SIZE : 0;
+  for (i = first; i < before; ++i) {
+    scratch[i - first] = tb->spans[i % TRACE_BUFFER_SIZE];
+  }
+  // Anything the owner has started writing since then (including the slot
+  // it may be halfway through right now) can't be trusted:
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  after = __atomic_load_n(&(tb->written), __ATOMIC_ACQUIRE);
+  valid = after >= TRACE_BUFFER_SIZE ? after - TRACE_BUFFER_SIZE + 1 : 0;
+  if (valid > first) {
+    if (valid >= before) {
+      return 0;
+    }
+    memmove(
+      scratch,
+      scratch + (valid - first),
+      sizeof(trace_span) * (before - valid)
+    );
+    first = valid;
+  }
+  return before - first;
+}
+
+// Writes a string as a JSON string literal:
+static void write_json_string(FILE *out, char const *str) {
+  fputc('"', out);
+  for (; *str != '\0'; ++str) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', out);
+      fputc(*str, out);
+    } else if ((unsigned char) *str < 0x20) {
+      fprintf(out, "\\u%04x", (unsigned char) *str);
+    } else {
+      fputc(*str, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/*************
+ * Functions *
+ *************/
+
+void init_ptrace(void) {
+  TRACE_EPOCH = trace_now();
+}
+
+double trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void trace_name_thread(char const *name) {
+  trace_buffer *tb = thread_buffer();
+  snprintf(tb->name, TRACE_THREAD_NAME_SIZE, "%s", name);
+}
+
+void trace_begin(char const *name) {
+  trace_buffer *tb = thread_buffer();
+  if (tb->depth < TRACE_MAX_DEPTH) {
+    tb->open[tb->depth].name = name;
+    tb->open[tb->depth].start = trace_now();
+  }
+  tb->depth += 1;
+}
+
+double trace_end(char const *name) {
+  trace_buffer *tb;
+  trace_frame *f = pop_frame(name);
+  trace_span *s;
+  uint64_t w;
+  double now;
+  if (f == NULL) {
+    return -1;
+  }
+  now = trace_now();
+  tb = THREAD_TRACE;
+  // Only this thread writes to its buffer, so a relaxed load is fine here:
+  w = __atomic_load_n(&(tb->written), __ATOMIC_RELAXED);
+  s = &(tb->spans[w % TRACE_BUFFER_SIZE]);
+  s->name = f->name;
+  s->start = f->start;
+  s->duration = now - f->start;
+  s->depth = (uint32_t) tb->depth;
+  __atomic_store_n(&(tb->written), w + 1, __ATOMIC_RELEASE);
+  return now - f->start;
+}
+
+void trace_cancel(char const *name) {
+  pop_frame(name);
+}
+
+size_t trace_depth(void) {
+  return thread_buffer()->depth;
+}
+
+size_t trace_thread_spans(trace_span *spans, size_t max) {
+  trace_buffer *tb = thread_buffer();
+  uint64_t w = tb->written;
+  size_t count = w < TRACE_BUFFER_SIZE ? (size_t) w : TRACE_BUFFER_SIZE;
+  size_t i;
+  if (count > max) {
+    count = max;
+  }
+  for (i = 0; i < count; ++i) {
+    spans[i] = tb->spans[(w - count + i) % TRACE_BUFFER_SIZE];
+  }
+  return count;
+}
+
+size_t trace_write(FILE *out) {
+  trace_buffer *tb;
+  trace_span *scratch, *s;
+  size_t i, count, result = 0;
+  int pid = (int) getpid();
+  scratch = (trace_span*) malloc(sizeof(trace_span) * TRACE_BUFFER_SIZE);
+  if (scratch == NULL) {
+    perror("Failed to allocate trace scratch space.");
+    exit(errno);
+  }
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(
+    out,
+    "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+    "\"args\":{\"name\":\"elf_forest\"}}",
+    pid
+  );
+  for (
+    tb = __atomic_load_n(&TRACE_BUFFERS, __ATOMIC_ACQUIRE);
+    tb != NULL;
+    tb = tb->next
+  ) {
+    fprintf(
+      out,
+      ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+      "\"args\":{\"name\":",
+      pid,
+      tb->tid
+    );
+    write_json_string(out, tb->name);
+    fprintf(out, "}}");
+    count = snapshot(tb, scratch);
+    for (i = 0; i < count; ++i) {
+      s = &(scratch[i]);
+      fprintf(out, ",\n{\"name\":");
+      write_json_string(out, s->name);
+      // Timestamps are in microseconds:
+      fprintf(
+        out,
+        ",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+        "\"args\":{\"depth\":%u}}",
+        pid,
+        tb->tid,
+        (s->start - TRACE_EPOCH) * 1e6,
+        s->duration * 1e6,
+        s->depth
+      );
+    }
+    result += count;
+  }
+  fprintf(out, "\n]}\n");
+  free(scratch);
+  return result;
+}
+
+size_t trace_dump(char const *filename) {
+  size_t result;
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    // A failed dump shouldn't take the game down with it:
+    fprintf(
+      stderr,
+      "Error: couldn't open trace file '%s': %s\n",
+      filename,
+      strerror(errno)
+    );
+    return 0;
+  }
+  result = trace_write(fp);
+  fclose(fp);
+  return result;
+}
@@ -0,0 +1,125 @@
+#ifndef PTRACE_H
+#define PTRACE_H
+
+// ptrace.h
+// Per-thread span tracing, dumped as Chrome trace-event JSON (load the output
+// in chrome://tracing or ui.perfetto.dev to see it on a timeline).
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**************
+ * Structures *
+ **************/
+
+struct trace_span_s;
+typedef struct trace_span_s trace_span;
+
+/*************
+ * Constants *
+ *************/
+
+// How many finished spans each thread keeps (older ones are overwritten):
+#define TRACE_BUFFER_SIZE 16384
+
+// How deeply spans may nest on a single thread. Deeper spans are balanced
+// properly but aren't recorded.
+#define TRACE_MAX_DEPTH 64
+
+// Thread names longer than this are truncated:
+#define TRACE_THREAD_NAME_SIZE 32
+
+/***********
+ * Globals *
+ ***********/
+
+// Where dumps go, and whether core_shutdown should write one on the way out:
+extern char const *TRACE_FILE;
+extern uint8_t TRACE_AT_EXIT;
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct trace_span_s {
+  char const *name; // must outlive the trace (use string literals)
+  double start; // in seconds (see trace_now)
+  double duration; // in seconds
+  uint32_t depth; // number of spans open around this one on its thread
+};
+
+/**********
+ * Macros *
+ **********/
+
+// These are what instrumented code should use: they compile to nothing
+// unless PROFILE_TIME is defined. TRACE_SCOPE opens a span that closes
+// automatically when the enclosing block exits (including via return).
+#ifdef PROFILE_TIME
+  #define TRACE_THREAD_NAME(name) trace_name_thread(name)
+  #define TRACE_BEGIN(name) trace_begin(name)
+  #define TRACE_END(name) trace_end(name)
+  #define TRACE_SCOPE(name) \
+    char const *TRACE_SCOPE_VAR(__LINE__) \
+      __attribute__((cleanup(trace_scope_exit))) = trace_scope_enter(name)
+  #define TRACE_SCOPE_VAR(line) TRACE_SCOPE_VAR_(line)
+  #define TRACE_SCOPE_VAR_(line) _trace_scope_ ## line
+#else
+  #define TRACE_THREAD_NAME(name)
+  #define TRACE_BEGIN(name)
+  #define TRACE_END(name)
+  #define TRACE_SCOPE(name)
+#endif
+
+/*************
+ * Functions *
+ *************/
+
+// Sets the zero point for trace timestamps. Called by init_ptime.
+void init_ptrace(void);
+
+// A monotonic clock in seconds, cheap enough to call for every span.
+double trace_now(void);
+
+// Names the calling thread in dumps. Call this before the thread starts
+// tracing, since other threads may be reading the name during a dump.
+void trace_name_thread(char const *name);
+
+// Opens a span on the calling thread. Each trace_begin must be matched by a
+// trace_end or trace_cancel with the same name, and spans on a single thread
+// must nest properly.
+void trace_begin(char const *name);
+
+// Closes the innermost open span, recording it, and returns its length in
+// seconds (or -1 if it was never begun or was nested too deeply to time).
+double trace_end(char const *name);
+
+// Closes the innermost open span without recording it.
+void trace_cancel(char const *name);
+
+// Returns the number of spans open on the calling thread.
+size_t trace_depth(void);
+
+// Copies up to max of the calling thread's most recent finished spans into
+// spans (oldest first), returning how many were copied.
+size_t trace_thread_spans(trace_span *spans, size_t max);
+
+// Writes every thread's recent spans to the given stream or file as Chrome
+// trace-event JSON, returning the number of spans written. This is safe to
+// call while other threads are tracing: spans they overwrite during the dump
+// are skipped rather than written out half-updated. If the file can't be
+// opened, trace_dump reports the error and returns 0.
+size_t trace_write(FILE *out);
+size_t trace_dump(char const *filename);
+
+// Helpers for TRACE_SCOPE:
+static inline char const * trace_scope_enter(char const *name) {
+  trace_begin(name);
+  return name;
+}
+
+static inline void trace_scope_exit(char const **name) {
+  trace_end(*name);
+}
+
+#endif //ifndef PTRACE_H
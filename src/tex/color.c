@@ -433,3 +433,119 @@ pixel blend_precisely(pixel a, pixel b, float blend) {
   lch__lab(&ca); /*->*/ lab__xyz(&ca);
   return xyz__rgb(&ca);
 }
+
+void px_batch__lch(
+  pixel const * const pixels,
+  size_t count,
+  float *l, float *c, float *h, float *alpha
+) {
+  size_t i;
+  float r, g, b, x, y, z;
+#pragma omp simd private(r, g, b, x, y, z)
+  for (i = 0; i < count; ++i) {
+    // RGB -> XYZ (see rgb__xyz):
+    r = px_red(pixels[i]) / (float) CHANNEL_MAX;
+    g = px_green(pixels[i]) / (float) CHANNEL_MAX;
+    b = px_blue(pixels[i]) / (float) CHANNEL_MAX;
+    alpha[i] = px_alpha(pixels[i]) / (float) CHANNEL_MAX;
+    r = r > 0.04045f ? powf((r + 0.055f) / 1.055f, 2.4f) : r / 12.92f;
+    g = g > 0.04045f ? powf((g + 0.055f) / 1.055f, 2.4f) : g / 12.92f;
+    b = b > 0.04045f ? powf((b + 0.055f) / 1.055f, 2.4f) : b / 12.92f;
+    r *= 100.0f;
+    g *= 100.0f;
+    b *= 100.0f;
+    x = r * 0.4124f + g * 0.3576f + b * 0.1805f;
+    y = r * 0.2126f + g * 0.7152f + b * 0.0722f;
+    z = r * 0.0193f + g * 0.1192f + b * 0.9505f;
+
+    // XYZ -> L*a*b* (see xyz__lab):
+    x /= 95.047f;
+    y /= 100.0f;
+    z /= 108.883f;
+    x = x > 0.008856f ? cbrtf(x) : (7.787f * x) + (16.0f / 116.0f);
+    y = y > 0.008856f ? cbrtf(y) : (7.787f * y) + (16.0f / 116.0f);
+    z = z > 0.008856f ? cbrtf(z) : (7.787f * z) + (16.0f / 116.0f);
+    l[i] = (116.0f * y) - 16.0f;
+    r = 500.0f * (x - y); // a*
+    b = 200.0f * (y - z); // b*
+
+    // L*a*b* -> L*c*h* (see lab__lch):
+    c[i] = sqrtf(r * r + b * b);
+    h[i] = atan2f(b, r);
+  }
+}
+
+void lch_batch__px(
+  float const * const l,
+  float const * const c,
+  float const * const h,
+  float const * const alpha,
+  size_t count,
+  pixel *results
+) {
+  size_t i;
+  float r, g, b, a, x, y, z;
+#pragma omp simd private(r, g, b, a, x, y, z)
+  for (i = 0; i < count; ++i) {
+    // L*c*h* -> L*a*b* -> XYZ (see lch__lab and lab__xyz):
+    y = (l[i] + 16.0f) / 116.0f;
+    x = (cosf(h[i]) * c[i]) / 500.0f + y;
+    z = y - (sinf(h[i]) * c[i]) / 200.0f;
+    x = x > 0.206893f ? x * x * x : (x - (16.0f / 116.0f)) / 7.787f;
+    y = y > 0.206893f ? y * y * y : (y - (16.0f / 116.0f)) / 7.787f;
+    z = z > 0.206893f ? z * z * z : (z - (16.0f / 116.0f)) / 7.787f;
+    // (The 100x scale factors for XYZ cancel out here.)
+    x *= 0.95047f;
+    z *= 1.08883f;
+
+    // XYZ -> RGB (see xyz__rgb):
+    r = x *  3.2406f + y * -1.5372f + z * -0.4986f;
+    g = x * -0.9689f + y *  1.8758f + z *  0.0415f;
+    b = x *  0.0557f + y * -0.2040f + z *  1.0570f;
+    r = r > 0.0031308f ? 1.055f * powf(r, 1.0f/2.4f) - 0.055f : r * 12.92f;
+    g = g > 0.0031308f ? 1.055f * powf(g, 1.0f/2.4f) - 0.055f : g * 12.92f;
+    b = b > 0.0031308f ? 1.055f * powf(b, 1.0f/2.4f) - 0.055f : b * 12.92f;
+
+    // Clamp out-of-gamut colors and pack:
+    r = fminf(fmaxf(r * 255.0f, 0.0f), 255.0f);
+    g = fminf(fmaxf(g * 255.0f, 0.0f), 255.0f);
+    b = fminf(fmaxf(b * 255.0f, 0.0f), 255.0f);
+    a = fminf(fmaxf(alpha[i] * 255.0f, 0.0f), 255.0f);
+    results[i] = (
+      (((pixel) r) << RED_SHIFT)
+    | (((pixel) g) << GREEN_SHIFT)
+    | (((pixel) b) << BLUE_SHIFT)
+    | (((pixel) a) << ALPHA_SHIFT)
+    );
+  }
+}
+
+void blend_precisely_batch(
+  pixel const * const a,
+  pixel const * const b,
+  float const * const blends,
+  pixel *results,
+  size_t count
+) {
+  float la[COLOR_BATCH_SIZE], ca[COLOR_BATCH_SIZE], ha[COLOR_BATCH_SIZE];
+  float aa[COLOR_BATCH_SIZE];
+  float lb[COLOR_BATCH_SIZE], cb[COLOR_BATCH_SIZE], hb[COLOR_BATCH_SIZE];
+  float ab[COLOR_BATCH_SIZE];
+  size_t start, n, i;
+  float t;
+  for (start = 0; start < count; start += COLOR_BATCH_SIZE) {
+    n = count - start;
+    if (n > COLOR_BATCH_SIZE) { n = COLOR_BATCH_SIZE; }
+    px_batch__lch(a + start, n, la, ca, ha, aa);
+    px_batch__lch(b + start, n, lb, cb, hb, ab);
+#pragma omp simd private(t)
+    for (i = 0; i < n; ++i) {
+      t = blends[start + i];
+      la[i] = t * la[i] + (1 - t) * lb[i];
+      ca[i] = t * ca[i] + (1 - t) * cb[i];
+      ha[i] = t * ha[i] + (1 - t) * hb[i];
+      aa[i] = t * aa[i] + (1 - t) * ab[i];
+    }
+    lch_batch__px(la, ca, ha, aa, n, results + start);
+  }
+}
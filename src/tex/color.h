@@ -63,6 +63,10 @@ struct precise_color_s {
 #define CHANNEL_BITS 8
 #define CHANNEL_MAX umaxof(channel)
 
+// Pixels are converted in groups of this size by the batched conversion
+// functions (which need this many floats of stack space per channel):
+#define COLOR_BATCH_SIZE 64
+
 #define RED_SHIFT 0
 #define GREEN_SHIFT 8
 #define BLUE_SHIFT 16
@@ -319,4 +323,32 @@ void convert_to_lch(precise_color *color);
 // in CIE L*c*h* color space.
 pixel blend_precisely(pixel a, pixel b, float blend);
 
+// Batched conversions between arrays of RGBA pixels and L*c*h* colors stored
+// as separate channel arrays. These give the same results as converting each
+// pixel separately with the functions above (to within a channel step), but
+// the loops are written so that the compiler can vectorize them.
+void px_batch__lch(
+  pixel const * const pixels,
+  size_t count,
+  float *l, float *c, float *h, float *alpha
+);
+void lch_batch__px(
+  float const * const l,
+  float const * const c,
+  float const * const h,
+  float const * const alpha,
+  size_t count,
+  pixel *results
+);
+
+// Batched version of blend_precisely: sets each result to
+// blend_precisely(a[i], b[i], blends[i]).
+void blend_precisely_batch(
+  pixel const * const a,
+  pixel const * const b,
+  float const * const blends,
+  pixel *results,
+  size_t count
+);
+
 #endif //ifndef COLOR_H
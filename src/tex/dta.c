@@ -14,6 +14,8 @@
 #include "datatypes/bitmap.h"
 #include "datatypes/map.h"
 
+#include "prof/ptrace.h"
+
 #include "world/blocks.h"
 
 /********************
@@ -85,6 +87,7 @@ void ensure_mapped(block b) {
   size_t i = dta_get_index(dta, b);
   texture *tx;
   if (i == 0) {
+    TRACE_SCOPE("texture synthesis");
     // We need to load the block's texture:
     // TODO: Real error checking/reporting!!
 #ifdef DEBUG
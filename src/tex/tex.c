@@ -9,24 +9,308 @@
 #include <stdio.h>
 #include <errno.h>
 
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
 #include "tex.h"
 
 #include "dta.h"
 #include "color.h"
 
 #include "datatypes/bitmap.h"
+#include "datatypes/dictionary.h"
 #include "datatypes/map.h"
+#include "datatypes/string.h"
+
+#include "filesys/filesys.h"
+
+#include "jobs/jobs.h"
 
 #include "prof/pmem.h"
 
 #include "world/blocks.h"
 
+#include "util.h"
+
+/**************
+ * Structures *
+ **************/
+
+// A PNG file waiting to be written by write_texture_to_png_async:
+struct png_write_s;
+typedef struct png_write_s png_write;
+
+struct png_write_s {
+  texture *tx;
+  char *filename;
+  png_write *next;
+};
+
 /********************
  * Global variables *
  ********************/
 
 char const * const BLOCK_TEXTURE_DIR = "res/textures/static";
 
+char const * const TEXTURE_DIR = "res/textures";
+
+uint8_t CACHE_TEXTURES = 1;
+uint8_t PRELOAD_TEXTURES = 0;
+
+// Decoded textures keyed by filename. Created on first use, and only touched
+// inside the texture_cache critical section:
+static dictionary *TEXTURE_CACHE = NULL;
+
+// Table size for the texture cache:
+#define TEXTURE_CACHE_TABLE_SIZE 256
+
+uint8_t ASYNC_PNG_WRITES = 1;
+
+// Queued PNG writes (oldest first), only touched inside the png_writes
+// critical section:
+static png_write *PNG_WRITES_HEAD = NULL;
+static png_write *PNG_WRITES_TAIL = NULL;
+
+// Writes that have been queued but not finished (including ones that have
+// been taken off of the queue and are being encoded right now):
+static size_t PNG_WRITES_PENDING = 0;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Takes the oldest queued PNG write off of the queue and writes it out.
+// Returns 0 if there was nothing to write.
+static int write_next_png(void) {
+  png_write *pw;
+#pragma omp critical (png_writes)
+  {
+    pw = PNG_WRITES_HEAD;
+    if (pw != NULL) {
+      PNG_WRITES_HEAD = pw->next;
+      if (PNG_WRITES_HEAD == NULL) {
+        PNG_WRITES_TAIL = NULL;
+      }
+    }
+  }
+  if (pw == NULL) {
+    return 0;
+  }
+  write_texture_to_png(pw->tx, pw->filename);
+  cleanup_texture(pw->tx);
+  free(pw->filename);
+  free(pw);
+  __atomic_sub_fetch(&PNG_WRITES_PENDING, 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Job for write_texture_to_png_async. Each job writes whichever file is at
+// the front of the queue, so that flush_png_writes can take over any writes
+// whose jobs haven't run yet.
+static void (*png_write_job(void *unused))() {
+  write_next_png();
+  return NULL;
+}
+
+// walk_dir_tree operation for preload_textures:
+static void preload_texture_file(
+  string const * const filename,
+  struct stat const * const st,
+  void *arg
+) {
+  char *fn = s_encode_nt(filename);
+  cleanup_texture(load_cached_texture(fn));
+  free(fn);
+}
+
+// Blending for a single pixel (used for the ends of rows that don't fill a
+// whole vector, and everywhere when SIMD isn't available). Must match the
+// vector code below.
+static inline pixel blend_px(pixel src_px, pixel dst_px) {
+  float alpha = px_alpha(src_px) / ((float) CHANNEL_MAX);
+  px_set_red(
+    &dst_px,
+    (px_red(src_px) * alpha) + (px_red(dst_px) * (1 - alpha))
+  );
+  px_set_green(
+    &dst_px,
+    (px_green(src_px) * alpha) + (px_green(dst_px) * (1 - alpha))
+  );
+  px_set_blue(
+    &dst_px,
+    (px_blue(src_px) * alpha) + (px_blue(dst_px) * (1 - alpha))
+  );
+  // TODO: Better here!
+  px_set_alpha(
+    &dst_px,
+    px_alpha(src_px)>px_alpha(dst_px) ? px_alpha(src_px) : px_alpha(dst_px)
+  );
+  return dst_px;
+}
+
+// Like blend_px, but treats missing destination alpha as room for the source
+// to show through (the rule tx_draw_region_wrapped has always used).
+static inline pixel blend_px_under(pixel src_px, pixel dst_px) {
+  float alpha = (
+    px_alpha(src_px) / ((float) CHANNEL_MAX)
+  +
+    (1 - (px_alpha(dst_px) / ((float) CHANNEL_MAX)))
+  );
+  if (alpha > 1) { alpha = 1; }
+  px_set_red(
+    &dst_px,
+    (px_red(src_px) * alpha) + (px_red(dst_px) * (1 - alpha))
+  );
+  px_set_green(
+    &dst_px,
+    (px_green(src_px) * alpha) + (px_green(dst_px) * (1 - alpha))
+  );
+  px_set_blue(
+    &dst_px,
+    (px_blue(src_px) * alpha) + (px_blue(dst_px) * (1 - alpha))
+  );
+  alpha = px_alpha(src_px) / ((float) CHANNEL_MAX) + px_alpha(dst_px);
+  if (alpha > 1) { alpha = 1; }
+  px_set_alpha(&dst_px, alpha * CHANNEL_MAX);
+  return dst_px;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+// Vector helpers: each __m128 holds the four channels of one pixel as floats
+// (in memory order: red, green, blue, alpha).
+
+// Returns a vector holding the given lane of v in all four lanes.
+#define SPLAT_LANE(v, lane) \
+  _mm_shuffle_ps((v), (v), _MM_SHUFFLE(lane, lane, lane, lane))
+
+// Mask selecting the alpha lane of a single-pixel vector:
+#define ALPHA_LANE_MASK _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0))
+
+// Blends one pixel's worth of channels. The alpha lane of the result is
+// garbage; callers fix it up.
+static inline __m128 blend_channels(__m128 s, __m128 d) {
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 alpha = _mm_div_ps(SPLAT_LANE(s, 3), _mm_set1_ps(CHANNEL_MAX));
+  return _mm_add_ps(
+    _mm_mul_ps(s, alpha),
+    _mm_mul_ps(d, _mm_sub_ps(one, alpha))
+  );
+}
+
+// As blend_channels, but following blend_px_under (including its alpha).
+static inline __m128 blend_channels_under(__m128 s, __m128 d) {
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 max = _mm_set1_ps(CHANNEL_MAX);
+  __m128 sa = _mm_div_ps(SPLAT_LANE(s, 3), max);
+  __m128 da = SPLAT_LANE(d, 3);
+  __m128 alpha = _mm_min_ps(
+    _mm_add_ps(sa, _mm_sub_ps(one, _mm_div_ps(da, max))),
+    one
+  );
+  __m128 color = _mm_add_ps(
+    _mm_mul_ps(s, alpha),
+    _mm_mul_ps(d, _mm_sub_ps(one, alpha))
+  );
+  alpha = _mm_mul_ps(_mm_min_ps(_mm_add_ps(sa, da), one), max);
+  return _mm_or_ps(
+    _mm_and_ps(ALPHA_LANE_MASK, alpha),
+    _mm_andnot_ps(ALPHA_LANE_MASK, color)
+  );
+}
+
+// Converts four blended pixels back to channels (truncating, like the scalar
+// conversions do) and packs them into a vector of four pixels.
+static inline __m128i pack_pixels(__m128 p0, __m128 p1, __m128 p2, __m128 p3) {
+  return _mm_packus_epi16(
+    _mm_packs_epi32(_mm_cvttps_epi32(p0), _mm_cvttps_epi32(p1)),
+    _mm_packs_epi32(_mm_cvttps_epi32(p2), _mm_cvttps_epi32(p3))
+  );
+}
+
+// Unpacks four pixels into four single-pixel float vectors.
+static inline void unpack_pixels(__m128i px, __m128 *out) {
+  __m128i zero = _mm_setzero_si128();
+#if defined(__AVX2__)
+  __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(px));
+  __m256 hi = _mm256_cvtepi32_ps(
+    _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(px, zero))
+  );
+  out[0] = _mm256_castps256_ps128(lo);
+  out[1] = _mm256_extractf128_ps(lo, 1);
+  out[2] = _mm256_castps256_ps128(hi);
+  out[3] = _mm256_extractf128_ps(hi, 1);
+#else
+  __m128i lo = _mm_unpacklo_epi8(px, zero);
+  __m128i hi = _mm_unpackhi_epi8(px, zero);
+  out[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+  out[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+  out[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+  out[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+#endif
+}
+
+#endif // SIMD helpers
+
+// Alpha-blends count pixels from src over dst (see blend_px). The rows must
+// not overlap.
+static void draw_row(pixel *dst, pixel const *src, size_t count) {
+  size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  __m128i alpha_mask = _mm_set1_epi32(ALPHA_MASK);
+  __m128i s, d, result;
+  __m128 sf[4], df[4];
+  for (; i + 4 <= count; i += 4) {
+    s = _mm_loadu_si128((__m128i const *) (src + i));
+    d = _mm_loadu_si128((__m128i const *) (dst + i));
+    unpack_pixels(s, sf);
+    unpack_pixels(d, df);
+    result = pack_pixels(
+      blend_channels(sf[0], df[0]),
+      blend_channels(sf[1], df[1]),
+      blend_channels(sf[2], df[2]),
+      blend_channels(sf[3], df[3])
+    );
+    // The result alpha is the larger of the two alphas:
+    result = _mm_or_si128(
+      _mm_andnot_si128(alpha_mask, result),
+      _mm_and_si128(alpha_mask, _mm_max_epu8(s, d))
+    );
+    _mm_storeu_si128((__m128i *) (dst + i), result);
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = blend_px(src[i], dst[i]);
+  }
+}
+
+// As draw_row, but using blend_px_under.
+static void draw_row_under(pixel *dst, pixel const *src, size_t count) {
+  size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  __m128 sf[4], df[4];
+  for (; i + 4 <= count; i += 4) {
+    unpack_pixels(_mm_loadu_si128((__m128i const *) (src + i)), sf);
+    unpack_pixels(_mm_loadu_si128((__m128i const *) (dst + i)), df);
+    _mm_storeu_si128(
+      (__m128i *) (dst + i),
+      pack_pixels(
+        blend_channels_under(sf[0], df[0]),
+        blend_channels_under(sf[1], df[1]),
+        blend_channels_under(sf[2], df[2]),
+        blend_channels_under(sf[3], df[3])
+      )
+    );
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = blend_px_under(src[i], dst[i]);
+  }
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -83,14 +367,19 @@ void setup_textures(void) {
   for (i = 0; i < N_LAYERS; ++i) {
     LAYER_ATLASES[i] = create_dynamic_atlas(DYNAMIC_ATLAS_SIZE);
   }
+  if (PRELOAD_TEXTURES) {
+    preload_textures(TEXTURE_DIR);
+  }
 }
 
 void cleanup_textures(void) {
   size_t i;
+  flush_png_writes();
   for (i = 0; i < N_LAYERS; ++i) {
     cleanup_dynamic_atlas(LAYER_ATLASES[i]);
     LAYER_ATLASES[i] = NULL;
   }
+  clear_texture_cache();
 }
 
 texture* load_texture_from_png(char const * const filename) {
@@ -211,6 +500,84 @@ texture* load_texture_from_png(char const * const filename) {
   return result;
 }
 
+texture* load_cached_texture(char const * const filename) {
+  texture *cached = NULL, *loaded = NULL, *result = NULL;
+  size_t len = strlen(filename);
+  if (!CACHE_TEXTURES) {
+    return load_texture_from_png(filename);
+  }
+#pragma omp critical (texture_cache)
+  {
+    if (TEXTURE_CACHE != NULL) {
+      cached = (texture *) d_get_value(
+        TEXTURE_CACHE,
+        (d_key_t *) filename,
+        len
+      );
+      if (cached != NULL) {
+        result = duplicate_texture(cached);
+      }
+    }
+  }
+  if (result != NULL) {
+    return result;
+  }
+  // Decode the file without holding up other threads. If two threads both
+  // miss on the same file, whichever finishes second throws its copy away.
+  loaded = load_texture_from_png(filename);
+#pragma omp critical (texture_cache)
+  {
+    if (TEXTURE_CACHE == NULL) {
+      TEXTURE_CACHE = create_dictionary(TEXTURE_CACHE_TABLE_SIZE);
+    }
+    cached = (texture *) d_get_value(TEXTURE_CACHE, (d_key_t *) filename, len);
+    if (cached == NULL) {
+      d_add_value(TEXTURE_CACHE, (d_key_t *) filename, len, (void *) loaded);
+      cached = loaded;
+      loaded = NULL;
+    }
+    result = duplicate_texture(cached);
+  }
+  if (loaded != NULL) {
+    cleanup_texture(loaded);
+  }
+  return result;
+}
+
+void preload_textures(char const * const dirname) {
+  string *root = create_string_from_ntchars(dirname);
+  walk_dir_tree(
+    root,
+    &fs_walk_filter_handle_all, NULL,
+    &fs_walk_filter_ignore_hidden, NULL,
+    &fs_walk_filter_by_extension, (void *) "png",
+    &preload_texture_file, NULL
+  );
+  cleanup_string(root);
+}
+
+void clear_texture_cache(void) {
+#pragma omp critical (texture_cache)
+  {
+    if (TEXTURE_CACHE != NULL) {
+      d_foreach(TEXTURE_CACHE, (void (*)(void *)) &cleanup_texture);
+      cleanup_dictionary(TEXTURE_CACHE);
+      TEXTURE_CACHE = NULL;
+    }
+  }
+}
+
+size_t texture_cache_count(void) {
+  size_t result = 0;
+#pragma omp critical (texture_cache)
+  {
+    if (TEXTURE_CACHE != NULL) {
+      result = d_get_count(TEXTURE_CACHE);
+    }
+  }
+  return result;
+}
+
 void write_texture_to_ppm(texture *tx, char const * const filename) {
   FILE *fp;
   pixel px;
@@ -279,7 +646,7 @@ void write_texture_to_png(texture *tx, char const * const filename) {
     PNG_FILTER_TYPE_DEFAULT
   );
   // Build an array of row pointers:
-  png_bytepp row_pointers = (png_bytepp) malloc(tx->width * sizeof(png_bytep));
+  png_bytepp row_pointers = (png_bytepp) malloc(tx->height * sizeof(png_bytep));
   for (i = 0; i < tx->height; ++i) {
     row_pointers[i] = ((png_bytep) tx->pixels) + tx->width*sizeof(pixel) * i;
   }
@@ -293,6 +660,64 @@ void write_texture_to_png(texture *tx, char const * const filename) {
   fclose(fp);
 }
 
+void write_texture_to_png_async(texture *tx, char const * const filename) {
+  png_write *pw;
+  if (!ASYNC_PNG_WRITES || JOB_POOL == NULL) {
+    write_texture_to_png(tx, filename);
+    cleanup_texture(tx);
+    return;
+  }
+  pw = (png_write*) malloc(sizeof(png_write));
+  if (pw == NULL) {
+    perror("Failed to allocate PNG write.");
+    exit(errno);
+  }
+  pw->tx = tx;
+  pw->filename = strdup(filename);
+  pw->next = NULL;
+  __atomic_add_fetch(&PNG_WRITES_PENDING, 1, __ATOMIC_RELAXED);
+#pragma omp critical (png_writes)
+  {
+    if (PNG_WRITES_TAIL == NULL) {
+      PNG_WRITES_HEAD = pw;
+    } else {
+      PNG_WRITES_TAIL->next = pw;
+    }
+    PNG_WRITES_TAIL = pw;
+  }
+  jp_start(JOB_POOL, &png_write_job, NULL, NULL, JOB_PRIORITY_LOW);
+}
+
+void read_async_png_setting(void) {
+  char const *value = getenv(TX_ASYNC_PNG_ENV);
+  if (value == NULL) {
+    return;
+  }
+  if (strcmp(value, "0") == 0) {
+    ASYNC_PNG_WRITES = 0;
+  } else if (strcmp(value, "1") == 0) {
+    ASYNC_PNG_WRITES = 1;
+  } else {
+    fprintf(
+      stderr,
+      "Warning: Ignoring unknown %s value '%s'.\n",
+      TX_ASYNC_PNG_ENV,
+      value
+    );
+  }
+}
+
+void flush_png_writes(void) {
+  while (write_next_png()) {}
+  while (__atomic_load_n(&PNG_WRITES_PENDING, __ATOMIC_ACQUIRE) > 0) {
+    nap(1);
+  }
+}
+
+size_t pending_png_writes(void) {
+  return __atomic_load_n(&PNG_WRITES_PENDING, __ATOMIC_ACQUIRE);
+}
+
 void upload_texture_to(texture* source, GLuint handle) {
   glBindTexture( GL_TEXTURE_2D, handle);
 
@@ -402,9 +827,7 @@ void tx_draw_region(
     size_t region_width,
     size_t region_height
 ) {
-  size_t row, column;
-  pixel src_px, dst_px;
-  float alpha;
+  size_t row;
 #ifdef DEBUG
   // Some bounds checking:
   if (dst_left + region_width > dst->width) {
@@ -425,29 +848,11 @@ void tx_draw_region(
   }
 #endif
   for (row = 0; row < region_height; ++row) {
-    for (column = 0; column < region_width; ++column) {
-      src_px = tx_get_px(src, src_left + column, src_top + row);
-      dst_px = tx_get_px(dst, dst_left + column, dst_top + row);
-      alpha = px_alpha(src_px) / ((float) CHANNEL_MAX);
-      px_set_red(
-        &dst_px,
-        (px_red(src_px) * alpha) + (px_red(dst_px) * (1 - alpha))
-      );
-      px_set_green(
-        &dst_px,
-        (px_green(src_px) * alpha) + (px_green(dst_px) * (1 - alpha))
-      );
-      px_set_blue(
-        &dst_px,
-        (px_blue(src_px) * alpha) + (px_blue(dst_px) * (1 - alpha))
-      );
-      // TODO: Better here!
-      px_set_alpha(
-        &dst_px,
-        px_alpha(src_px)>px_alpha(dst_px) ? px_alpha(src_px) : px_alpha(dst_px)
-      );
-      tx_set_px(dst, dst_px, dst_left + column, dst_top + row);
-    }
+    draw_row(
+      tx_get_addr(dst, dst_left, dst_top + row),
+      tx_get_addr(src, src_left, src_top + row),
+      region_width
+    );
   }
 }
 
@@ -461,41 +866,24 @@ void tx_draw_region_wrapped(
     size_t region_width,
     size_t region_height
 ) {
-  size_t row, column, dr, dc;
-  pixel src_px, dst_px;
-  float alpha;
+  size_t row, column, sr, sc, dr, dc, span;
   for (row = 0; row < region_height; ++row) {
-    for (column = 0; column < region_width; ++column) {
-      src_px = tx_get_px(
-        src,
-        (src_left + column) % src->width,
-        (src_top + row) % src->height
-      );
-      dr = (dst_top + row) % dst->height;
+    sr = (src_top + row) % src->height;
+    dr = (dst_top + row) % dst->height;
+    // Blend runs of pixels that don't wrap in either texture:
+    column = 0;
+    while (column < region_width) {
+      sc = (src_left + column) % src->width;
       dc = (dst_left + column) % dst->width;
-      dst_px = tx_get_px(dst, dc, dr);
-      alpha = (
-        px_alpha(src_px) / ((float) CHANNEL_MAX)
-      +
-        (1 - (px_alpha(dst_px) / ((float) CHANNEL_MAX)))
-      );
-      if (alpha > 1) { alpha = 1; }
-      px_set_red(
-        &dst_px,
-        (px_red(src_px) * alpha) + (px_red(dst_px) * (1 - alpha))
-      );
-      px_set_green(
-        &dst_px,
-        (px_green(src_px) * alpha) + (px_green(dst_px) * (1 - alpha))
-      );
-      px_set_blue(
-        &dst_px,
-        (px_blue(src_px) * alpha) + (px_blue(dst_px) * (1 - alpha))
+      span = region_width - column;
+      if (span > src->width - sc) { span = src->width - sc; }
+      if (span > dst->width - dc) { span = dst->width - dc; }
+      draw_row_under(
+        tx_get_addr(dst, dc, dr),
+        tx_get_addr(src, sc, sr),
+        span
       );
-      alpha = px_alpha(src_px) / ((float) CHANNEL_MAX) + px_alpha(dst_px);
-      if (alpha > 1) { alpha = 1; }
-      px_set_alpha(&dst_px, alpha * CHANNEL_MAX);
-      tx_set_px(dst, dst_px, dc, dr);
+      column += span;
     }
   }
 }
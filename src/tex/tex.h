@@ -34,6 +34,9 @@ typedef struct tcoords_s tcoords;
 // Pixel dimension of each block texture:
 #define BLOCK_TEXTURE_SIZE 32
 
+// The environment variable that read_async_png_setting checks:
+#define TX_ASYNC_PNG_ENV "ELF_ASYNC_PNG"
+
 /********************
  * Global variables *
  ********************/
@@ -41,6 +44,22 @@ typedef struct tcoords_s tcoords;
 // The directory to load static block textures from:
 extern char const * const BLOCK_TEXTURE_DIR;
 
+// The root directory for all textures (see preload_textures):
+extern char const * const TEXTURE_DIR;
+
+// Whether load_cached_texture keeps decoded textures around (otherwise every
+// call reads and decodes the file):
+extern uint8_t CACHE_TEXTURES;
+
+// Whether setup_textures should decode everything under TEXTURE_DIR into the
+// texture cache up front:
+extern uint8_t PRELOAD_TEXTURES;
+
+// Whether write_texture_to_png_async may leave PNG encoding to the main job
+// pool (otherwise it writes files immediately). May be changed at runtime (see
+// read_async_png_setting):
+extern uint8_t ASYNC_PNG_WRITES;
+
 /*************************
  * Structure Definitions *
  *************************/
@@ -121,18 +140,52 @@ void cleanup_texture(texture *tx);
 // Sets up the standard dynamic texture atlases.
 void setup_textures(void);
 
-// Cleans up the texture subsystem.
+// Cleans up the texture subsystem (writing out any queued PNG files first).
 void cleanup_textures(void);
 
 // Loads a PNG file and returns a newly-allocated texture pointer.
 texture * load_texture_from_png(char const * const filename);
 
+// Returns a newly-allocated copy of the texture in the given PNG file, which
+// the caller is free to modify and must clean up. Decoded files are kept in a
+// process-wide cache keyed by filename, so each file is only read once. Safe
+// to call from multiple threads.
+texture * load_cached_texture(char const * const filename);
+
+// Decodes every PNG file under the given directory into the texture cache.
+void preload_textures(char const * const dirname);
+
+// Frees every texture in the texture cache. Called by cleanup_textures.
+void clear_texture_cache(void);
+
+// Returns the number of textures in the texture cache.
+size_t texture_cache_count(void);
+
 // Writes the given texture in .ppm format to the given file.
 void write_texture_to_ppm(texture *tx, char const * const filename);
 
 // Writes the given texture in .png format to the given file using libpng.
 void write_texture_to_png(texture *tx, char const * const filename);
 
+// Works like write_texture_to_png, but takes ownership of the texture (which
+// is cleaned up once it's been written) and, if ASYNC_PNG_WRITES is set and
+// the main job pool exists, queues the write as a low-priority job instead of
+// encoding it on the calling thread. Safe to call from multiple threads.
+void write_texture_to_png_async(texture *tx, char const * const filename);
+
+// Sets ASYNC_PNG_WRITES from the TX_ASYNC_PNG_ENV environment variable, which
+// may be "0" or "1". Leaves it alone if the variable isn't set, and warns
+// about any other value.
+void read_async_png_setting(void);
+
+// Writes out every PNG file still queued by write_texture_to_png_async on the
+// calling thread, and waits for any that are being written elsewhere.
+void flush_png_writes(void);
+
+// Returns the number of PNG files queued by write_texture_to_png_async that
+// haven't been completely written yet.
+size_t pending_png_writes(void);
+
 // Uploads the given texture to the given texture handle (which must already
 // have been created). Overwrites any data that may have been stored at that
 // handle.
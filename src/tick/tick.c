@@ -25,6 +25,7 @@
 #include "shaders/pipeline.h"
 #include "jobs/jobs.h"
 #include "tex/tex.h"
+#include "txgen/cartography.h"
 #include "gen/worldgen.h"
 #include "ui/ui.h"
 
@@ -60,6 +61,10 @@ void _get_everything_set_up(ptrdiff_t seed, int argc, char** argv) {
   // Prepare the window context:
   prepare_default(&argc, argv);
 
+  // Read settings from the environment:
+  read_async_png_setting();
+  read_preview_setting();
+
   // Set up the test world:
   printf("Setting up subsystems...\n");
 
@@ -80,10 +85,8 @@ void _get_everything_set_up(ptrdiff_t seed, int argc, char** argv) {
   printf("  ...blocks...\n");
   init_blocks();
 
-  // Setup stateful subsystems:
-  // TODO: Do we need/want this subsystem?
-  //printf("  ...jobs...\n");
-  //setup_jobs();
+  // Setup stateful subsystems (the jobs system is set up in start_game, since
+  // it determines how many threads we need):
   printf("  ...rendering...\n");
   setup_render();
   printf("  ...shaders...\n");
@@ -138,8 +141,22 @@ void start_game(
   int thread_id = 0;
   global_chunk_pos area_origin, last_origin;
 
+  // Allow one level of nesting so that parallel kernels (e.g., the heightmap
+  // operations used during worldgen) can still fan out when they're called
+  // from one of the main threads:
+  omp_set_max_active_levels(2);
+
+  // The render thread, the job pool, and the data thread's biogen team share
+  // the cores between them (job workers sleep while there's no work):
+  setup_jobs();
+  BIOGEN_THREADS = omp_get_num_procs() - 1 - (int) JOB_POOL->n_workers;
+  if (BIOGEN_THREADS < 1) {
+    BIOGEN_THREADS = 1;
+  }
+
   // Start the main threads:
-#pragma omp parallel num_threads(2) firstprivate(thread_id)
+#pragma omp parallel num_threads(2 + JOB_POOL->n_workers) \
+  firstprivate(thread_id)
   {
     thread_id = omp_get_thread_num();
     // Everyone waits while the graphics thread performs setup:
@@ -159,12 +176,15 @@ void start_game(
     // And then each thread starts its own loop:
     if (thread_id == 0) {
       // The main thread (which gets to have the graphics context):
+      TRACE_THREAD_NAME("render");
       // Ensure control of the GLFW window:
       glfwMakeContextCurrent(WINDOW);
       while (!SHUTDOWN) {
         if (glfwWindowShouldClose(WINDOW)) {
           break;
         }
+        // Nothing from last frame's cell_at calls is held on to:
+        cell_at_quiesce();
         // Compile chunks
 #ifdef PROFILE_TIME
         start_duration(&COMPILE_TIME);
@@ -203,6 +223,7 @@ void start_game(
       }
     } else if (thread_id == 1) {
       // The data management thread:
+      TRACE_THREAD_NAME("data");
       while (!SHUTDOWN) {
         if (TICK_AUTOLOAD) {
           omp_set_lock(&POSITION_LOCK);
@@ -223,6 +244,10 @@ void start_game(
         nap(10);
       }
       DATA_DONE = 1;
+    } else if (thread_id < 2 + JOB_POOL->n_workers) {
+      // A job pool worker (returns once the pool is shut down):
+      TRACE_THREAD_NAME("job worker");
+      jp_work(JOB_POOL, thread_id - 2);
     } else {
       fprintf(stderr, "Error: unexpected thread ID %d. Aborting.\n", thread_id);
       core_shutdown(-1);
@@ -240,7 +265,7 @@ void cleanup(void) {
   cleanup_shaders();
   cleanup_render();
   cleanup_elf_forest_data();
-  //cleanup_jobs();
+  cleanup_jobs();
 }
 
 void core_shutdown(int returnval) {
@@ -256,6 +281,16 @@ void core_shutdown(int returnval) {
     nap(5);
     patience -= 1;
   }
+  // Let the job pool's workers finish their current steps:
+  if (JOB_POOL != NULL) {
+    jp_shutdown(JOB_POOL);
+  }
+#ifdef PROFILE_TIME
+  if (TRACE_AT_EXIT) {
+    printf("Writing timing trace to '%s'.\n", TRACE_FILE);
+    trace_dump(TRACE_FILE);
+  }
+#endif
   cleanup();
   glfwTerminate();
   exit(returnval);
@@ -1,6 +1,10 @@
 // cartography.c
 // Map drawing functions.
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
 #include "tex/tex.h"
 #include "tex/draw.h"
 #include "gen/worldgen.h"
@@ -183,10 +187,60 @@ gradient_map const PRECIPITATION_GRADIENT = {
 
 pixel const RIVER_COLOR = 0xffdd9955;
 
+/***********
+ * Globals *
+ ***********/
+
+preview_mode PREVIEW_MAPS = PREVIEW_REDUCED;
+
 /*************
  * Functions *
  *************/
 
+void read_preview_setting(void) {
+  char const *value = getenv(CART_PREVIEW_ENV);
+  if (value == NULL) {
+    return;
+  }
+  if (strcmp(value, "none") == 0) {
+    PREVIEW_MAPS = PREVIEW_NONE;
+  } else if (strcmp(value, "reduced") == 0) {
+    PREVIEW_MAPS = PREVIEW_REDUCED;
+  } else if (strcmp(value, "full") == 0) {
+    PREVIEW_MAPS = PREVIEW_FULL;
+  } else {
+    fprintf(
+      stderr,
+      "Warning: Ignoring unknown %s value '%s'.\n",
+      CART_PREVIEW_ENV,
+      value
+    );
+  }
+}
+
+texture* create_preview_texture(size_t width, size_t height) {
+  switch (PREVIEW_MAPS) {
+    case PREVIEW_NONE:
+    default:
+      return NULL;
+    case PREVIEW_REDUCED:
+      width /= CART_PREVIEW_REDUCTION;
+      height /= CART_PREVIEW_REDUCTION;
+      if (width < 1) { width = 1; }
+      if (height < 1) { height = 1; }
+      return create_texture(width, height);
+    case PREVIEW_FULL:
+      return create_texture(width, height);
+  }
+}
+
+void write_preview(texture *tx, char const * const filename) {
+  if (tx == NULL) {
+    return;
+  }
+  write_texture_to_png_async(tx, filename);
+}
+
 void render_map_layer(
   world_map *wm,
   texture *tx,
@@ -197,10 +251,11 @@ void render_map_layer(
   world_map_pos wmpos;
   world_region *wr;
   pixel color;
-  for (col = 0; col < tx->width; ++col) {
-    for (row = 0; row < tx->height; ++row) {
+#pragma omp parallel for schedule(static) private(col, x, y, wmpos, wr, color)
+  for (row = 0; row < tx->height; ++row) {
+    y = (row + 0.5) / ((float) tx->height);
+    for (col = 0; col < tx->width; ++col) {
       x = (col + 0.5) / ((float) tx->width);
-      y = (row + 0.5) / ((float) tx->height);
       wmpos.x = (wm_pos_t) ffloor(x * wm->width);
       wmpos.y = (wm_pos_t) ffloor(y * wm->height);
       wr = get_world_region(wm, &wmpos);
@@ -227,10 +282,16 @@ void render_map_vectors(
   world_map_pos wmpos;
   world_region *wr;
   vector from, to;
+  // Spacing and length are given for one pixel per region, so they shrink
+  // along with the texture (e.g., for PREVIEW_REDUCED previews):
+  float scale = tx->width / (float) wm->width;
+  size_t spacing = (size_t) roundf(CART_VECTOR_SPACING * scale);
+  float length = CART_MAX_VECTOR_LENGTH * scale;
+  if (spacing < 1) { spacing = 1; }
   from.z = 0;
   to.z = 0;
-  for (col = 0; col < tx->width; col += CART_VECTOR_SPACING) {
-    for (row = 0; row < tx->height; row += CART_VECTOR_SPACING) {
+  for (col = 0; col < tx->width; col += spacing) {
+    for (row = 0; row < tx->height; row += spacing) {
       x = (col + 0.5) / ((float) tx->width);
       y = (row + 0.5) / ((float) tx->height);
       wmpos.x = (wm_pos_t) ffloor(x * wm->width);
@@ -240,8 +301,8 @@ void render_map_vectors(
         vector_layer_fn(wr, &r, &theta);
         from.x = col;
         from.y = row;
-        to.x = from.x + CART_MAX_VECTOR_LENGTH * r * cos(theta);
-        to.y = from.y + CART_MAX_VECTOR_LENGTH * r * sin(theta);
+        to.x = from.x + length * r * cos(theta);
+        to.y = from.y + length * r * sin(theta);
         draw_line_gradient(tx, &from, &to, start, end);
       }
     }
@@ -257,12 +318,13 @@ void render_heightmap(
   float x, y;
   size_t hx, hy;
   pixel color;
-  for (col = 0; col < tx->width; ++col) {
-    for (row = 0; row < tx->height; ++row) {
+#pragma omp parallel for schedule(static) private(col, x, y, hx, hy, color)
+  for (row = 0; row < tx->height; ++row) {
+    y = (row + 0.5) / ((float) tx->height);
+    hy = ffloor(y * hm->height);
+    for (col = 0; col < tx->width; ++col) {
       x = (col + 0.5) / ((float) tx->width);
-      y = (row + 0.5) / ((float) tx->height);
       hx = ffloor(x * hm->width);
-      hy = ffloor(y * hm->height);
       if (use_color) {
         color = gradient_result(&LAND_GRADIENT, hm_height(hm, hx, hy));
       } else {
@@ -8,10 +8,24 @@
 #include "txgen/txgen.h"
 #include "gen/worldgen.h"
 
+/*********
+ * Enums *
+ *********/
+
+// How preview maps (the images written out during world generation) are
+// produced:
+enum preview_mode_e {
+  PREVIEW_NONE = 0, // skip them entirely
+  PREVIEW_REDUCED = 1, // render them at 1/CART_PREVIEW_REDUCTION size
+  PREVIEW_FULL = 2, // render them at full size
+};
+typedef enum preview_mode_e preview_mode;
+
 /*************
  * Constants *
  *************/
 
+// Vector map layout, in pixels at one pixel per world region:
 #define CART_VECTOR_SPACING 8
 #define CART_MAX_VECTOR_LENGTH 6.0
 
@@ -30,6 +44,20 @@ extern pixel const RIVER_COLOR;
 #define SHORE_HUE_ADJUST (-20)
 #define SHORE_VAL_ADJUST (-10)
 
+// Reduced-size preview maps are this many times smaller along each axis:
+#define CART_PREVIEW_REDUCTION 4
+
+// The environment variable that read_preview_setting checks:
+#define CART_PREVIEW_ENV "ELF_PREVIEW_MAPS"
+
+/***********
+ * Globals *
+ ***********/
+
+// How to produce preview maps (reduced size by default). May be changed at
+// runtime (see read_preview_setting) before world generation starts.
+extern preview_mode PREVIEW_MAPS;
+
 /********************
  * Inline Functions *
  ********************/
@@ -40,7 +68,24 @@ extern pixel const RIVER_COLOR;
  * Functions *
  *************/
 
+// Sets PREVIEW_MAPS from the CART_PREVIEW_ENV environment variable, which may
+// be "none", "reduced", or "full". Leaves it alone if the variable isn't set,
+// and warns about any other value.
+void read_preview_setting(void);
+
+// Returns a new texture for a preview of something that's width x height
+// regions or cells in size, scaled down if PREVIEW_MAPS asks for reduced
+// previews. Returns NULL if previews are turned off.
+texture* create_preview_texture(size_t width, size_t height);
+
+// Queues the given preview map to be written to the given file (see
+// write_texture_to_png_async), taking ownership of the texture. Does nothing
+// if the texture is NULL.
+void write_preview(texture *tx, char const * const filename);
+
 // Renders a map of the given layer of the given world into the given texture.
+// Rows are rendered in parallel, so the layer function must be safe to call
+// from multiple threads.
 void render_map_layer(
   world_map *wm,
   texture *tx,
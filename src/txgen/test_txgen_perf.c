@@ -0,0 +1,270 @@
+// test_txgen_perf.c
+// Measures per-texture latency for grammar-based texture generation and for
+// gen_block_texture across every block type.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "tex/tex.h"
+#include "world/blocks.h"
+#include "world/species.h"
+
+#include "txg_minerals.h"
+#include "txgen.h"
+
+// Each configuration is timed repeatedly until at least this much time has
+// passed:
+#define MIN_SECONDS 0.5
+
+/***********
+ * Grammar *
+ ***********/
+
+// A moss texture like the ones in the txgen unit tests: a template that gets
+// covered in randomly-chosen clumps.
+
+tx_grammar_literal bench_clump_1 = SIMPLE_TX_LITERAL(
+  "res/textures/plants/mosses/leaf-moss-1.png",
+  3, 2
+);
+tx_grammar_literal bench_clump_2 = SIMPLE_TX_LITERAL(
+  "res/textures/plants/mosses/leaf-moss-2.png",
+  3, 2
+);
+tx_grammar_literal bench_clump_3 = SIMPLE_TX_LITERAL(
+  "res/textures/plants/mosses/leaf-moss-3.png",
+  2, 2
+);
+tx_grammar_literal bench_clump_4 = SIMPLE_TX_LITERAL(
+  "res/textures/plants/mosses/leaf-moss-4.png",
+  2, 3
+);
+tx_grammar_literal bench_clump_5 = SIMPLE_TX_LITERAL(
+  "res/textures/plants/mosses/leaf-moss-5.png",
+  3, 2
+);
+
+TX_ANY_ENTRY(bench_clump, 5, NULL, 1);
+TX_ANY_ENTRY(bench_clump, 4, &TX_ANY(bench_clump, 5), 1);
+TX_ANY_ENTRY(bench_clump, 3, &TX_ANY(bench_clump, 4), 1);
+TX_ANY_ENTRY(bench_clump, 2, &TX_ANY(bench_clump, 3), 1);
+TX_ANY_ENTRY(bench_clump, 1, &TX_ANY(bench_clump, 2), 1);
+
+tx_grammar_literal bench_moss = {
+  .filename = "res/textures/plants/mosses/template-sparse.png",
+  .anchor_x = 0,
+  .anchor_y = 0,
+  .preprocess = NULL,
+    .preargs = NULL,
+  .postprocess = NULL,
+    .postargs = NULL,
+  .children = {
+    &any_bench_clump_1,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+  },
+  .result = NULL
+};
+
+/******************
+ * Mineral Species *
+ ******************/
+
+// Appearance used for the procedurally-textured mineral species (dirt, mud,
+// sand, clay, and stone):
+mineral_filter_args bench_mineral = {
+  .seed = 31,
+  .scale = 0.095,
+
+  .gritty = 0.14,
+  .contoured = 0.4,
+  .porous = 0.8,
+  .bumpy = 0.3,
+  .layered = 0.4,
+  .layerscale = 0.25,
+  .layerwaves = 0.3,
+  .wavescale = 0.5,
+
+  .inclusions = 0.4,
+
+  .dscale = 0.165,
+  .distortion = 3.3,
+  .squash = 0.9,
+  .base_color = 0xff999999, // gray
+  .alt_color = 0xff888078, // blue-gray
+  .sat_noise = 0.1,
+  .desaturate = 0.2,
+  .brightness = 0.2,
+};
+
+static block const MINERAL_BLOCKS[] = {
+  B_DIRT, B_MUD, B_SAND, B_CLAY, B_STONE, B_VOID
+};
+
+/*************
+ * Benchmark *
+ *************/
+
+// Generates the given texture over and over and reports the average time per
+// texture.
+static void bench(char const * const name, tx_grammar_literal *lit) {
+  size_t reps = 0;
+  double start, elapsed;
+  start = omp_get_wtime();
+  do {
+    run_grammar(lit);
+    cleanup_grammar_results(lit);
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  printf(
+    "%-24s %9.1f us/texture (%zu textures)\n",
+    name,
+    elapsed * 1000000.0 / reps,
+    reps
+  );
+}
+
+// Like bench, but for gen_block_texture on a single block.
+static void bench_block(char const * const name, block b) {
+  size_t reps = 0;
+  double start, elapsed;
+  texture *tx;
+  start = omp_get_wtime();
+  do {
+    tx = gen_block_texture(b);
+    if (tx != NULL) {
+      cleanup_texture(tx);
+    }
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  printf(
+    "%-24s %9.1f us/texture (%zu textures)\n",
+    name,
+    elapsed * 1000000.0 / reps,
+    reps
+  );
+}
+
+// Generates the default texture for every defined block type once and
+// reports the average and the slowest type.
+static void bench_all_blocks(char const * const name) {
+  block id, slowest = B_VOID;
+  size_t found = 0, missing = 0;
+  double start, elapsed, total = 0, worst = 0;
+  texture *tx;
+  for (id = 0; id < TOTAL_BLOCK_TYPES; ++id) {
+    if (BLOCK_NAMES[id] == NULL || b_is_invisible(b_make_block(id))) {
+      continue;
+    }
+    start = omp_get_wtime();
+    tx = gen_block_texture(b_make_block(id));
+    elapsed = omp_get_wtime() - start;
+    if (tx == NULL) {
+      missing += 1;
+      continue;
+    }
+    cleanup_texture(tx);
+    found += 1;
+    total += elapsed;
+    if (elapsed > worst) {
+      worst = elapsed;
+      slowest = id;
+    }
+  }
+  printf(
+    "%-24s %9.1f us/texture (%zu block types, %zu without textures)\n",
+    name,
+    found > 0 ? total * 1000000.0 / found : 0,
+    found,
+    missing
+  );
+  if (found > 0) {
+    printf(
+      "%-24s %9.1f us (%s)\n",
+      "  slowest",
+      worst * 1000000.0,
+      BLOCK_NAMES[slowest]
+    );
+  }
+}
+
+int main(int argc, char** argv) {
+  size_t i;
+  double start;
+  char name[64];
+  species dirt, clay, stone;
+  block b;
+
+  init_blocks();
+  setup_species();
+
+  CACHE_TEXTURES = 0;
+  bench("moss (no cache)", &bench_moss);
+
+  CACHE_TEXTURES = 1;
+  clear_texture_cache();
+  start = omp_get_wtime();
+  run_grammar(&bench_moss);
+  cleanup_grammar_results(&bench_moss);
+  printf(
+    "%-24s %9.1f us/texture\n",
+    "moss (first use)",
+    (omp_get_wtime() - start) * 1000000.0
+  );
+  bench("moss (cached)", &bench_moss);
+
+  clear_texture_cache();
+  start = omp_get_wtime();
+  preload_textures(TEXTURE_DIR);
+  printf(
+    "Preloaded %zu textures from '%s' in %.1f ms.\n",
+    texture_cache_count(),
+    TEXTURE_DIR,
+    (omp_get_wtime() - start) * 1000.0
+  );
+  clear_texture_cache();
+
+  // Block textures:
+  bench_all_blocks("all blocks (first use)");
+  bench_all_blocks("all blocks (cached)");
+
+  dirt = create_dirt_species();
+  get_dirt_species(dirt)->appearance = bench_mineral;
+  clay = create_clay_species();
+  get_clay_species(clay)->appearance = bench_mineral;
+  stone = create_stone_species();
+  get_stone_species(stone)->appearance = bench_mineral;
+
+  for (i = 0; MINERAL_BLOCKS[i] != B_VOID; ++i) {
+    switch (MINERAL_BLOCKS[i]) {
+      case B_DIRT:
+      case B_MUD:
+      default:
+        b = b_make_species(MINERAL_BLOCKS[i], dirt);
+        break;
+      case B_CLAY:
+        b = b_make_species(MINERAL_BLOCKS[i], clay);
+        break;
+      case B_SAND:
+      case B_STONE:
+        b = b_make_species(MINERAL_BLOCKS[i], stone);
+        break;
+    }
+    PARALLEL_TEXTURE_FILTERS = 0;
+    snprintf(name, 64, "%s (serial)", BLOCK_NAMES[MINERAL_BLOCKS[i]]);
+    bench_block(name, b);
+    PARALLEL_TEXTURE_FILTERS = 1;
+    snprintf(name, 64, "%s (threaded)", BLOCK_NAMES[MINERAL_BLOCKS[i]]);
+    bench_block(name, b);
+  }
+
+  clear_texture_cache();
+  return 0;
+}
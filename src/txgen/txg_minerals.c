@@ -1,6 +1,11 @@
 // txg_minerals.c
 // Mineral and soil texture generation.
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
 #include "noise/noise.h"
 #include "tex/tex.h"
 #include "tex/draw.h"
@@ -13,17 +18,21 @@
 
 #include "txg_minerals.h"
 
-/********************
- * Filter Functions *
- ********************/
+/**************
+ * Structures *
+ **************/
 
-// Generates mineral textures.
-void fltr_mineral(texture *tx, void const * const fargs) {
-  mineral_filter_args *mfargs = (mineral_filter_args *) fargs;
+// Everything about a mineral texture that stays the same from pixel to pixel,
+// worked out once per texture so that the row kernel can be run on any thread.
+struct mineral_kernel_s;
+typedef struct mineral_kernel_s mineral_kernel;
 
-  int row, col; // position within texture
-  float x, y; // distorted/squashed x/y coordinates
-  float alx, aly; // distorted/squashed alternate x/y coordinates
+struct mineral_kernel_s {
+  mineral_filter_args const *mfargs;
+
+  // Seeds for the different noise functions:
+  ptrdiff_t salt1, salt2, salt3, salt4, salt6, salt7, salt8;
+  uint8_t invert_layers; // whether layers use 1 - expdist (from salt5)
 
   float scx, scy; // rounded x/y scales
   float dscx, dscy; // rounded x/y distortion scales
@@ -33,168 +42,218 @@ void fltr_mineral(texture *tx, void const * const fargs) {
   float dwx, dwy; // distortion wrap scales
   float alwx, alwy; // alternate wrap scales
 
+  float layerscale; // layer height in pixels
+  float *col_phase; // per-column layer wave phase
+
+  pixel base_hsv, alt_hsv; // base and alternate colors in hsv
+};
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Fills in a single row of a mineral texture.
+static void mineral_row(texture *tx, mineral_kernel const * const k, int row) {
+  mineral_filter_args const * const mfargs = k->mfargs;
+
+  int col; // position within texture
+  float x, y; // distorted/squashed x/y coordinates
+  float alx, aly; // distorted/squashed alternate x/y coordinates
+
   float ds; // distortion
   float grit, contours, matrix, bumps, alternate, layers; // noise components
-  float wavescale, layerscale, lphase; // layer phase
+  float lphase; // layer phase
   float snoise; // saturation noise
   float saturation, value; // color values
 
   float dontcare;
 
-  // Seeds for the different noise functions:
-  ptrdiff_t seed = prng(mfargs->seed - 5);
-  ptrdiff_t salt1, salt2, salt3, salt4, salt5, salt6, salt7, salt8;
-
-  pixel base_hsv, alt_hsv; // base and alternate colors in hsv
   pixel hsv; // temp hsv color
   pixel rgb; // final rgb color
-  base_hsv = rgb__hsv(mfargs->base_color);
-  alt_hsv = rgb__hsv(mfargs->alt_color);
-
-  salt1 = prng(seed + 555);
-  salt2 = prng(salt1);
-  salt3 = prng(salt2);
-  salt4 = prng(salt3);
-  salt5 = prng(salt4);
-  salt6 = prng(salt5);
-  salt7 = prng(salt6);
-  salt8 = prng(salt7);
 
-  // Round all scale values so that the scaled coordinate-space texture
-  // boundaries are integers (for simplex noise wrapping purposes):
-  scx = rounddenom(mfargs->scale*mfargs->squash, tx->width);
-  scy = rounddenom(mfargs->scale/mfargs->squash, tx->height);
-  wx = (float) tx->width * scx;
-  wy = (float) tx->height * scy;
-
-  dscx = rounddenom(mfargs->dscale, tx->width);
-  dscy = rounddenom(mfargs->dscale, tx->height);
-  dwx = tx->width * dscx;
-  dwy = tx->height * dscy;
-
-  alscx = (tx->width/5 + scx*tx->width)/((float) tx->width);
-  alscy = (tx->height/5 + scy*tx->height)/((float) tx->height);
-  alwx = tx->width * alscx;
-  alwy = tx->height * alscy;
-
-  // Loop over each pixel of the texture:
   for (col = 0; col < tx->width; col += 1) {
-    for (row = 0; row < tx->height; row += 1) {
-      ds = tiled_func(
-        &sxnoise_2d,
-        col * dscx, row * dscy,
-        dwx, dwy,
-        salt1
-      );
-      x = (col + ds * mfargs->distortion) * scx;
-      y = (row + ds * mfargs->distortion) * scy;
-      grit = ptrf(prng(col * col + fastfloor(x) + prng(row + fastfloor(y))));
-      contours = (
-        1 + tiled_func(&sxnoise_2d, x, y, wx, wy, salt2)
-      ) / 2.0;
-      matrix = sqrtf(
-        wrnoise_2d_fancy(
-          x, y, salt3,
-          fastfloor(wx), fastfloor(wy),
-          &dontcare, &dontcare,
-          0
-        )
-      );
-      bumps = sqrtf(
-        wrnoise_2d_fancy(
-          x, y, salt4,
-          fastfloor(wx), fastfloor(wy),
-          &dontcare, &dontcare,
-          WORLEY_FLAG_INCLUDE_NEXTBEST
-        )
-      );
-
-      wavescale = ((float) tx->width) / roundf(1.0 / mfargs->wavescale);
-      lphase = (1.0 + sinf(((float) col) * 2 * M_PI / wavescale)) / 2.0;
-      wavescale = ((float) tx->width) / roundf(3.0 / mfargs->wavescale);
-      lphase += 0.5 * (1.0 + sinf(((float) col) * 2 * M_PI / wavescale)) / 2.0;
-      lphase /= 1.5;
-
-      layerscale = ((float) tx->height) / roundf(1.0 / mfargs->layerscale);
-      lphase = (((float) row) + lphase * mfargs->layerwaves) / layerscale;
-      lphase -= fastfloor(lphase);
-      if (ptrf(salt5) > 0.5) {
-        layers = 1 - expdist(lphase, 2.5);
-      } else {
-        layers = expdist(lphase, 2.5);
-      }
-
-      alx = col * alscx;
-      aly = row * alscy;
-      alternate = wrnoise_2d_fancy(
-        alx, aly, salt6,
-        fastfloor(wx), fastfloor(wy),
+    ds = tiled_func(
+      &sxnoise_2d,
+      col * k->dscx, row * k->dscy,
+      k->dwx, k->dwy,
+      k->salt1
+    );
+    x = (col + ds * mfargs->distortion) * k->scx;
+    y = (row + ds * mfargs->distortion) * k->scy;
+    grit = ptrf(prng(col * col + fastfloor(x) + prng(row + fastfloor(y))));
+    contours = (
+      1 + tiled_func(&sxnoise_2d, x, y, k->wx, k->wy, k->salt2)
+    ) / 2.0;
+    matrix = sqrtf(
+      wrnoise_2d_fancy(
+        x, y, k->salt3,
+        fastfloor(k->wx), fastfloor(k->wy),
+        &dontcare, &dontcare,
+        0
+      )
+    );
+    bumps = sqrtf(
+      wrnoise_2d_fancy(
+        x, y, k->salt4,
+        fastfloor(k->wx), fastfloor(k->wy),
         &dontcare, &dontcare,
         WORLEY_FLAG_INCLUDE_NEXTBEST
-      ) * (
-        (
-          1 + tiled_func(
-            &sxnoise_2d,
-            alx, aly,
-            alwx, alwy,
-            salt7
-          )
-        ) / 2.0
-      );
-      alternate = sqrtf(alternate);
-
-      // value construction:
-      value = (
-        mfargs->gritty * grit
-      + mfargs->contoured * contours
-      + mfargs->porous * matrix
-      + mfargs->bumpy * bumps
-      ) / (
-        mfargs->gritty
-      + mfargs->contoured
-      + mfargs->porous
-      + mfargs->bumpy
-      );
-      // multiplicative blending for layers:
-      value *= (mfargs->layered) * layers + (1 - mfargs->layered);
-
-      // saturation variance:
-      saturation = (
-        0.7 + 0.3 * tiled_func(
+      )
+    );
+
+    lphase = k->col_phase[col];
+    lphase = (((float) row) + lphase * mfargs->layerwaves) / k->layerscale;
+    lphase -= fastfloor(lphase);
+    if (k->invert_layers) {
+      layers = 1 - expdist(lphase, 2.5);
+    } else {
+      layers = expdist(lphase, 2.5);
+    }
+
+    alx = col * k->alscx;
+    aly = row * k->alscy;
+    alternate = wrnoise_2d_fancy(
+      alx, aly, k->salt6,
+      fastfloor(k->wx), fastfloor(k->wy),
+      &dontcare, &dontcare,
+      WORLEY_FLAG_INCLUDE_NEXTBEST
+    ) * (
+      (
+        1 + tiled_func(
           &sxnoise_2d,
-          x, y,
-          wx, wy,
-          salt8
+          alx, aly,
+          k->alwx, k->alwy,
+          k->salt7
         )
-      );
-      snoise = ptrf(prng(prng(col + fastfloor(x)) + row + fastfloor(y)));
-      saturation = (
-        (1.0 - mfargs->sat_noise) * saturation
-      + mfargs->sat_noise * snoise
-      );
-
-      saturation *= (1 - mfargs->desaturate);
-
-      // figure out the base color:
-      hsv = base_hsv;
-      px_set_sat(&hsv, px_sat(hsv) * saturation);
-      px_set_val(&hsv, CHANNEL_MAX * value);
-      if (alternate > (1 - mfargs->inclusions)) {
-        px_set_hue(&hsv, px_hue(alt_hsv));
-        px_set_sat(&hsv, px_sat(alt_hsv));
-        px_set_val(&hsv, CHANNEL_MAX * alternate);
-      } else if (alternate > (1 - (mfargs->inclusions + 0.05))) {
-        px_set_sat(&hsv, 0.5*px_sat(hsv));
-        px_set_val(&hsv, (px_val(hsv) + CHANNEL_MAX * alternate)/2.0);
-      }
-      rgb = hsv__rgb(hsv);
-      rgb = px_relight(rgb, mfargs->brightness);
-
-      tx_set_px(tx, rgb, col, row);
+      ) / 2.0
+    );
+    alternate = sqrtf(alternate);
+
+    // value construction:
+    value = (
+      mfargs->gritty * grit
+    + mfargs->contoured * contours
+    + mfargs->porous * matrix
+    + mfargs->bumpy * bumps
+    ) / (
+      mfargs->gritty
+    + mfargs->contoured
+    + mfargs->porous
+    + mfargs->bumpy
+    );
+    // multiplicative blending for layers:
+    value *= (mfargs->layered) * layers + (1 - mfargs->layered);
+
+    // saturation variance:
+    saturation = (
+      0.7 + 0.3 * tiled_func(
+        &sxnoise_2d,
+        x, y,
+        k->wx, k->wy,
+        k->salt8
+      )
+    );
+    snoise = ptrf(prng(prng(col + fastfloor(x)) + row + fastfloor(y)));
+    saturation = (
+      (1.0 - mfargs->sat_noise) * saturation
+    + mfargs->sat_noise * snoise
+    );
+
+    saturation *= (1 - mfargs->desaturate);
+
+    // figure out the base color:
+    hsv = k->base_hsv;
+    px_set_sat(&hsv, px_sat(hsv) * saturation);
+    px_set_val(&hsv, CHANNEL_MAX * value);
+    if (alternate > (1 - mfargs->inclusions)) {
+      px_set_hue(&hsv, px_hue(k->alt_hsv));
+      px_set_sat(&hsv, px_sat(k->alt_hsv));
+      px_set_val(&hsv, CHANNEL_MAX * alternate);
+    } else if (alternate > (1 - (mfargs->inclusions + 0.05))) {
+      px_set_sat(&hsv, 0.5*px_sat(hsv));
+      px_set_val(&hsv, (px_val(hsv) + CHANNEL_MAX * alternate)/2.0);
     }
+    rgb = hsv__rgb(hsv);
+    rgb = px_relight(rgb, mfargs->brightness);
+
+    tx_set_px(tx, rgb, col, row);
   }
 }
 
+/********************
+ * Filter Functions *
+ ********************/
+
+// Generates mineral textures.
+void fltr_mineral(texture *tx, void const * const fargs) {
+  mineral_filter_args *mfargs = (mineral_filter_args *) fargs;
+  mineral_kernel k;
+
+  int row, col;
+  float wavescale, lphase; // layer wave scale and phase
+
+  // Seeds for the different noise functions:
+  ptrdiff_t seed = prng(mfargs->seed - 5);
+  ptrdiff_t salt5;
+
+  k.mfargs = mfargs;
+
+  k.base_hsv = rgb__hsv(mfargs->base_color);
+  k.alt_hsv = rgb__hsv(mfargs->alt_color);
+
+  k.salt1 = prng(seed + 555);
+  k.salt2 = prng(k.salt1);
+  k.salt3 = prng(k.salt2);
+  k.salt4 = prng(k.salt3);
+  salt5 = prng(k.salt4);
+  k.salt6 = prng(salt5);
+  k.salt7 = prng(k.salt6);
+  k.salt8 = prng(k.salt7);
+  k.invert_layers = ptrf(salt5) > 0.5;
+
+  // Round all scale values so that the scaled coordinate-space texture
+  // boundaries are integers (for simplex noise wrapping purposes):
+  k.scx = rounddenom(mfargs->scale*mfargs->squash, tx->width);
+  k.scy = rounddenom(mfargs->scale/mfargs->squash, tx->height);
+  k.wx = (float) tx->width * k.scx;
+  k.wy = (float) tx->height * k.scy;
+
+  k.dscx = rounddenom(mfargs->dscale, tx->width);
+  k.dscy = rounddenom(mfargs->dscale, tx->height);
+  k.dwx = tx->width * k.dscx;
+  k.dwy = tx->height * k.dscy;
+
+  k.alscx = (tx->width/5 + k.scx*tx->width)/((float) tx->width);
+  k.alscy = (tx->height/5 + k.scy*tx->height)/((float) tx->height);
+  k.alwx = tx->width * k.alscx;
+  k.alwy = tx->height * k.alscy;
+
+  // The layer waves only depend on the column, so we compute them up front:
+  k.layerscale = ((float) tx->height) / roundf(1.0 / mfargs->layerscale);
+  k.col_phase = (float *) malloc(sizeof(float) * tx->width);
+  if (k.col_phase == NULL) {
+    perror("Failed to allocate mineral texture layer phases.");
+    exit(errno);
+  }
+  for (col = 0; col < tx->width; col += 1) {
+    wavescale = ((float) tx->width) / roundf(1.0 / mfargs->wavescale);
+    lphase = (1.0 + sinf(((float) col) * 2 * M_PI / wavescale)) / 2.0;
+    wavescale = ((float) tx->width) / roundf(3.0 / mfargs->wavescale);
+    lphase += 0.5 * (1.0 + sinf(((float) col) * 2 * M_PI / wavescale)) / 2.0;
+    lphase /= 1.5;
+    k.col_phase[col] = lphase;
+  }
+
+  // Fill in the texture in tiles of rows:
+#pragma omp parallel for schedule(dynamic, TXGEN_TILE_ROWS) \
+  if (PARALLEL_TEXTURE_FILTERS)
+  for (row = 0; row < tx->height; row += 1) {
+    mineral_row(tx, &k, row);
+  }
+
+  free(k.col_phase);
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
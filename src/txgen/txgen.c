@@ -31,6 +31,12 @@ pixel const GRAMMAR_KEYS[N_GRAMMAR_KEYS] = {
   GRAMMAR_KEY_5
 };
 
+/***********
+ * Globals *
+ ***********/
+
+uint8_t PARALLEL_TEXTURE_FILTERS = 1;
+
 /********************
  * Inline Functions *
  ********************/
@@ -367,7 +373,7 @@ texture* gen_block_texture(block b) {
     BLOCK_NAMES[id]
   );
   if (access(filename, R_OK) != -1) {
-    return load_texture_from_png(filename);
+    return load_cached_texture(filename);
   }
   // Give up
   return NULL;
@@ -394,7 +400,7 @@ void run_grammar(tx_grammar_literal *lit) {
     }
     lit->result = create_texture(lit->anchor_x, lit->anchor_y);
   } else {
-    lit->result = load_texture_from_png(lit->filename);
+    lit->result = load_cached_texture(lit->filename);
   }
   if (lit->preprocess != NULL) {
     (*(lit->preprocess))(lit->result, lit->preargs);
@@ -499,40 +505,66 @@ void fltr_scatter(texture *tx, void const * const fargs) {
   );
 }
 
-void fltr_apply_gradient_map(texture *tx, void const * const fargs) {
-  int row, col;
+// Row kernels for the per-pixel filters below. Each one fills in a single row
+// of the texture, so that rows can be handed out to different threads.
+
+static inline void gradient_map_row(
+  texture *tx,
+  gradient_map const * const grmap,
+  int row
+) {
+  int col;
   pixel p;
-  gradient_map *grmap = (gradient_map *) fargs;
   for (col = 0; col < tx->width; col += 1) {
-    for (row = 0; row < tx->height; row += 1) {
-      p = tx_get_px(tx, col, row);
-      tx_set_px(tx, gradient_map_result(grmap, p), col, row);
-    }
+    p = tx_get_px(tx, col, row);
+    tx_set_px(tx, gradient_map_result(grmap, p), col, row);
   }
 }
 
-void fltr_worley(texture *tx, void const * const fargs) {
-  int row, col;
+static inline void worley_row(
+  texture *tx,
+  worley_filter_args const * const wfargs,
+  ptrdiff_t salt,
+  int row
+) {
+  int col;
   float noise;
   float dontcare;
+  for (col = 0; col < tx->width; col += 1) {
+    noise = wrnoise_2d_fancy(
+      col * wfargs->freq, row * wfargs->freq, salt,
+      32.0 * wfargs->freq, 32.0 * wfargs->freq,
+      &dontcare, &dontcare,
+      0
+    );
+    tx_set_px(
+      tx,
+      gradient_map_result(wfargs->grmap, noise),
+      col,
+      row
+    );
+  }
+}
+
+void fltr_apply_gradient_map(texture *tx, void const * const fargs) {
+  int row;
+  gradient_map *grmap = (gradient_map *) fargs;
+#pragma omp parallel for schedule(static, TXGEN_TILE_ROWS) \
+  if (PARALLEL_TEXTURE_FILTERS && tx->width*tx->height >= TXGEN_PARALLEL_MIN_PIXELS)
+  for (row = 0; row < tx->height; row += 1) {
+    gradient_map_row(tx, grmap, row);
+  }
+}
+
+void fltr_worley(texture *tx, void const * const fargs) {
+  int row;
   ptrdiff_t salt;
   worley_filter_args *wfargs = (worley_filter_args *) fargs;
   salt = prng(wfargs->seed);
-  for (col = 0; col < tx->width; col += 1) {
-    for (row = 0; row < tx->height; row += 1) {
-      noise = wrnoise_2d_fancy(
-        col * wfargs->freq, row * wfargs->freq, salt,
-        32.0 * wfargs->freq, 32.0 * wfargs->freq,
-        &dontcare, &dontcare,
-        0
-      );
-      tx_set_px(
-        tx,
-        gradient_map_result(wfargs->grmap, noise),
-        col,
-        row
-      );
-    }
+#pragma omp parallel for schedule(dynamic, TXGEN_TILE_ROWS) \
+  if (PARALLEL_TEXTURE_FILTERS)
+  for (row = 0; row < tx->height; row += 1) {
+    worley_row(tx, wfargs, salt, row);
   }
 }
 
@@ -84,6 +84,23 @@ extern pixel const GRAMMAR_KEYS[N_GRAMMAR_KEYS];
 
 #define GRADIENT_MAX_SIZE 64
 
+// Per-pixel filters split their textures into tiles of this many rows which
+// are handed out to worker threads:
+#define TXGEN_TILE_ROWS 4
+
+// Cheap per-pixel filters (like gradient mapping) only use multiple threads
+// for textures with at least this many pixels. Noise-based filters are
+// expensive enough per pixel that they always do.
+#define TXGEN_PARALLEL_MIN_PIXELS (128*128)
+
+/***********
+ * Globals *
+ ***********/
+
+// Whether per-pixel filters may split their work across threads (the results
+// are the same either way).
+extern uint8_t PARALLEL_TEXTURE_FILTERS;
+
 /*************************
  * Structure Definitions *
  *************************/
@@ -300,6 +300,7 @@ static inline void draw_durations(int *h) {
 static inline void draw_mem(int *h) {
   // First compute memory info:
   compute_chunk_cache_mem();
+  compute_chunk_pool_mem();
   // Draw memory info:
   sprintf(
     TXT,
@@ -322,6 +323,13 @@ static inline void draw_mem(int *h) {
   );
   render_string_shadow(TXT, COOL_BLUE, LEAF_SHADOW, 1, 17, 445, *h);
   *h -= 25;
+  sprintf(
+    TXT,
+    "chunk pools resident :: %.2f MB",
+    (CHUNK_POOL_USAGE.data + CHUNK_POOL_USAGE.overhead) / (1024.0 * 1024.0)
+  );
+  render_string_shadow(TXT, COOL_BLUE, LEAF_SHADOW, 1, 17, 445, *h);
+  *h -= 25;
   sprintf(
     TXT,
     "texture RAM usage :: %.2f MB",
@@ -351,7 +359,6 @@ static inline void draw_pos_info(int *h) {
   global_pos player_pos;
   get_head_glpos(PLAYER, &player_pos);
   glpos__wmpos(&player_pos, &wmpos);
-  refresh_cell_at_cache();
   cell *c = cell_at(&(PLAYER_CURSOR.pos));
 
   // Draw geoform data:
@@ -449,6 +456,16 @@ static inline void draw_perf_info(int *h) {
   render_string_shadow(TXT, FRESH_CREAM, LEAF_SHADOW, 1, 20, 30, *h);
   *h -= 30;
 
+  sprintf(
+    TXT,
+    "chunks // draws // vertices occluded :: %d // %d // %d",
+    CHUNKS_OCCLUDED.average,
+    DRAWS_OCCLUDED.average,
+    VERTICES_OCCLUDED.average
+  );
+  render_string_shadow(TXT, FRESH_CREAM, LEAF_SHADOW, 1, 20, 30, *h);
+  *h -= 30;
+
   sprintf(
     TXT,
     "chunks loaded :: %d",
@@ -473,6 +490,15 @@ static inline void draw_perf_info(int *h) {
   );
   render_string_shadow(TXT, FRESH_CREAM, LEAF_SHADOW, 1, 20, 30, *h);
   *h -= 30;
+
+  sprintf(
+    TXT,
+    "biome cache hits // misses :: %d // %d",
+    BIOME_CACHE_HITS.average,
+    BIOME_CACHE_MISSES.average
+  );
+  render_string_shadow(TXT, FRESH_CREAM, LEAF_SHADOW, 1, 20, 30, *h);
+  *h -= 30;
 }
 
 /*************
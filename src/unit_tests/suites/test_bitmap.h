@@ -5,6 +5,7 @@
     &test_bitmap_setup_cleanup, \
     &test_bitmap_fill_empty, \
     &test_bitmap_selection, \
+    &test_bitmap_rank_select, \
     NULL, \
   }
 
@@ -195,5 +196,52 @@ size_t test_bitmap_selection(void) {
   return 0;
 }
 
+size_t test_bitmap_rank_select(void) {
+  size_t i, j, size, index, span, closed, rank;
+  ptrdiff_t seed = 7731;
+  bitmap *bm;
+  // Odd size so that the last row is partial:
+  size = 10007;
+  bm = create_bitmap(size);
+  if (bm_select_open(bm, size - 1) != size - 1) { return 1; }
+  if (bm_select_open(bm, size) != -1) { return 2; }
+  if (bm_select_closed(bm, 0) != -1) { return 3; }
+  for (i = 0; i < 300; ++i) {
+    // Set or clear a random range (possibly running off the end):
+    seed = prng(seed);
+    index = posmod(seed, size);
+    seed = prng(seed);
+    span = posmod(seed, 200);
+    if (i % 3 == 2) {
+      bm_clear_bits(bm, index, span);
+    } else {
+      bm_set_bits(bm, index, span);
+    }
+    // Check popcount, rank, and both selections against a linear scan:
+    closed = 0;
+    for (j = 0; j < size; ++j) {
+      if (bm_rank(bm, j) != closed) { return 1000 + i; }
+      if (bm_check_bit(bm, j)) {
+        if (bm_select_closed(bm, closed) != j) { return 2000 + i; }
+        closed += 1;
+      } else {
+        if (bm_select_open(bm, j - closed) != j) { return 3000 + i; }
+      }
+    }
+    if (bm_popcount(bm) != closed) { return 4000 + i; }
+    if (bm_rank(bm, size) != closed) { return 5000 + i; }
+    if (bm_select_closed(bm, closed) != -1) { return 6000 + i; }
+    if (bm_select_open(bm, size - closed) != -1) { return 7000 + i; }
+  }
+  // Rank should count everything before a fully-set prefix:
+  bm_clear_bits(bm, 0, size);
+  bm_set_bits(bm, 0, 129);
+  rank = bm_rank(bm, 129);
+  if (rank != 129) { return 8000; }
+  if (bm_select_open(bm, 0) != 129) { return 8001; }
+  if (bm_select_closed(bm, 128) != 128) { return 8002; }
+  cleanup_bitmap(bm);
+  return 0;
+}
 
 #endif //ifndef TEST_BITMAP_H
@@ -0,0 +1,468 @@
+#undef TEST_SUITE_NAME
+#undef TEST_SUITE_TESTS
+#define TEST_SUITE_NAME generation
+#define TEST_SUITE_TESTS { \
+    &test_setup_generation, \
+    &test_biome_cache, \
+    &test_place_seeds, \
+    &test_strata_profile, \
+    &test_noise_volumes, \
+    &test_bulk_chunk_generation, \
+    NULL, \
+  }
+
+#ifndef TEST_GENERATION_H
+#define TEST_GENERATION_H
+
+// Checks for the parts of world generation that don't need the data/persist
+// pipeline (those live in test_worldgen).
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "gen/worldgen.h"
+#include "gen/geology.h"
+#include "gen/terrain.h"
+#include "noise/noise.h"
+#include "gen/biology.h"
+#include "ecology/grow.h"
+#include "data/data.h"
+#include "world/world.h"
+#include "world/world_map.h"
+#include "world/species.h"
+
+#include "unit_tests/test_suite.h"
+
+/********************
+ * Shared Variables *
+ ********************/
+
+// A world with only its geology generated (THE_WORLD is fully generated):
+world_map *GEOLOGY_WORLD = NULL;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// The seeding loop from add_biology as it was before place_seeds, which fills
+// a whole cell neighborhood for every cell. Used as a reference.
+static void _reference_place_seeds(
+  chunk *c,
+  chunk_neighborhood *ch_nbh,
+  biome *local_biome
+) {
+  list *sp_list;
+  frequent_species fqsp;
+  cell_neighborhood cl_nbh;
+  cell* cl;
+  block_index idx;
+  block substrate;
+  global_pos glpos;
+  ptrdiff_t seed_hash = prng(chunk_hash(c) + 616485);
+  ptrdiff_t spacing_hash = prng(THE_WORLD->seed + 44544);
+  c_expand_cells(c); // seeds get written straight into the cells
+  idx.xyz.w = 0;
+  for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
+    for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
+      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
+        cidx__glpos(c, &idx, &glpos);
+        fill_cell_neighborhood_exact(idx, ch_nbh, &cl_nbh);
+        cl = cl_nbh.members[NBH_CENTER];
+        sp_list = NULL;
+        if (b_is_void(cl->blocks[1])) {
+          if (b_id(cl->blocks[0]) == B_AIR) {
+            substrate = cl_nbh.members[NBH_CENTER - NBH_DIR_UD]->blocks[0];
+            if (b_is_natural_terrain(substrate)) {
+              sp_list = local_biome->ephemeral_terrestrial_flora;
+            }
+          } else if (b_id(cl->blocks[0]) == B_WATER) {
+            substrate = cl_nbh.members[NBH_CENTER - NBH_DIR_UD]->blocks[0];
+            if (b_is_natural_terrain(substrate)) {
+              sp_list = local_biome->ephemeral_aquatic_flora;
+            }
+          } else if (b_is_natural_terrain(cl->blocks[0])) {
+            substrate = cl->blocks[0];
+            if (
+              b_id(cl_nbh.members[NBH_CENTER + NBH_DIR_UD]->blocks[0]) == B_AIR
+            ) {
+              if (wide_spacing_hit(glpos, spacing_hash)) {
+                sp_list = local_biome->wide_spaced_terrestrial_flora;
+              } else if (medium_spacing_hit(glpos, spacing_hash)) {
+                sp_list = local_biome->medium_spaced_terrestrial_flora;
+              } else if (close_spacing_hit(glpos, spacing_hash)) {
+                sp_list = local_biome->close_spaced_terrestrial_flora;
+              } else {
+                sp_list = local_biome->ubiquitous_terrestrial_flora;
+              }
+            } else if (
+              b_id(cl_nbh.members[NBH_CENTER + NBH_DIR_UD]->blocks[0]) ==B_WATER
+            ) {
+              if (wide_spacing_hit(glpos, spacing_hash)) {
+                sp_list = local_biome->wide_spaced_aquatic_flora;
+              } else if (medium_spacing_hit(glpos, spacing_hash)) {
+                sp_list = local_biome->medium_spaced_aquatic_flora;
+              } else if (close_spacing_hit(glpos, spacing_hash)) {
+                sp_list = local_biome->close_spaced_aquatic_flora;
+              } else {
+                sp_list = local_biome->ubiquitous_aquatic_flora;
+              }
+            } else if (
+              b_id(cl_nbh.members[NBH_CENTER - NBH_DIR_UD]->blocks[0]) == B_AIR
+            ) {
+              sp_list = local_biome->hanging_terrestrial_flora;
+            }
+          }
+          if (sp_list != NULL) {
+            fqsp = pick_appropriate_frequent_species(
+              sp_list,
+              substrate,
+              seed_hash
+            );
+            if (frequent_species_species_type(fqsp) != SPT_NO_SPECIES) {
+              cl->blocks[1] = b_make_species(
+                seed_block_type(frequent_species_species_type(fqsp)),
+                frequent_species_species(fqsp)
+              );
+              gri_set_sprout_timer(&(cl->blocks[1]), 1);
+              seed_hash = prng(
+                idx.xyz.x + idx.xyz.y + glpos.z +
+                prng(seed_hash + glpos.x + glpos.y + idx.xyz.z)
+              );
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/******************
+ * Test Functions *
+ ******************/
+
+size_t test_setup_generation(void) {
+  init_strings();
+  init_blocks();
+  setup_species();
+  setup_worldgen(1821271);
+  GEOLOGY_WORLD = create_world_map(178352, 64, 64);
+  printf("Generating test world geology...\n");
+  generate_geology(GEOLOGY_WORLD);
+  printf("  ...done.\n");
+  return 0;
+}
+
+size_t test_biome_cache(void) {
+  size_t i;
+  uint64_t hits, misses;
+  biome *a, *b, *c;
+  biome *held[WM_BIOME_CACHE_SIZE + 8];
+  world_region *wr1 = &(GEOLOGY_WORLD->regions[0]);
+  world_region *wr2 = &(GEOLOGY_WORLD->regions[1]);
+  take_biome_cache_stats(GEOLOGY_WORLD, &hits, &misses); // reset the counts
+
+  // Nearby strengths should share a merged biome:
+  a = acquire_merged_biome(GEOLOGY_WORLD, wr1, wr2, 0.75, 0.25);
+  b = acquire_merged_biome(GEOLOGY_WORLD, wr1, wr2, 0.76, 0.24);
+  c = acquire_merged_biome(GEOLOGY_WORLD, wr1, wr2, 0.25, 0.75);
+  if (a != b) { return 1; }
+  if (a == c) { return 2; }
+  take_biome_cache_stats(GEOLOGY_WORLD, &hits, &misses);
+  if (hits != 1 || misses != 2) { return 3; }
+  release_merged_biome(GEOLOGY_WORLD, a);
+  release_merged_biome(GEOLOGY_WORLD, b);
+  release_merged_biome(GEOLOGY_WORLD, c);
+
+  // Holding more biomes than the cache has room for still works:
+  for (i = 0; i < WM_BIOME_CACHE_SIZE + 8; ++i) {
+    held[i] = acquire_merged_biome(
+      GEOLOGY_WORLD,
+      &(GEOLOGY_WORLD->regions[i % 32]),
+      &(GEOLOGY_WORLD->regions[32 + i / 32]),
+      1,
+      0
+    );
+    if (held[i] == NULL) { return 10 + i; }
+  }
+  for (i = 0; i < WM_BIOME_CACHE_SIZE + 8; ++i) {
+    release_merged_biome(GEOLOGY_WORLD, held[i]);
+  }
+  take_biome_cache_stats(GEOLOGY_WORLD, &hits, &misses);
+  if (hits != 0 || misses != WM_BIOME_CACHE_SIZE + 8) { return 4; }
+
+  // Once released, the overflow entries can evict older ones:
+  a = acquire_merged_biome(GEOLOGY_WORLD, wr1, wr2, 0.75, 0.25);
+  release_merged_biome(GEOLOGY_WORLD, a);
+  return 0;
+}
+
+// Checks that place_seeds puts exactly the same seeds in exactly the same
+// places as the reference loop for a few surface chunks of a fixed world.
+size_t test_place_seeds(void) {
+  size_t i, sample, seeds = 0;
+  ptrdiff_t seed = 9918;
+  global_pos glpos;
+  global_chunk_pos glcpos, nbpos;
+  manifold_point dontcare, th;
+  world_map_pos wmpos;
+  world_region *wr;
+  chunk_neighborhood nbh;
+  chunk *reference, *streamed;
+  block_index idx;
+  for (sample = 0; sample < 6; ++sample) {
+    glpos.x = posmod(seed, WORLD_WIDTH * WORLD_REGION_BLOCKS);
+    seed = prng(seed);
+    glpos.y = posmod(seed, WORLD_HEIGHT * WORLD_REGION_BLOCKS);
+    seed = prng(seed);
+    glpos.z = 0;
+    glpos.w = 0;
+    compute_terrain_height(THE_WORLD, &glpos, &dontcare, &dontcare, &th);
+    glpos.z = (gl_pos_t) th.z;
+    glpos__glcpos(&glpos, &glcpos);
+    glpos__wmpos(&glpos, &wmpos);
+    wr = get_world_region(THE_WORLD, &wmpos);
+    if (wr == NULL || wr->ecology.biome_count == 0) {
+      continue;
+    }
+
+    i = 0;
+    for (nbpos.x = glcpos.x - 1; nbpos.x <= glcpos.x + 1; ++nbpos.x) {
+      for (nbpos.y = glcpos.y - 1; nbpos.y <= glcpos.y + 1; ++nbpos.y) {
+        for (nbpos.z = glcpos.z - 1; nbpos.z <= glcpos.z + 1; ++nbpos.z) {
+          nbh.members[i] = create_chunk(&nbpos);
+          generate_chunk(nbh.members[i]);
+          i += 1;
+        }
+      }
+    }
+    copy_glcpos(&glcpos, &(nbh.glcpos));
+
+    reference = nbh.members[NBH_CENTER];
+    _reference_place_seeds(reference, &nbh, wr->ecology.biomes[0]);
+    streamed = create_chunk(&glcpos);
+    generate_chunk(streamed);
+    nbh.members[NBH_CENTER] = streamed;
+    place_seeds(streamed, &nbh, wr->ecology.biomes[0]);
+
+    idx.xyz.w = 0;
+    for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
+      for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
+        for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
+          if (
+            c_cell(reference, idx)->blocks[1]
+         != c_cell(streamed, idx)->blocks[1]
+          ) {
+            return 100 + sample;
+          }
+          if (!b_is_void(c_cell(streamed, idx)->blocks[1])) {
+            seeds += 1;
+          }
+        }
+      }
+    }
+
+    cleanup_chunk(reference);
+    for (i = 0; i < 27; ++i) {
+      cleanup_chunk(nbh.members[i]);
+    }
+  }
+  if (seeds == 0) {
+    return 1; // nothing was compared
+  }
+  return 0;
+}
+
+// Checks that profile_stratum finds the same stratum as get_stratum, both for
+// the test world's regions and for a region with unsorted (and some NaN)
+// stratum bottoms. Heights outside of [0, 1] are included.
+size_t test_strata_profile(void) {
+  size_t i, j, trial;
+  ptrdiff_t seed = 77123;
+  float h;
+  strata_profile *sp = (strata_profile*) malloc(sizeof(strata_profile));
+  world_region *wr;
+  world_region *scrambled = (world_region*) calloc(1, sizeof(world_region));
+
+  // Cycle through more regions than the profile can hold at once so that
+  // some slots get replaced:
+  reset_strata_profile(sp, GEOLOGY_WORLD, 0, 0);
+  for (i = 0; i < 64; ++i) {
+    wr = &(
+      GEOLOGY_WORLD->regions[
+        (i * 37) % (GEOLOGY_WORLD->width * GEOLOGY_WORLD->height)
+      ]
+    );
+    for (j = 0; j <= 240; ++j) {
+      h = -0.1 + j * (1.2 / 240.0);
+      if (profile_stratum(sp, wr, h) != get_stratum(wr, h)) {
+        free(scrambled);
+        free(sp);
+        return 1;
+      }
+    }
+  }
+
+  for (trial = 0; trial < 200; ++trial) {
+    seed = prng(seed);
+    scrambled->geology.stratum_count = posmod(seed, WM_MAX_STRATA_LAYERS + 1);
+    for (i = 0; i < scrambled->geology.stratum_count; ++i) {
+      // The strata are never dereferenced, so any distinct pointers will do:
+      scrambled->geology.strata[i] = (stratum*) (&(scrambled->geology.bottoms[i]));
+      seed = prng(seed);
+      scrambled->geology.bottoms[i] = ptrf(seed);
+      if (ptrf(prng(seed + 1)) < 0.02) {
+        scrambled->geology.bottoms[i] = NAN;
+      }
+    }
+    // The same address with new contents has to be reloaded:
+    reset_strata_profile(sp, GEOLOGY_WORLD, trial, 0);
+    for (j = 0; j < 100; ++j) {
+      seed = prng(seed);
+      h = -0.05 + 1.1 * ptrf(seed);
+      if (profile_stratum(sp, scrambled, h) != get_stratum(scrambled, h)) {
+        free(scrambled);
+        free(sp);
+        return 2;
+      }
+    }
+    if (profile_stratum(sp, scrambled, NAN) != get_stratum(scrambled, NAN)) {
+      free(scrambled);
+      free(sp);
+      return 3;
+    }
+  }
+  free(scrambled);
+  free(sp);
+  return 0;
+}
+
+// Checks that each of the noise volumes used during chunk generation stays
+// within its error budget over a few chunks, and that sampling a whole chunk
+// takes far fewer field evaluations than evaluating every cell.
+size_t test_noise_volumes(void) {
+  size_t i, sample;
+  ptrdiff_t seed = 50021;
+  ptrdiff_t x, y, z;
+  ptrdiff_t soil_salts[NV_MAX_SALTS] = { 0, 0, 0, 0 };
+  noise_volume *volumes[3];
+  ptrdiff_t const *salts[3] = {
+    TR_STRATA_NOISE_SALTS,
+    TR_CAVE_NOISE_SALTS,
+    soil_salts
+  };
+  float const budgets[3] = {
+    TR_STRATA_NOISE_BUDGET,
+    TR_CAVE_NOISE_BUDGET,
+    TR_SOIL_ALT_NOISE_BUDGET
+  };
+  size_t result = 0;
+  volumes[0] = create_noise_volume(
+    &tr_strata_noise,
+    CHUNK_SIZE,
+    TR_STRATA_NOISE_SPACING
+  );
+  volumes[1] = create_noise_volume(
+    &tr_cave_noise,
+    CHUNK_SIZE,
+    TR_CAVE_NOISE_SPACING
+  );
+  volumes[2] = create_noise_volume(
+    &tr_soil_alt_noise,
+    CHUNK_SIZE,
+    TR_SOIL_ALT_NOISE_SPACING
+  );
+  for (sample = 0; sample < 8 && result == 0; ++sample) {
+    seed = prng(seed);
+    x = posmod(seed, WORLD_WIDTH * WORLD_REGION_SIZE) * CHUNK_SIZE;
+    seed = prng(seed);
+    y = posmod(seed, WORLD_HEIGHT * WORLD_REGION_SIZE) * CHUNK_SIZE;
+    seed = prng(seed);
+    z = posmod(seed, TR_MAX_HEIGHT / CHUNK_SIZE) * CHUNK_SIZE;
+    soil_salts[0] = seed + 4920 * (sample % WM_MAX_SOIL_ALTS);
+    soil_salts[1] = seed + 7482 * (sample % WM_MAX_SOIL_ALTS);
+    soil_salts[2] = seed + 3194 * (sample % WM_MAX_SOIL_ALTS);
+    for (i = 0; i < 3; ++i) {
+      nv_place(volumes[i], x, y, z, salts[i]);
+      if (nv_max_error(volumes[i]) > budgets[i]) {
+        result = 1 + i;
+        break;
+      }
+    }
+  }
+  // Sampling a whole chunk of strata or soil noise should evaluate the field
+  // at least ten times less often than evaluating it per cell would:
+  for (i = 0; i < 3 && result == 0; i += 2) {
+    nv_place(volumes[i], CHUNK_SIZE, 0, 0, salts[i]);
+    volumes[i]->evaluations = 0;
+    for (x = 0; x < CHUNK_SIZE; ++x) {
+      for (y = 0; y < CHUNK_SIZE; ++y) {
+        for (z = 0; z < CHUNK_SIZE; ++z) {
+          nv_sample(volumes[i], CHUNK_SIZE + x, y, z);
+        }
+      }
+    }
+    if (volumes[i]->evaluations * 10 > CHUNK_SIZE*CHUNK_SIZE*CHUNK_SIZE) {
+      result = 10 + i;
+    }
+  }
+  for (i = 0; i < 3; ++i) {
+    cleanup_noise_volume(volumes[i]);
+  }
+  return result;
+}
+
+// Checks that generate_chunk gives exactly the same results with and without
+// bulk generation for a fixed grid of chunks: for a few columns, from below
+// the surface to well above it, along with a chunk outside the world.
+size_t test_bulk_chunk_generation(void) {
+  size_t i, col;
+  uint8_t was_bulk = BULK_CHUNK_GENERATION;
+  global_pos glpos;
+  global_chunk_pos glcpos;
+  manifold_point dontcare, rocks;
+  chunk *bulk, *reference;
+  size_t result = 0;
+  for (col = 0; col < 5 && result == 0; ++col) {
+    glcpos.x = ((col % 2) + 1) * WORLD_WIDTH * WORLD_REGION_SIZE / 3 + col;
+    glcpos.y = ((col / 2) + 1) * WORLD_HEIGHT * WORLD_REGION_SIZE / 3 - col;
+    glcpos__glpos(&glcpos, &glpos);
+    compute_terrain_height(THE_WORLD, &glpos, &dontcare, &rocks, &dontcare);
+    for (i = 0; i < 8 && result == 0; ++i) {
+      if (col == 4) {
+        glcpos.z = -1; // outside the world
+      } else if (i == 7) {
+        glcpos.z = (TR_MAX_HEIGHT / CHUNK_SIZE) - col; // far above
+      } else {
+        glcpos.z = (rocks.z / CHUNK_SIZE) + i - 4; // near the surface
+      }
+      BULK_CHUNK_GENERATION = 0;
+      reference = create_chunk(&glcpos);
+      generate_chunk(reference);
+      BULK_CHUNK_GENERATION = 1;
+      bulk = create_chunk(&glcpos);
+      generate_chunk(bulk);
+      // Either one might be stored as a uniform chunk:
+      c_expand_cells(reference);
+      c_expand_cells(bulk);
+      if (
+        memcmp(
+          reference->cells,
+          bulk->cells,
+          sizeof(cell) * TOTAL_CHUNK_CELLS
+        ) != 0
+      ) {
+        result = 1 + 10 * col + i;
+      }
+      cleanup_chunk(reference);
+      cleanup_chunk(bulk);
+      if (col == 4) {
+        break;
+      }
+    }
+  }
+  BULK_CHUNK_GENERATION = was_bulk;
+  return result;
+}
+
+#endif //ifndef TEST_GENERATION_H
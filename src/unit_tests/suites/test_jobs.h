@@ -0,0 +1,311 @@
+#undef TEST_SUITE_NAME
+#undef TEST_SUITE_TESTS
+#define TEST_SUITE_NAME jobs
+#define TEST_SUITE_TESTS { \
+    &test_jobs_priorities, \
+    &test_jobs_fairness, \
+    &test_jobs_cancellation, \
+    &test_jobs_shutdown, \
+    &test_jobs_promises, \
+    NULL, \
+  }
+
+#ifndef TEST_JOBS_H
+#define TEST_JOBS_H
+
+#include <stdint.h>
+
+#include <omp.h>
+
+#include "util.h"
+
+#include "datatypes/promise.h"
+#include "jobs/jobs.h"
+
+/********************
+ * Shared Variables *
+ ********************/
+
+struct test_job_state_s {
+  int id;
+  int *counter;
+  int *cleanups;
+  int *flag;
+};
+typedef struct test_job_state_s test_job_state;
+
+int JOB_LOG[64];
+size_t JOB_LOG_LENGTH = 0;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+static test_job_state* _test_job_state(
+  int id,
+  int *counter,
+  int *cleanups,
+  int *flag
+) {
+  test_job_state *result = (test_job_state*) malloc(sizeof(test_job_state));
+  result->id = id;
+  result->counter = counter;
+  result->cleanups = cleanups;
+  result->flag = flag;
+  return result;
+}
+
+static void _count_cleanup(void *s) {
+  __atomic_add_fetch(((test_job_state*) s)->cleanups, 1, __ATOMIC_ACQ_REL);
+}
+
+// Records its ID in the job log.
+static void (*_log_job(void *s))() {
+  JOB_LOG[JOB_LOG_LENGTH] = ((test_job_state*) s)->id;
+  JOB_LOG_LENGTH += 1;
+  return NULL;
+}
+
+// Increments its counter.
+static void (*_count_job(void *s))() {
+  __atomic_add_fetch(((test_job_state*) s)->counter, 1, __ATOMIC_ACQ_REL);
+  return NULL;
+}
+
+// Increments its counter every step, forever.
+static void (*_forever_job(void *s))() {
+  __atomic_add_fetch(((test_job_state*) s)->counter, 1, __ATOMIC_ACQ_REL);
+  return (void (*)()) &_forever_job;
+}
+
+// Counts steps until its flag is set.
+static void (*_wait_for_flag_job(void *s))() {
+  test_job_state *st = (test_job_state*) s;
+  if (*(st->flag)) {
+    return NULL;
+  }
+  *(st->counter) += 1;
+  return (void (*)()) &_wait_for_flag_job;
+}
+
+static void (*_set_flag_job(void *s))() {
+  *(((test_job_state*) s)->flag) = 1;
+  return NULL;
+}
+
+// Spawns a bunch of _count_job jobs (which end up on the current worker's
+// deque, where other workers have to steal them from).
+static void (*_spawn_job(void *s))() {
+  test_job_state *st = (test_job_state*) s;
+  int i;
+  for (i = 0; i < 200; ++i) {
+    jp_start(
+      JOB_POOL,
+      &_count_job,
+      _test_job_state(i, st->counter, NULL, NULL),
+      NULL,
+      JOB_PRIORITY_NORMAL
+    );
+  }
+  return NULL;
+}
+
+static void * _double_value(void **v) {
+  return (void*) (2 * (intptr_t) *v);
+}
+
+static void * _recover(void **message) {
+  return (void*) (intptr_t) 7;
+}
+
+/******************
+ * Test Functions *
+ ******************/
+
+size_t test_jobs_priorities(void) {
+  job_pool *jp = create_job_pool(1);
+  static int const expected[] = { 31, 32, 21, 22, 11, 12 };
+  size_t i;
+  JOB_LOG_LENGTH = 0;
+  jp_start(jp, &_log_job, _test_job_state(11, 0, 0, 0), 0, JOB_PRIORITY_LOW);
+  jp_start(jp, &_log_job, _test_job_state(21, 0, 0, 0), 0, JOB_PRIORITY_NORMAL);
+  jp_start(jp, &_log_job, _test_job_state(31, 0, 0, 0), 0, JOB_PRIORITY_HIGH);
+  jp_start(jp, &_log_job, _test_job_state(12, 0, 0, 0), 0, JOB_PRIORITY_LOW);
+  jp_start(jp, &_log_job, _test_job_state(22, 0, 0, 0), 0, JOB_PRIORITY_NORMAL);
+  jp_start(jp, &_log_job, _test_job_state(32, 0, 0, 0), 0, JOB_PRIORITY_HIGH);
+  if (jp_run_pending(jp, 0, 0) != 6) { return 1; }
+  if (JOB_LOG_LENGTH != 6) { return 2; }
+  for (i = 0; i < 6; ++i) {
+    if (JOB_LOG[i] != expected[i]) { return 10 + i; }
+  }
+  if (!jp_is_idle(jp)) { return 3; }
+  cleanup_job_pool(jp);
+  return 0;
+}
+
+size_t test_jobs_fairness(void) {
+  job_pool *jp = create_job_pool(1);
+  int flag = 0, steps = 0;
+  // An urgent job that never finishes until a low-priority job lets it:
+  jp_start(
+    jp,
+    &_wait_for_flag_job,
+    _test_job_state(0, &steps, NULL, &flag),
+    NULL,
+    JOB_PRIORITY_HIGH
+  );
+  jp_start(
+    jp,
+    &_set_flag_job,
+    _test_job_state(0, NULL, NULL, &flag),
+    NULL,
+    JOB_PRIORITY_LOW
+  );
+  jp_run_pending(jp, 0, 10 * JOB_FAIRNESS_INTERVAL);
+  if (!flag) { return 1; }
+  if (steps >= JOB_FAIRNESS_INTERVAL) { return 2; }
+  if (!jp_is_idle(jp)) { return 3; }
+  cleanup_job_pool(jp);
+  return 0;
+}
+
+size_t test_jobs_cancellation(void) {
+  job_pool *jp = create_job_pool(1);
+  int counter = 0, cleanups = 0;
+  work_state *running, *waiting;
+
+  // Cancelling a running job stops it after its current step:
+  running = jp_submit(
+    jp,
+    &_forever_job,
+    _test_job_state(0, &counter, &cleanups, NULL),
+    &_count_cleanup,
+    JOB_PRIORITY_NORMAL
+  );
+  if (jp_run_pending(jp, 0, 5) != 5) { return 1; }
+  if (counter != 5) { return 2; }
+  if (jp_is_done(running)) { return 3; }
+  jp_cancel(running);
+  jp_run_pending(jp, 0, 0);
+  if (counter != 5) { return 4; }
+  if (!jp_is_done(running)) { return 5; }
+  if (cleanups != 0) { return 6; } // we still hold a handle
+  jp_release(running);
+  if (cleanups != 1) { return 7; }
+
+  // A job cancelled before it starts never runs:
+  waiting = jp_submit(
+    jp,
+    &_forever_job,
+    _test_job_state(0, &counter, &cleanups, NULL),
+    &_count_cleanup,
+    JOB_PRIORITY_NORMAL
+  );
+  jp_cancel(waiting);
+  jp_run_pending(jp, 0, 0);
+  if (counter != 5) { return 8; }
+  if (!jp_is_done(waiting)) { return 9; }
+  jp_release(waiting);
+  if (cleanups != 2) { return 10; }
+  if (!jp_is_idle(jp)) { return 11; }
+  cleanup_job_pool(jp);
+  return 0;
+}
+
+size_t test_jobs_shutdown(void) {
+  job_pool *old_pool = JOB_POOL;
+  int i, counter = 0, cleanups = 0, forever_steps = 0, patience = 5000;
+  JOB_POOL = create_job_pool(3);
+  for (i = 0; i < 1000; ++i) {
+    jp_start(
+      JOB_POOL,
+      &_count_job,
+      _test_job_state(i, &counter, NULL, NULL),
+      NULL,
+      JOB_PRIORITY_NORMAL
+    );
+  }
+  jp_start(
+    JOB_POOL,
+    &_spawn_job,
+    _test_job_state(0, &counter, NULL, NULL),
+    NULL,
+    JOB_PRIORITY_HIGH
+  );
+  // This one will still be going when the pool shuts down:
+  jp_start(
+    JOB_POOL,
+    &_forever_job,
+    _test_job_state(0, &forever_steps, &cleanups, NULL),
+    &_count_cleanup,
+    JOB_PRIORITY_LOW
+  );
+#pragma omp parallel num_threads(4)
+  {
+    int id = omp_get_thread_num();
+    if (id > 0) {
+      jp_work(JOB_POOL, (size_t) (id - 1));
+    } else {
+      while (
+        patience > 0
+     && __atomic_load_n(&counter, __ATOMIC_ACQUIRE) < 1200
+      ) {
+        nap(1);
+        patience -= 1;
+      }
+      jp_shutdown(JOB_POOL);
+    }
+  }
+  if (counter != 1200) { return 1; }
+  if (JOB_POOL->active != 0) { return 2; }
+  if (jp_is_idle(JOB_POOL)) { return 3; } // the forever job is still pending
+  if (cleanups != 0) { return 4; }
+  cleanup_job_pool(JOB_POOL);
+  if (cleanups != 1) { return 5; }
+  JOB_POOL = old_pool;
+  return 0;
+}
+
+size_t test_jobs_promises(void) {
+  job_pool *jp;
+  promise *pr, *then, *otherwise;
+
+  // Without a pool, continuations run right away:
+  jp_run_promises(NULL);
+  pr = create_promise();
+  then = pr_then(pr, &_double_value);
+  otherwise = pr_else(pr, &_recover);
+  if (!pr_is_unresolved(then) || !pr_is_unresolved(otherwise)) { return 1; }
+  pr_fulfill(pr, (void*) 21);
+  if (!pr_is_fulfilled(then) || pr_get_value(then) != (void*) 42) { return 2; }
+  if (!pr_is_fulfilled(otherwise) || pr_get_value(otherwise) != (void*) 21) {
+    return 3;
+  }
+  destroy_promise(pr);
+
+  pr = create_promise();
+  pr_reject(pr, (void*) 3);
+  then = pr_then(pr, &_double_value); // added after resolution
+  otherwise = pr_else(pr, &_recover);
+  if (!pr_is_broken(then) || pr_get_value(then) != (void*) 3) { return 4; }
+  if (!pr_is_fulfilled(otherwise) || pr_get_value(otherwise) != (void*) 7) {
+    return 5;
+  }
+  destroy_promise(pr);
+
+  // With a pool, they wait for a worker:
+  jp = create_job_pool(1);
+  jp_run_promises(jp);
+  pr = create_promise();
+  then = pr_then(pr_then(pr, &_double_value), &_double_value);
+  pr_fulfill(pr, (void*) 5);
+  if (!pr_is_unresolved(then)) { return 6; }
+  jp_run_pending(jp, 0, 0);
+  if (!pr_is_fulfilled(then) || pr_get_value(then) != (void*) 20) { return 7; }
+  jp_run_promises(NULL);
+  destroy_promise(pr);
+  cleanup_job_pool(jp);
+  return 0;
+}
+
+#endif //ifndef TEST_JOBS_H
@@ -0,0 +1,232 @@
+#undef TEST_SUITE_NAME
+#undef TEST_SUITE_TESTS
+#define TEST_SUITE_NAME mpmc_queue
+#define TEST_SUITE_TESTS { \
+    &test_mpmc_queue_setup_cleanup, \
+    &test_mpmc_queue_push_pop, \
+    &test_mpmc_queue_full, \
+    &test_mpmc_queue_wraparound, \
+    &test_mpmc_queue_stress, \
+    &test_mpmc_queue_stress_small, \
+    NULL, \
+  }
+
+#ifndef TEST_MPMC_QUEUE_H
+#define TEST_MPMC_QUEUE_H
+
+#include <sched.h>
+
+#include <omp.h>
+
+#include "datatypes/mpmc_queue.h"
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// The number of threads to run the stress tests with: one per processor, but
+// at least two and at most eight.
+static int _mpmc_threads(void) {
+  int n = omp_get_num_procs();
+  if (n < 2) {
+    return 2;
+  } else if (n > 8) {
+    return 8;
+  }
+  return n;
+}
+
+// Has the given number of producer threads each push the values 1 through
+// per_producer (tagged with the producer's index in their high bits) while
+// the given number of consumer threads pop until everything has been
+// received. Checks that each value arrives exactly once and that each
+// producer's values arrive in order at any single consumer.
+static size_t _mpmc_stress(
+  size_t capacity,
+  int producers,
+  int consumers,
+  uintptr_t per_producer
+) {
+  mpmc_queue *q = create_mpmc_queue(capacity);
+  uintptr_t total = producers * per_producer;
+  uint64_t received = 0;
+  size_t failures = 0;
+  uintptr_t k;
+  uint8_t *seen = (uint8_t*) calloc(total, sizeof(uint8_t));
+#pragma omp parallel num_threads(producers + consumers) reduction(+:failures)
+  {
+    int id = omp_get_thread_num();
+    int p;
+    uintptr_t i, v, idx;
+    uintptr_t *last;
+    if (omp_get_num_threads() != producers + consumers) {
+      // Not enough threads to run the test as intended; go single-threaded:
+      if (id == 0) {
+        for (p = 0; p < producers; ++p) {
+          for (i = 1; i <= per_producer; ++i) {
+            while (!mq_push_element(q, (void*) ((((uintptr_t) p) << 32) | i))) {
+              v = (uintptr_t) mq_pop_element(q);
+              idx = (v >> 32) * per_producer + (v & 0xffffffff) - 1;
+              seen[idx] += 1;
+              received += 1;
+            }
+          }
+        }
+        while ((v = (uintptr_t) mq_pop_element(q)) != 0) {
+          idx = (v >> 32) * per_producer + (v & 0xffffffff) - 1;
+          seen[idx] += 1;
+          received += 1;
+        }
+      }
+    } else if (id < producers) {
+      for (i = 1; i <= per_producer; ++i) {
+        v = (((uintptr_t) id) << 32) | i;
+        while (!mq_push_element(q, (void*) v)) {
+          sched_yield(); // let the consumers catch up
+        }
+      }
+    } else {
+      last = (uintptr_t*) calloc(producers, sizeof(uintptr_t));
+      while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) < total) {
+        v = (uintptr_t) mq_pop_element(q);
+        if (v == 0) {
+          sched_yield(); // let the producers catch up
+          continue;
+        }
+        p = (int) (v >> 32);
+        i = v & 0xffffffff;
+        if (p >= producers || i < 1 || i > per_producer) {
+          failures += 1;
+        } else {
+          if (i <= last[p]) {
+            failures += 1; // out of order
+          }
+          last[p] = i;
+          __atomic_add_fetch(&(seen[p * per_producer + i - 1]), 1, __ATOMIC_ACQ_REL);
+        }
+        __atomic_add_fetch(&received, 1, __ATOMIC_ACQ_REL);
+      }
+      free(last);
+    }
+  }
+  if (failures) {
+    free(seen);
+    cleanup_mpmc_queue(q);
+    return 1;
+  }
+  for (k = 0; k < total; ++k) {
+    if (seen[k] != 1) {
+      free(seen);
+      cleanup_mpmc_queue(q);
+      return 2;
+    }
+  }
+  free(seen);
+  if (!mq_is_empty(q)) { return 3; }
+  if (mq_pop_element(q) != NULL) { return 4; }
+  cleanup_mpmc_queue(q);
+  return 0;
+}
+
+/******************
+ * Test Functions *
+ ******************/
+
+size_t test_mpmc_queue_setup_cleanup(void) {
+  int i;
+  mpmc_queue *q;
+  for (i = 0; i < 10000; ++i) {
+    q = create_mpmc_queue(i);
+    if (mq_get_capacity(q) < i) { return 1; }
+    cleanup_mpmc_queue(q);
+  }
+  q = create_mpmc_queue(1000);
+  if (mq_get_capacity(q) != 1024) { return 2; }
+  cleanup_mpmc_queue(q);
+  return 0;
+}
+
+size_t test_mpmc_queue_push_pop(void) {
+  mpmc_queue *q = create_mpmc_queue(16);
+  if (!mq_is_empty(q)) { return 1; }
+  if (!mq_push_element(q, (void *) 17)) { return 2; }
+  if (mq_get_length(q) != 1) { return 3; }
+  if (mq_pop_element(q) != (void *) 17) { return 4; }
+  if (mq_pop_element(q) != NULL) { return 5; }
+  if (mq_pop_element(q) != NULL) { return 6; }
+  mq_push_element(q, (void *) 8);
+  mq_push_element(q, (void *) 9);
+  mq_push_element(q, (void *) 10);
+  if (mq_get_length(q) != 3) { return 7; }
+  if (mq_pop_element(q) != (void *) 8) { return 8; }
+  if (mq_pop_element(q) != (void *) 9) { return 9; }
+  if (mq_pop_element(q) != (void *) 10) { return 10; }
+  if (mq_pop_element(q) != NULL) { return 11; }
+  if (!mq_is_empty(q)) { return 12; }
+  cleanup_mpmc_queue(q);
+  return 0;
+}
+
+size_t test_mpmc_queue_full(void) {
+  uintptr_t i;
+  mpmc_queue *q = create_mpmc_queue(64);
+  for (i = 1; i <= 64; ++i) {
+    if (!mq_push_element(q, (void *) i)) { return 1; }
+  }
+  if (mq_push_element(q, (void *) 65)) { return 2; }
+  if (mq_get_length(q) != 64) { return 3; }
+  if (mq_pop_element(q) != (void *) 1) { return 4; }
+  if (!mq_push_element(q, (void *) 65)) { return 5; }
+  for (i = 2; i <= 65; ++i) {
+    if (mq_pop_element(q) != (void *) i) { return 6; }
+  }
+  if (mq_pop_element(q) != NULL) { return 7; }
+  cleanup_mpmc_queue(q);
+  return 0;
+}
+
+size_t test_mpmc_queue_wraparound(void) {
+  uintptr_t i, j, next_in = 1, next_out = 1;
+  mpmc_queue *q = create_mpmc_queue(8);
+  // Many laps around the ring at varying fill levels:
+  for (i = 0; i < 10000; ++i) {
+    for (j = 0; j < (i % 7) + 1; ++j) {
+      if (!mq_push_element(q, (void *) next_in)) { break; }
+      next_in += 1;
+    }
+    for (j = 0; j < (i % 5) + 1; ++j) {
+      if (next_out == next_in) {
+        if (mq_pop_element(q) != NULL) { return 1; }
+        break;
+      }
+      if (mq_pop_element(q) != (void *) next_out) { return 2; }
+      next_out += 1;
+    }
+    if (mq_get_length(q) != next_in - next_out) { return 3; }
+  }
+  cleanup_mpmc_queue(q);
+  return 0;
+}
+
+size_t test_mpmc_queue_stress(void) {
+  size_t result;
+  int n = _mpmc_threads();
+  result = _mpmc_stress(1024, n / 2, n - n / 2, 100000);
+  if (result) { return result; }
+  result = _mpmc_stress(1024, 1, n - 1, 100000);
+  if (result) { return 10 + result; }
+  result = _mpmc_stress(1024, n - 1, 1, 50000);
+  if (result) { return 20 + result; }
+  return 0;
+}
+
+size_t test_mpmc_queue_stress_small(void) {
+  // A tiny queue keeps producers running into a full queue and consumers
+  // into an empty one:
+  int n = _mpmc_threads();
+  size_t result = _mpmc_stress(2, n / 2, n - n / 2, 50000);
+  if (result) { return result; }
+  return 0;
+}
+
+#endif //ifndef TEST_MPMC_QUEUE_H
@@ -0,0 +1,174 @@
+#undef TEST_SUITE_NAME
+#undef TEST_SUITE_TESTS
+#define TEST_SUITE_NAME pool
+#define TEST_SUITE_TESTS { \
+    &test_pool_setup_cleanup, \
+    &test_pool_alloc_free, \
+    &test_pool_idle_slabs, \
+    &test_pool_trim, \
+    &test_pool_stress, \
+    NULL, \
+  }
+
+#ifndef TEST_POOL_H
+#define TEST_POOL_H
+
+#include <string.h>
+
+#include <omp.h>
+
+#include "datatypes/pool.h"
+
+/******************
+ * Test Functions *
+ ******************/
+
+size_t test_pool_setup_cleanup(void) {
+  size_t i;
+  slab_pool *sp;
+  slab_pool_stats st;
+  void *obj;
+  for (i = 1; i < 300000; i = i * 3 + 1) {
+    sp = create_slab_pool("test", i, 1, 0);
+    sp_get_stats(sp, &st);
+    if (st.object_size < i) { return 1; }
+    if (st.slab_size & (st.slab_size - 1)) { return 2; }
+    if (st.slab_size < SP_MIN_SLAB_OBJECTS * i) { return 3; }
+    obj = sp_alloc(sp);
+    if (((uintptr_t) obj) % 16 != 0) { return 4; }
+    if (i >= 4096 && ((uintptr_t) obj) % 4096 != 0) { return 5; }
+    memset(obj, 0xff, i);
+    sp_free(sp, obj);
+    cleanup_slab_pool(sp);
+  }
+  return 0;
+}
+
+size_t test_pool_alloc_free(void) {
+  size_t i, per_slab;
+  slab_pool *sp = create_slab_pool("test", 100, 0, 0);
+  slab_pool_stats st;
+  uint8_t *objs[1000];
+  for (i = 0; i < 1000; ++i) {
+    objs[i] = (uint8_t*) sp_alloc(sp);
+    memset(objs[i], (int) (i & 0xff), 100);
+  }
+  for (i = 0; i < 1000; ++i) {
+    if (objs[i][0] != (i & 0xff) || objs[i][99] != (i & 0xff)) { return 1; }
+  }
+  sp_get_stats(sp, &st);
+  per_slab = st.slab_size / st.object_size;
+  if (st.live != 1000 || st.allocations != 1000) { return 2; }
+  if (st.slabs < 1000 / per_slab || st.slabs > 1000 / per_slab + 2) {
+    return 3;
+  }
+  // A freed object is the next one handed out:
+  sp_free(sp, objs[500]);
+  if (sp_alloc(sp) != objs[500]) { return 4; }
+  for (i = 0; i < 1000; ++i) {
+    sp_free(sp, objs[i]);
+  }
+  sp_get_stats(sp, &st);
+  if (st.live != 0 || st.frees != 1001 || st.peak_live != 1000) { return 5; }
+  // Without any idle slabs allowed, everything goes back to the OS:
+  if (st.slabs != 0 || st.unmapped_slabs != st.peak_slabs) { return 6; }
+  if (sp_data_size(sp) != 0) { return 7; }
+  cleanup_slab_pool(sp);
+  return 0;
+}
+
+size_t test_pool_idle_slabs(void) {
+  size_t i;
+  slab_pool *sp = create_slab_pool("test", 64 * 1024, 2, 0);
+  slab_pool_stats st;
+  void *objs[40];
+  for (i = 0; i < 40; ++i) {
+    objs[i] = sp_alloc(sp);
+  }
+  for (i = 0; i < 40; ++i) {
+    sp_free(sp, objs[i]);
+  }
+  sp_get_stats(sp, &st);
+  if (st.idle_slabs != 2 || st.slabs != 2) { return 1; }
+  if (st.unmapped_slabs != st.peak_slabs - 2) { return 2; }
+  // Idle slabs get reused before new ones are mapped:
+  objs[0] = sp_alloc(sp);
+  sp_get_stats(sp, &st);
+  if (st.idle_slabs != 1 || st.slabs != 2) { return 3; }
+  sp_free(sp, objs[0]);
+  cleanup_slab_pool(sp);
+  return 0;
+}
+
+size_t test_pool_trim(void) {
+  size_t i;
+  slab_pool *sp = create_slab_pool("test", 8192, 4, 0);
+  slab_pool_stats st;
+  uint8_t *objs[8];
+  for (i = 0; i < 8; ++i) {
+    objs[i] = (uint8_t*) sp_alloc(sp);
+    memset(objs[i], 0xab, 8192);
+  }
+  for (i = 0; i < 8; ++i) {
+    sp_free(sp, objs[i]);
+  }
+  sp_get_stats(sp, &st);
+  if (st.trimmed_slabs != 0 || st.idle_slabs == 0) { return 1; }
+  if (sp_trim(sp) != st.idle_slabs) { return 2; }
+  if (sp_trim(sp) != 0) { return 3; }
+  sp_get_stats(sp, &st);
+  if (st.trimmed_slabs != st.idle_slabs) { return 4; }
+  // Trimmed pages come back zeroed:
+  for (i = 0; i < 8; ++i) {
+    objs[i] = (uint8_t*) sp_alloc(sp);
+    if (objs[i][0] != 0 || objs[i][8191] != 0) { return 5; }
+  }
+  sp_get_stats(sp, &st);
+  if (st.trimmed_slabs != 0) { return 6; }
+  for (i = 0; i < 8; ++i) {
+    sp_free(sp, objs[i]);
+  }
+  cleanup_slab_pool(sp);
+  // Pools created with trimming on trim as slabs go idle:
+  sp = create_slab_pool("test", 8192, 4, 1);
+  objs[0] = (uint8_t*) sp_alloc(sp);
+  sp_free(sp, objs[0]);
+  sp_get_stats(sp, &st);
+  if (st.idle_slabs != 1 || st.trimmed_slabs != 1) { return 7; }
+  if (sp_overhead_size(sp) >= st.slab_size) { return 8; }
+  cleanup_slab_pool(sp);
+  return 0;
+}
+
+size_t test_pool_stress(void) {
+  size_t failures = 0;
+  slab_pool *sp = create_slab_pool("test", 48, 2, 1);
+  slab_pool_stats st;
+  #pragma omp parallel num_threads(4) reduction(+:failures)
+  {
+    size_t i, j;
+    uintptr_t tag = (uintptr_t) omp_get_thread_num() + 1;
+    uintptr_t *held[64];
+    for (i = 0; i < 2000; ++i) {
+      for (j = 0; j < 64; ++j) {
+        held[j] = (uintptr_t*) sp_alloc(sp);
+        held[j][0] = tag;
+        held[j][5] = j;
+      }
+      for (j = 0; j < 64; ++j) {
+        if (held[j][0] != tag || held[j][5] != j) {
+          failures += 1;
+        }
+        sp_free(sp, held[j]);
+      }
+    }
+  }
+  if (failures) { return 1; }
+  sp_get_stats(sp, &st);
+  if (st.live != 0 || st.allocations != 4 * 2000 * 64) { return 2; }
+  if (st.allocations != st.frees) { return 3; }
+  cleanup_slab_pool(sp);
+  return 0;
+}
+
+#endif //ifndef TEST_POOL_H
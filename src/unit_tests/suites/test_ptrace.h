@@ -0,0 +1,191 @@
+#undef TEST_SUITE_NAME
+#undef TEST_SUITE_TESTS
+#define TEST_SUITE_NAME ptrace
+#define TEST_SUITE_TESTS { \
+    &test_ptrace_nesting, \
+    &test_ptrace_cancel, \
+    &test_ptrace_wrap, \
+    &test_ptrace_scope, \
+    &test_ptrace_concurrent_dump, \
+    &test_ptrace_dump_failure, \
+    NULL, \
+  }
+
+#ifndef TEST_PTRACE_H
+#define TEST_PTRACE_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include "prof/ptrace.h"
+
+/*************
+ * Constants *
+ *************/
+
+#define TEST_PTRACE_WRITERS 4
+#define TEST_PTRACE_WRITER_SPANS 200000
+
+/******************
+ * Test Functions *
+ ******************/
+
+size_t test_ptrace_nesting(void) {
+  trace_span spans[3];
+  size_t depth = trace_depth();
+  trace_begin("outer");
+  trace_begin("middle");
+  trace_begin("inner");
+  if (trace_depth() != depth + 3) { return 1; }
+  if (trace_end("inner") < 0) { return 2; }
+  if (trace_end("middle") < 0) { return 3; }
+  if (trace_end("outer") < 0) { return 4; }
+  if (trace_depth() != depth) { return 5; }
+  // Spans are recorded as they finish, so the innermost comes first:
+  if (trace_thread_spans(spans, 3) != 3) { return 6; }
+  if (strcmp(spans[0].name, "inner") || spans[0].depth != depth + 2) {
+    return 7;
+  }
+  if (strcmp(spans[1].name, "middle") || spans[1].depth != depth + 1) {
+    return 8;
+  }
+  if (strcmp(spans[2].name, "outer") || spans[2].depth != depth) {
+    return 9;
+  }
+  if (
+    spans[1].start > spans[0].start
+ || spans[2].start > spans[1].start
+ || spans[0].start + spans[0].duration > spans[1].start + spans[1].duration
+ || spans[1].start + spans[1].duration > spans[2].start + spans[2].duration
+  ) {
+    return 10;
+  }
+  return 0;
+}
+
+size_t test_ptrace_cancel(void) {
+  trace_span spans[2];
+  trace_begin("kept");
+  trace_end("kept");
+  trace_begin("outer");
+  trace_begin("cancelled");
+  trace_cancel("cancelled");
+  trace_end("outer");
+  if (trace_thread_spans(spans, 2) != 2) { return 1; }
+  if (strcmp(spans[0].name, "kept") || strcmp(spans[1].name, "outer")) {
+    return 2;
+  }
+  return 0;
+}
+
+size_t test_ptrace_wrap(void) {
+  size_t i;
+  static trace_span spans[TRACE_BUFFER_SIZE + 1];
+  for (i = 0; i < TRACE_BUFFER_SIZE + 100; ++i) {
+    trace_begin(i < 100 ? "old" : "new");
+    trace_end(i < 100 ? "old" : "new");
+  }
+  // Only the most recent spans are kept:
+  if (trace_thread_spans(spans, TRACE_BUFFER_SIZE + 1) != TRACE_BUFFER_SIZE) {
+    return 1;
+  }
+  for (i = 0; i < TRACE_BUFFER_SIZE; ++i) {
+    if (strcmp(spans[i].name, "new")) { return 2; }
+  }
+  for (i = 1; i < TRACE_BUFFER_SIZE; ++i) {
+    if (spans[i].start < spans[i-1].start) { return 3; }
+  }
+  return 0;
+}
+
+#ifdef PROFILE_TIME
+static int _test_ptrace_scoped(int early) {
+  TRACE_SCOPE("scoped");
+  if (early) {
+    return (int) trace_depth();
+  }
+  {
+    TRACE_SCOPE("nested");
+    TRACE_SCOPE("nested twice");
+  }
+  return (int) trace_depth();
+}
+#endif
+
+size_t test_ptrace_scope(void) {
+#ifdef PROFILE_TIME
+  trace_span spans[3];
+  int depth = (int) trace_depth();
+  if (_test_ptrace_scoped(1) != depth + 1) { return 1; }
+  if ((int) trace_depth() != depth) { return 2; }
+  if (_test_ptrace_scoped(0) != depth + 1) { return 3; }
+  if ((int) trace_depth() != depth) { return 4; }
+  if (trace_thread_spans(spans, 3) != 3) { return 5; }
+  if (
+    strcmp(spans[0].name, "nested twice")
+ || strcmp(spans[1].name, "nested")
+ || strcmp(spans[2].name, "scoped")
+  ) {
+    return 6;
+  }
+#endif
+  return 0;
+}
+
+size_t test_ptrace_concurrent_dump(void) {
+  int done = 0, running = 0;
+  char line[256];
+  FILE *fp = tmpfile();
+  if (fp == NULL) { return 1; }
+  #pragma omp parallel num_threads(TEST_PTRACE_WRITERS + 1)
+  {
+    size_t i;
+    if (omp_get_thread_num() == 0) {
+      // Dump repeatedly while the other threads are busy tracing:
+      while (__atomic_load_n(&running, __ATOMIC_ACQUIRE) == 0) {}
+      while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < TEST_PTRACE_WRITERS) {
+        rewind(fp);
+        trace_write(fp);
+      }
+    } else {
+      __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+      for (i = 0; i < TEST_PTRACE_WRITER_SPANS; ++i) {
+        trace_begin("writer");
+        trace_begin("writer inner");
+        trace_end("writer inner");
+        trace_end("writer");
+      }
+      __atomic_add_fetch(&done, 1, __ATOMIC_ACQ_REL);
+    }
+  }
+  fclose(fp);
+  // A dump once everyone has stopped should include every writer's full
+  // buffer, and every event in it must be well-formed:
+  fp = tmpfile();
+  if (fp == NULL) { return 2; }
+  if (trace_write(fp) < TEST_PTRACE_WRITERS * TRACE_BUFFER_SIZE) { return 3; }
+  rewind(fp);
+  if (fgets(line, sizeof(line), fp) == NULL) { return 4; }
+  if (strncmp(line, "{\"displayTimeUnit\"", 18)) { return 5; }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (
+      strstr(line, "\"ph\":\"X\"") != NULL
+   && strstr(line, "\"dur\":") == NULL
+    ) {
+      return 6;
+    }
+  }
+  if (strcmp(line, "]}\n")) { return 7; }
+  fclose(fp);
+  return 0;
+}
+
+size_t test_ptrace_dump_failure(void) {
+  // Failing to open the file is reported, not fatal:
+  if (trace_dump("/nonexistent/elf_forest/trace.json") != 0) { return 1; }
+  return 0;
+}
+
+#endif //ifndef TEST_PTRACE_H
@@ -0,0 +1,524 @@
+#undef TEST_SUITE_NAME
+#undef TEST_SUITE_TESTS
+#define TEST_SUITE_NAME render_set
+#define TEST_SUITE_TESTS { \
+    &test_render_set_add_remove, \
+    &test_render_set_detail, \
+    &test_render_set_frustum, \
+    &test_render_set_opaque_faces, \
+    &test_render_set_uniform_chunks, \
+    &test_render_set_occlusion_terrain, \
+    &test_render_set_occlusion_wall, \
+    &test_render_set_occlusion_corner, \
+    NULL, \
+  }
+
+#ifndef TEST_RENDER_SET_H
+#define TEST_RENDER_SET_H
+
+#include <math.h>
+
+#include "datatypes/list.h"
+#include "datatypes/vector.h"
+#include "world/blocks.h"
+#include "world/world.h"
+#include "world/chunk_data.h"
+#include "data/render_set.h"
+
+/********************
+ * Shared Variables *
+ ********************/
+
+gl_cpos_t const TEST_RS_DISTANCES[N_LODS] = { 4, 6, 8, 10, 12 };
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Sets up a view from the origin looking north (+y) with a 90-degree field of
+// view in each direction.
+static void _rs_test_view(render_view *rv) {
+  vector eye = { .x = 0, .y = 0, .z = 0 };
+  vector fwd = { .x = 0, .y = 1, .z = 0 };
+  vector side = { .x = 1, .y = 0, .z = 0 };
+  vector up = { .x = 0, .y = 0, .z = 1 };
+  rv->origin.x = 0;
+  rv->origin.y = 0;
+  rv->origin.z = 0;
+  rv->origin.w = 0;
+  rv->center.x = 0;
+  rv->center.y = 0;
+  rv->center.z = 0;
+  rv->min_cull_dist = 0;
+  rv->max_distances = TEST_RS_DISTANCES;
+  rv->occlusion_cull = 0;
+  rv_set_frustum(rv, &eye, &fwd, &side, &up, M_PI/4.0, M_PI/4.0);
+}
+
+// Adds a chunk at the given position to the given set and returns it.
+static chunk * _rs_add_chunk(
+  render_set *rs,
+  gl_cpos_t x,
+  gl_cpos_t y,
+  gl_cpos_t z
+) {
+  global_chunk_pos glcpos = { .x = x, .y = y, .z = z };
+  chunk_or_approx coa;
+  chunk *c = create_chunk(&glcpos);
+  ch__coa(c, &coa);
+  rs_lock(rs);
+  rs_add(rs, &coa);
+  rs_unlock(rs);
+  return c;
+}
+
+// Sets the opaque face flags of the given chunk.
+static void _rs_set_faces(chunk *c, chunk_flag faces) {
+  c->chunk_flags = (c->chunk_flags & ~CF_OPAQUE_FACES) | faces;
+}
+
+// Finds the chunk at the given position among the given results, returning
+// NULL if it isn't there.
+static chunk * _rs_find_result(
+  chunk_or_approx *results,
+  size_t n,
+  gl_cpos_t x,
+  gl_cpos_t y,
+  gl_cpos_t z
+) {
+  size_t i;
+  chunk *c;
+  for (i = 0; i < n; ++i) {
+    c = (chunk *) results[i].ptr;
+    if (c->glcpos.x == x && c->glcpos.y == y && c->glcpos.z == z) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+// Cleans up every chunk in the given set, then the set itself.
+static void _rs_cleanup_all(render_set *rs) {
+  size_t i;
+  for (i = 0; i < rs_get_count(rs); ++i) {
+    cleanup_chunk((chunk *) rs->entries[i].levels[LOD_BASE]);
+  }
+  cleanup_render_set(rs);
+}
+
+// Counts how many of the given results point to the given data.
+static size_t _rs_count_results(
+  chunk_or_approx *results,
+  size_t n,
+  void *ptr
+) {
+  size_t i, count = 0;
+  for (i = 0; i < n; ++i) {
+    if (results[i].ptr == ptr) {
+      count += 1;
+    }
+  }
+  return count;
+}
+
+/******************
+ * Test Functions *
+ ******************/
+
+size_t test_render_set_add_remove(void) {
+  size_t i;
+  chunk *chunks[100];
+  chunk *c, *replacement;
+  chunk_or_approx coa;
+  render_set *rs = create_render_set();
+  for (i = 0; i < 100; ++i) {
+    chunks[i] = _rs_add_chunk(rs, i % 10, i / 10, 0);
+  }
+  if (rs_get_count(rs) != 100) { return 1; }
+  // Adding the same data twice doesn't add a new entry:
+  ch__coa(chunks[17], &coa);
+  rs_lock(rs);
+  rs_add(rs, &coa);
+  rs_unlock(rs);
+  if (rs_get_count(rs) != 100) { return 2; }
+  // Removing from the middle keeps every other entry findable:
+  for (i = 0; i < 100; i += 3) {
+    ch__coa(chunks[i], &coa);
+    rs_lock(rs);
+    rs_remove(rs, &coa);
+    rs_unlock(rs);
+  }
+  if (rs_get_count(rs) != 66) { return 3; }
+  for (i = 0; i < rs_get_count(rs); ++i) {
+    c = (chunk *) rs->entries[i].levels[LOD_BASE];
+    if (c == NULL) { return 4; }
+    if ((c->glcpos.x + 10 * c->glcpos.y) % 3 == 0) { return 5; }
+  }
+  // Removing stale data doesn't remove its replacement:
+  replacement = _rs_add_chunk(rs, 1, 0, 0);
+  ch__coa(chunks[1], &coa);
+  rs_lock(rs);
+  rs_remove(rs, &coa);
+  rs_unlock(rs);
+  if (rs_get_count(rs) != 66) { return 6; }
+  ch__coa(replacement, &coa);
+  rs_lock(rs);
+  rs_remove(rs, &coa);
+  rs_unlock(rs);
+  if (rs_get_count(rs) != 65) { return 7; }
+  rs_clear(rs);
+  if (rs_get_count(rs) != 0) { return 8; }
+  for (i = 0; i < 100; ++i) {
+    cleanup_chunk(chunks[i]);
+  }
+  cleanup_chunk(replacement);
+  cleanup_render_set(rs);
+  return 0;
+}
+
+size_t test_render_set_detail(void) {
+  chunk_or_approx results[4];
+  chunk_or_approx coa;
+  size_t n;
+  render_view rv;
+  global_chunk_pos glcpos = { .x = 0, .y = 7, .z = 0 };
+  render_set *rs = create_render_set();
+  chunk *c = _rs_add_chunk(rs, 0, 7, 0);
+  chunk_approximation *ca = create_chunk_approximation(&glcpos, LOD_QUARTER);
+  _rs_test_view(&rv);
+  aprx__coa(ca, &coa);
+  rs_lock(rs);
+  rs_add(rs, &coa);
+  rs_unlock(rs);
+  if (rs_get_count(rs) != 1) { return 1; }
+  // At distance 7 the desired detail is LOD_QUARTER, so the chunk is too
+  // detailed but the quarter-detail approximation will do:
+  n = rs_collect_visible(rs, &rv, results, 4);
+  if (n != 1) { return 2; }
+  if (results[0].ptr != ca) { return 3; }
+  if (results[0].type != CA_TYPE_APPROXIMATION) { return 4; }
+  // Closer up the chunk is used:
+  rv.center.y = 6;
+  n = rs_collect_visible(rs, &rv, results, 4);
+  if (n != 1 || results[0].ptr != c) { return 5; }
+  if (results[0].type != CA_TYPE_CHUNK) { return 6; }
+  // Without the approximation nothing is detailed enough far away:
+  rv.center.y = 0;
+  rs_lock(rs);
+  rs_remove(rs, &coa);
+  rs_unlock(rs);
+  if (rs_get_count(rs) != 1) { return 7; }
+  n = rs_collect_visible(rs, &rv, results, 4);
+  if (n != 0) { return 8; }
+  // Beyond the farthest render distance nothing is drawn:
+  rv.center.y = -6;
+  rs_lock(rs);
+  rs_add(rs, &coa);
+  rs_unlock(rs);
+  n = rs_collect_visible(rs, &rv, results, 4);
+  if (n != 0) { return 9; }
+  rs_clear(rs);
+  cleanup_chunk(c);
+  cleanup_chunk_approximation(ca);
+  cleanup_render_set(rs);
+  return 0;
+}
+
+size_t test_render_set_frustum(void) {
+  chunk_or_approx results[16];
+  size_t n;
+  render_view rv;
+  render_set *rs = create_render_set();
+  chunk *ahead = _rs_add_chunk(rs, 0, 1, 0);
+  chunk *behind = _rs_add_chunk(rs, 0, -2, 0);
+  chunk *left = _rs_add_chunk(rs, -3, 0, 0);
+  chunk *above = _rs_add_chunk(rs, 0, 0, 3);
+  chunk *edge = _rs_add_chunk(rs, 1, 1, 0); // straddles the right-hand plane
+  chunk *here = _rs_add_chunk(rs, 0, 0, 0); // contains the eye
+  _rs_test_view(&rv);
+  n = rs_collect_visible(rs, &rv, results, 16);
+  if (_rs_count_results(results, n, ahead) != 1) { return 1; }
+  if (_rs_count_results(results, n, behind) != 0) { return 2; }
+  if (_rs_count_results(results, n, left) != 0) { return 3; }
+  if (_rs_count_results(results, n, above) != 0) { return 4; }
+  if (_rs_count_results(results, n, edge) != 1) { return 5; }
+  if (_rs_count_results(results, n, here) != 1) { return 6; }
+  if (n != 3) { return 7; }
+  // Turning around swaps what's in front and behind:
+  rv.planes[0].y *= -1;
+  rv.planes[1].y *= -1;
+  rv.planes[2].y *= -1;
+  rv.planes[3].y *= -1;
+  n = rs_collect_visible(rs, &rv, results, 16);
+  if (_rs_count_results(results, n, ahead) != 0) { return 8; }
+  if (_rs_count_results(results, n, behind) != 1) { return 9; }
+  // Nothing near the eye is culled:
+  rv.min_cull_dist = 5 * CHUNK_SIZE;
+  n = rs_collect_visible(rs, &rv, results, 16);
+  if (n != 6) { return 10; }
+  // The result count is capped:
+  n = rs_collect_visible(rs, &rv, results, 2);
+  if (n != 2) { return 11; }
+  rs_clear(rs);
+  cleanup_chunk(ahead);
+  cleanup_chunk(behind);
+  cleanup_chunk(left);
+  cleanup_chunk(above);
+  cleanup_chunk(edge);
+  cleanup_chunk(here);
+  cleanup_render_set(rs);
+  return 0;
+}
+
+size_t test_render_set_opaque_faces(void) {
+  global_chunk_pos glcpos = { .x = 0, .y = 0, .z = 0 };
+  chunk *c = create_chunk(&glcpos);
+  chunk_or_approx coa;
+  block_index idx;
+  init_blocks();
+  ch__coa(c, &coa);
+  c_fill_with_block(c, b_make_block(B_STONE));
+  if (compute_opaque_faces(&coa) != CF_OPAQUE_FACES) { return 1; }
+  // Hollowing out the middle doesn't matter:
+  idx.xyz.x = CHUNK_SIZE / 2;
+  idx.xyz.y = CHUNK_SIZE / 2;
+  idx.xyz.z = CHUNK_SIZE / 2;
+  idx.xyz.w = 0;
+  c_edit_cell(c, idx)->blocks[0] = b_make_block(B_AIR);
+  if (compute_opaque_faces(&coa) != CF_OPAQUE_FACES) { return 2; }
+  // A gap in the top face:
+  idx.xyz.z = CHUNK_SIZE - 1;
+  c_edit_cell(c, idx)->blocks[0] = b_make_block(B_AIR);
+  if (compute_opaque_faces(&coa) != (CF_OPAQUE_FACES & ~CF_OPAQUE_ABOVE)) {
+    return 3;
+  }
+  // A gap in the bottom north-west corner opens three faces at once:
+  idx.xyz.x = 0;
+  idx.xyz.y = CHUNK_SIZE - 1;
+  idx.xyz.z = 0;
+  c_edit_cell(c, idx)->blocks[0] = b_make_block(B_WATER);
+  if (
+    compute_opaque_faces(&coa)
+ != (CF_OPAQUE_EAST | CF_OPAQUE_SOUTH)
+  ) {
+    return 4;
+  }
+  cleanup_chunk(c);
+  return 0;
+}
+
+size_t test_render_set_uniform_chunks(void) {
+  global_chunk_pos glcpos = { .x = 0, .y = 0, .z = 0 };
+  chunk *c = create_chunk(&glcpos);
+  chunk_approximation *ca = create_chunk_approximation(&glcpos, LOD_QUARTER);
+  chunk_or_approx coa;
+  block_index idx = { .xyz = { .x = 3, .y = 17, .z = 31, .w = 0 } };
+  block_index other = { .xyz = { .x = 30, .y = 0, .z = 9, .w = 0 } };
+  cell fill = { .blocks = { 0, 0 } };
+  init_blocks();
+  ch__coa(c, &coa);
+  // New chunks are uniform and don't have a cell array yet:
+  if (!c_is_uniform(c)) { return 1; }
+  if (chunk_data_size(c) != sizeof(cell)) { return 2; }
+  c_fill_with_block(c, b_make_block(B_STONE));
+  if (b_id(c_cell(c, idx)->blocks[0]) != B_STONE) { return 3; }
+  if (b_id(c_cell(c, other)->blocks[0]) != B_STONE) { return 4; }
+  if (!c_is_uniform(c)) { return 5; }
+  // Writing a cell expands the chunk without changing the others:
+  c_edit_cell(c, idx)->blocks[0] = b_make_block(B_AIR);
+  if (c_is_uniform(c)) { return 6; }
+  if (chunk_data_size(c) != sizeof(cell) * TOTAL_CHUNK_CELLS) { return 7; }
+  if (b_id(c_cell(c, idx)->blocks[0]) != B_AIR) { return 8; }
+  if (b_id(c_cell(c, other)->blocks[0]) != B_STONE) { return 9; }
+  if (compute_opaque_faces(&coa) != (CF_OPAQUE_FACES & ~CF_OPAQUE_ABOVE)) {
+    return 10;
+  }
+  // Only chunks that really are uniform get compacted:
+  if (c_compact_cells(c)) { return 11; }
+  *c_edit_block(c, idx) = b_make_block(B_STONE);
+  if (!c_compact_cells(c)) { return 12; }
+  if (!c_is_uniform(c) || chunk_data_size(c) != sizeof(cell)) { return 13; }
+  if (b_id(c_cell(c, idx)->blocks[0]) != B_STONE) { return 14; }
+  // Approximations work the same way:
+  if (!ca_is_uniform(ca)) { return 15; }
+  fill.blocks[0] = b_make_block(B_WATER);
+  ca_make_uniform(ca, &fill);
+  if (b_id(ca_cell(ca, other)->blocks[0]) != B_WATER) { return 16; }
+  ca_edit_cell(ca, idx)->blocks[0] = b_make_block(B_AIR);
+  if (ca_is_uniform(ca)) { return 17; }
+  if (chunk_approx_data_size(ca) != sizeof(approx_data_2)) { return 18; }
+  if (b_id(ca_cell(ca, idx)->blocks[0]) != B_AIR) { return 19; }
+  if (b_id(ca_cell(ca, other)->blocks[0]) != B_WATER) { return 20; }
+  ca_make_uniform(ca, &fill);
+  if (chunk_approx_data_size(ca) != sizeof(cell)) { return 21; }
+  cleanup_chunk(c);
+  cleanup_chunk_approximation(ca);
+  return 0;
+}
+
+size_t test_render_set_occlusion_terrain(void) {
+  chunk_or_approx results[4096];
+  chunk_or_approx *culled = (chunk_or_approx *) malloc(
+    sizeof(chunk_or_approx) * 4096
+  );
+  size_t i, n_all, n_culled;
+  gl_cpos_t x, y, z;
+  chunk *c;
+  render_view rv;
+  render_set *rs = create_render_set();
+  // Solid ground from z = -5 up to z = -1, with a few things (trees, say)
+  // standing on it:
+  for (x = -8; x <= 8; ++x) {
+    for (y = -8; y <= 8; ++y) {
+      for (z = -5; z <= 0; ++z) {
+        if (z == 0 && (x + 3 * y) % 5 != 0) {
+          continue;
+        }
+        c = _rs_add_chunk(rs, x, y, z);
+        if (z < 0) {
+          _rs_set_faces(c, CF_OPAQUE_FACES);
+          // Buried chunks have something to draw (ore and caves, say):
+          if (z < -1) {
+            l_append_element(c->layers[L_OPAQUE].vcounts, (void *) 36);
+          }
+        }
+      }
+    }
+  }
+  _rs_test_view(&rv);
+  rv_set_frustum(
+    &rv,
+    &(rv.eye),
+    &((vector) { .x = 0, .y = 1, .z = 0 }),
+    &((vector) { .x = 1, .y = 0, .z = 0 }),
+    &((vector) { .x = 0, .y = 0, .z = 1 }),
+    3 * M_PI / 8,
+    3 * M_PI / 8
+  );
+  n_all = rs_collect_visible(rs, &rv, results, 4096);
+  if (rs->n_occluded != 0) { return 1; }
+  rv.occlusion_cull = 1;
+  n_culled = rs_collect_visible(rs, &rv, culled, 4096);
+  if (n_culled >= n_all) { return 2; }
+  if (rs->n_occluded != n_all - n_culled) { return 3; }
+  // Each buried chunk would have been one draw call of 36 indices:
+  if (rs->occluded_draws != rs->n_occluded) { return 4; }
+  if (rs->occluded_vertices != 36 * rs->n_occluded) { return 5; }
+  // Everything at or above the surface stays visible, and nothing buried
+  // does:
+  for (i = 0; i < n_all; ++i) {
+    c = (chunk *) results[i].ptr;
+    if (c->glcpos.z >= -1) {
+      if (
+        _rs_find_result(culled, n_culled, c->glcpos.x, c->glcpos.y, c->glcpos.z)
+     == NULL
+      ) {
+        return 6;
+      }
+    } else if (
+      _rs_find_result(culled, n_culled, c->glcpos.x, c->glcpos.y, c->glcpos.z)
+   != NULL
+    ) {
+      return 7;
+    }
+  }
+  // From underground (inside a cave in the camera's chunk) only the
+  // neighboring chunks can be seen:
+  rv.center.z = -3;
+  rv.origin.z = -3 * CHUNK_SIZE;
+  n_culled = rs_collect_visible(rs, &rv, culled, 4096);
+  if (n_culled == 0 || n_culled > 7) { return 8; }
+  if (_rs_find_result(culled, n_culled, 0, 0, -3) == NULL) { return 9; }
+  if (_rs_find_result(culled, n_culled, 0, 1, -3) == NULL) { return 10; }
+  free(culled);
+  _rs_cleanup_all(rs);
+  return 0;
+}
+
+size_t test_render_set_occlusion_wall(void) {
+  chunk_or_approx results[1024];
+  size_t n;
+  gl_cpos_t x, z;
+  chunk *c, *hole = NULL;
+  render_view rv;
+  render_set *rs = create_render_set();
+  // A wall just north of the camera with things behind it:
+  for (x = -6; x <= 6; ++x) {
+    for (z = -6; z <= 6; ++z) {
+      c = _rs_add_chunk(rs, x, 1, z);
+      _rs_set_faces(c, CF_OPAQUE_FACES);
+      if (x == 0 && z == 0) {
+        hole = c;
+      }
+    }
+  }
+  if (hole == NULL) { return 11; }
+  for (x = -1; x <= 1; ++x) {
+    _rs_add_chunk(rs, x, 3, 0);
+  }
+  _rs_test_view(&rv);
+  n = rs_collect_visible(rs, &rv, results, 1024);
+  if (_rs_find_result(results, n, 0, 3, 0) == NULL) { return 10; }
+  rv.occlusion_cull = 1;
+  n = rs_collect_visible(rs, &rv, results, 1024);
+  if (_rs_find_result(results, n, 0, 1, 0) == NULL) { return 1; }
+  if (_rs_find_result(results, n, 0, 3, 0) != NULL) { return 2; }
+  if (_rs_find_result(results, n, 1, 3, 0) != NULL) { return 3; }
+  // (Some wall chunks at the edge of the view are hidden too, so this is just
+  // a lower bound.)
+  if (rs->n_occluded < 3) { return 4; }
+  // Knocking a hole in the wall lets us see through it:
+  _rs_set_faces(hole, 0);
+  n = rs_collect_visible(rs, &rv, results, 1024);
+  if (_rs_find_result(results, n, 0, 3, 0) == NULL) { return 5; }
+  if (_rs_find_result(results, n, 1, 3, 0) == NULL) { return 6; }
+  // A hole with its far side blocked up doesn't:
+  _rs_set_faces(hole, CF_OPAQUE_NORTH);
+  n = rs_collect_visible(rs, &rv, results, 1024);
+  if (_rs_find_result(results, n, 0, 1, 0) == NULL) { return 7; }
+  if (_rs_find_result(results, n, 0, 3, 0) != NULL) { return 8; }
+  // And the camera's own chunk never blocks the view:
+  rv.center.y = 1;
+  rv.origin.y = CHUNK_SIZE;
+  _rs_set_faces(hole, CF_OPAQUE_FACES);
+  n = rs_collect_visible(rs, &rv, results, 1024);
+  if (_rs_find_result(results, n, 0, 3, 0) == NULL) { return 9; }
+  _rs_cleanup_all(rs);
+  return 0;
+}
+
+// A chunk that the flood first arrives at through an opaque face can still be
+// seen through if it's also reached through an open one.
+size_t test_render_set_occlusion_corner(void) {
+  chunk_or_approx results[64];
+  size_t n;
+  chunk *c;
+  render_view rv;
+  render_set *rs = create_render_set();
+  // The corner of an L: the flood gets here from (0, 1, 0) through the
+  // opaque west face before it gets here from (1, 0, 0) through the open
+  // south face:
+  c = _rs_add_chunk(rs, 1, 1, 0);
+  _rs_set_faces(c, CF_OPAQUE_FACES & ~(CF_OPAQUE_SOUTH | CF_OPAQUE_NORTH));
+  _rs_add_chunk(rs, 0, 1, 0);
+  _rs_add_chunk(rs, 1, 0, 0);
+  // Behind the corner, and only visible through it:
+  c = _rs_add_chunk(rs, 0, 2, 0);
+  _rs_set_faces(c, CF_OPAQUE_FACES);
+  _rs_add_chunk(rs, 1, 2, 0);
+  _rs_test_view(&rv);
+  rv.occlusion_cull = 1;
+  n = rs_collect_visible(rs, &rv, results, 64);
+  if (_rs_find_result(results, n, 1, 1, 0) == NULL) { return 1; }
+  if (_rs_find_result(results, n, 1, 2, 0) == NULL) { return 2; }
+  // Closing the south face hides what's behind it again:
+  c = _rs_find_result(results, n, 1, 1, 0);
+  _rs_set_faces(c, CF_OPAQUE_FACES & ~CF_OPAQUE_NORTH);
+  n = rs_collect_visible(rs, &rv, results, 64);
+  if (_rs_find_result(results, n, 1, 1, 0) == NULL) { return 3; }
+  if (_rs_find_result(results, n, 1, 2, 0) != NULL) { return 4; }
+  _rs_cleanup_all(rs);
+  return 0;
+}
+
+#endif //ifndef TEST_RENDER_SET_H
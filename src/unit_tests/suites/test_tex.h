@@ -4,6 +4,11 @@
 #define TEST_SUITE_TESTS { \
     &test_texture_pixels, \
     &test_load_png, \
+    &test_tex_draw_golden, \
+    &test_tex_draw_wrapped_golden, \
+    &test_tex_blend_batch, \
+    &test_tex_cache, \
+    &test_tex_async_png, \
     NULL, \
   }
 
@@ -11,9 +16,167 @@
 #define TEST_TEX_H
 
 #include "tex/tex.h"
+#include "tex/color.h"
+#include "jobs/jobs.h"
+
+#include "util.h"
 
 #include "unit_tests/test_suite.h"
 
+/********************
+ * Shared Variables *
+ ********************/
+
+#define TEST_TEX_BLEND_COUNT (3 * COLOR_BATCH_SIZE + 5)
+
+#define TEST_TEX_ASYNC_WRITES 6
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Per-pixel reference versions of tx_draw_region and tx_draw_region_wrapped
+// (the original implementations), which the optimized versions should match.
+
+static void _tex_reference_draw(
+  texture *dst,
+  texture const * const src,
+  size_t dst_left, size_t dst_top,
+  size_t src_left, size_t src_top,
+  size_t region_width, size_t region_height
+) {
+  size_t row, column;
+  pixel src_px, dst_px;
+  float alpha;
+  for (row = 0; row < region_height; ++row) {
+    for (column = 0; column < region_width; ++column) {
+      src_px = tx_get_px(src, src_left + column, src_top + row);
+      dst_px = tx_get_px(dst, dst_left + column, dst_top + row);
+      alpha = px_alpha(src_px) / ((float) CHANNEL_MAX);
+      px_set_red(
+        &dst_px,
+        (px_red(src_px) * alpha) + (px_red(dst_px) * (1 - alpha))
+      );
+      px_set_green(
+        &dst_px,
+        (px_green(src_px) * alpha) + (px_green(dst_px) * (1 - alpha))
+      );
+      px_set_blue(
+        &dst_px,
+        (px_blue(src_px) * alpha) + (px_blue(dst_px) * (1 - alpha))
+      );
+      px_set_alpha(
+        &dst_px,
+        px_alpha(src_px)>px_alpha(dst_px) ? px_alpha(src_px) : px_alpha(dst_px)
+      );
+      tx_set_px(dst, dst_px, dst_left + column, dst_top + row);
+    }
+  }
+}
+
+static void _tex_reference_draw_wrapped(
+  texture *dst,
+  texture const * const src,
+  size_t dst_left, size_t dst_top,
+  size_t src_left, size_t src_top,
+  size_t region_width, size_t region_height
+) {
+  size_t row, column, dr, dc;
+  pixel src_px, dst_px;
+  float alpha;
+  for (row = 0; row < region_height; ++row) {
+    for (column = 0; column < region_width; ++column) {
+      src_px = tx_get_px(
+        src,
+        (src_left + column) % src->width,
+        (src_top + row) % src->height
+      );
+      dr = (dst_top + row) % dst->height;
+      dc = (dst_left + column) % dst->width;
+      dst_px = tx_get_px(dst, dc, dr);
+      alpha = (
+        px_alpha(src_px) / ((float) CHANNEL_MAX)
+      +
+        (1 - (px_alpha(dst_px) / ((float) CHANNEL_MAX)))
+      );
+      if (alpha > 1) { alpha = 1; }
+      px_set_red(
+        &dst_px,
+        (px_red(src_px) * alpha) + (px_red(dst_px) * (1 - alpha))
+      );
+      px_set_green(
+        &dst_px,
+        (px_green(src_px) * alpha) + (px_green(dst_px) * (1 - alpha))
+      );
+      px_set_blue(
+        &dst_px,
+        (px_blue(src_px) * alpha) + (px_blue(dst_px) * (1 - alpha))
+      );
+      alpha = px_alpha(src_px) / ((float) CHANNEL_MAX) + px_alpha(dst_px);
+      if (alpha > 1) { alpha = 1; }
+      px_set_alpha(&dst_px, alpha * CHANNEL_MAX);
+      tx_set_px(dst, dst_px, dc, dr);
+    }
+  }
+}
+
+// Fills a texture with noise, with plenty of fully transparent and fully
+// opaque pixels mixed in.
+static void _tex_fill_noise(texture *tx, ptrdiff_t seed) {
+  size_t i;
+  pixel p;
+  for (i = 0; i < tx->width * tx->height; ++i) {
+    seed = prng(seed);
+    p = (pixel) (seed & 0xffffffff);
+    switch ((seed >> 32) & 0x3) {
+      case 0:
+        px_set_alpha(&p, 0);
+        break;
+      case 1:
+        px_set_alpha(&p, CHANNEL_MAX);
+        break;
+      default:
+        break;
+    }
+    tx->pixels[i] = p;
+  }
+}
+
+// Returns the largest difference between any two corresponding channels of
+// the given textures (which must be the same size).
+static int _tex_max_difference(texture const *a, texture const *b) {
+  size_t i;
+  int d, result = 0;
+  for (i = 0; i < a->width * a->height; ++i) {
+    d = abs(px_red(a->pixels[i]) - px_red(b->pixels[i]));
+    if (d > result) { result = d; }
+    d = abs(px_green(a->pixels[i]) - px_green(b->pixels[i]));
+    if (d > result) { result = d; }
+    d = abs(px_blue(a->pixels[i]) - px_blue(b->pixels[i]));
+    if (d > result) { result = d; }
+    d = abs(px_alpha(a->pixels[i]) - px_alpha(b->pixels[i]));
+    if (d > result) { result = d; }
+  }
+  return result;
+}
+
+// Returns the largest difference between any two corresponding channels of
+// the given pixels.
+static int _tex_px_difference(pixel a, pixel b) {
+  int d, result = abs(px_red(a) - px_red(b));
+  d = abs(px_green(a) - px_green(b));
+  if (d > result) { result = d; }
+  d = abs(px_blue(a) - px_blue(b));
+  if (d > result) { result = d; }
+  d = abs(px_alpha(a) - px_alpha(b));
+  if (d > result) { result = d; }
+  return result;
+}
+
+/******************
+ * Test Functions *
+ ******************/
+
 size_t test_texture_pixels(void) {
   texture * tx = create_texture(3, 3);
   tx_set_px(tx, 0xffffffff, 0, 0);
@@ -59,4 +222,175 @@ size_t test_load_png(void) {
   return 0;
 }
 
+size_t test_tex_draw_golden(void) {
+  texture *src = create_texture(37, 19);
+  texture *dst = create_texture(41, 23);
+  texture *golden = create_texture(41, 23);
+  size_t offset, width;
+  _tex_fill_noise(src, 17);
+  // Different offsets and widths exercise unaligned rows and the leftover
+  // pixels at the end of each row:
+  for (offset = 0; offset < 4; ++offset) {
+    for (width = 1; width <= 37 - offset; width += 3) {
+      _tex_fill_noise(dst, 9183 + offset * 100 + width);
+      tx_paste(golden, dst, 0, 0);
+      _tex_reference_draw(golden, src, offset, 2, offset, 1, width, 17);
+      tx_draw_region(dst, src, offset, 2, offset, 1, width, 17);
+      if (_tex_max_difference(dst, golden) > 1) { return 1; }
+    }
+  }
+  // The whole texture at once:
+  _tex_fill_noise(dst, 5551);
+  tx_paste(golden, dst, 0, 0);
+  _tex_reference_draw(golden, src, 3, 1, 0, 0, 37, 19);
+  tx_draw(dst, src, 3, 1);
+  if (_tex_max_difference(dst, golden) > 1) { return 2; }
+  cleanup_texture(src);
+  cleanup_texture(dst);
+  cleanup_texture(golden);
+  return 0;
+}
+
+size_t test_tex_draw_wrapped_golden(void) {
+  texture *src = create_texture(13, 11);
+  texture *dst = create_texture(32, 32);
+  texture *golden = create_texture(32, 32);
+  size_t left, top;
+  _tex_fill_noise(src, 881);
+  for (left = 0; left < 32; left += 5) {
+    for (top = 0; top < 32; top += 7) {
+      _tex_fill_noise(dst, 71 + left * 32 + top);
+      tx_paste(golden, dst, 0, 0);
+      // Regions that wrap around both textures (more than once for the
+      // source):
+      _tex_reference_draw_wrapped(golden, src, left, top, 4, 9, 30, 25);
+      tx_draw_region_wrapped(dst, src, left, top, 4, 9, 30, 25);
+      if (_tex_max_difference(dst, golden) > 1) { return 1; }
+      _tex_reference_draw_wrapped(golden, src, left, top, 0, 0, 13, 11);
+      tx_draw_wrapped(dst, src, left, top);
+      if (_tex_max_difference(dst, golden) > 1) { return 2; }
+    }
+  }
+  cleanup_texture(src);
+  cleanup_texture(dst);
+  cleanup_texture(golden);
+  return 0;
+}
+
+size_t test_tex_blend_batch(void) {
+  // More than one batch's worth, with some left over:
+  size_t const count = TEST_TEX_BLEND_COUNT;
+  pixel a[TEST_TEX_BLEND_COUNT];
+  pixel b[TEST_TEX_BLEND_COUNT];
+  pixel results[TEST_TEX_BLEND_COUNT];
+  float blends[TEST_TEX_BLEND_COUNT];
+  pixel expect;
+  size_t i;
+  ptrdiff_t seed = 4417;
+  for (i = 0; i < count; ++i) {
+    seed = prng(seed);
+    a[i] = (pixel) (seed & 0xffffffff);
+    b[i] = (pixel) ((seed >> 32) & 0xffffffff);
+    blends[i] = ptrf(prng(seed + 1));
+  }
+  // Some fixed points, including the extremes of the gamut:
+  a[0] = PX_BLACK; b[0] = PX_WHITE; blends[0] = 0.5;
+  a[1] = 0xffff0000; b[1] = 0xff00ff00; blends[1] = 0.25;
+  a[2] = 0xff334455; b[2] = PX_EMPTY; blends[2] = 1.0;
+  a[3] = 0x80808080; b[3] = 0x80808080; blends[3] = 0.0;
+  blend_precisely_batch(a, b, blends, results, count);
+  for (i = 0; i < count; ++i) {
+    expect = blend_precisely(a[i], b[i], blends[i]);
+    if (_tex_px_difference(results[i], expect) > 1) { return 1 + i; }
+  }
+  return 0;
+}
+
+size_t test_tex_cache(void) {
+  char const * const fn = "res/textures/plants/mosses/template-sparse.png";
+  texture *direct, *first, *second;
+  size_t i, count;
+  clear_texture_cache();
+  direct = load_texture_from_png(fn);
+  first = load_cached_texture(fn);
+  if (texture_cache_count() != 1) { return 1; }
+  if (first->width != direct->width || first->height != direct->height) {
+    return 2;
+  }
+  for (i = 0; i < direct->width * direct->height; ++i) {
+    if (first->pixels[i] != direct->pixels[i]) { return 3; }
+  }
+  // Callers get their own copies, which they can change freely:
+  tx_clear(first);
+  second = load_cached_texture(fn);
+  if (second == first || second->pixels == first->pixels) { return 4; }
+  if (texture_cache_count() != 1) { return 5; }
+  for (i = 0; i < direct->width * direct->height; ++i) {
+    if (second->pixels[i] != direct->pixels[i]) { return 6; }
+  }
+  cleanup_texture(first);
+  cleanup_texture(second);
+  // Preloading picks up every template in a directory (without reloading
+  // files that are already cached):
+  preload_textures("res/textures/plants/mosses");
+  count = texture_cache_count();
+  if (count < 10) { return 7; }
+  cleanup_texture(load_cached_texture(fn));
+  if (texture_cache_count() != count) { return 8; }
+  clear_texture_cache();
+  if (texture_cache_count() != 0) { return 9; }
+  // With caching off, nothing is kept:
+  CACHE_TEXTURES = 0;
+  first = load_cached_texture(fn);
+  CACHE_TEXTURES = 1;
+  if (texture_cache_count() != 0) { return 10; }
+  if (first->pixels[0] != direct->pixels[0]) { return 11; }
+  cleanup_texture(first);
+  cleanup_texture(direct);
+  return 0;
+}
+
+// Queued PNG writes should produce the same files as direct ones, whether
+// they're picked up by a job pool worker or by flush_png_writes.
+size_t test_tex_async_png(void) {
+  job_pool *old_pool = JOB_POOL;
+  texture *tx, *loaded;
+  char filename[64];
+  size_t i, j;
+  size_t result = 0;
+  JOB_POOL = create_job_pool(1);
+  for (i = 0; i < TEST_TEX_ASYNC_WRITES; ++i) {
+    tx = create_texture(17 + i, 9);
+    for (j = 0; j < tx->width * tx->height; ++j) {
+      tx->pixels[j] = 0xff000000 | (pixel) prng(j + 31 * i);
+    }
+    sprintf(filename, "out/test/async-%zu.png", i);
+    write_texture_to_png_async(tx, filename);
+  }
+  if (pending_png_writes() != TEST_TEX_ASYNC_WRITES) { result = 1; }
+  // Let the pool write a couple and leave the rest for the flush:
+  jp_run_pending(JOB_POOL, 0, 2);
+  if (result == 0 && pending_png_writes() != TEST_TEX_ASYNC_WRITES - 2) {
+    result = 2;
+  }
+  flush_png_writes();
+  if (result == 0 && pending_png_writes() != 0) { result = 3; }
+  for (i = 0; i < TEST_TEX_ASYNC_WRITES && result == 0; ++i) {
+    sprintf(filename, "out/test/async-%zu.png", i);
+    loaded = load_texture_from_png(filename);
+    if (loaded->width != 17 + i || loaded->height != 9) { result = 4; }
+    for (j = 0; j < loaded->width * loaded->height && result == 0; ++j) {
+      if (loaded->pixels[j] != (0xff000000 | (pixel) prng(j + 31 * i))) {
+        result = 5;
+      }
+    }
+    cleanup_texture(loaded);
+  }
+  // The leftover jobs find nothing to write:
+  jp_run_pending(JOB_POOL, 0, 0);
+  cleanup_job_pool(JOB_POOL);
+  JOB_POOL = old_pool;
+  return result;
+}
+
 #endif //ifndef TEST_TEX_H
@@ -3,14 +3,21 @@
 #define TEST_SUITE_NAME txg_minerals
 #define TEST_SUITE_TESTS { \
     &test_minerals_stone_filter, \
+    &test_minerals_parallel_filter, \
     NULL, \
   }
 
 #ifndef TEST_TXG_MINERALS_H
 #define TEST_TXG_MINERALS_H
 
+#include <string.h>
+
+#include "txgen/txgen.h"
 #include "txgen/txg_minerals.h"
 #include "tex/tex.h"
+#include "noise/noise.h"
+#include "math/functions.h"
+#include "util.h"
 
 #include "unit_tests/test_suite.h"
 
@@ -44,6 +51,189 @@ tx_grammar_literal example_stone_literal = FILTER_TX_LITERAL(
   BLOCK_TEXTURE_SIZE
 );
 
+/******************
+ * Reference Code *
+ ******************/
+
+// The original single-threaded per-pixel mineral filter, kept verbatim as a
+// reference for the row-tiled version:
+static void _reference_mineral(texture *tx, void const * const fargs) {
+  mineral_filter_args *mfargs = (mineral_filter_args *) fargs;
+
+  int row, col; // position within texture
+  float x, y; // distorted/squashed x/y coordinates
+  float alx, aly; // distorted/squashed alternate x/y coordinates
+
+  float scx, scy; // rounded x/y scales
+  float dscx, dscy; // rounded x/y distortion scales
+  float alscx, alscy; // rounded alternate x/y scales
+
+  float wx, wy; // wrap scales
+  float dwx, dwy; // distortion wrap scales
+  float alwx, alwy; // alternate wrap scales
+
+  float ds; // distortion
+  float grit, contours, matrix, bumps, alternate, layers; // noise components
+  float wavescale, layerscale, lphase; // layer phase
+  float snoise; // saturation noise
+  float saturation, value; // color values
+
+  float dontcare;
+
+  // Seeds for the different noise functions:
+  ptrdiff_t seed = prng(mfargs->seed - 5);
+  ptrdiff_t salt1, salt2, salt3, salt4, salt5, salt6, salt7, salt8;
+
+  pixel base_hsv, alt_hsv; // base and alternate colors in hsv
+  pixel hsv; // temp hsv color
+  pixel rgb; // final rgb color
+  base_hsv = rgb__hsv(mfargs->base_color);
+  alt_hsv = rgb__hsv(mfargs->alt_color);
+
+  salt1 = prng(seed + 555);
+  salt2 = prng(salt1);
+  salt3 = prng(salt2);
+  salt4 = prng(salt3);
+  salt5 = prng(salt4);
+  salt6 = prng(salt5);
+  salt7 = prng(salt6);
+  salt8 = prng(salt7);
+
+  // Round all scale values so that the scaled coordinate-space texture
+  // boundaries are integers (for simplex noise wrapping purposes):
+  scx = rounddenom(mfargs->scale*mfargs->squash, tx->width);
+  scy = rounddenom(mfargs->scale/mfargs->squash, tx->height);
+  wx = (float) tx->width * scx;
+  wy = (float) tx->height * scy;
+
+  dscx = rounddenom(mfargs->dscale, tx->width);
+  dscy = rounddenom(mfargs->dscale, tx->height);
+  dwx = tx->width * dscx;
+  dwy = tx->height * dscy;
+
+  alscx = (tx->width/5 + scx*tx->width)/((float) tx->width);
+  alscy = (tx->height/5 + scy*tx->height)/((float) tx->height);
+  alwx = tx->width * alscx;
+  alwy = tx->height * alscy;
+
+  // Loop over each pixel of the texture:
+  for (col = 0; col < tx->width; col += 1) {
+    for (row = 0; row < tx->height; row += 1) {
+      ds = tiled_func(
+        &sxnoise_2d,
+        col * dscx, row * dscy,
+        dwx, dwy,
+        salt1
+      );
+      x = (col + ds * mfargs->distortion) * scx;
+      y = (row + ds * mfargs->distortion) * scy;
+      grit = ptrf(prng(col * col + fastfloor(x) + prng(row + fastfloor(y))));
+      contours = (
+        1 + tiled_func(&sxnoise_2d, x, y, wx, wy, salt2)
+      ) / 2.0;
+      matrix = sqrtf(
+        wrnoise_2d_fancy(
+          x, y, salt3,
+          fastfloor(wx), fastfloor(wy),
+          &dontcare, &dontcare,
+          0
+        )
+      );
+      bumps = sqrtf(
+        wrnoise_2d_fancy(
+          x, y, salt4,
+          fastfloor(wx), fastfloor(wy),
+          &dontcare, &dontcare,
+          WORLEY_FLAG_INCLUDE_NEXTBEST
+        )
+      );
+
+      wavescale = ((float) tx->width) / roundf(1.0 / mfargs->wavescale);
+      lphase = (1.0 + sinf(((float) col) * 2 * M_PI / wavescale)) / 2.0;
+      wavescale = ((float) tx->width) / roundf(3.0 / mfargs->wavescale);
+      lphase += 0.5 * (1.0 + sinf(((float) col) * 2 * M_PI / wavescale)) / 2.0;
+      lphase /= 1.5;
+
+      layerscale = ((float) tx->height) / roundf(1.0 / mfargs->layerscale);
+      lphase = (((float) row) + lphase * mfargs->layerwaves) / layerscale;
+      lphase -= fastfloor(lphase);
+      if (ptrf(salt5) > 0.5) {
+        layers = 1 - expdist(lphase, 2.5);
+      } else {
+        layers = expdist(lphase, 2.5);
+      }
+
+      alx = col * alscx;
+      aly = row * alscy;
+      alternate = wrnoise_2d_fancy(
+        alx, aly, salt6,
+        fastfloor(wx), fastfloor(wy),
+        &dontcare, &dontcare,
+        WORLEY_FLAG_INCLUDE_NEXTBEST
+      ) * (
+        (
+          1 + tiled_func(
+            &sxnoise_2d,
+            alx, aly,
+            alwx, alwy,
+            salt7
+          )
+        ) / 2.0
+      );
+      alternate = sqrtf(alternate);
+
+      // value construction:
+      value = (
+        mfargs->gritty * grit
+      + mfargs->contoured * contours
+      + mfargs->porous * matrix
+      + mfargs->bumpy * bumps
+      ) / (
+        mfargs->gritty
+      + mfargs->contoured
+      + mfargs->porous
+      + mfargs->bumpy
+      );
+      // multiplicative blending for layers:
+      value *= (mfargs->layered) * layers + (1 - mfargs->layered);
+
+      // saturation variance:
+      saturation = (
+        0.7 + 0.3 * tiled_func(
+          &sxnoise_2d,
+          x, y,
+          wx, wy,
+          salt8
+        )
+      );
+      snoise = ptrf(prng(prng(col + fastfloor(x)) + row + fastfloor(y)));
+      saturation = (
+        (1.0 - mfargs->sat_noise) * saturation
+      + mfargs->sat_noise * snoise
+      );
+
+      saturation *= (1 - mfargs->desaturate);
+
+      // figure out the base color:
+      hsv = base_hsv;
+      px_set_sat(&hsv, px_sat(hsv) * saturation);
+      px_set_val(&hsv, CHANNEL_MAX * value);
+      if (alternate > (1 - mfargs->inclusions)) {
+        px_set_hue(&hsv, px_hue(alt_hsv));
+        px_set_sat(&hsv, px_sat(alt_hsv));
+        px_set_val(&hsv, CHANNEL_MAX * alternate);
+      } else if (alternate > (1 - (mfargs->inclusions + 0.05))) {
+        px_set_sat(&hsv, 0.5*px_sat(hsv));
+        px_set_val(&hsv, (px_val(hsv) + CHANNEL_MAX * alternate)/2.0);
+      }
+      rgb = hsv__rgb(hsv);
+      rgb = px_relight(rgb, mfargs->brightness);
+
+      tx_set_px(tx, rgb, col, row);
+    }
+  }
+}
+
 /******************
  * Test Functions *
  ******************/
@@ -58,4 +248,34 @@ size_t test_minerals_stone_filter(void) {
   return 0;
 }
 
+// The mineral filter should produce exactly the same textures as the original
+// per-pixel loop, whether or not it splits its rows across threads, including
+// for sizes that don't divide evenly into row tiles.
+size_t test_minerals_parallel_filter(void) {
+  size_t sizes[] = { BLOCK_TEXTURE_SIZE, 90, 0 };
+  size_t i, bytes;
+  size_t result = 0;
+  texture *reference, *serial, *parallel;
+  for (i = 0; sizes[i] != 0 && result == 0; ++i) {
+    reference = create_texture(sizes[i], sizes[i] - 3);
+    serial = create_texture(sizes[i], sizes[i] - 3);
+    parallel = create_texture(sizes[i], sizes[i] - 3);
+    bytes = reference->width * reference->height * sizeof(pixel);
+    _reference_mineral(reference, &example_stone_args);
+    PARALLEL_TEXTURE_FILTERS = 0;
+    fltr_mineral(serial, &example_stone_args);
+    PARALLEL_TEXTURE_FILTERS = 1;
+    fltr_mineral(parallel, &example_stone_args);
+    if (memcmp(reference->pixels, serial->pixels, bytes)) {
+      result = 2*i + 1;
+    } else if (memcmp(reference->pixels, parallel->pixels, bytes)) {
+      result = 2*i + 2;
+    }
+    cleanup_texture(reference);
+    cleanup_texture(serial);
+    cleanup_texture(parallel);
+  }
+  return result;
+}
+
 #endif //ifndef TEST_TXG_MINERALS_H
@@ -5,14 +5,18 @@
     &test_txgen_template_moss, \
     &test_txgen_scatter_filter_moss, \
     &test_worley_noise, \
+    &test_txgen_parallel_filters, \
     NULL, \
   }
 
 #ifndef TEST_TXGEN_H
 #define TEST_TXGEN_H
 
+#include <string.h>
+
 #include "txgen/txgen.h"
 #include "tex/tex.h"
+#include "noise/noise.h"
 
 #include "unit_tests/test_suite.h"
 
@@ -179,6 +183,52 @@ tx_grammar_literal scattered_moss = {
   .result = NULL
 };
 
+/******************
+ * Reference Code *
+ ******************/
+
+// The original single-threaded per-pixel filters, kept verbatim as references
+// for the row-tiled versions:
+static void _reference_apply_gradient_map(
+  texture *tx,
+  void const * const fargs
+) {
+  int row, col;
+  pixel p;
+  gradient_map *grmap = (gradient_map *) fargs;
+  for (col = 0; col < tx->width; col += 1) {
+    for (row = 0; row < tx->height; row += 1) {
+      p = tx_get_px(tx, col, row);
+      tx_set_px(tx, gradient_map_result(grmap, p), col, row);
+    }
+  }
+}
+
+static void _reference_worley(texture *tx, void const * const fargs) {
+  int row, col;
+  float noise;
+  float dontcare;
+  ptrdiff_t salt;
+  worley_filter_args *wfargs = (worley_filter_args *) fargs;
+  salt = prng(wfargs->seed);
+  for (col = 0; col < tx->width; col += 1) {
+    for (row = 0; row < tx->height; row += 1) {
+      noise = wrnoise_2d_fancy(
+        col * wfargs->freq, row * wfargs->freq, salt,
+        32.0 * wfargs->freq, 32.0 * wfargs->freq,
+        &dontcare, &dontcare,
+        0
+      );
+      tx_set_px(
+        tx,
+        gradient_map_result(wfargs->grmap, noise),
+        col,
+        row
+      );
+    }
+  }
+}
+
 /******************
  * Test Functions *
  ******************/
@@ -210,4 +260,46 @@ size_t test_worley_noise(void) {
   return 0;
 }
 
+// Filters should give exactly the same results as the original per-pixel
+// loops, whether or not they're split across threads (the texture is big
+// enough that even cheap filters use multiple threads).
+size_t test_txgen_parallel_filters(void) {
+  size_t size = 256;
+  size_t bytes = size*size*sizeof(pixel);
+  texture *reference = create_texture(size, size);
+  texture *serial = create_texture(size, size);
+  texture *parallel = create_texture(size, size);
+  size_t result = 0;
+
+  _reference_worley(reference, &worley_test_args);
+  PARALLEL_TEXTURE_FILTERS = 0;
+  fltr_worley(serial, &worley_test_args);
+  PARALLEL_TEXTURE_FILTERS = 1;
+  fltr_worley(parallel, &worley_test_args);
+  if (memcmp(reference->pixels, serial->pixels, bytes)) {
+    result = 1;
+  } else if (memcmp(reference->pixels, parallel->pixels, bytes)) {
+    result = 2;
+  }
+
+  _reference_apply_gradient_map(reference, &worley_test_map);
+  PARALLEL_TEXTURE_FILTERS = 0;
+  fltr_apply_gradient_map(serial, &worley_test_map);
+  PARALLEL_TEXTURE_FILTERS = 1;
+  fltr_apply_gradient_map(parallel, &worley_test_map);
+  if (result == 0 && memcmp(reference->pixels, serial->pixels, bytes)) {
+    result = 3;
+  } else if (
+    result == 0
+ && memcmp(reference->pixels, parallel->pixels, bytes)
+  ) {
+    result = 4;
+  }
+
+  cleanup_texture(reference);
+  cleanup_texture(serial);
+  cleanup_texture(parallel);
+  return result;
+}
+
 #endif //ifndef TEST_TXGEN_H
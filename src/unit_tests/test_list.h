@@ -8,6 +8,10 @@ DEFINE_IMPORTED_BUILDER
 DEFINE_IMPORTED_BUILDER
 #include "suites/test_queue.h"
 DEFINE_IMPORTED_BUILDER
+#include "suites/test_mpmc_queue.h"
+DEFINE_IMPORTED_BUILDER
+#include "suites/test_pool.h"
+DEFINE_IMPORTED_BUILDER
 #include "suites/test_dictionary.h"
 DEFINE_IMPORTED_BUILDER
 #include "suites/test_map.h"
@@ -16,6 +20,12 @@ DEFINE_IMPORTED_BUILDER
 DEFINE_IMPORTED_BUILDER
 #include "suites/test_bitmap.h"
 DEFINE_IMPORTED_BUILDER
+#include "suites/test_jobs.h"
+DEFINE_IMPORTED_BUILDER
+#include "suites/test_ptrace.h"
+DEFINE_IMPORTED_BUILDER
+#include "suites/test_render_set.h"
+DEFINE_IMPORTED_BUILDER
 #include "suites/test_blocks.h"
 DEFINE_IMPORTED_BUILDER
 #include "suites/test_tex.h"
@@ -26,6 +36,8 @@ DEFINE_IMPORTED_BUILDER
 DEFINE_IMPORTED_BUILDER
 #include "suites/test_txg_minerals.h"
 DEFINE_IMPORTED_BUILDER
+#include "suites/test_generation.h"
+DEFINE_IMPORTED_BUILDER
 #include "suites/test_worldgen.h"
 DEFINE_IMPORTED_BUILDER
 #endif // TEST_LIST_DEFINE
@@ -55,6 +67,24 @@ l_append_element(ALL_TEST_SUITES, ts);
 #include "suites/test_dictionary.h"
 ts = INVOKE_IMPORTED_BUILDER;
 l_append_element(ALL_TEST_SUITES, ts);
+#include "suites/test_jobs.h"
+ts = INVOKE_IMPORTED_BUILDER;
+l_append_element(ALL_TEST_SUITES, ts);
+#include "suites/test_ptrace.h"
+ts = INVOKE_IMPORTED_BUILDER;
+l_append_element(ALL_TEST_SUITES, ts);
+#include "suites/test_pool.h"
+ts = INVOKE_IMPORTED_BUILDER;
+l_append_element(ALL_TEST_SUITES, ts);
+#include "suites/test_mpmc_queue.h"
+ts = INVOKE_IMPORTED_BUILDER;
+l_append_element(ALL_TEST_SUITES, ts);
+#include "suites/test_render_set.h"
+ts = INVOKE_IMPORTED_BUILDER;
+l_append_element(ALL_TEST_SUITES, ts);
+#include "suites/test_generation.h"
+ts = INVOKE_IMPORTED_BUILDER;
+l_append_element(ALL_TEST_SUITES, ts);
 /*
 #include "suites/test_worldgen.h"
 ts = INVOKE_IMPORTED_BUILDER;
@@ -23,6 +23,7 @@
 #include "graphics/render.h"
 #include "physics/physics.h"
 #include "data/data.h"
+#include "data/render_set.h"
 #include "tick/tick.h"
 #include "ui/ui.h"
 
@@ -130,7 +131,15 @@ void stage_chunk(chunk *c) {
   );
 #pragma GCC diagnostic warning "-Wint-to-pointer-cast"
 
-  // Clean up the previous chunk:
+  // Swap the new chunk into the render set and clean up the previous chunk:
+  rs_lock(RENDER_SET);
+  if (old_chunk != NULL && old_chunk != c) {
+    ch__coa(old_chunk, &coa);
+    rs_remove(RENDER_SET, &coa);
+  }
+  ch__coa(c, &coa);
+  rs_add(RENDER_SET, &coa);
+  rs_unlock(RENDER_SET);
   if (old_chunk != NULL && old_chunk != c) {
     cleanup_chunk(old_chunk);
   }
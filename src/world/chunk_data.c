@@ -31,6 +31,19 @@ static inline int occludes_face(block neighbor, block occluded) {
   );
 }
 
+// Tests whether the primary block of the given cell of either the given chunk
+// or (if the chunk is NULL) the given approximation is opaque.
+static inline int boundary_cell_is_opaque(
+  chunk *c,
+  chunk_approximation *ca,
+  block_index idx
+) {
+  if (c != NULL) {
+    return b_is_opaque(c_cell(c, idx)->blocks[0]);
+  }
+  return b_is_opaque(ca_cell(ca, idx)->blocks[0]);
+}
+
 /*************
  * Functions *
  *************/
@@ -124,3 +137,66 @@ block compute_cell_exposure(
 
   return result;
 }
+
+chunk_flag compute_opaque_faces(chunk_or_approx *coa) {
+  chunk *c = NULL;
+  chunk_approximation *ca = NULL;
+  chunk_flag result = CF_OPAQUE_FACES;
+  block_index idx;
+  int step = 1;
+  int i, j, last;
+  if (coa->type == CA_TYPE_CHUNK) {
+    c = (chunk *) (coa->ptr);
+  } else if (coa->type == CA_TYPE_APPROXIMATION) {
+    ca = (chunk_approximation *) (coa->ptr);
+    step = 1 << (ca->detail);
+  } else {
+    return 0;
+  }
+  // Every face of a uniform chunk or approximation is the same:
+  if (c != NULL && c_is_uniform(c)) {
+    return b_is_opaque(c->fill.blocks[0]) ? CF_OPAQUE_FACES : 0;
+  } else if (ca != NULL && ca_is_uniform(ca)) {
+    return b_is_opaque(ca->fill.blocks[0]) ? CF_OPAQUE_FACES : 0;
+  }
+  last = CHUNK_SIZE - step;
+  idx.xyz.w = 0;
+  // Each iteration checks one cell on each of the six faces, and we can stop
+  // as soon as every face has a gap in it:
+  for (i = 0; i < CHUNK_SIZE && result; i += step) {
+    for (j = 0; j < CHUNK_SIZE && result; j += step) {
+      // Bottom and top:
+      idx.xyz.x = i;
+      idx.xyz.y = j;
+      idx.xyz.z = 0;
+      if (!boundary_cell_is_opaque(c, ca, idx)) {
+        result &= ~CF_OPAQUE_BELOW;
+      }
+      idx.xyz.z = last;
+      if (!boundary_cell_is_opaque(c, ca, idx)) {
+        result &= ~CF_OPAQUE_ABOVE;
+      }
+      // South and north:
+      idx.xyz.z = j;
+      idx.xyz.y = 0;
+      if (!boundary_cell_is_opaque(c, ca, idx)) {
+        result &= ~CF_OPAQUE_SOUTH;
+      }
+      idx.xyz.y = last;
+      if (!boundary_cell_is_opaque(c, ca, idx)) {
+        result &= ~CF_OPAQUE_NORTH;
+      }
+      // West and east:
+      idx.xyz.y = i;
+      idx.xyz.x = 0;
+      if (!boundary_cell_is_opaque(c, ca, idx)) {
+        result &= ~CF_OPAQUE_WEST;
+      }
+      idx.xyz.x = last;
+      if (!boundary_cell_is_opaque(c, ca, idx)) {
+        result &= ~CF_OPAQUE_EAST;
+      }
+    }
+  }
+  return result;
+}
@@ -23,4 +23,10 @@ block compute_cell_exposure(
   approx_neighborhood *apx_nbh
 );
 
+// Returns the CF_OPAQUE_* flags for each face of the given chunk or
+// approximation whose boundary cells all have opaque primary blocks. Nothing
+// behind such a face can be seen through it, which lets the renderer skip
+// whole chunks that are hidden underground or behind terrain.
+chunk_flag compute_opaque_faces(chunk_or_approx *coa);
+
 #endif // ifndef CHUNK_DATA_H
@@ -47,6 +47,19 @@ static inline int _check_block(
   }
 }
 
+// Points an expansion's target at the given block of a neighborhood for
+// matching. Matching only reads, so uniform chunks aren't expanded here; the
+// chunk and index are kept so that apply_expansion can do that if it writes.
+static inline void _set_target(
+  cg_expansion *cge,
+  chunk_neighborhood *nbh,
+  block_index idx
+) {
+  cge->target_chunk = nb_chunk(nbh, &idx);
+  cge->target_idx = idx;
+  cge->target = c_block(cge->target_chunk, idx);
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -86,6 +99,8 @@ cg_expansion* copy_cell_grammar_expansion(cg_expansion *cge) {
   result->replace = cge->replace;
   result->type = cge->type;
   result->target = cge->target;
+  result->target_chunk = cge->target_chunk;
+  result->target_idx = cge->target_idx;
   for (i = 0; i < l_get_length(cge->children); ++i) {
     l_append_element(
       result->children,
@@ -115,7 +130,6 @@ int check_expansion(
   block_index base,
   block root_block
 ) {
-  cell *cl;
   size_t i;
   int subresult;
   block_index oidx;
@@ -150,22 +164,20 @@ int check_expansion(
   switch (cge->type) {
     default:
     case CGET_BLOCK_RELATIVE:
-      cge->target = nb_block(nbh, cidx_add(base, cge->offset));
+      _set_target(cge, nbh, cidx_add(base, cge->offset));
       b = *(cge->target);
       return _check_block(cge->cmp_strategy, b, compare, cge->cmp_mask);
     case CGET_BLOCK_EXACT:
-      cge->target = &(
-        nb_cell(
-          nbh,
-          cidx_add(base, cge->offset)
-        )->blocks[cge->offset.xyz.w]
-      );
+      oidx = cidx_add(base, cge->offset);
+      oidx.xyz.w = cge->offset.xyz.w;
+      _set_target(cge, nbh, oidx);
       b = *(cge->target);
       return _check_block(cge->cmp_strategy, b, compare, cge->cmp_mask);
     case CGET_BLOCK_EITHER:
-      cl = nb_cell(nbh, cidx_add(base, cge->offset));
+      oidx = cidx_add(base, cge->offset);
       // Try the first block:
-      cge->target = &(cl->blocks[cge->offset.xyz.w]);
+      oidx.xyz.w = cge->offset.xyz.w;
+      _set_target(cge, nbh, oidx);
       b = *(cge->target);
       if ((b & cge->cmp_mask) == compare) {
         return 1;
@@ -174,7 +186,8 @@ int check_expansion(
         return 1;
       }
       // Try the other block:
-      cge->target = &(cl->blocks[cge->offset.xyz.w ^ 1]);
+      oidx.xyz.w ^= 1;
+      _set_target(cge, nbh, oidx);
       b = *(cge->target);
       return _check_block(cge->cmp_strategy, b, compare, cge->cmp_mask);
     case CGET_LOGICAL_AND:
@@ -274,8 +287,12 @@ void apply_expansion(cg_expansion *cge, block root_block) {
         replace &= ~BM_SPECIES;
         replace |= (root_block & BM_SPECIES);
       }
+      // (this expands the target's chunk if it's uniform)
+      cge->target = c_edit_block(cge->target_chunk, cge->target_idx);
       *(cge->target) &= ~(cge->rpl_mask);
       *(cge->target) |= (cge->rpl_mask & cge->replace);
+      // The growth index doesn't know about this write, so it must be rebuilt:
+      c_invalidate_growth_index(cge->target_chunk);
       break;
     case CGET_LOGICAL_AND:
       for(i = 0; i < l_get_length(cge->children); ++i) {
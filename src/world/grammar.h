@@ -88,6 +88,8 @@ struct cg_expansion_s {
   list* children;
   // For use during expansion:
   block* target;
+  chunk* target_chunk; // where a BLOCK-type target lives, so that
+  block_index target_idx; // apply_expansion can get a writable pointer
 };
 
 /******************************
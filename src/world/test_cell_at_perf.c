@@ -0,0 +1,176 @@
+// test_cell_at_perf.c
+// Measures cell_at throughput for random-walk and scattered access patterns
+// across several threads.
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <omp.h>
+
+#include "util.h"
+
+#include "data/data.h"
+
+#include "world.h"
+
+// Size of the loaded area, in chunks:
+#define AREA_XY 8
+#define AREA_Z 4
+
+// Lookups per thread per timing run:
+#define LOOKUPS 1000000
+
+// Each configuration is timed repeatedly until at least this much time has
+// passed:
+#define MIN_SECONDS 0.5
+
+static int const THREAD_COUNTS[] = { 1, 2, 4, 8, 16, 0 };
+
+static gl_pos_t const AREA_BLOCKS_XY = AREA_XY * CHUNK_SIZE;
+static gl_pos_t const AREA_BLOCKS_Z = AREA_Z * CHUNK_SIZE;
+
+// Sums of looked-up block IDs, so the lookups can't be optimized away:
+static uint64_t CHECKSUM = 0;
+
+// cell_at's lookup without any cache (what a reentrant version would cost
+// without per-thread caching):
+static cell* cell_at_uncached(global_pos const * const glpos) {
+  global_chunk_pos glcpos;
+  chunk_or_approx coa;
+  block_index cidx;
+  glpos__glcpos(glpos, &glcpos);
+  glpos__cidx(glpos, &cidx);
+  get_best_data(&glcpos, &coa);
+  if (coa.type == CA_TYPE_CHUNK) {
+    return c_cell((chunk *) (coa.ptr), cidx);
+  }
+  return NULL;
+}
+
+// Steps through the area like a ray or a moving entity: mostly single-block
+// moves with the occasional jump somewhere else.
+static uint64_t random_walk(
+  cell* (*lookup)(global_pos const * const),
+  ptrdiff_t seed
+) {
+  size_t i;
+  uint64_t sum = 0;
+  global_pos pos;
+  cell *cl;
+  pos.x = AREA_BLOCKS_XY / 2;
+  pos.y = AREA_BLOCKS_XY / 2;
+  pos.z = AREA_BLOCKS_Z / 2;
+  pos.w = 0;
+  for (i = 0; i < LOOKUPS; ++i) {
+    seed = prng(seed);
+    if ((seed & 0xff) == 0) {
+      pos.x = posmod(prng(seed + 1), AREA_BLOCKS_XY);
+      pos.y = posmod(prng(seed + 2), AREA_BLOCKS_XY);
+      pos.z = posmod(prng(seed + 3), AREA_BLOCKS_Z);
+    } else {
+      pos.x = posmod(pos.x + ((seed >> 8) % 3) - 1, AREA_BLOCKS_XY);
+      pos.y = posmod(pos.y + ((seed >> 10) % 3) - 1, AREA_BLOCKS_XY);
+      pos.z = posmod(pos.z + ((seed >> 12) % 3) - 1, AREA_BLOCKS_Z);
+    }
+    cl = lookup(&pos);
+    if (cl != NULL) {
+      sum += b_id(cl->blocks[0]);
+    }
+  }
+  return sum;
+}
+
+// Looks up uniformly scattered positions (the worst case for any cache).
+static uint64_t scattered(
+  cell* (*lookup)(global_pos const * const),
+  ptrdiff_t seed
+) {
+  size_t i;
+  uint64_t sum = 0;
+  global_pos pos;
+  cell *cl;
+  pos.w = 0;
+  for (i = 0; i < LOOKUPS; ++i) {
+    seed = prng(seed);
+    pos.x = posmod(seed, AREA_BLOCKS_XY);
+    pos.y = posmod(seed >> 16, AREA_BLOCKS_XY);
+    pos.z = posmod(seed >> 32, AREA_BLOCKS_Z);
+    cl = lookup(&pos);
+    if (cl != NULL) {
+      sum += b_id(cl->blocks[0]);
+    }
+  }
+  return sum;
+}
+
+static void bench(
+  char const * const name,
+  uint64_t (*pattern)(cell* (*)(global_pos const * const), ptrdiff_t),
+  cell* (*lookup)(global_pos const * const),
+  int n_threads
+) {
+  size_t reps = 0;
+  double start, elapsed;
+  start = omp_get_wtime();
+  do {
+#pragma omp parallel num_threads(n_threads)
+    {
+      uint64_t sum = pattern(lookup, 1771 + 31 * omp_get_thread_num() + reps);
+      __atomic_add_fetch(&CHECKSUM, sum, __ATOMIC_RELAXED);
+    }
+    reps += 1;
+    elapsed = omp_get_wtime() - start;
+  } while (elapsed < MIN_SECONDS);
+  printf(
+    "%-24s %3d thread(s) %7.1f ns/lookup %12.0f lookups/s\n",
+    name,
+    n_threads,
+    elapsed * 1000000000.0 / (reps * LOOKUPS),
+    (1.0 * reps * LOOKUPS * n_threads) / elapsed
+  );
+}
+
+int main(int argc, char** argv) {
+  size_t i;
+  global_chunk_pos glcpos;
+  chunk *c;
+  omp_set_dynamic(0);
+  setup_data();
+
+  printf(
+    "Filling the chunk cache with %dx%dx%d chunks...\n",
+    AREA_XY,
+    AREA_XY,
+    AREA_Z
+  );
+  for (glcpos.x = 0; glcpos.x < AREA_XY; ++glcpos.x) {
+    for (glcpos.y = 0; glcpos.y < AREA_XY; ++glcpos.y) {
+      for (glcpos.z = 0; glcpos.z < AREA_Z; ++glcpos.z) {
+        c = create_chunk(&glcpos);
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+        m3_put_value(
+          CHUNK_CACHE->levels[LOD_BASE],
+          (void *) c,
+          (map_key_t) glcpos.x,
+          (map_key_t) glcpos.y,
+          (map_key_t) glcpos.z
+        );
+#pragma GCC diagnostic warning "-Wint-to-pointer-cast"
+      }
+    }
+  }
+  invalidate_cell_at_caches();
+
+  for (i = 0; THREAD_COUNTS[i] != 0; ++i) {
+    bench("walk (uncached)", &random_walk, &cell_at_uncached, THREAD_COUNTS[i]);
+    bench("walk (cell_at)", &random_walk, &cell_at, THREAD_COUNTS[i]);
+  }
+  for (i = 0; THREAD_COUNTS[i] != 0; ++i) {
+    bench("scatter (uncached)", &scattered, &cell_at_uncached, THREAD_COUNTS[i]);
+    bench("scatter (cell_at)", &scattered, &cell_at, THREAD_COUNTS[i]);
+  }
+  printf("(checksum %lu)\n", (unsigned long) CHECKSUM);
+
+  cleanup_data();
+  return 0;
+}
@@ -0,0 +1,307 @@
+// test_chunk_pool_perf.c
+// Soak test for chunk memory: simulates a long flight across the world,
+// loading and unloading chunks and approximations (and churning their vertex
+// data) around a wandering viewpoint, and reports peak and steady-state RSS
+// with and without the chunk pools.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <omp.h>
+
+#include "prof/pmem.h"
+
+#include "world.h"
+
+// Loaded data extends this many chunks from the viewpoint horizontally (as a
+// square) and is this many chunks tall:
+#define VIEW_RADIUS 9
+#define VIEW_HEIGHT 3
+
+// Chebyshev distances out to which each level of detail is loaded:
+static int const LOD_RADII[N_LODS] = { 2, 4, 6, 8, 9 };
+
+// Number of steps in the flight, and the step after which RSS is considered
+// to have settled:
+#define FLIGHT_STEPS 2000
+#define SETTLE_STEP 500
+
+// Chance (out of 100) that the viewpoint changes direction at each step, and
+// that any given loaded chunk is recompiled at each step:
+#define TURN_CHANCE 8
+#define RECOMPILE_CHANCE 2
+
+// Chance (out of 100) that a chunk or approximation is uniform:
+#define UNIFORM_CHANCE 40
+
+// Largest simulated vertex cache for a full chunk, in vertices (caches for
+// approximations are scaled down by their level of detail):
+#define MAX_VERTICES 32768
+
+// The edge of the ring of slots holding loaded data. Each loaded position has
+// exactly one slot, so positions entering the view replace those leaving it.
+#define RING (2 * VIEW_RADIUS + 1)
+
+/**************
+ * Structures *
+ **************/
+
+struct soak_slot_s {
+  global_chunk_pos glcpos;
+  lod detail; // N_LODS if the slot is empty
+  void *ptr;
+};
+typedef struct soak_slot_s soak_slot;
+
+struct soak_result_s {
+  double seconds;
+  size_t peak_rss, steady_rss, final_rss, unloaded_rss, max_rss;
+};
+typedef struct soak_result_s soak_result;
+
+/*******************
+ * Private Globals *
+ *******************/
+
+static soak_slot SLOTS[RING][RING][VIEW_HEIGHT];
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Current resident set size in bytes:
+static size_t current_rss(void) {
+  long pages = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  if (fscanf(f, "%*d %ld", &pages) != 1) {
+    pages = 0;
+  }
+  fclose(f);
+  return (size_t) pages * (size_t) sysconf(_SC_PAGESIZE);
+}
+
+static inline int ring_index(gl_cpos_t x) {
+  return ((x % RING) + RING) % RING;
+}
+
+static inline uint32_t position_hash(global_chunk_pos const * const glcpos) {
+  uint32_t h = (uint32_t) glcpos->x * 73856093u;
+  h ^= (uint32_t) glcpos->y * 19349663u;
+  h ^= (uint32_t) glcpos->z * 83492791u;
+  h ^= h >> 13;
+  h *= 0x5bd1e995u;
+  return h ^ (h >> 15);
+}
+
+// Fills the given vertex buffer's data caches with a random amount of
+// garbage, the way compiling a chunk would (freeing any old caches first).
+static void fake_compile(vertex_buffer *vb, lod detail) {
+  size_t count = 1 + rand() % (MAX_VERTICES >> (detail * 2));
+  reset_vertex_buffer(vb);
+  vb->vdata = (vertex*) malloc(sizeof(vertex) * count);
+  vb->idata = (vb_index*) malloc(sizeof(vb_index) * count * 3 / 2);
+  if (vb->vdata == NULL || vb->idata == NULL) {
+    perror("Failed to allocate vertex data.");
+    exit(errno);
+  }
+  vb->vdata[count - 1].x = 0;
+  vb->idata[count * 3 / 2 - 1] = 0;
+  vb->allocated = 1;
+}
+
+// Creates and fills in data for the given position. Non-uniform data gets a
+// full cell array with a few cells changed, and a compiled opaque layer.
+static void *load(global_chunk_pos *glcpos, lod detail) {
+  uint32_t h = position_hash(glcpos);
+  uint8_t uniform = (h % 100) < UNIFORM_CHANCE;
+  cell fill;
+  block_index idx;
+  chunk *c;
+  chunk_approximation *ca;
+  fill.blocks[0] = b_make_block(uniform ? B_STONE : B_DIRT);
+  fill.blocks[1] = b_make_block(B_VOID);
+  idx.xyz.x = h & CH_MASK;
+  idx.xyz.y = (h >> CHUNK_BITS) & CH_MASK;
+  idx.xyz.z = (h >> (2 * CHUNK_BITS)) & CH_MASK;
+  idx.xyz.w = 0;
+  if (detail == LOD_BASE) {
+    c = create_chunk(glcpos);
+    c_make_uniform(c, &fill);
+    if (!uniform) {
+      c_edit_cell(c, idx)->blocks[0] = b_make_block(B_AIR);
+      fake_compile(&(c->layers[L_OPAQUE]), detail);
+    }
+    return c;
+  }
+  ca = create_chunk_approximation(glcpos, detail);
+  ca_make_uniform(ca, &fill);
+  if (!uniform) {
+    ca_edit_cell(ca, idx)->blocks[0] = b_make_block(B_AIR);
+    fake_compile(&(ca->layers[L_OPAQUE]), detail);
+  }
+  return ca;
+}
+
+static void unload(soak_slot *slot) {
+  if (slot->detail == LOD_BASE) {
+    cleanup_chunk((chunk*) slot->ptr);
+  } else if (slot->detail < N_LODS) {
+    cleanup_chunk_approximation((chunk_approximation*) slot->ptr);
+  }
+  slot->detail = N_LODS;
+  slot->ptr = NULL;
+}
+
+// Brings every slot up to date for a viewpoint at the given chunk position,
+// and recompiles a few of the slots that didn't change.
+static void update_view(gl_cpos_t cx, gl_cpos_t cy) {
+  gl_cpos_t x, y, z, d;
+  lod detail;
+  soak_slot *slot;
+  for (x = cx - VIEW_RADIUS; x <= cx + VIEW_RADIUS; ++x) {
+    for (y = cy - VIEW_RADIUS; y <= cy + VIEW_RADIUS; ++y) {
+      d = abs(x - cx) > abs(y - cy) ? abs(x - cx) : abs(y - cy);
+      for (detail = LOD_BASE; LOD_RADII[detail] < d; ++detail) {}
+      for (z = 0; z < VIEW_HEIGHT; ++z) {
+        slot = &(SLOTS[ring_index(x)][ring_index(y)][z]);
+        if (
+          slot->detail == detail
+       && slot->glcpos.x == x
+       && slot->glcpos.y == y
+        ) {
+          if (detail < N_LODS && (rand() % 100) < RECOMPILE_CHANCE) {
+            if (detail == LOD_BASE) {
+              fake_compile(&(((chunk*) slot->ptr)->layers[L_OPAQUE]), detail);
+            } else {
+              fake_compile(
+                &(((chunk_approximation*) slot->ptr)->layers[L_OPAQUE]),
+                detail
+              );
+            }
+          }
+          continue;
+        }
+        unload(slot);
+        slot->glcpos.x = x;
+        slot->glcpos.y = y;
+        slot->glcpos.z = z;
+        slot->detail = detail;
+        if (detail < N_LODS) {
+          slot->ptr = load(&(slot->glcpos), detail);
+        }
+      }
+    }
+  }
+}
+
+// Flies around for a while and reports memory use. Runs in a child process
+// so that each configuration starts from a fresh heap.
+static void soak(soak_result *result) {
+  size_t step, rss, steady_total = 0;
+  int i, j, k;
+  gl_cpos_t cx = 0, cy = 0;
+  int dx = 1, dy = 0;
+  double start;
+  struct rusage usage;
+
+  srand(17);
+  for (i = 0; i < RING; ++i) {
+    for (j = 0; j < RING; ++j) {
+      for (k = 0; k < VIEW_HEIGHT; ++k) {
+        SLOTS[i][j][k].detail = N_LODS;
+        SLOTS[i][j][k].ptr = NULL;
+      }
+    }
+  }
+
+  result->peak_rss = 0;
+  start = omp_get_wtime();
+  for (step = 0; step < FLIGHT_STEPS; ++step) {
+    if ((rand() % 100) < TURN_CHANCE) {
+      dx = (rand() % 3) - 1;
+      dy = (rand() % 3) - 1;
+      if (dx == 0 && dy == 0) {
+        dx = 1;
+      }
+    }
+    cx += dx;
+    cy += dy;
+    update_view(cx, cy);
+    rss = current_rss();
+    if (rss > result->peak_rss) {
+      result->peak_rss = rss;
+    }
+    if (step >= SETTLE_STEP) {
+      steady_total += rss;
+    }
+  }
+  result->seconds = omp_get_wtime() - start;
+  result->steady_rss = steady_total / (FLIGHT_STEPS - SETTLE_STEP);
+  result->final_rss = current_rss();
+
+  if (CHUNK_POOLING) {
+    print_chunk_pool_stats(stdout);
+  }
+
+  for (i = 0; i < RING; ++i) {
+    for (j = 0; j < RING; ++j) {
+      for (k = 0; k < VIEW_HEIGHT; ++k) {
+        unload(&(SLOTS[i][j][k]));
+      }
+    }
+  }
+  result->unloaded_rss = current_rss();
+  getrusage(RUSAGE_SELF, &usage);
+  result->max_rss = (size_t) usage.ru_maxrss * 1024;
+}
+
+static void run(char const * const name, uint8_t pooling, uint8_t trimming) {
+  soak_result result;
+  pid_t child;
+  fflush(stdout);
+  child = fork();
+  if (child < 0) {
+    perror("Failed to fork soak test.");
+    exit(errno);
+  } else if (child == 0) {
+    CHUNK_POOLING = pooling;
+    CHUNK_POOL_TRIMMING = trimming;
+    soak(&result);
+    printf(
+      "%-16s %6.2f s | RSS MB: peak %7.1f, steady %7.1f, final %7.1f, "
+      "after unload %7.1f (max %7.1f)\n",
+      name,
+      result.seconds,
+      result.peak_rss / (1024.0 * 1024.0),
+      result.steady_rss / (1024.0 * 1024.0),
+      result.final_rss / (1024.0 * 1024.0),
+      result.unloaded_rss / (1024.0 * 1024.0),
+      result.max_rss / (1024.0 * 1024.0)
+    );
+    fflush(stdout);
+    exit(EXIT_SUCCESS);
+  }
+  waitpid(child, NULL, 0);
+}
+
+int main(int argc, char** argv) {
+  init_blocks();
+  printf(
+    "Flying %d steps with %dx%dx%d chunks loaded:\n",
+    FLIGHT_STEPS,
+    RING,
+    RING,
+    VIEW_HEIGHT
+  );
+  run("heap", 0, 0);
+  run("pools", 1, 0);
+  run("pools (trimmed)", 1, 1);
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
+#include <errno.h>
 // DEBUG
 #include <stdio.h>
 
@@ -20,7 +21,11 @@
 // Macros for defining a get/paste_cell functions at different scales:
 #define CA_CELL_DEF(BITS) \
   CA_CELL_SIG(CA_CELL_FN(BITS)) { \
-    return &(ca->data->d ## BITS.cells[ \
+    approx_data *data = __atomic_load_n(&(ca->data), __ATOMIC_ACQUIRE); \
+    if (data == NULL) { \
+      return (cell*) &(ca->fill); /* uniform */ \
+    } \
+    return &(data->d ## BITS.cells[ \
       ((idx->xyz.x & CH_MASK) >> BITS) + \
       (((idx->xyz.y & CH_MASK) >> BITS) << (CHUNK_BITS - BITS)) + \
       (((idx->xyz.z & CH_MASK) >> BITS) << ((CHUNK_BITS - BITS)*2)) \
@@ -29,27 +34,213 @@
 
 #define CA_PASTE_CELL_DEF(BITS) \
   CA_PASTE_CELL_SIG(CA_PASTE_CELL_FN(BITS)) { \
-    cell *dst = CA_CELL_FN(BITS)(ca, idx); \
+    cell *dst; \
+    if (ca_is_uniform(ca)) { \
+      ca_expand_cells((chunk_approximation*) ca); \
+    } \
+    dst = CA_CELL_FN(BITS)(ca, idx); \
     copy_cell(cl, dst); \
   }
 
+/*************
+ * Constants *
+ *************/
+
+// Initial number of entries allocated for a chunk's growth index:
+#define GROWTH_INDEX_INITIAL_CAPACITY 64
+
+// How many chunk lookups each thread's cell_at cache remembers:
+#define CELL_AT_CACHE_SIZE 8
+
+// How many empty slabs each chunk pool keeps around for reuse:
+#define CHUNK_POOL_MAX_IDLE 4
+
+/**************
+ * Structures *
+ **************/
+
+struct cell_at_cache_entry_s {
+  global_chunk_pos glcpos;
+  chunk_or_approx coa;
+};
+typedef struct cell_at_cache_entry_s cell_at_cache_entry;
+
+// Every thread that calls cell_at registers one of these, so that evictions
+// can wait until it's done with the pointers it looked up:
+struct cell_at_reader_s {
+  uint64_t quiesced; // CELL_AT_GENERATION at the last cell_at_quiesce
+  struct cell_at_reader_s *next;
+};
+typedef struct cell_at_reader_s cell_at_reader;
+
+/***********
+ * Globals *
+ ***********/
+
+uint8_t CHUNK_POOLING = 1;
+uint8_t CHUNK_POOL_TRIMMING = 1;
+
+slab_pool *CHUNK_POOL = NULL;
+slab_pool *CHUNK_APPROX_POOL = NULL;
+slab_pool *CELL_DATA_POOLS[N_LODS] = { NULL, NULL, NULL, NULL, NULL };
+
+/*******************
+ * Private Globals *
+ *******************/
+
+// Each thread keeps its own cell_at cache, valid only while its generation
+// matches CELL_AT_GENERATION (which starts at 1, so new threads start out
+// invalid):
+static __thread cell_at_cache_entry CELL_AT_CACHE[CELL_AT_CACHE_SIZE];
+static __thread uint64_t CELL_AT_CACHE_GENERATION = 0;
+static __thread size_t CELL_AT_CACHE_COUNT = 0;
+static __thread size_t CELL_AT_CACHE_LAST = 0; // most recently used entry
+static __thread size_t CELL_AT_CACHE_NEXT = 0; // next entry to replace
+
+// The calling thread's reader record, and a list of all of them (records are
+// never freed; there's one per thread that has ever called cell_at):
+static __thread cell_at_reader *CELL_AT_READER = NULL;
+static cell_at_reader *CELL_AT_READERS = NULL;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// The position of a block in a full chunk scan (x, then y, then z, then w).
+static inline uint32_t growth_scan_key(block_index idx) {
+  return (
+    (
+      (
+        ((uint32_t) idx.xyz.x << CHUNK_BITS)
+      | (uint32_t) idx.xyz.y
+      ) << CHUNK_BITS
+    | (uint32_t) idx.xyz.z
+    ) << 1
+  ) | (uint32_t) idx.xyz.w;
+}
+
+static int growth_scan_order(void const *a, void const *b) {
+  uint32_t ka = growth_scan_key(*((block_index const *) a));
+  uint32_t kb = growth_scan_key(*((block_index const *) b));
+  return (ka > kb) - (ka < kb);
+}
+
+static inline void growth_index_append(growth_index *gi, block_index idx) {
+  if (gi->count == gi->capacity) {
+    gi->capacity = (
+      gi->capacity == 0 ? GROWTH_INDEX_INITIAL_CAPACITY : gi->capacity * 2
+    );
+    gi->entries = (block_index*) realloc(
+      gi->entries,
+      gi->capacity * sizeof(block_index)
+    );
+    if (gi->entries == NULL) {
+      perror("Failed to grow chunk growth index.");
+      exit(errno);
+    }
+  }
+  gi->entries[gi->count] = idx;
+  gi->count += 1;
+}
+
+// The number of cells stored by a full approximation at the given detail:
+static inline size_t approx_cell_count(lod detail) {
+  return 1 << ((CHUNK_BITS - detail) * 3);
+}
+
+// Creates the chunk pools if they don't exist yet. CHUNK_POOL is set last, so
+// once it's visible every other pool is too.
+static void setup_chunk_pools(void) {
+  lod i;
+#pragma omp critical (chunk_pools)
+  {
+    if (CHUNK_POOL == NULL) {
+      CHUNK_APPROX_POOL = create_slab_pool(
+        "approximations",
+        sizeof(chunk_approximation),
+        CHUNK_POOL_MAX_IDLE,
+        CHUNK_POOL_TRIMMING
+      );
+      CELL_DATA_POOLS[LOD_BASE] = create_slab_pool(
+        "chunk cells",
+        sizeof(cell) * TOTAL_CHUNK_CELLS,
+        CHUNK_POOL_MAX_IDLE,
+        CHUNK_POOL_TRIMMING
+      );
+      for (i = LOD_BASE + 1; i < N_LODS; ++i) {
+        CELL_DATA_POOLS[i] = create_slab_pool(
+          "approximation cells",
+          sizeof(cell) * approx_cell_count(i),
+          CHUNK_POOL_MAX_IDLE,
+          CHUNK_POOL_TRIMMING
+        );
+      }
+      __atomic_store_n(
+        &CHUNK_POOL,
+        create_slab_pool(
+          "chunks",
+          sizeof(chunk),
+          CHUNK_POOL_MAX_IDLE,
+          CHUNK_POOL_TRIMMING
+        ),
+        __ATOMIC_RELEASE
+      );
+    }
+  }
+}
+
+// Allocates memory for chunk data from the given pool, or from the heap if
+// CHUNK_POOLING is off:
+static inline void * chunk_mem_alloc(slab_pool **pool, size_t size) {
+  void *result;
+  if (CHUNK_POOLING) {
+    if (__atomic_load_n(&CHUNK_POOL, __ATOMIC_ACQUIRE) == NULL) {
+      setup_chunk_pools();
+    }
+    result = sp_alloc(*pool);
+  } else {
+    result = malloc(size);
+  }
+  if (result == NULL) {
+    perror("Failed to allocate chunk memory.");
+    exit(errno);
+  }
+  return result;
+}
+
+static inline void chunk_mem_free(slab_pool *pool, void *ptr) {
+  if (CHUNK_POOLING) {
+    sp_free(pool, ptr);
+  } else {
+    free(ptr);
+  }
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
 
 chunk * create_chunk(global_chunk_pos const * const glcpos) {
-  chunk *c = (chunk *) malloc(sizeof(chunk));
+  chunk *c = (chunk *) chunk_mem_alloc(&CHUNK_POOL, sizeof(chunk));
   c->type = CA_TYPE_CHUNK;
   c->glcpos.x = glcpos->x;
   c->glcpos.y = glcpos->y;
   c->glcpos.z = glcpos->z;
   c->chunk_flags = 0;
   c->growth_counter = 0;
+  c->growing.entries = NULL;
+  c->growing.count = 0;
+  c->growing.capacity = 0;
+  c->growing.valid = 0; // cell data isn't initialized yet
+  c->growing.sorted = 1;
   layer ly;
   for (ly = 0; ly < N_LAYERS; ++ly) {
     setup_vertex_buffer(&(c->layers[ly]));
   }
   c->cell_entities = create_list(LIST_DEFAULT_LARGE_CHUNK_SIZE);
+  c->fill.blocks[0] = b_make_block(B_VOID);
+  c->fill.blocks[1] = b_make_block(B_VOID);
+  c->cells = &(c->fill);
   return c;
 }
 
@@ -65,14 +256,19 @@ void cleanup_chunk(chunk *c) {
     cleanup_vertex_buffer(&(c->layers[ly]));
   }
   destroy_list(c->cell_entities);
-  free(c);
+  free(c->growing.entries);
+  if (!c_is_uniform(c)) {
+    chunk_mem_free(CELL_DATA_POOLS[LOD_BASE], c->cells);
+  }
+  chunk_mem_free(CHUNK_POOL, c);
 }
 
 chunk_approximation * create_chunk_approximation(
   global_chunk_pos *glcpos,
   lod detail
 ) {
-  chunk_approximation *ca = (chunk_approximation *) malloc(
+  chunk_approximation *ca = (chunk_approximation *) chunk_mem_alloc(
+    &CHUNK_APPROX_POOL,
     sizeof(chunk_approximation)
   );
   ca->type = CA_TYPE_APPROXIMATION;
@@ -85,15 +281,9 @@ chunk_approximation * create_chunk_approximation(
     setup_vertex_buffer(&(ca->layers[ly]));
   }
   ca->detail = detail;
-  if (detail == LOD_HALF) {
-    ca->data = (approx_data *) malloc(sizeof(APPROX_DATA_STRUCT(1)));
-  } else if (detail == LOD_QUARTER) {
-    ca->data = (approx_data *) malloc(sizeof(APPROX_DATA_STRUCT(2)));
-  } else if (detail == LOD_EIGHTH) {
-    ca->data = (approx_data *) malloc(sizeof(APPROX_DATA_STRUCT(3)));
-  } else if (detail == LOD_SIXTEENTH) {
-    ca->data = (approx_data *) malloc(sizeof(APPROX_DATA_STRUCT(4)));
-  }
+  ca->data = NULL;
+  ca->fill.blocks[0] = b_make_block(B_VOID);
+  ca->fill.blocks[1] = b_make_block(B_VOID);
   return ca;
 }
 
@@ -105,17 +295,180 @@ void cleanup_chunk_approximation(chunk_approximation *ca) {
   }
 #endif
   layer ly;
-  free(ca->data);
+  if (ca->data != NULL) {
+    chunk_mem_free(CELL_DATA_POOLS[ca->detail], ca->data);
+  }
   for (ly = 0; ly < N_LAYERS; ++ly) {
     cleanup_vertex_buffer(&(ca->layers[ly]));
   }
-  free(ca);
+  chunk_mem_free(CHUNK_APPROX_POOL, ca);
 }
 
 /*************
  * Functions *
  *************/
 
+void c_make_uniform(chunk *c, cell const * const fill) {
+  cell *old = NULL;
+#ifdef DEBUG
+  if (c->chunk_flags & CF_LOADED) {
+    fprintf(stderr, "Error: can't make a loaded chunk uniform.\n");
+    exit(EXIT_FAILURE);
+  }
+#endif
+  if (!c_is_uniform(c)) {
+    old = c->cells;
+  }
+  copy_cell(fill, &(c->fill));
+  __atomic_store_n(&(c->cells), &(c->fill), __ATOMIC_RELEASE);
+  if (old != NULL) {
+    chunk_mem_free(CELL_DATA_POOLS[LOD_BASE], old);
+  }
+  // Either there's nothing to grow or the whole chunk grows:
+  if (bi_grws(fill->blocks[0]) || bi_grws(fill->blocks[1])) {
+    c_invalidate_growth_index(c);
+  } else {
+    c_reset_growth_index(c);
+  }
+}
+
+void c_expand_cells(chunk *c) {
+  size_t i;
+  cell *cells;
+  if (!c_is_uniform(c)) {
+    return;
+  }
+  cells = (cell*) chunk_mem_alloc(
+    &(CELL_DATA_POOLS[LOD_BASE]),
+    sizeof(cell) * TOTAL_CHUNK_CELLS
+  );
+  for (i = 0; i < TOTAL_CHUNK_CELLS; ++i) {
+    copy_cell(&(c->fill), &(cells[i]));
+  }
+  // Readers on other threads might be using the fill cell, which stays where
+  // it is; they'll see the array once it's filled in:
+  __atomic_store_n(&(c->cells), cells, __ATOMIC_RELEASE);
+}
+
+uint8_t c_compact_cells(chunk *c) {
+  size_t i;
+  cell fill;
+  if (c_is_uniform(c)) {
+    return 1;
+  }
+  for (i = 1; i < TOTAL_CHUNK_CELLS; ++i) {
+    if (
+      c->cells[i].blocks[0] != c->cells[0].blocks[0]
+   || c->cells[i].blocks[1] != c->cells[0].blocks[1]
+    ) {
+      return 0;
+    }
+  }
+  copy_cell(&(c->cells[0]), &fill);
+  c_make_uniform(c, &fill);
+  return 1;
+}
+
+void ca_make_uniform(chunk_approximation *ca, cell const * const fill) {
+  approx_data *old = ca->data;
+#ifdef DEBUG
+  if (ca->chunk_flags & CF_LOADED) {
+    fprintf(stderr, "Error: can't make a loaded approximation uniform.\n");
+    exit(EXIT_FAILURE);
+  }
+#endif
+  copy_cell(fill, &(ca->fill));
+  __atomic_store_n(&(ca->data), NULL, __ATOMIC_RELEASE);
+  if (old != NULL) {
+    chunk_mem_free(CELL_DATA_POOLS[ca->detail], old);
+  }
+}
+
+void ca_expand_cells(chunk_approximation *ca) {
+  size_t i, count;
+  cell *cells;
+  if (!ca_is_uniform(ca)) {
+    return;
+  }
+  count = approx_cell_count(ca->detail);
+  cells = (cell*) chunk_mem_alloc(
+    &(CELL_DATA_POOLS[ca->detail]),
+    sizeof(cell) * count
+  );
+  for (i = 0; i < count; ++i) {
+    copy_cell(&(ca->fill), &(cells[i]));
+  }
+  // (see c_expand_cells)
+  __atomic_store_n(&(ca->data), (approx_data*) cells, __ATOMIC_RELEASE);
+}
+
+void c_note_growing_block(chunk *c, block_index idx) {
+  growth_index *gi = &(c->growing);
+  if (!gi->valid) {
+    return;
+  }
+  if (
+    gi->sorted
+  && gi->count > 0
+  && growth_scan_key(gi->entries[gi->count - 1]) >= growth_scan_key(idx)
+  ) {
+    gi->sorted = 0;
+  }
+  growth_index_append(gi, idx);
+}
+
+void c_refresh_growth_index(chunk *c) {
+  growth_index *gi = &(c->growing);
+  block_index idx;
+  cell *cl;
+  uint32_t i, kept;
+  if (!gi->valid) {
+    c_reset_growth_index(c);
+    if (
+      c_is_uniform(c)
+   && !bi_grws(c->fill.blocks[0])
+   && !bi_grws(c->fill.blocks[1])
+    ) {
+      return;
+    }
+    for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
+      for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
+        for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
+          cl = c_cell(c, idx);
+          idx.xyz.w = 0;
+          if (bi_grws(cl->blocks[0])) {
+            growth_index_append(gi, idx);
+          }
+          idx.xyz.w = 1;
+          if (bi_grws(cl->blocks[1])) {
+            growth_index_append(gi, idx);
+          }
+        }
+      }
+    }
+    return;
+  }
+  if (!gi->sorted) {
+    qsort(gi->entries, gi->count, sizeof(block_index), &growth_scan_order);
+    gi->sorted = 1;
+  }
+  // Drop duplicates and blocks that have stopped growing:
+  kept = 0;
+  for (i = 0; i < gi->count; ++i) {
+    if (
+      bi_grws(*c_block(c, gi->entries[i]))
+    && (
+        kept == 0
+     || gi->entries[kept - 1].combined != gi->entries[i].combined
+      )
+    ) {
+      gi->entries[kept] = gi->entries[i];
+      kept += 1;
+    }
+  }
+  gi->count = kept;
+}
+
 // Macro-based definitions of the various approximate cell manipulation
 // routines:
 CA_CELL_DEF(1)
@@ -133,39 +486,101 @@ DECLARE_APPROX_FN_VARIANTS_TABLE(CA_CELL_SIG, CA_CELL_FN)
 DECLARE_APPROX_FN_VARIANTS_TABLE(CA_PASTE_CELL_SIG, CA_PASTE_CELL_FN)
 
 
-uint8_t CELL_AT_SALT = 0;
+uint64_t CELL_AT_GENERATION = 1;
+
+// Registers the calling thread as a cell_at reader. It counts as not having
+// quiesced at all until its first cell_at_quiesce, and it's registered before
+// its first lookup, so it can't pick up anything that's already being retired
+// without holding up the free.
+static void register_cell_at_reader(void) {
+  cell_at_reader *r = (cell_at_reader*) malloc(sizeof(cell_at_reader));
+  if (r == NULL) {
+    perror("Failed to allocate cell_at reader.");
+    exit(errno);
+  }
+  r->quiesced = 0;
+  r->next = __atomic_load_n(&CELL_AT_READERS, __ATOMIC_RELAXED);
+  while (
+    !__atomic_compare_exchange_n(
+      &CELL_AT_READERS,
+      &(r->next),
+      r,
+      1,
+      __ATOMIC_SEQ_CST,
+      __ATOMIC_RELAXED
+    )
+  ) {}
+  CELL_AT_READER = r;
+}
+
+// Looks up the chunk or approximation for the given position in the calling
+// thread's cell_at cache, falling back to get_best_data.
+static inline void cell_at_lookup(
+  global_chunk_pos const * const glcpos,
+  chunk_or_approx *coa
+) {
+  size_t i;
+  cell_at_cache_entry *e;
+  uint64_t generation;
+  if (CELL_AT_READER == NULL) {
+    register_cell_at_reader();
+  }
+  generation = __atomic_load_n(&CELL_AT_GENERATION, __ATOMIC_SEQ_CST);
+  if (generation != CELL_AT_CACHE_GENERATION) {
+    CELL_AT_CACHE_GENERATION = generation;
+    CELL_AT_CACHE_COUNT = 0;
+    CELL_AT_CACHE_LAST = 0;
+    CELL_AT_CACHE_NEXT = 0;
+  }
+  // Consecutive lookups usually hit the same chunk, so check that one first:
+  if (CELL_AT_CACHE_COUNT > 0) {
+    e = &(CELL_AT_CACHE[CELL_AT_CACHE_LAST]);
+    if (
+      e->glcpos.x == glcpos->x
+   && e->glcpos.y == glcpos->y
+   && e->glcpos.z == glcpos->z
+    ) {
+      coa->type = e->coa.type;
+      coa->ptr = e->coa.ptr;
+      return;
+    }
+  }
+  for (i = 0; i < CELL_AT_CACHE_COUNT; ++i) {
+    e = &(CELL_AT_CACHE[i]);
+    if (
+      e->glcpos.x == glcpos->x
+   && e->glcpos.y == glcpos->y
+   && e->glcpos.z == glcpos->z
+    ) {
+      coa->type = e->coa.type;
+      coa->ptr = e->coa.ptr;
+      CELL_AT_CACHE_LAST = i;
+      return;
+    }
+  }
+  // A miss: look it up (get_best_data takes the chunk cache locks) and
+  // remember the result, replacing entries round-robin:
+  get_best_data((global_chunk_pos*) glcpos, coa);
+  i = CELL_AT_CACHE_NEXT;
+  CELL_AT_CACHE_NEXT = (CELL_AT_CACHE_NEXT + 1) % CELL_AT_CACHE_SIZE;
+  if (CELL_AT_CACHE_COUNT < CELL_AT_CACHE_SIZE) {
+    CELL_AT_CACHE_COUNT += 1;
+  }
+  e = &(CELL_AT_CACHE[i]);
+  copy_glcpos(glcpos, &(e->glcpos));
+  e->coa.type = coa->type;
+  e->coa.ptr = coa->ptr;
+  CELL_AT_CACHE_LAST = i;
+}
+
 cell* cell_at(global_pos const * const glpos) {
   global_chunk_pos glcpos;
-  static global_chunk_pos last_glcpos = { .x = 0, .y = 0, .z = 0 };
   chunk_or_approx coa;
-  static chunk_or_approx last_coa = { .type=CA_TYPE_NOT_LOADED, .ptr=NULL };
   block_index cidx;
-  static uint8_t last_salt = 1;
 
   glpos__glcpos(glpos, &glcpos);
   glpos__cidx(glpos, &cidx);
-  if (
-    last_salt == CELL_AT_SALT
-  &&
-    last_coa.type != CA_TYPE_NOT_LOADED
-  &&
-    last_glcpos.x == glcpos.x
-  &&
-    last_glcpos.y == glcpos.y
-  &&
-    last_glcpos.z == glcpos.z
-  ) {
-    // We can use the cached chunk pointer!
-    coa.type = last_coa.type;
-    coa.ptr = last_coa.ptr;
-  } else {
-    // We need to recompute our chunk pointer.
-    get_best_data(&glcpos, &coa);
-    last_coa.type = coa.type;
-    last_coa.ptr = coa.ptr;
-  }
-  copy_glcpos(&glcpos, &last_glcpos);
-  last_salt = CELL_AT_SALT;
+  cell_at_lookup(&glcpos, &coa);
   if (coa.type == CA_TYPE_CHUNK) {
     return c_cell((chunk *) (coa.ptr), cidx);
   } else if (coa.type == CA_TYPE_APPROXIMATION) {
@@ -174,12 +589,39 @@ cell* cell_at(global_pos const * const glpos) {
   return NULL;
 }
 
+void cell_at_quiesce(void) {
+  if (CELL_AT_READER != NULL) {
+    __atomic_store_n(
+      &(CELL_AT_READER->quiesced),
+      __atomic_load_n(&CELL_AT_GENERATION, __ATOMIC_SEQ_CST),
+      __ATOMIC_SEQ_CST
+    );
+  }
+}
+
+int cell_at_quiesced(uint64_t generation) {
+  cell_at_reader *r;
+  for (
+    r = __atomic_load_n(&CELL_AT_READERS, __ATOMIC_SEQ_CST);
+    r != NULL;
+    r = r->next
+  ) {
+    if (__atomic_load_n(&(r->quiesced), __ATOMIC_SEQ_CST) < generation) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 size_t chunk_data_size(chunk *c) {
-  return sizeof(cell) * CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+  if (c_is_uniform(c)) {
+    return sizeof(cell);
+  }
+  return sizeof(cell) * TOTAL_CHUNK_CELLS;
 }
 
 size_t chunk_overhead_size(chunk *c) {
-  return sizeof(chunk) - chunk_data_size(c);
+  return sizeof(chunk) - sizeof(cell); // the fill cell counts as data
 }
 
 size_t chunk_gpu_size(chunk *c) {
@@ -193,7 +635,9 @@ size_t chunk_gpu_size(chunk *c) {
 }
 
 size_t chunk_approx_data_size(chunk_approximation *ca) {
-  if (ca->detail == LOD_BASE) {
+  if (ca_is_uniform(ca)) {
+    return sizeof(cell);
+  } else if (ca->detail == LOD_BASE) {
     fprintf(stderr, "Error: found approx with base LOD.\n");
     exit(EXIT_FAILURE);
   } else if (ca->detail == LOD_HALF) {
@@ -215,7 +659,7 @@ size_t chunk_approx_data_size(chunk_approximation *ca) {
 }
 
 size_t chunk_approx_overhead_size(chunk_approximation *ca) {
-  return sizeof(chunk_approximation);
+  return sizeof(chunk_approximation) - sizeof(cell);
 }
 
 size_t chunk_approx_gpu_size(chunk_approximation *ca) {
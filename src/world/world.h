@@ -20,6 +20,7 @@
 #include "datatypes/list.h"
 #include "datatypes/map.h"
 #include "datatypes/octree.h"
+#include "datatypes/pool.h"
 #include "graphics/vbo.h"
 
 /**********
@@ -130,6 +131,10 @@ typedef uint16_t chunk_flag;
 struct chunk_s;
 typedef struct chunk_s chunk;
 
+// A compact list of the blocks in a chunk that can grow (see bi_grws):
+struct growth_index_s;
+typedef struct growth_index_s growth_index;
+
 // Holds (a) lower-resolution representation(s) of a chunk:
 struct chunk_approximation_s;
 typedef struct chunk_approximation_s chunk_approximation;
@@ -187,6 +192,17 @@ static chunk_flag const     CF_COMPILE_ON_LOAD = 0x0008;
 static chunk_flag const      CF_QUEUED_TO_LOAD = 0x0010;
 static chunk_flag const   CF_QUEUED_TO_COMPILE = 0x0020;
 static chunk_flag const   CF_QUEUED_FOR_BIOGEN = 0x0040;
+// Set at compile time for each face whose boundary cells are all opaque, so
+// that nothing can be seen through that face (see compute_opaque_faces):
+static chunk_flag const       CF_OPAQUE_ABOVE = 0x0080;
+static chunk_flag const       CF_OPAQUE_BELOW = 0x0100;
+static chunk_flag const       CF_OPAQUE_NORTH = 0x0200;
+static chunk_flag const       CF_OPAQUE_SOUTH = 0x0400;
+static chunk_flag const        CF_OPAQUE_EAST = 0x0800;
+static chunk_flag const        CF_OPAQUE_WEST = 0x1000;
+#define CF_OPAQUE_FACES (CF_OPAQUE_ABOVE | CF_OPAQUE_BELOW \
+                       | CF_OPAQUE_NORTH | CF_OPAQUE_SOUTH \
+                       | CF_OPAQUE_EAST | CF_OPAQUE_WEST)
 
 // The index of the central member in a 3x3x3 neighborhood:
 static int const NBH_CENTER = 13;
@@ -195,6 +211,28 @@ static int const NBH_DIR_UD = 1;
 static int const NBH_DIR_NS = 3;
 static int const NBH_DIR_EW = 9;
 
+/***********
+ * Globals *
+ ***********/
+
+// Whether chunks, approximations, and their cell data are allocated from slab
+// pools instead of the heap. Pooled memory goes back to the OS as chunks are
+// unloaded, where the heap tends to fragment and stay at its high-water mark.
+// Must not be changed while any chunks or approximations exist.
+extern uint8_t CHUNK_POOLING;
+
+// Whether the chunk pools release the pages of the slabs they keep around for
+// reuse (see create_slab_pool). Only takes effect when the pools are created.
+extern uint8_t CHUNK_POOL_TRIMMING;
+
+// The pools themselves (NULL until the first chunk or approximation is
+// created): one for chunk structs, one for approximation structs, and one
+// for the cell data of each level of detail (the LOD_BASE entry holds full
+// chunk cell arrays).
+extern slab_pool *CHUNK_POOL;
+extern slab_pool *CHUNK_APPROX_POOL;
+extern slab_pool *CELL_DATA_POOLS[N_LODS];
+
 /*************************
  * Structure Definitions *
  *************************/
@@ -225,16 +263,29 @@ union block_index_u {
 // (16 * 16 * 16) * 32 = 131072 bits = 16 KB
 // (16 * 16 * 16) * 64 = 262144 bits = 32 KB
 // (32 * 32 * 32) * 64 = 2097152 bits = 256 KB <-
+struct growth_index_s {
+  block_index *entries; // indices of blocks that can grow
+  uint32_t count; // how many entries are in use
+  uint32_t capacity; // how many entries are allocated
+  uint8_t valid; // if zero, entries must be rebuilt from cell data before use
+  uint8_t sorted; // whether entries are in the order a full chunk scan uses
+};
+
 struct chunk_s {
   capprox_type type; // Always CA_TYPE_CHUNK
   global_chunk_pos glcpos; // Absolute location.
   vertex_buffer layers[N_LAYERS]; // The vertex buffers.
   chunk_flag chunk_flags; // Flags
   size_t growth_counter; // Cumulative growth cycles experienced by this chunk
+  growth_index growing; // Blocks that can grow (see grow_plants)
 
   list *cell_entities; // Cell entities.
   // TODO: merge these?
-  cell cells[TOTAL_CHUNK_CELLS]; // Cells.
+  // Cells. For a uniform chunk this points at the fill cell below, and
+  // otherwise to TOTAL_CHUNK_CELLS cells. Whether a chunk is uniform is
+  // decided by this pointer alone, so one load gives a consistent view of it.
+  cell *cells;
+  cell fill; // The value of every cell in a uniform chunk.
 };
 
 struct chunk_approximation_s {
@@ -244,7 +295,8 @@ struct chunk_approximation_s {
   chunk_flag chunk_flags; // Flags
 
   lod detail; // The highest level of approximation contained here.
-  approx_data *data; // Approximate cell data.
+  approx_data *data; // Approximate cell data (NULL when uniform).
+  cell fill; // The value of every cell in a uniform approximation.
 };
 
 struct chunk_or_approx_s {
@@ -456,14 +508,46 @@ static inline block_index cidx_add(
 // Indexing functions:
 // These must be super-fast 'cause they crop up in all sorts of inner loops.
 
+// Uniform storage: a chunk whose cells are all the same only stores one cell.
+// Reading through c_cell and c_block works either way, but the pointers they
+// return for a uniform chunk all point to the same cell, so code that writes
+// cells must use c_edit_cell or c_edit_block (or c_paste_cell) instead, which
+// expand a uniform chunk into a full cell array first. Expanding is safe
+// while other threads are reading the chunk (the fill cell they may be
+// looking at stays put), but turning a chunk back into a uniform one frees
+// its cell array, so that's only allowed before the chunk is loaded.
+
+static inline uint8_t c_is_uniform(chunk const * const c) {
+  return __atomic_load_n(&(c->cells), __ATOMIC_ACQUIRE) == &(c->fill);
+}
+
+// Turns the given chunk into a uniform chunk filled with the given cell,
+// freeing its cell array if it has one. Also updates the growth index. The
+// chunk must not be CF_LOADED yet, since other threads may be reading it.
+void c_make_uniform(chunk *c, cell const * const fill);
+
+// Gives a uniform chunk a full cell array (with every cell set to the fill
+// value). Does nothing to chunks that aren't uniform.
+void c_expand_cells(chunk *c);
+
+// Checks whether every cell of the given chunk is the same and if so turns it
+// into a uniform chunk. Returns 1 if the chunk ends up uniform. Like
+// c_make_uniform, this is only for chunks that aren't CF_LOADED yet.
+uint8_t c_compact_cells(chunk *c);
+
 static inline cell* c_cell(
   chunk *c,
   block_index idx
 ) {
-  return &(c->cells[
-    (((int) idx.xyz.x) & CH_MASK) +
-    ((((int) idx.xyz.y) & CH_MASK) << CHUNK_BITS) +
-    ((((int) idx.xyz.z) & CH_MASK) << (CHUNK_BITS*2))
+  // Every index picks out the fill cell of a uniform chunk:
+  cell *cells = __atomic_load_n(&(c->cells), __ATOMIC_ACQUIRE);
+  uint32_t mask = cells == &(c->fill) ? 0 : TOTAL_CHUNK_CELLS - 1;
+  return &(cells[
+    (
+      (((int) idx.xyz.x) & CH_MASK) +
+      ((((int) idx.xyz.y) & CH_MASK) << CHUNK_BITS) +
+      ((((int) idx.xyz.z) & CH_MASK) << (CHUNK_BITS*2))
+    ) & mask
   ]);
 }
 
@@ -474,40 +558,64 @@ static inline block* c_block(
   return &(c_cell(c, idx)->blocks[idx.xyz.w]);
 }
 
+static inline cell* c_edit_cell(
+  chunk *c,
+  block_index idx
+) {
+  if (c_is_uniform(c)) {
+    c_expand_cells(c);
+  }
+  return c_cell(c, idx);
+}
+
+static inline block* c_edit_block(
+  chunk *c,
+  block_index idx
+) {
+  return &(c_edit_cell(c, idx)->blocks[idx.xyz.w]);
+}
+
 static inline void c_paste_cell(
   chunk *c,
   block_index idx,
   cell *cl
 ) {
-  cell *dst = c_cell(c, idx);
+  cell *dst = c_edit_cell(c, idx);
   copy_cell(cl, dst);
 }
 
-// Picks out a cell from a chunk neighborhood based on an extended chunk index.
-static inline cell* nb_cell(chunk_neighborhood *nbh, block_index idx) {
+// Picks out the member of a chunk neighborhood that contains the given
+// extended chunk index, and adjusts the index to be relative to that member.
+static inline chunk* nb_chunk(chunk_neighborhood *nbh, block_index *idx) {
   size_t nb_i = NBH_CENTER; // default is central chunk of the neighborhood
-  if (idx.xyz.x < 0) {
-    idx.xyz.x += CHUNK_SIZE;
+  if (idx->xyz.x < 0) {
+    idx->xyz.x += CHUNK_SIZE;
     nb_i -= 9;
-  } else if (idx.xyz.x >= CHUNK_SIZE) {
-    idx.xyz.x -= CHUNK_SIZE;
+  } else if (idx->xyz.x >= CHUNK_SIZE) {
+    idx->xyz.x -= CHUNK_SIZE;
     nb_i += 9;
   }
-  if (idx.xyz.y < 0) {
-    idx.xyz.y += CHUNK_SIZE;
+  if (idx->xyz.y < 0) {
+    idx->xyz.y += CHUNK_SIZE;
     nb_i -= 3;
-  } else if (idx.xyz.y >= CHUNK_SIZE) {
-    idx.xyz.y -= CHUNK_SIZE;
+  } else if (idx->xyz.y >= CHUNK_SIZE) {
+    idx->xyz.y -= CHUNK_SIZE;
     nb_i += 3;
   }
-  if (idx.xyz.z < 0) {
-    idx.xyz.z += CHUNK_SIZE;
+  if (idx->xyz.z < 0) {
+    idx->xyz.z += CHUNK_SIZE;
     nb_i -= 1;
-  } else if (idx.xyz.z >= CHUNK_SIZE) {
-    idx.xyz.z -= CHUNK_SIZE;
+  } else if (idx->xyz.z >= CHUNK_SIZE) {
+    idx->xyz.z -= CHUNK_SIZE;
     nb_i += 1;
   }
-  return c_cell(nbh->members[nb_i], idx);
+  return nbh->members[nb_i];
+}
+
+// Picks out a cell from a chunk neighborhood based on an extended chunk index.
+static inline cell* nb_cell(chunk_neighborhood *nbh, block_index idx) {
+  chunk *c = nb_chunk(nbh, &idx);
+  return c_cell(c, idx);
 }
 
 static inline block* nb_block(chunk_neighborhood *nbh, block_index idx) {
@@ -515,41 +623,42 @@ static inline block* nb_block(chunk_neighborhood *nbh, block_index idx) {
   return &(cl->blocks[idx.xyz.w]);
 }
 
+// Versions of nb_cell and nb_block for writing (see c_edit_cell):
+static inline cell* nb_edit_cell(chunk_neighborhood *nbh, block_index idx) {
+  chunk *c = nb_chunk(nbh, &idx);
+  return c_edit_cell(c, idx);
+}
+
+static inline block* nb_edit_block(chunk_neighborhood *nbh, block_index idx) {
+  cell *cl = nb_edit_cell(nbh, idx);
+  return &(cl->blocks[idx.xyz.w]);
+}
+
 // General utility functions:
 
 static inline void c_erase_cell_data(chunk *c) {
-  memset(
-    c->cells,
-    0,
-    TOTAL_CHUNK_CELLS * sizeof(cell)
-  );
+  cell empty = { .blocks = { 0, 0 } };
+  c_make_uniform(c, &empty);
 }
 
 static inline void c_fill_with_block(chunk *c, block b) {
-  block_index idx = { .xyz = { .x = 0, .y = 0, .z = 0, .w=0 } };
-  c_erase_cell_data(c);
-  for (idx.xyz.x = 0; idx.xyz.x < CHUNK_SIZE; ++idx.xyz.x) {
-    for (idx.xyz.y = 0; idx.xyz.y < CHUNK_SIZE; ++idx.xyz.y) {
-      for (idx.xyz.z = 0; idx.xyz.z < CHUNK_SIZE; ++idx.xyz.z) {
-        *c_block(c, idx) = b;
-      }
-    }
-  }
+  cell fill = { .blocks = { b, 0 } };
+  c_make_uniform(c, &fill);
 }
 
 /******************************
  * Constructors & Destructors *
  ******************************/
 
-// Allocates and initializes a new chunk at the given position. Allocates but
-// does not initialize the chunk's cell data.
+// Allocates and initializes a new chunk at the given position. The new chunk
+// is uniform (filled with B_VOID) and gets a cell array when first written to.
 chunk * create_chunk(global_chunk_pos const * const glcpos);
 
 // Cleans up memory allocated for the given chunk.
 void cleanup_chunk(chunk *c);
 
 // Allocates and initializes a new chunk approximation at the given position
-// with the given level of detail.
+// with the given level of detail. Like a new chunk, it starts out uniform.
 chunk_approximation * create_chunk_approximation(
   global_chunk_pos *glcpos,
   lod detail
@@ -562,6 +671,43 @@ void cleanup_chunk_approximation(chunk_approximation *ca);
  * Functions *
  *************/
 
+// Growth index maintenance. Code that rewrites every cell of a chunk should
+// reset its growth index first and then note each growing block it writes,
+// in scan order if possible. Code that changes cells without noting growing
+// blocks must invalidate the index, which then gets rebuilt by scanning the
+// chunk the next time it's needed.
+static inline void c_invalidate_growth_index(chunk *c) {
+  c->growing.valid = 0;
+}
+
+static inline void c_reset_growth_index(chunk *c) {
+  c->growing.count = 0;
+  c->growing.valid = 1;
+  c->growing.sorted = 1;
+}
+
+// Adds the given block to the chunk's growth index (does nothing if the
+// index is invalid anyway). The block should be one that bi_grws.
+void c_note_growing_block(chunk *c, block_index idx);
+
+// Makes sure that the chunk's growth index is valid and in scan order
+// (rebuilding or sorting it as necessary). Also drops entries for blocks
+// that no longer grow.
+void c_refresh_growth_index(chunk *c);
+
+// Uniform storage for approximations works just like it does for chunks
+// (see c_make_uniform): ca_cell returns the fill cell for every index of a
+// uniform approximation, writes must go through ca_edit_cell or
+// ca_paste_cell, and ca_make_uniform is only for approximations that aren't
+// CF_LOADED yet.
+static inline uint8_t ca_is_uniform(chunk_approximation const * const ca) {
+  return __atomic_load_n(&(ca->data), __ATOMIC_ACQUIRE) == NULL;
+}
+
+void ca_make_uniform(chunk_approximation *ca, cell const * const fill);
+
+void ca_expand_cells(chunk_approximation *ca);
+
 // Getting/putting approximate cells within a chunk approximation:
 DECLARE_APPROX_FN_VARIANTS(CA_CELL_SIG, CA_CELL_FN)
 DECLARE_APPROX_FN_VARIANTS(CA_PASTE_CELL_SIG, CA_PASTE_CELL_FN)
@@ -575,6 +721,16 @@ static inline cell* ca_cell(
   return ca_cell_table[ca->detail](ca, &idx);
 }
 
+static inline cell* ca_edit_cell(
+  chunk_approximation *ca,
+  block_index idx
+) {
+  if (ca_is_uniform(ca)) {
+    ca_expand_cells(ca);
+  }
+  return ca_cell_table[ca->detail](ca, &idx);
+}
+
 // Picks out a cell from an approximate neighborhood based on an extended chunk
 // index. Returns NULL if it is within an unloaded chunk.
 static inline cell* nb_approx_cell(
@@ -616,17 +772,31 @@ static inline cell* nb_approx_cell(
 
 // cell_at returns the cell at the given global position according to the best
 // available currently-loaded data, returning NULL if there is no data loaded
-// for that position. Note that this will cache the chunk used and re-use it
-// when possible, subject to changes in the value of CELL_AT_SALT, so
-// refresh_cell_at_cache should be called before any set of calls to cell_at to
-// ensure that you don't use stale cell data or worse, an invalid chunk
-// pointer.
-extern uint8_t CELL_AT_SALT;
-static inline void refresh_cell_at_cache(void) {
-  CELL_AT_SALT += 1; // overflow is fine
+// for that position. It's safe to call from any thread: each thread caches
+// its last few chunk lookups, and those caches are dropped whenever
+// CELL_AT_GENERATION changes. The data subsystem calls
+// invalidate_cell_at_caches whenever it replaces a chunk or approximation in
+// the chunk cache, but it doesn't free the old one until every thread that
+// has called cell_at has since called cell_at_quiesce (see
+// cell_at_quiesced). So a returned cell pointer stays good until the calling
+// thread's next cell_at_quiesce, and it must not be written through (see
+// c_edit_cell). Threads that use cell_at must call cell_at_quiesce regularly
+// at points where they hold no such pointers, or evicted data will pile up.
+extern uint64_t CELL_AT_GENERATION;
+static inline uint64_t invalidate_cell_at_caches(void) {
+  return __atomic_add_fetch(&CELL_AT_GENERATION, 1, __ATOMIC_SEQ_CST);
 }
 cell* cell_at(global_pos const * const glpos);
 
+// Declares that the calling thread no longer holds any pointers it got from
+// cell_at (nor any chunk pointers it looked up from the chunk cache).
+void cell_at_quiesce(void);
+
+// Returns 1 if every thread that has called cell_at has called
+// cell_at_quiesce since CELL_AT_GENERATION reached the given generation (so
+// data retired at that generation can be freed), or 0 otherwise.
+int cell_at_quiesced(uint64_t generation);
+
 // These inline functions call cell_at for neighboring cells:
 static inline cell* cell_above(global_pos const * const glpos) {
   global_pos above;
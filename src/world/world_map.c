@@ -1,15 +1,13 @@
 // world_map.c
 // World map structure definition.
 
-#ifdef DEBUG
-  #include <stdio.h>
-#endif
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "noise/noise.h"
 
 #include "datatypes/list.h"
-#include "datatypes/queue.h"
-#include "datatypes/map.h"
 
 #include "gen/terrain.h"
 #include "gen/geology.h"
@@ -26,6 +24,172 @@
 // The globally-accessible world:
 world_map* THE_WORLD;
 
+/*********************
+ * Private Functions *
+ *********************/
+
+// Takes idle flood-fill state from the given world map's pool (creating new
+// state if none is available) and readies it for a new search.
+static wm_flood *_begin_flood(world_map *wm) {
+  wm_flood *fl;
+  l_lock(wm->idle_floods);
+  fl = (wm_flood*) l_pop_element(wm->idle_floods);
+  l_unlock(wm->idle_floods);
+  if (fl == NULL) {
+    fl = create_wm_flood(wm);
+  }
+  fl->generation += 1;
+  if (fl->generation == 0) {
+    // The stamps have wrapped around; clear them so that old stamps can't be
+    // mistaken for new ones:
+    memset(fl->stamps, 0, fl->capacity * sizeof(uint32_t));
+    fl->generation = 1;
+  }
+  fl->head = 0;
+  fl->count = 0;
+  return fl;
+}
+
+// Returns the given flood-fill state to the given world map's pool.
+static void _end_flood(world_map *wm, wm_flood *fl) {
+  l_lock(wm->idle_floods);
+  l_append_element(wm->idle_floods, fl);
+  l_unlock(wm->idle_floods);
+}
+
+// Adds the region at the given position to the open ring unless it's outside
+// the map or has already been visited during this search.
+static inline void _flood_visit(
+  world_map *wm,
+  wm_flood *fl,
+  world_map_pos *wmpos
+) {
+  world_region *wr = get_world_region(wm, wmpos);
+  size_t idx;
+  if (wr == NULL) {
+    return;
+  }
+  idx = wr - wm->regions;
+  if (fl->stamps[idx] == fl->generation) {
+    return;
+  }
+  fl->stamps[idx] = fl->generation;
+  // Each region is added at most once per search, so this can't overflow:
+  fl->open[(fl->head + fl->count) % fl->capacity] = wr;
+  fl->count += 1;
+}
+
+// Visits the neighbors of the given region.
+// TODO: This has always visited (x+1, y-1) and (x+1, y+1) rather than
+// (x, y-1) and (x, y+1); fixing that will change generated worlds.
+static inline void _flood_visit_neighbors(
+  world_map *wm,
+  wm_flood *fl,
+  world_region *wr
+) {
+  world_map_pos wmpos;
+  wmpos.x = wr->pos.x + 1;
+  wmpos.y = wr->pos.y;
+  _flood_visit(wm, fl, &wmpos);
+  wmpos.x -= 2;
+  _flood_visit(wm, fl, &wmpos);
+  wmpos.x += 2;
+  wmpos.y -= 1;
+  _flood_visit(wm, fl, &wmpos);
+  wmpos.y += 2;
+  _flood_visit(wm, fl, &wmpos);
+}
+
+// Removes and returns the oldest region in the open ring (which must not be
+// empty).
+static inline world_region *_flood_pop(wm_flood *fl) {
+  world_region *result = fl->open[fl->head];
+  fl->head = (fl->head + 1) % fl->capacity;
+  fl->count -= 1;
+  return result;
+}
+
+// Shuffles the open ring (using the same generator as q_shuffle).
+static void _flood_shuffle(wm_flood *fl, ptrdiff_t seed) {
+  size_t i, j;
+  ptrdiff_t rng = seed;
+  world_region *phased;
+  world_region **a, **b;
+  if (fl->count < 2) {
+    return;
+  }
+  for (i = fl->count - 1; i > 0; --i) {
+    rng = (rng * 39181 + 19991); // <- both are primes
+    j = rng % (i+1);
+    a = &(fl->open[(fl->head + i) % fl->capacity]);
+    b = &(fl->open[(fl->head + j) % fl->capacity]);
+    phased = *a;
+    *a = *b;
+    *b = phased;
+  }
+}
+
+// Quantizes the share of a two-way merge that goes to the first region into
+// one of WM_BIOME_CACHE_WEIGHT_STEPS steps.
+static inline uint32_t _merge_weight(float str1, float str2) {
+  float share;
+  if (str1 + str2 == 0) {
+    return WM_BIOME_CACHE_WEIGHT_STEPS; // create_merged_biome uses 100% wr1
+  }
+  share = str1 / (str1 + str2);
+  if (share <= 0) {
+    return 0;
+  } else if (share >= 1) {
+    return WM_BIOME_CACHE_WEIGHT_STEPS;
+  }
+  return (uint32_t) (share * WM_BIOME_CACHE_WEIGHT_STEPS + 0.5);
+}
+
+// Finds the cache entry for the given merge, returning NULL if there isn't
+// one. The cache must be locked.
+static inline biome_cache_entry* _find_merged_biome(
+  biome_cache *bc,
+  world_region *wr1,
+  world_region *wr2,
+  uint32_t weight
+) {
+  size_t i;
+  biome_cache_entry *e;
+  for (i = 0; i < WM_BIOME_CACHE_SIZE; ++i) {
+    e = &(bc->entries[i]);
+    if (
+      e->merged != NULL
+   && e->wr1 == wr1
+   && e->wr2 == wr2
+   && e->weight == weight
+    ) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+// Picks an entry to hold a new merged biome: an empty entry if there is one,
+// or else the least-recently-used entry that nobody is holding. Returns NULL
+// if every entry is in use. The cache must be locked.
+static inline biome_cache_entry* _pick_biome_cache_slot(biome_cache *bc) {
+  size_t i;
+  biome_cache_entry *e, *result = NULL;
+  for (i = 0; i < WM_BIOME_CACHE_SIZE; ++i) {
+    e = &(bc->entries[i]);
+    if (e->merged == NULL) {
+      return e;
+    }
+    if (
+      e->refs == 0
+   && (result == NULL || e->last_used < result->last_used)
+    ) {
+      result = e;
+    }
+  }
+  return result;
+}
+
 /******************************
  * Constructors & Destructors *
  ******************************/
@@ -58,10 +222,16 @@ world_map *create_world_map(ptrdiff_t seed, wm_pos_t width, wm_pos_t height) {
   result->all_biomes = create_list();
   result->all_civs = create_list();
 
+  result->idle_floods = create_list();
+  result->merged_biomes = create_biome_cache();
+
   return result;
 }
 
 void cleanup_world_map(world_map *wm) {
+  l_foreach(wm->idle_floods, &cleanup_v_wm_flood);
+  cleanup_list(wm->idle_floods);
+  cleanup_biome_cache(wm->merged_biomes);
   // most of these don't need special cleanup beyond a free()
   destroy_list(wm->all_strata);
   destroy_list(wm->all_water);
@@ -73,6 +243,25 @@ void cleanup_world_map(world_map *wm) {
   free(wm);
 }
 
+wm_flood *create_wm_flood(world_map *wm) {
+  wm_flood *result = (wm_flood*) malloc(sizeof(wm_flood));
+  result->generation = 0;
+  result->capacity = wm->width * wm->height;
+  result->stamps = (uint32_t*) calloc(result->capacity, sizeof(uint32_t));
+  result->open = (world_region**) malloc(
+    result->capacity * sizeof(world_region*)
+  );
+  result->head = 0;
+  result->count = 0;
+  return result;
+}
+
+CLEANUP_IMPL(wm_flood) {
+  free(doomed->stamps);
+  free(doomed->open);
+  free(doomed);
+}
+
 biome* create_biome(biome_category category) {
   biome *result = (biome*) malloc(sizeof(biome));
   result->category = category;
@@ -162,6 +351,125 @@ biome* create_merged_biome(
   return result;
 }
 
+biome_cache* create_biome_cache(void) {
+  biome_cache *result = (biome_cache*) calloc(1, sizeof(biome_cache));
+  if (result == NULL) {
+    perror("Failed to allocate merged biome cache");
+    exit(errno);
+  }
+  omp_init_lock(&(result->lock));
+  return result;
+}
+
+CLEANUP_IMPL(biome_cache) {
+  size_t i;
+  for (i = 0; i < WM_BIOME_CACHE_SIZE; ++i) {
+    if (doomed->entries[i].merged != NULL) {
+#ifdef DEBUG
+      if (doomed->entries[i].refs > 0) {
+        fprintf(
+          stderr,
+          "Warning: Cleaning up a merged biome that's still in use.\n"
+        );
+      }
+#endif
+      cleanup_biome(doomed->entries[i].merged);
+    }
+  }
+  omp_destroy_lock(&(doomed->lock));
+  free(doomed);
+}
+
+biome* acquire_merged_biome(
+  world_map *wm,
+  world_region *wr1,
+  world_region *wr2,
+  float str1,
+  float str2
+) {
+  biome_cache *bc = wm->merged_biomes;
+  biome_cache_entry *e;
+  biome *fresh, *evicted = NULL;
+  uint32_t weight = _merge_weight(str1, str2);
+
+  omp_set_lock(&(bc->lock));
+  bc->clock += 1;
+  e = _find_merged_biome(bc, wr1, wr2, weight);
+  if (e != NULL) {
+    bc->hits += 1;
+    e->refs += 1;
+    e->last_used = bc->clock;
+    omp_unset_lock(&(bc->lock));
+    return e->merged;
+  }
+  bc->misses += 1;
+  omp_unset_lock(&(bc->lock));
+
+  // Do the actual merging without holding the lock:
+  fresh = create_merged_biome(
+    wr1,
+    wr2,
+    (float) weight,
+    (float) (WM_BIOME_CACHE_WEIGHT_STEPS - weight)
+  );
+
+  omp_set_lock(&(bc->lock));
+  // Another thread may have merged the same biome in the meantime:
+  e = _find_merged_biome(bc, wr1, wr2, weight);
+  if (e != NULL) {
+    e->refs += 1;
+    e->last_used = bc->clock;
+    omp_unset_lock(&(bc->lock));
+    cleanup_biome(fresh);
+    return e->merged;
+  }
+  e = _pick_biome_cache_slot(bc);
+  if (e != NULL) {
+    evicted = e->merged;
+    e->wr1 = wr1;
+    e->wr2 = wr2;
+    e->weight = weight;
+    e->merged = fresh;
+    e->refs = 1;
+    e->last_used = bc->clock;
+  }
+  // If every entry is in use the fresh biome just isn't cached, and
+  // release_merged_biome will clean it up.
+  omp_unset_lock(&(bc->lock));
+  if (evicted != NULL) {
+    cleanup_biome(evicted);
+  }
+  return fresh;
+}
+
+void release_merged_biome(world_map *wm, biome *b) {
+  biome_cache *bc = wm->merged_biomes;
+  size_t i;
+  omp_set_lock(&(bc->lock));
+  for (i = 0; i < WM_BIOME_CACHE_SIZE; ++i) {
+    if (bc->entries[i].merged == b) {
+#ifdef DEBUG
+      assert(bc->entries[i].refs > 0);
+#endif
+      bc->entries[i].refs -= 1;
+      omp_unset_lock(&(bc->lock));
+      return;
+    }
+  }
+  omp_unset_lock(&(bc->lock));
+  cleanup_biome(b); // this one never made it into the cache
+}
+
+void take_biome_cache_stats(world_map *wm, uint64_t *hits, uint64_t *misses) {
+  biome_cache *bc = wm->merged_biomes;
+  omp_set_lock(&(bc->lock));
+  *hits = bc->hits;
+  *misses = bc->misses;
+  bc->hits = 0;
+  bc->misses = 0;
+  omp_unset_lock(&(bc->lock));
+}
+
 /*************
  * Functions *
  *************/
@@ -595,80 +903,47 @@ int breadth_first_iter(
   void *arg,
   step_result (*process)(search_step, world_region*, void*)
 ) {
-  world_map_pos wmpos;
-  queue *open = create_queue();
-  map *visited = create_map(1, 2048);
-  world_region *this, *next;
+  wm_flood *fl = _begin_flood(wm);
+  world_region *this;
 
   int size = 0, sresult;
 
   this = get_world_region(wm, origin);
   if (this != NULL) {
-    q_push_element(open, this);
-    m_put_value(visited, (void*) 1, (map_key_t) this);
+    _flood_visit(wm, fl, origin);
     process(SSTEP_INIT, this, arg);
   }
 
-  while (!q_is_empty(open) && (max_size < 0 || size <= max_size)) {
+  while (fl->count > 0 && (max_size < 0 || size <= max_size)) {
     // Grab the next open region:
-    this = (world_region*) q_pop_element(open);
+    this = _flood_pop(fl);
     sresult = process(SSTEP_PROCESS, this, arg);
     if (sresult == SRESULT_ABORT) {
-      cleanup_queue(open);
-      cleanup_map(visited);
+      _end_flood(wm, fl);
       process(SSTEP_CLEANUP, this, arg);
       return 0;
     } else if (sresult == SRESULT_FINISHED) {
       process(SSTEP_FINISH, this, arg);
       process(SSTEP_CLEANUP, this, arg);
-      cleanup_queue(open);
-      cleanup_map(visited);
+      _end_flood(wm, fl);
       return 1;
     } else if (sresult == SRESULT_IGNORE) {
       continue;
     } else { // SRESULT_CONTINUE
       size += 1;
       // Add our neighbors to the open list:
-      wmpos.x = this->pos.x + 1;
-      wmpos.y = this->pos.y;
-      next = get_world_region(wm, &wmpos);
-      if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-        q_push_element(open, next);
-        m_put_value(visited, (void*) 1, (map_key_t) next);
-      }
-      wmpos.x -= 2;
-      next = get_world_region(wm, &wmpos);
-      if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-        q_push_element(open, next);
-        m_put_value(visited, (void*) 1, (map_key_t) next);
-      }
-      wmpos.x += 2;
-      wmpos.y -= 1;
-      next = get_world_region(wm, &wmpos);
-      if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-        q_push_element(open, next);
-        m_put_value(visited, (void*) 1, (map_key_t) next);
-      }
-      wmpos.y += 2;
-      next = get_world_region(wm, &wmpos);
-      if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-        q_push_element(open, next);
-        m_put_value(visited, (void*) 1, (map_key_t) next);
-      }
+      _flood_visit_neighbors(wm, fl, this);
     }
   }
+  _end_flood(wm, fl);
   if ((max_size >= 0 && size > max_size) || size < min_size) {
     // We hit one of the size limits: cleanup without finishing and fail.
-    cleanup_queue(open);
-    cleanup_map(visited);
     process(SSTEP_CLEANUP, NULL, arg);
     return 0;
   }
   // Otherwise we should finish, cleanup, and succeed.
   process(SSTEP_FINISH, NULL, arg);
   process(SSTEP_CLEANUP, NULL, arg);
-  cleanup_queue(open);
-  cleanup_map(visited);
   return 1;
 }
 
@@ -683,23 +958,20 @@ int blob_first_iter(
   void *arg,
   step_result (*process)(search_step, world_region*, void*)
 ) {
-  world_map_pos wmpos;
-  queue *open = create_queue();
-  map *visited = create_map(1, 2048);
-  world_region *this, *next;
+  wm_flood *fl = _begin_flood(wm);
+  world_region *this;
   seed = prng(seed);
 
   int size = 0, sresult, stopping = 0;
 
   this = get_world_region(wm, origin);
   if (this != NULL) {
-    q_push_element(open, this);
-    m_put_value(visited, (void*) 1, (map_key_t) this);
+    _flood_visit(wm, fl, origin);
     process(SSTEP_INIT, this, arg);
   }
 
   while (
-    !q_is_empty(open)
+    fl->count > 0
  && (fill_edges || max_size < 0 || size <= max_size)
   ) {
     if (fill_edges && max_size >= 0 && size > max_size) {
@@ -707,16 +979,15 @@ int blob_first_iter(
     }
     // Shuffle the queue regularly:
     if (size % smoothness == 1 || smoothness <= 1) {
-      q_shuffle(open, seed);
+      _flood_shuffle(fl, seed);
       seed = prng(seed);
     }
     // Grab the next open region:
-    this = (world_region*) q_pop_element(open);
+    this = _flood_pop(fl);
     sresult = process(SSTEP_PROCESS, this, arg);
     if (sresult == SRESULT_ABORT) {
       process(SSTEP_CLEANUP, this, arg);
-      cleanup_queue(open);
-      cleanup_map(visited);
+      _end_flood(wm, fl);
       return 0;
     } else if (sresult == SRESULT_FINISHED) {
       if (fill_edges) {
@@ -725,8 +996,7 @@ int blob_first_iter(
       } else {
         process(SSTEP_FINISH, this, arg);
         process(SSTEP_CLEANUP, this, arg);
-        cleanup_queue(open);
-        cleanup_map(visited);
+        _end_flood(wm, fl);
         return 1;
       }
     } else if (sresult == SRESULT_IGNORE) {
@@ -735,47 +1005,19 @@ int blob_first_iter(
       size += 1;
       if (!stopping) {
         // Add our neighbors to the open list:
-        wmpos.x = this->pos.x + 1;
-        wmpos.y = this->pos.y;
-        next = get_world_region(wm, &wmpos);
-        if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-          q_push_element(open, next);
-          m_put_value(visited, (void*) 1, (map_key_t) next);
-        }
-        wmpos.x -= 2;
-        next = get_world_region(wm, &wmpos);
-        if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-          q_push_element(open, next);
-          m_put_value(visited, (void*) 1, (map_key_t) next);
-        }
-        wmpos.x += 2;
-        wmpos.y -= 1;
-        next = get_world_region(wm, &wmpos);
-        if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-          q_push_element(open, next);
-          m_put_value(visited, (void*) 1, (map_key_t) next);
-        }
-        wmpos.y += 2;
-        next = get_world_region(wm, &wmpos);
-        if (next != NULL && !m_contains_key(visited, (map_key_t) next)) {
-          q_push_element(open, next);
-          m_put_value(visited, (void*) 1, (map_key_t) next);
-        }
+        _flood_visit_neighbors(wm, fl, this);
       }
     }
   }
+  _end_flood(wm, fl);
   if ((!fill_edges && max_size >= 0 && size > max_size) || size < min_size) {
     // We hit one of the size limits: cleanup without finishing and fail.
-    cleanup_queue(open);
-    cleanup_map(visited);
     process(SSTEP_CLEANUP, NULL, arg);
     return 0;
   }
   // Otherwise we should finish, cleanup, and succeed.
   process(SSTEP_FINISH, NULL, arg);
   process(SSTEP_CLEANUP, NULL, arg);
-  cleanup_queue(open);
-  cleanup_map(visited);
   return 1;
 }
 
@@ -5,6 +5,7 @@
 // World map structure definition.
 
 #include <stdint.h>
+#include <omp.h>
 #ifdef DEBUG
   #include <assert.h>
 #endif
@@ -402,6 +403,11 @@ typedef struct world_region_s world_region;
 struct world_map_s;
 typedef struct world_map_s world_map;
 
+// Reusable state for flood-fill searches over a world map (see
+// breadth_first_iter).
+struct wm_flood_s;
+typedef struct wm_flood_s wm_flood;
+
 // Info
 // ----
 
@@ -465,6 +471,14 @@ typedef struct soil_type_s soil_type;
 struct biome_s;
 typedef struct biome_s biome;
 
+// A bounded cache of merged biomes shared between chunks (see
+// acquire_merged_biome).
+struct biome_cache_s;
+typedef struct biome_cache_s biome_cache;
+
+struct biome_cache_entry_s;
+typedef struct biome_cache_entry_s biome_cache_entry;
+
 /*************
  * Constants *
  *************/
@@ -608,6 +622,13 @@ FEED_SNEK(i, WM_MAX_BIOME_BUSHES)
 FEED_SNEK(i, WM_MAX_BIOME_SHRUBS)
 FEED_SNEK(i, WM_MAX_BIOME_TREES)
 
+// Number of merged biomes each world map keeps around for reuse:
+#define WM_BIOME_CACHE_SIZE 64
+
+// Merge strengths are quantized to this many steps so that neighboring chunks
+// end up sharing merged biomes:
+#define WM_BIOME_CACHE_WEIGHT_STEPS 32
+
 /***********
  * Globals *
  ***********/
@@ -868,6 +889,30 @@ struct world_region_s {
   civ_info anthropology;
 };
 
+struct wm_flood_s {
+  uint32_t generation; // stamp for regions visited by the current search
+  uint32_t *stamps; // last generation to visit each region (by region index)
+  world_region **open; // ring buffer of regions waiting to be expanded
+  size_t head; // ring index of the next region to pop
+  size_t count; // number of regions in the ring
+  size_t capacity; // size of both arrays (the number of regions in the map)
+};
+
+struct biome_cache_entry_s {
+  world_region *wr1, *wr2; // the regions merged (wr2 may be NULL)
+  uint32_t weight; // quantized strength of wr1 (of WM_BIOME_CACHE_WEIGHT_STEPS)
+  biome *merged; // the merged biome (NULL for an empty entry)
+  uint32_t refs; // number of acquisitions not yet released
+  uint64_t last_used; // cache clock at the most recent acquisition
+};
+
+struct biome_cache_s {
+  biome_cache_entry entries[WM_BIOME_CACHE_SIZE];
+  uint64_t clock; // ticks once per lookup; used for least-recently-used eviction
+  uint64_t hits, misses; // lookup statistics
+  omp_lock_t lock;
+};
+
 // The world map is a grid of regions, with lists of all strata, water, rivers,
 // biomes, and civilizations.
 struct world_map_s {
@@ -875,6 +920,8 @@ struct world_map_s {
   wm_pos_t width, height;
   world_region *regions;
   tectonic_sheet *tectonics;
+  list *idle_floods; // flood-fill state ready for reuse by the next search
+  biome_cache *merged_biomes; // recently merged biomes (see add_biology)
 
   list *air_elements;
   list *water_elements;
@@ -1204,6 +1251,14 @@ world_map* create_world_map(ptrdiff_t seed, wm_pos_t width, wm_pos_t height);
 // Cleans up the given world map and frees the associated memory.
 void cleanup_world_map(world_map *wm);
 
+// Allocates flood-fill state sized for the given world map. Normally there's
+// no need to call this directly: breadth_first_iter and blob_first_iter draw
+// flood-fill state from a pool attached to the world map.
+wm_flood *create_wm_flood(world_map *wm);
+
+// Frees the memory associated with the given flood-fill state.
+CLEANUP_DECL(wm_flood);
+
 // Allocates a new blank biome with the given category.
 biome* create_biome(biome_category category);
 
@@ -1222,6 +1277,31 @@ biome* create_merged_biome(
 // Frees the given biome.
 void cleanup_biome(biome* b);
 
+// Allocates and frees an empty merged biome cache. The cache must not have any
+// outstanding acquisitions when it's cleaned up.
+biome_cache* create_biome_cache(void);
+CLEANUP_DECL(biome_cache);
+
+// Works like create_merged_biome but with str1 and str2 quantized, returning a
+// shared biome from the given world map's cache where possible. The result
+// must not be modified, and must be handed back to release_merged_biome
+// (instead of cleanup_biome) when the caller is done with it. Safe to call
+// from multiple threads at once.
+biome* acquire_merged_biome(
+  world_map *wm,
+  world_region *wr1,
+  world_region *wr2,
+  float str1,
+  float str2
+);
+
+// Releases a biome returned by acquire_merged_biome.
+void release_merged_biome(world_map *wm, biome *b);
+
+// Reads (and resets) the hit and miss counts for the given world map's merged
+// biome cache.
+void take_biome_cache_stats(world_map *wm, uint64_t *hits, uint64_t *misses);
+
 /*************
  * Functions *
  *************/
@@ -1303,7 +1383,11 @@ void find_valley(world_map *wm, world_map_pos *pos);
 // SSTEP_FINISH and then SSTEP_CLEANUP. Otherwise, SSTEP_FINISH is not called
 // (just SSTEP_CLEANUP) and 0 is returned. The given arg is passed to the
 // process function as the third argument. SSTEP_VALIDATE, SSTEP_GET_MIN_SIZE,
-// and SSTEP_GET_MAX_SIZE aren't used by this function.
+// and SSTEP_GET_MAX_SIZE aren't used by this function. Searches don't
+// allocate: visited regions are tracked by generation stamps and open regions
+// are kept in a ring buffer, both of which are reused between searches (and
+// searches from within process functions or on different threads each get
+// their own).
 int breadth_first_iter(
   world_map *wm,
   world_map_pos *origin,